@@ -25,6 +25,12 @@ layout(set = MATERIAL_SET, binding = 11) buffer VisibleMeshCount
 	uint late_flag;
 };
 
+// A bit per instance hidden behind the CPU occluders this frame.
+layout(set = MATERIAL_SET, binding = 13) readonly buffer OccludedMeshInstances
+{
+	uint occluded_instances[];
+};
+
 layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
 
 void main() {
@@ -35,6 +41,14 @@ void main() {
 
 	if (mesh_instance_index < count) {
 		uint mesh_draw_index = mesh_instance_draws[mesh_instance_index].mesh_draw_index;
+		// Released instance slot.
+		if (mesh_draw_index == 0xffffffff) {
+			return;
+		}
+		// Occluded on the CPU: neither drawn early nor tested by the late pass.
+		if ((occluded_instances[mesh_instance_index / 32] & (1u << (mesh_instance_index % 32))) != 0) {
+			return;
+		}
 
 		MeshData mesh = mesh_data[mesh_draw_index];
 		MaterialData material = material_data[mesh_draw_index];
@@ -62,22 +76,26 @@ void main() {
 	    	vec4 aabb;
 	    	if ( project_sphere(view_bounding_center.xyz, radius, z_near, projection_00, projection_11, aabb ) ) {
     			// TODO: improve
+    			// Rendered part of the depth pyramid: the early pass reads the one of the
+    			// previous frame.
+    			vec2 pyramid_scale = late_flag == 0 ? render_scale.zw : render_scale.xy;
     			ivec2 depth_pyramid_size = textureSize(global_textures[nonuniformEXT(depth_pyramid_texture_index)], 0);
-	    		float width = (aabb.z - aabb.x) * depth_pyramid_size.x;
-				  float height = (aabb.w - aabb.y) * depth_pyramid_size.y;
+	    		float width = (aabb.z - aabb.x) * depth_pyramid_size.x * pyramid_scale.x;
+				  float height = (aabb.w - aabb.y) * depth_pyramid_size.y * pyramid_scale.y;
 
 				float level = floor(log2(max(width, height)));
 
 				// Sampler is set up to do max reduction, so this computes the minimum depth of a 2x2 texel quad
 				vec2 uv = (aabb.xy + aabb.zw) * 0.5;
             	uv.y = 1 - uv.y;
+            	uv *= pyramid_scale;
 				
 				float depth = textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], uv, level).r;
 				// Sample also 4 corners
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.y), level).r);
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.w), level).r);
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.w), level).r);
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.y), level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.y) * pyramid_scale, level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.w) * pyramid_scale, level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.w) * pyramid_scale, level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.y) * pyramid_scale, level).r);
 
 				vec3 dir = normalize(eye.xyz - world_bounding_center.xyz);
 				mat4 view_projection_m = freeze_occlusion_camera == 0 ? previous_view_projection : view_projection_debug;
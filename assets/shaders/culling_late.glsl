@@ -64,22 +64,25 @@ void main() {
 	    	vec4 aabb;
 	    	if ( project_sphere(view_bounding_center.xyz, radius, z_near, projection_00, projection_11, aabb ) ) {
     			// TODO: improve
+    			// Rendered part of the depth pyramid of this frame.
+    			vec2 pyramid_scale = render_scale.xy;
     			ivec2 depth_pyramid_size = textureSize(global_textures[nonuniformEXT(depth_pyramid_texture_index)], 0);
-	    		float width = (aabb.z - aabb.x) * depth_pyramid_size.x;
-				float height = (aabb.w - aabb.y) * depth_pyramid_size.y;
+	    		float width = (aabb.z - aabb.x) * depth_pyramid_size.x * pyramid_scale.x;
+				float height = (aabb.w - aabb.y) * depth_pyramid_size.y * pyramid_scale.y;
 
 				float level = floor(log2(max(width, height)));
 
 				// Sampler is set up to do max reduction, so this computes the minimum depth of a 2x2 texel quad
 				vec2 uv = (aabb.xy + aabb.zw) * 0.5;
             	uv.y = 1 - uv.y;
+            	uv *= pyramid_scale;
 				
 				float depth = textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], uv, level).r;
 				// Sample also 4 corners
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.y), level).r);
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.w), level).r);
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.w), level).r);
-            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.y), level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.y) * pyramid_scale, level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.w) * pyramid_scale, level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.w) * pyramid_scale, level).r);
+            	depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.y) * pyramid_scale, level).r);
 
 				vec3 dir = normalize(eye.xyz - world_bounding_center.xyz);
 				mat4 view_projection_m = freeze_occlusion_camera == 0 ? previous_view_projection : view_projection_debug;
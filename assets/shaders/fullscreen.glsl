@@ -23,14 +23,6 @@ layout (location = 1) flat in uint texture_id;
 
 layout (location = 0) out vec4 out_color;
 
-layout ( std140, set = MATERIAL_SET, binding = 0 ) uniform LocalConstants {
-    mat4        view_projection;
-    vec4        eye;
-    vec4        light;
-    float       light_range;
-    float       light_intensity;
-};
-
 // AGX Tone Mapping Function
 vec3 agxToneMap(vec3 color) {
     // Apply a basic curve for highlight compression
@@ -44,7 +36,11 @@ vec3 agxToneMap(vec3 color) {
 }
 
 void main() {
-    vec4 color = texture(global_textures[nonuniformEXT(texture_id)], vTexCoord.xy);
+    // Bilinear upscale of the rendered part of the texture, clamped to its
+    // last texel center so that the unrendered part is never filtered in.
+    vec2 texel_size = 1.0f / vec2(textureSize(global_textures[nonuniformEXT(texture_id)], 0));
+    vec2 uv = min(vTexCoord.xy * render_scale.xy, render_scale.xy - texel_size * 0.5f);
+    vec4 color = texture(global_textures[nonuniformEXT(texture_id)], uv);
 
     float exposure = 1.f;
     // exposure tone mapping
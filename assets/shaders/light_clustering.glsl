@@ -0,0 +1,82 @@
+#if defined(COMPUTE_LIGHT_CLUSTERING)
+
+layout(set = MATERIAL_SET, binding = 1) readonly buffer PointLightData
+{
+	PointLight pointLights[];
+};
+
+struct ClusterBounds {
+	vec4 min_bounds;
+	vec4 max_bounds;
+};
+
+layout(set = MATERIAL_SET, binding = 2) readonly buffer LightClusterBounds
+{
+	ClusterBounds cluster_bounds[];
+};
+
+layout(set = MATERIAL_SET, binding = 3) writeonly buffer LightClusterData
+{
+	uint cluster_light_counts[LIGHT_CLUSTER_COUNT];
+	uint cluster_light_indices[];
+};
+
+#define GROUP_SIZE 64
+
+layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// View space spheres of the lights tested by the group.
+shared vec4 group_light_spheres[GROUP_SIZE];
+
+// The arithmetic is written in the order of LightClustering.cpp and marked
+// precise, so the lists match the CPU version.
+vec4 light_view_sphere(PointLight light) {
+	precise vec3 center = world_to_camera[0].xyz * light.position.x +
+	                      world_to_camera[1].xyz * light.position.y +
+	                      world_to_camera[2].xyz * light.position.z +
+	                      world_to_camera[3].xyz;
+	return vec4(center, light.range);
+}
+
+bool cluster_test_sphere(ClusterBounds bounds, vec4 sphere) {
+	precise vec3 d = sphere.xyz - clamp(sphere.xyz, bounds.min_bounds.xyz, bounds.max_bounds.xyz);
+	precise float distance_squared = d.x * d.x + d.y * d.y + d.z * d.z;
+	precise float radius_squared = sphere.w * sphere.w;
+	return distance_squared <= radius_squared;
+}
+
+void main() {
+	uint cluster_index = gl_GlobalInvocationID.x;
+	bool valid_cluster = cluster_index < LIGHT_CLUSTER_COUNT;
+
+	ClusterBounds bounds;
+	if (valid_cluster) {
+		bounds = cluster_bounds[cluster_index];
+	}
+
+	uint count = 0;
+	uint first_index = cluster_index * MAX_LIGHTS_PER_CLUSTER;
+	for (uint first_light = 0; first_light < point_light_count; first_light += GROUP_SIZE) {
+		// Every invocation loads one light of the batch.
+		uint light_index = first_light + gl_LocalInvocationID.x;
+		if (light_index < point_light_count) {
+			group_light_spheres[gl_LocalInvocationID.x] = light_view_sphere(pointLights[light_index]);
+		}
+		barrier();
+
+		uint batch_count = min(uint(GROUP_SIZE), point_light_count - first_light);
+		for (uint i = 0; valid_cluster && i < batch_count && count < MAX_LIGHTS_PER_CLUSTER; ++i) {
+			if (cluster_test_sphere(bounds, group_light_spheres[i])) {
+				cluster_light_indices[first_index + count] = first_light + i;
+				++count;
+			}
+		}
+		barrier();
+	}
+
+	if (valid_cluster) {
+		cluster_light_counts[cluster_index] = count;
+	}
+}
+
+#endif // COMPUTE_LIGHT_CLUSTERING
@@ -0,0 +1,27 @@
+#ifndef HELIX_GLSL_LIGHT_CLUSTERS_H
+#define HELIX_GLSL_LIGHT_CLUSTERS_H
+
+// Clustered point lights, the constants must match LightClustering.hpp.
+#define LIGHT_CLUSTER_TILES_X 16
+#define LIGHT_CLUSTER_TILES_Y 8
+#define LIGHT_CLUSTER_SLICES 24
+#define LIGHT_CLUSTER_COUNT                                                    \
+  (LIGHT_CLUSTER_TILES_X * LIGHT_CLUSTER_TILES_Y * LIGHT_CLUSTER_SLICES)
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+// Screen tile and exponential depth slice of a view space position.
+uint light_cluster_index(vec3 view_position) {
+  float depth = -view_position.z;
+  vec2 ndc = vec2(view_position.x * projection_00,
+                  view_position.y * projection_11) / depth;
+
+  vec2 tiles = vec2(LIGHT_CLUSTER_TILES_X, LIGHT_CLUSTER_TILES_Y);
+  uvec2 tile = uvec2(clamp((ndc * 0.5 + 0.5) * tiles, vec2(0.0), tiles - 1.0));
+  uint slice = uint(clamp(log(depth / z_near) *
+                              (LIGHT_CLUSTER_SLICES / log(z_far / z_near)),
+                          0.0, LIGHT_CLUSTER_SLICES - 1));
+  return (slice * LIGHT_CLUSTER_TILES_Y + tile.y) * LIGHT_CLUSTER_TILES_X +
+         tile.x;
+}
+
+#endif  // HELIX_GLSL_LIGHT_CLUSTERS_H
@@ -71,7 +71,7 @@ void main() {
 
     if (textures.z != INVALID_TEXTURE_INDEX) {
         // NOTE(marco): normal textures are encoded to [0, 1] but need to be mapped to [-1, 1] value
-        vec3 bump_normal = normalize( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0 );
+        vec3 bump_normal = decode_normal_map( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rg );
         mat3 TBN = mat3(
             tangent,
             bitangent,
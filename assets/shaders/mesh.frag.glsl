@@ -4,6 +4,12 @@ layout(set = MATERIAL_SET, binding = 9) buffer PointLightData
 	PointLight pointLights[];
 };
 
+layout(set = MATERIAL_SET, binding = 13) readonly buffer LightClusterData
+{
+	uint cluster_light_counts[LIGHT_CLUSTER_COUNT];
+	uint cluster_light_indices[];
+};
+
 #if defined(FRAGMENT_GBUFFER_CULLING)
 
 layout (location = 0) in vec2 vTexcoord0;
@@ -73,7 +79,7 @@ void main() {
 
     if (textures.z != INVALID_TEXTURE_INDEX) {
         // NOTE(marco): normal textures are encoded to [0, 1] but need to be mapped to [-1, 1] value
-        vec3 bump_normal = normalize( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0 );
+        vec3 bump_normal = decode_normal_map( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rg );
         mat3 TBN = mat3(
             tangent,
             bitangent,
@@ -194,7 +200,7 @@ void main() {
 
     if (textures.z != INVALID_TEXTURE_INDEX) {
         // NOTE(marco): normal textures are encoded to [0, 1] but need to be mapped to [-1, 1] value
-        vec3 bump_normal = normalize( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0 );
+        vec3 bump_normal = decode_normal_map( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rg );
         mat3 TBN = mat3(
             tangent,
             bitangent,
@@ -233,8 +239,13 @@ void main() {
 #if DEBUG
     color_out = vColour;
 #else
-    for(uint i = 0; i < point_light_count; i++){
-      color_out += calculate_lighting_point( base_colour, vec3(roughness, metalness ,occlusion), normal, emissive_colour.rgb, world_position, pointLights[i] );
+    // Only the point lights listed in the cluster of the fragment.
+    vec3 view_position = (world_to_camera * vec4(world_position, 1.0f)).xyz;
+    uint cluster_index = light_cluster_index(view_position);
+    uint first_light = cluster_index * MAX_LIGHTS_PER_CLUSTER;
+    for(uint i = 0; i < cluster_light_counts[cluster_index]; i++){
+      PointLight light = pointLights[cluster_light_indices[first_light + i]];
+      color_out += calculate_lighting_point( base_colour, vec3(roughness, metalness ,occlusion), normal, emissive_colour.rgb, world_position, light );
     }
     color_out += calculate_lighting_directional(base_colour, vec3(roughness, metalness ,occlusion), normal, emissive_colour.rgb, world_position, directional_light_data.direction_intensity);
 #endif
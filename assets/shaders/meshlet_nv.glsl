@@ -65,23 +65,26 @@ void main()
         vec4 aabb;
         if ( project_sphere(view_center.xyz, radius, z_near, projection_00, projection_11, aabb ) ) {
             // TODO: improve
+            // Rendered part of the depth pyramid, of this frame as view_projection.
+            vec2 pyramid_scale = render_scale.xy;
             ivec2 depth_pyramid_size = textureSize(global_textures[nonuniformEXT(depth_pyramid_texture_index)], 0);
-            float width = (aabb.z - aabb.x) * depth_pyramid_size.x;
-            float height = (aabb.w - aabb.y) * depth_pyramid_size.y;
+            float width = (aabb.z - aabb.x) * depth_pyramid_size.x * pyramid_scale.x;
+            float height = (aabb.w - aabb.y) * depth_pyramid_size.y * pyramid_scale.y;
 
             float level = floor(log2(max(width, height)));
 
             // Sampler is set up to do max reduction, so this computes the minimum depth of a 2x2 texel quad
             vec2 uv = (aabb.xy + aabb.zw) * 0.5;
             uv.y = 1 - uv.y;
+            uv *= pyramid_scale;
 
             // Depth is raw, 0..1 space.
             float depth = textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], uv, level).r;
             // Sample also 4 corners
-            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.y), level).r);
-            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.w), level).r);
-            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.w), level).r);
-            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.y), level).r);
+            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.y) * pyramid_scale, level).r);
+            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.w) * pyramid_scale, level).r);
+            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.x, 1.0f - aabb.w) * pyramid_scale, level).r);
+            depth = max(depth, textureLod(global_textures[nonuniformEXT(depth_pyramid_texture_index)], vec2(aabb.z, 1.0f - aabb.y) * pyramid_scale, level).r);
 
             vec3 dir = freeze_occlusion_camera == 0 ? normalize(eye.xyz - world_center.xyz) : normalize(eye_debug.xyz - world_center.xyz);
             mat4 view_projection_m = freeze_occlusion_camera == 0 ? view_projection : view_projection_debug;
@@ -301,7 +304,7 @@ void main() {
 
     if (textures.z != INVALID_TEXTURE_INDEX) {
         // NOTE(marco): normal textures are encoded to [0, 1] but need to be mapped to [-1, 1] value
-        vec3 bump_normal = normalize( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0 );
+        vec3 bump_normal = decode_normal_map( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rg );
         mat3 TBN = mat3(
             tangent,
             bitangent,
@@ -421,7 +424,7 @@ void main() {
 
     if (textures.z != INVALID_TEXTURE_INDEX) {
         // NOTE(marco): normal textures are encoded to [0, 1] but need to be mapped to [-1, 1] value
-        vec3 bump_normal = normalize( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0 );
+        vec3 bump_normal = decode_normal_map( texture(global_textures[nonuniformEXT(textures.z)], vTexcoord0).rg );
         mat3 TBN = mat3(
             tangent,
             bitangent,
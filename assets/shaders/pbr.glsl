@@ -57,6 +57,12 @@ layout(set = MATERIAL_SET, binding = 2) uniform DirectionalLightData {
   DirectionalLight directional_light_data;
 };
 
+layout(set = MATERIAL_SET, binding = 3) readonly buffer LightClusterData
+{
+	uint cluster_light_counts[LIGHT_CLUSTER_COUNT];
+	uint cluster_light_indices[];
+};
+
 layout( push_constant ) uniform LightingData {
 
     // x = colour index, y = roughness_metalness_occlusion index, z = normal index, w = depth index.
@@ -69,8 +75,10 @@ layout (location = 0) out vec4 frag_color;
 
 void main() {
     frag_color = vec4(0.f);
-    vec4 base_colour = texture(global_textures[nonuniformEXT(gbuffer_textures.x)], vTexcoord0);
-    float raw_depth = texture(global_textures[nonuniformEXT(gbuffer_textures.w)], vTexcoord0).r;
+    // The gbuffer is rendered in part of its textures, at the render scale.
+    vec2 gbuffer_uv = vTexcoord0 * render_scale.xy;
+    vec4 base_colour = texture(global_textures[nonuniformEXT(gbuffer_textures.x)], gbuffer_uv);
+    float raw_depth = texture(global_textures[nonuniformEXT(gbuffer_textures.w)], gbuffer_uv).r;
 #if DEBUG
     frag_color = vec4( encode_srgb( base_colour.xyz ), base_colour.a );
     return;
@@ -80,8 +88,8 @@ void main() {
       return;
     }
 #endif //DEBUG
-    vec3 rmo = texture(global_textures[nonuniformEXT(gbuffer_textures.y)], vTexcoord0).rgb;
-    vec3 normal = texture(global_textures[nonuniformEXT(gbuffer_textures.z)], vTexcoord0).rgb;
+    vec3 rmo = texture(global_textures[nonuniformEXT(gbuffer_textures.y)], gbuffer_uv).rgb;
+    vec3 normal = texture(global_textures[nonuniformEXT(gbuffer_textures.z)], gbuffer_uv).rgb;
     // Convert from [0, 1] -> [-1, 1] then decode
     normal.rg = (normal.rg * 2.0f) - vec2(1.0f);
     normal = octahedral_decode(normal.rg);
@@ -105,8 +113,13 @@ void main() {
         vPosition,
         directional_light_data.direction_intensity) * shadow ;
 
-    for(uint i = 0; i < point_light_count; i++){
-      frag_color += calculate_lighting_point(base_colour, rmo, normal, vec3(0.f), vPosition, pointLights[i]);
+    // Only the point lights listed in the cluster of the pixel.
+    vec3 view_position = (world_to_camera * vec4(vPosition, 1.0f)).xyz;
+    uint cluster_index = light_cluster_index(view_position);
+    uint first_light = cluster_index * MAX_LIGHTS_PER_CLUSTER;
+    for(uint i = 0; i < cluster_light_counts[cluster_index]; i++){
+      PointLight light = pointLights[cluster_light_indices[first_light + i]];
+      frag_color += calculate_lighting_point(base_colour, rmo, normal, vec3(0.f), vPosition, light);
     }
     frag_color.a = 1.0f;
 }
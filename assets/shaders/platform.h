@@ -108,6 +108,13 @@ vec3 octahedral_decode(vec2 f) {
     return normalize(n);
 }
 
+// Tangent space normal from a normal map texel. Z is rebuilt from XY so two
+// channel (BC5) normal maps can be sampled as well.
+vec3 decode_normal_map( vec2 c ) {
+    vec2 xy = c * 2.0 - 1.0;
+    return vec3( xy, sqrt( max( 1.0 - dot( xy, xy ), 0.0 ) ) );
+}
+
 // float32x3_to_oct
 vec2 octahedral_encode(vec3 n) {
     // Project the sphere onto the octahedron, and then onto the xy plane
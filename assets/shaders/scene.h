@@ -37,6 +37,10 @@ layout(std140, set = MATERIAL_SET, binding = 0) uniform SceneConstants {
   float pad0001;
 
   vec4 frustum_planes[6];
+
+  // Rendered part of the attachments sized by the swapchain, this frame in xy
+  // and the previous frame in zw.
+  vec4 render_scale;
 };
 
 struct DirectionalLight {
@@ -101,13 +101,12 @@ namespace Helix {
 
         bits = (u8*)hallocam(new_size, allocator);
 
+        // New bits start cleared.
+        memset(bits, 0, new_size);
         if (old_bits) {
-            memcpy(bits, old_bits, size);
+            memcpy(bits, old_bits, size < new_size ? size : new_size);
             hfree(old_bits, allocator);
         }
-        else {
-            memset(bits, 0, new_size);
-        }
 
         size = new_size;
     }
@@ -60,6 +60,27 @@ namespace Helix {
     }
 #endif // _WIN64
 
+    bool file_size_and_write_time(cstring filename, sizet* out_size, u64* out_write_time) {
+#if defined(_WIN64)
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data)) {
+            return false;
+        }
+
+        *out_size = ((sizet)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        *out_write_time = ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat file_stat;
+        if (stat(filename, &file_stat) != 0) {
+            return false;
+        }
+
+        *out_size = (sizet)file_stat.st_size;
+        *out_write_time = (u64)file_stat.st_mtime;
+#endif // _WIN64
+        return true;
+    }
+
     u32 file_resolve_to_full_path(cstring path, char* out_full_path, u32 max_size) {
 #if defined(_WIN64)
         return GetFullPathNameA(path, max_size, out_full_path, nullptr);
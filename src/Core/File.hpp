@@ -59,6 +59,8 @@ namespace Helix {
 #if defined(_WIN64)
     FileTime                        file_last_write_time(cstring filename);
 #endif
+    // Size and last write time of a file without reading it, false if it doesn't exist.
+    bool                            file_size_and_write_time(cstring filename, sizet* out_size, u64* out_write_time);
 
     // Try to resolve path to non-relative version.
     u32                             file_resolve_to_full_path(cstring path, char* out_full_path, u32 max_size);
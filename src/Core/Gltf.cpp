@@ -549,6 +549,10 @@ namespace Helix {
     }
 
     glTF::glTF gltf_load_file(cstring file_path) {
+        return gltf_load_file(file_path, &MemoryService::instance()->system_allocator);
+    }
+
+    glTF::glTF gltf_load_file(cstring file_path, Allocator* heap_allocator) {
         glTF::glTF result{ };
 
         if (!file_exists(file_path)) {
@@ -556,8 +560,6 @@ namespace Helix {
             return result;
         }
 
-        Allocator* heap_allocator = &MemoryService::instance()->system_allocator;
-
         FileReadResult read_result = file_read_text(file_path, heap_allocator);
 
         json gltf_data = json::parse(read_result.data);
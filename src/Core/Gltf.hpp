@@ -318,6 +318,9 @@ namespace Helix {
     } // namespace glTF
 
     glTF::glTF                      gltf_load_file(cstring file_path);
+    // The file text is read with heap_allocator, a thread safe one allows
+    // loading from tasks.
+    glTF::glTF                      gltf_load_file(cstring file_path, Allocator* heap_allocator);
 
     void                            gltf_free(glTF::glTF& scene);
 
@@ -1,11 +1,351 @@
 #include "Renderer/AsynchronousLoader.hpp"
 
+#include "Core/File.hpp"
 #include "Core/Time.hpp"
 #include "Renderer/Renderer.hpp"
 #include "vendor/imgui/stb_image.h"
 #include "vendor/tracy/tracy/Tracy.hpp"
 
 namespace Helix {
+// StagingRingAllocator ///////////////////////////////////////////////////
+
+void StagingRingAllocator::init(sizet size) {
+  capacity = size;
+  head = 0;
+  tail = 0;
+  used_size = 0;
+  uncommitted_size = 0;
+  first_region = 0;
+  region_count = 0;
+}
+
+sizet StagingRingAllocator::allocate(sizet size, sizet alignment) {
+  if (used_size == 0) {
+    head = 0;
+    tail = 0;
+  }
+
+  sizet offset = memory_align(head, alignment);
+  if (head >= tail && used_size < capacity) {
+    // Free space is [head, capacity) and [0, tail).
+    if (offset + size > capacity) {
+      if (size > tail) {
+        return k_invalid_staging_offset;
+      }
+      offset = 0;
+    }
+  } else if (offset + size > tail) {
+    return k_invalid_staging_offset;
+  }
+
+  // Padding and the skipped end of the ring are released with the allocation.
+  const sizet consumed =
+      offset >= head ? offset + size - head : capacity - head + offset + size;
+  head = offset + size;
+  used_size += consumed;
+  uncommitted_size += consumed;
+  return offset;
+}
+
+void StagingRingAllocator::commit(u64 timeline_value) {
+  if (uncommitted_size == 0) {
+    return;
+  }
+  HASSERT(region_count < k_max_upload_batches);
+
+  Region& region =
+      regions[(first_region + region_count) % k_max_upload_batches];
+  region.end = head;
+  region.size = uncommitted_size;
+  region.timeline_value = timeline_value;
+  ++region_count;
+
+  uncommitted_size = 0;
+}
+
+void StagingRingAllocator::release(u64 completed_timeline_value) {
+  while (region_count) {
+    const Region& region = regions[first_region];
+    if (region.timeline_value > completed_timeline_value) {
+      break;
+    }
+
+    tail = region.end;
+    used_size -= region.size;
+
+    first_region = (first_region + 1) % k_max_upload_batches;
+    --region_count;
+  }
+}
+
+// LoadJobQueue ///////////////////////////////////////////////////////////
+
+void LoadJobQueue::init(Allocator* allocator, u32 initial_capacity) {
+  jobs.init(allocator, initial_capacity);
+  free_jobs.init(allocator, initial_capacity);
+  heap.init(allocator, initial_capacity);
+
+  next_sequence = 0;
+  next_group = 0;
+  pending_count = 0;
+}
+
+void LoadJobQueue::shutdown() {
+  jobs.shutdown();
+  free_jobs.shutdown();
+  heap.shutdown();
+}
+
+LoadJobHandle LoadJobQueue::push(const FileLoadRequest& request, f32 priority,
+                                 u32 group, LoadJobCallback callback,
+                                 void* user_data) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  u32 job_index;
+  if (free_jobs.size) {
+    job_index = free_jobs.back();
+    free_jobs.pop();
+  } else {
+    job_index = jobs.size;
+    LoadJob& new_job = jobs.push_use();
+    new_job = LoadJob{};
+  }
+
+  LoadJob& job = jobs[job_index];
+  const u32 generation = job.generation + 1;
+  job = LoadJob{};
+  job.request = request;
+  job.callback = callback;
+  job.user_data = user_data;
+  job.priority = priority;
+  job.group = group;
+  job.sequence = next_sequence++;
+  job.generation = generation;
+  job.state = LoadJobState::Queued;
+
+  job.heap_index = heap.size;
+  heap.push(job_index);
+  heap_sift_up(job.heap_index);
+
+  ++pending_count;
+
+  return {job_index, generation};
+}
+
+bool LoadJobQueue::pop(LoadJobHandle& out_job, FileLoadRequest& out_request) {
+  std::lock_guard<std::mutex> guard(mutex);
+  if (heap.size == 0) {
+    return false;
+  }
+
+  const u32 job_index = heap[0];
+  heap_remove(0);
+
+  LoadJob& job = jobs[job_index];
+  job.state = LoadJobState::Read;
+
+  out_job = {job_index, job.generation};
+  out_request = job.request;
+  return true;
+}
+
+void LoadJobQueue::set_priority(LoadJobHandle handle, f32 priority) {
+  std::lock_guard<std::mutex> guard(mutex);
+  LoadJob* job = access_job(handle);
+  if (job == nullptr || job->priority == priority) {
+    return;
+  }
+
+  const f32 old_priority = job->priority;
+  job->priority = priority;
+  if (job->heap_index == k_invalid_index) {
+    return;
+  }
+  if (priority > old_priority) {
+    heap_sift_up(job->heap_index);
+  } else {
+    heap_sift_down(job->heap_index);
+  }
+}
+
+void LoadJobQueue::cancel(LoadJobHandle handle) {
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    LoadJob* job = access_job(handle);
+    if (job == nullptr || job->state >= LoadJobState::Ready) {
+      return;
+    }
+
+    job->cancel_requested = true;
+    if (job->heap_index != k_invalid_index) {
+      heap_remove(job->heap_index);
+      queued = true;
+    }
+  }
+
+  if (queued) {
+    finish(handle, LoadJobState::Cancelled);
+  }
+}
+
+void LoadJobQueue::cancel_group(u32 group) {
+  // Handles are gathered first as finishing a job calls back into user code.
+  Array<LoadJobHandle> cancelled;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    cancelled.init(jobs.allocator, heap.size);
+
+    for (u32 i = 0; i < jobs.size; ++i) {
+      LoadJob& job = jobs[i];
+      if (job.group != group || job.state >= LoadJobState::Ready) {
+        continue;
+      }
+
+      job.cancel_requested = true;
+      if (job.heap_index != k_invalid_index) {
+        heap_remove(job.heap_index);
+        cancelled.push({i, job.generation});
+      }
+    }
+  }
+
+  for (u32 i = 0; i < cancelled.size; ++i) {
+    finish(cancelled[i], LoadJobState::Cancelled);
+  }
+  cancelled.shutdown();
+}
+
+u32 LoadJobQueue::create_group() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return ++next_group;
+}
+
+bool LoadJobQueue::advance(LoadJobHandle handle, LoadJobState::Enum state) {
+  std::lock_guard<std::mutex> guard(mutex);
+  LoadJob* job = access_job(handle);
+  if (job == nullptr || job->cancel_requested) {
+    return false;
+  }
+
+  HASSERT(state > job->state && state < LoadJobState::Ready);
+  job->state = state;
+  return true;
+}
+
+bool LoadJobQueue::is_cancelled(LoadJobHandle handle) {
+  std::lock_guard<std::mutex> guard(mutex);
+  LoadJob* job = access_job(handle);
+  return job == nullptr || job->cancel_requested;
+}
+
+void LoadJobQueue::finish(LoadJobHandle handle, LoadJobState::Enum state) {
+  HASSERT(state >= LoadJobState::Ready && state < LoadJobState::Count);
+
+  LoadJobCallback callback = nullptr;
+  void* user_data = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    LoadJob* job = access_job(handle);
+    if (job == nullptr || job->state >= LoadJobState::Ready) {
+      return;
+    }
+
+    // The slot is recycled but keeps its final state until it is reused.
+    job->state = state;
+    callback = job->callback;
+    user_data = job->user_data;
+    free_jobs.push(handle.index);
+    --pending_count;
+  }
+
+  if (callback) {
+    callback(handle, state, user_data);
+  }
+}
+
+LoadJobState::Enum LoadJobQueue::get_state(LoadJobHandle handle) {
+  std::lock_guard<std::mutex> guard(mutex);
+  LoadJob* job = access_job(handle);
+  return job ? job->state : LoadJobState::Count;
+}
+
+u32 LoadJobQueue::get_pending_count() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return pending_count;
+}
+
+LoadJob* LoadJobQueue::access_job(LoadJobHandle handle) {
+  if (handle.index >= jobs.size) {
+    return nullptr;
+  }
+  LoadJob& job = jobs[handle.index];
+  return job.generation == handle.generation ? &job : nullptr;
+}
+
+bool LoadJobQueue::heap_less(u32 heap_a, u32 heap_b) const {
+  const LoadJob& job_a = jobs[heap[heap_a]];
+  const LoadJob& job_b = jobs[heap[heap_b]];
+  if (job_a.priority != job_b.priority) {
+    return job_a.priority < job_b.priority;
+  }
+  return job_a.sequence > job_b.sequence;
+}
+
+void LoadJobQueue::heap_swap(u32 heap_a, u32 heap_b) {
+  const u32 job_a = heap[heap_a];
+  heap[heap_a] = heap[heap_b];
+  heap[heap_b] = job_a;
+
+  jobs[heap[heap_a]].heap_index = heap_a;
+  jobs[heap[heap_b]].heap_index = heap_b;
+}
+
+void LoadJobQueue::heap_sift_up(u32 heap_index) {
+  while (heap_index > 0) {
+    const u32 parent = (heap_index - 1) / 2;
+    if (!heap_less(parent, heap_index)) {
+      break;
+    }
+    heap_swap(parent, heap_index);
+    heap_index = parent;
+  }
+}
+
+void LoadJobQueue::heap_sift_down(u32 heap_index) {
+  while (true) {
+    const u32 left = heap_index * 2 + 1;
+    const u32 right = left + 1;
+    u32 largest = heap_index;
+    if (left < heap.size && heap_less(largest, left)) {
+      largest = left;
+    }
+    if (right < heap.size && heap_less(largest, right)) {
+      largest = right;
+    }
+    if (largest == heap_index) {
+      break;
+    }
+    heap_swap(heap_index, largest);
+    heap_index = largest;
+  }
+}
+
+void LoadJobQueue::heap_remove(u32 heap_index) {
+  const u32 job_index = heap[heap_index];
+  const u32 last = heap.size - 1;
+  if (heap_index != last) {
+    heap_swap(heap_index, last);
+  }
+  heap.pop();
+  jobs[job_index].heap_index = k_invalid_index;
+
+  if (heap_index < heap.size) {
+    heap_sift_down(heap_index);
+    heap_sift_up(heap_index);
+  }
+}
+
 // AsynchonousLoader //////////////////////////////////////////////////////
 
 void AsynchronousLoader::init(Renderer* renderer_,
@@ -15,16 +355,13 @@ void AsynchronousLoader::init(Renderer* renderer_,
   task_scheduler = task_scheduler_;
   allocator = resident_allocator;
 
-  file_load_requests.init(allocator, 16);
+  load_jobs.init(allocator, 16);
   upload_requests.init(allocator, 16);
 
-  texture_ready.index = k_invalid_texture.index;
-  cpu_buffer_ready.index = k_invalid_buffer.index;
-  gpu_buffer_ready.index = k_invalid_buffer.index;
-  completed = nullptr;
-
   using namespace Helix;
 
+  GpuDevice* gpu = renderer->gpu;
+
   // Create a persistently-mapped staging buffer
   BufferCreation bc;
   bc.reset()
@@ -32,226 +369,626 @@ void AsynchronousLoader::init(Renderer* renderer_,
            hmega(64))
       .set_name("staging_buffer")
       .set_persistent(true);
-  BufferHandle staging_buffer_handle = renderer->gpu->create_buffer(bc);
+  BufferHandle staging_buffer_handle = gpu->create_buffer(bc);
 
-  staging_buffer = renderer->gpu->access_buffer(staging_buffer_handle);
+  staging_buffer = gpu->access_buffer(staging_buffer_handle);
+  staging_ring.init(staging_buffer->size);
 
-  staging_buffer_offset = 0;
+  for (u32 i = 0; i < k_max_upload_batches; ++i) {
+    UploadBatch& batch = upload_batches[i];
 
-  for (u32 i = 0; i < k_max_frames; ++i) {
     VkCommandPoolCreateInfo cmd_pool_info = {
         VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr};
-    cmd_pool_info.queueFamilyIndex =
-        renderer->gpu->vulkan_transfer_queue_family;
+    cmd_pool_info.queueFamilyIndex = gpu->vulkan_transfer_queue_family;
     cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-    vkCreateCommandPool(renderer->gpu->vulkan_device, &cmd_pool_info,
-                        renderer->gpu->vulkan_allocation_callbacks,
-                        &command_pools[i]);
+    vkCreateCommandPool(gpu->vulkan_device, &cmd_pool_info,
+                        gpu->vulkan_allocation_callbacks, &batch.command_pool);
 
     VkCommandBufferAllocateInfo cmd = {
         VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr};
-    cmd.commandPool = command_pools[i];
+    cmd.commandPool = batch.command_pool;
     cmd.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     cmd.commandBufferCount = 1;
 
-    vkAllocateCommandBuffers(renderer->gpu->vulkan_device, &cmd,
-                             &command_buffers[i].vk_handle);
+    vkAllocateCommandBuffers(gpu->vulkan_device, &cmd,
+                             &batch.command_buffer.vk_handle);
 
-    command_buffers[i].is_recording = false;
-    command_buffers[i].device = renderer->gpu;
-  }
+    batch.command_buffer.is_recording = false;
+    batch.command_buffer.device = gpu;
 
-  VkSemaphoreCreateInfo semaphore_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-  vkCreateSemaphore(renderer->gpu->vulkan_device, &semaphore_info,
-                    renderer->gpu->vulkan_allocation_callbacks,
-                    &transfer_complete_semaphore);
+    VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    vkCreateFence(gpu->vulkan_device, &fence_info,
+                  gpu->vulkan_allocation_callbacks, &batch.fence);
 
-  VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  vkCreateFence(renderer->gpu->vulkan_device, &fence_info,
-                renderer->gpu->vulkan_allocation_callbacks, &transfer_fence);
+    batch.timeline_value = 0;
+    batch.in_flight = false;
+    batch.requests.init(allocator, 16);
+  }
+  next_upload_batch = 0;
+
+  if (gpu->gpu_device_features & GpuDeviceFeature_TIMELINE_SEMAPHORE) {
+    VkSemaphoreTypeCreateInfo timeline_info{
+        VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    timeline_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timeline_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{
+        VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphore_info.pNext = &timeline_info;
+    vkCreateSemaphore(gpu->vulkan_device, &semaphore_info,
+                      gpu->vulkan_allocation_callbacks,
+                      &upload_timeline_semaphore);
+  }
+  upload_timeline_value = 0;
 }
 
 void AsynchronousLoader::shutdown() {
-  renderer->gpu->destroy_buffer(staging_buffer->handle);
+  GpuDevice* gpu = renderer->gpu;
+
+  gpu->destroy_buffer(staging_buffer->handle);
 
-  file_load_requests.shutdown();
+  load_jobs.shutdown();
   upload_requests.shutdown();
 
-  for (u32 i = 0; i < k_max_frames; ++i) {
-    vkDestroyCommandPool(renderer->gpu->vulkan_device, command_pools[i],
-                         renderer->gpu->vulkan_allocation_callbacks);
+  for (u32 i = 0; i < k_max_upload_batches; ++i) {
+    UploadBatch& batch = upload_batches[i];
+    vkDestroyCommandPool(gpu->vulkan_device, batch.command_pool,
+                         gpu->vulkan_allocation_callbacks);
     // Command buffers are destroyed with the pool associated.
+    vkDestroyFence(gpu->vulkan_device, batch.fence,
+                   gpu->vulkan_allocation_callbacks);
+    batch.requests.shutdown();
   }
 
-  vkDestroySemaphore(renderer->gpu->vulkan_device, transfer_complete_semaphore,
-                     renderer->gpu->vulkan_allocation_callbacks);
-  vkDestroyFence(renderer->gpu->vulkan_device, transfer_fence,
-                 renderer->gpu->vulkan_allocation_callbacks);
+  if (upload_timeline_semaphore != VK_NULL_HANDLE) {
+    vkDestroySemaphore(gpu->vulkan_device, upload_timeline_semaphore,
+                       gpu->vulkan_allocation_callbacks);
+  }
 }
 
 void AsynchronousLoader::update(Allocator* stack_allocator) {
-  // If a texture was processed in the previous commands, signal the renderer
-  if (texture_ready.index != k_invalid_texture.index) {
-    // Add update request.
-    // This method is multithreaded_safe
-    renderer->add_texture_to_update(texture_ready);
-    texture_ready = k_invalid_texture;
+  // Notify finished uploads and give their staging memory back.
+  retire_upload_batches();
+
+  // Process upload requests
+  if (upload_requests.size) {
+    submit_upload_batch();
   }
 
-  if (cpu_buffer_ready.index != k_invalid_buffer.index) {
-    HASSERT(completed != nullptr);
-    (*completed)++;
+  // Process the most important file request
+  LoadJobHandle job;
+  FileLoadRequest load_request;
+  if (load_jobs.pop(job, load_request)) {
+    process_load_job(job, load_request);
+  }
+}
+
+void AsynchronousLoader::process_load_job(LoadJobHandle job,
+                                          const FileLoadRequest& request) {
+  ZoneScoped;
 
-    // TODO(marco): free cpu buffer
+  i64 start_reading_file = Time::now();
 
-    gpu_buffer_ready.index = k_invalid_buffer.index;
-    cpu_buffer_ready.index = k_invalid_buffer.index;
-    completed = nullptr;
+  if (request.compression != TextureCompressionFormat::Count) {
+    CompressedTexture* compressed_texture =
+        load_compressed_texture(job, request);
+    if (compressed_texture) {
+      HINFO("Compressed texture {} ready in {} ms", request.path,
+            Time::from_milliseconds(start_reading_file));
+      push_texture_upload(job, request, nullptr, compressed_texture);
+    } else if (load_jobs.is_cancelled(job)) {
+      load_jobs.finish(job, LoadJobState::Cancelled);
+    } else {
+      HCRITICAL("Error reading compressed texture {}", request.path);
+      load_jobs.finish(job, LoadJobState::Failed);
+    }
+    return;
   }
 
-  // Process upload requests
-  if (upload_requests.size) {
-    ZoneScoped;
-    // TODO: Maybe have fences for each frame
-    // Wait for transfer fence to be finished
-    VkResult res = vkGetFenceStatus(renderer->gpu->vulkan_device, transfer_fence);
-    if ( res != VK_SUCCESS) {
-      return;
+  FileReadResult file = file_read_binary(request.path, &io_allocator);
+  if (file.data == nullptr) {
+    // TODO: use defualt texture if none found
+    HCRITICAL("Error reading file {}", request.path);
+    load_jobs.finish(job, LoadJobState::Failed);
+    return;
+  }
+
+  if (!load_jobs.advance(job, LoadJobState::Decode)) {
+    hfree(file.data, &io_allocator);
+    load_jobs.finish(job, LoadJobState::Cancelled);
+    return;
+  }
+
+  int x, y, comp;
+  u8* texture_data = stbi_load_from_memory((const stbi_uc*)file.data,
+                                           (int)file.size, &x, &y, &comp, 4);
+  hfree(file.data, &io_allocator);
+
+  if (texture_data == nullptr) {
+    HCRITICAL("Error decoding file {}", request.path);
+    load_jobs.finish(job, LoadJobState::Failed);
+    return;
+  }
+
+  HINFO("File {} read in {} ms", request.path,
+        Time::from_milliseconds(start_reading_file));
+  push_texture_upload(job, request, texture_data, nullptr);
+}
+
+void AsynchronousLoader::push_texture_upload(
+    LoadJobHandle job, const FileLoadRequest& request, void* data,
+    CompressedTexture* compressed_texture) {
+  UploadRequest upload_request;
+  upload_request.data = data;
+  upload_request.compressed_texture = compressed_texture;
+  upload_request.texture = request.texture;
+  upload_request.job = job;
+
+  if (!load_jobs.advance(job, LoadJobState::Upload)) {
+    drop_upload(upload_request, LoadJobState::Cancelled);
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(upload_mutex);
+  upload_requests.push(upload_request);
+}
+
+void AsynchronousLoader::drop_upload(UploadRequest& request,
+                                     LoadJobState::Enum state) {
+  if (request.compressed_texture) {
+    texture_compressed_free(*request.compressed_texture);
+    hfree(request.compressed_texture, &io_allocator);
+    request.compressed_texture = nullptr;
+  }
+  if (request.data) {
+    free(request.data);
+    request.data = nullptr;
+  }
+
+  if (request.job.index != k_invalid_index) {
+    load_jobs.finish(request.job, state);
+  }
+}
+
+bool AsynchronousLoader::is_upload_batch_complete(const UploadBatch& batch) {
+  if (upload_timeline_semaphore != VK_NULL_HANDLE) {
+    u64 completed_value = 0;
+    vkGetSemaphoreCounterValue(renderer->gpu->vulkan_device,
+                               upload_timeline_semaphore, &completed_value);
+    return completed_value >= batch.timeline_value;
+  }
+  return vkGetFenceStatus(renderer->gpu->vulkan_device, batch.fence) ==
+         VK_SUCCESS;
+}
+
+void AsynchronousLoader::retire_upload_batches() {
+  // Batches complete in submission order, starting from the oldest.
+  for (u32 i = 0; i < k_max_upload_batches; ++i) {
+    UploadBatch& batch =
+        upload_batches[(next_upload_batch + i) % k_max_upload_batches];
+    if (!batch.in_flight || !is_upload_batch_complete(batch)) {
+      continue;
     }
-    // Reset if file requests are present.
-    vkResetFences(renderer->gpu->vulkan_device, 1, &transfer_fence);
-
-    // Get last request
-    UploadRequest request = upload_requests.back();
-    upload_requests.pop();
-
-    CommandBuffer* cb = &command_buffers[renderer->gpu->current_frame];
-    cb->begin();
-
-    if (request.texture.index != k_invalid_texture.index) {
-      Texture* texture = renderer->gpu->access_texture(request.texture);
-      const u32 k_texture_channels = 4;
-      const u32 k_texture_alignment = 4;
-      const sizet aligned_image_size =
-          memory_align(texture->width * texture->height * k_texture_channels,
-                       k_texture_alignment);
-      // Request place in buffer
-      const sizet current_offset =
-          std::atomic_fetch_add(&staging_buffer_offset, aligned_image_size);
-
-      cb->upload_texture_data(texture->handle, request.data,
-                              staging_buffer->handle, current_offset);
-
-      free(request.data);
-    } else if (request.cpu_buffer.index != k_invalid_buffer.index &&
-               request.gpu_buffer.index != k_invalid_buffer.index) {
-      Buffer* src = renderer->gpu->access_buffer(request.cpu_buffer);
-      Buffer* dst = renderer->gpu->access_buffer(request.gpu_buffer);
-
-      cb->upload_buffer_data(src->handle, dst->handle);
-    } else if (request.cpu_buffer.index != k_invalid_buffer.index) {
-      Buffer* buffer = renderer->gpu->access_buffer(request.cpu_buffer);
-      // TODO: proper alignment
-      const sizet aligned_image_size = memory_align(buffer->size, 64);
-      const sizet current_offset =
-          std::atomic_fetch_add(&staging_buffer_offset, aligned_image_size);
-      cb->upload_buffer_data(buffer->handle, request.data,
-                             staging_buffer->handle, current_offset);
-
-      free(request.data);
-    } else if (request.gpu_buffer.index != k_invalid_buffer.index) {
-      Buffer* buffer = renderer->gpu->access_buffer(request.gpu_buffer);
-      const sizet current_offset =
-          std::atomic_fetch_add(&staging_buffer_offset, buffer->size);
-      cb->upload_buffer_data(buffer->handle, request.data,
-                             staging_buffer->handle, current_offset);
+
+    for (u32 r = 0; r < batch.requests.size; ++r) {
+      const UploadRequest& request = batch.requests[r];
+      if (request.texture.index != k_invalid_texture.index) {
+        // This method is multithreaded_safe
+        renderer->add_texture_to_update(request.texture);
+        if (request.job.index != k_invalid_index) {
+          load_jobs.finish(request.job, LoadJobState::Ready);
+        }
+      } else if (request.cpu_buffer.index != k_invalid_buffer.index &&
+                 request.gpu_buffer.index != k_invalid_buffer.index) {
+        HASSERT(request.completed != nullptr);
+        (*request.completed)++;
+
+        // TODO(marco): free cpu buffer
+      }
     }
+    batch.requests.clear();
+    batch.in_flight = false;
+
+    staging_ring.release(batch.timeline_value);
+  }
+}
+
+void AsynchronousLoader::submit_upload_batch() {
+  ZoneScoped;
 
-    cb->end();
-
-    VkSubmitInfo submitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cb->vk_handle;
-    VkPipelineStageFlags wait_flag[]{VK_PIPELINE_STAGE_TRANSFER_BIT};
-    VkSemaphore wait_semaphore[]{transfer_complete_semaphore};
-    submitInfo.pWaitSemaphores = wait_semaphore;
-    submitInfo.pWaitDstStageMask = wait_flag;
-
-    VkQueue used_queue = renderer->gpu->vulkan_transfer_queue;
-    vkQueueSubmit(used_queue, 1, &submitInfo, transfer_fence);
-
-    // TODO(marco): better management for state machine. We need to account for
-    // file -> buffer, buffer -> texture and buffer -> buffer. One the CPU
-    // buffer has been used it should be freed.
-    if (request.texture.index != k_invalid_index) {
-      HASSERT(texture_ready.index == k_invalid_texture.index);
-      texture_ready = request.texture;
-    } else if (request.cpu_buffer.index != k_invalid_buffer.index &&
-               request.gpu_buffer.index != k_invalid_buffer.index) {
-      HASSERT(cpu_buffer_ready.index == k_invalid_index);
-      HASSERT(gpu_buffer_ready.index == k_invalid_index);
-      HASSERT(completed == nullptr);
-      cpu_buffer_ready = request.cpu_buffer;
-      gpu_buffer_ready = request.gpu_buffer;
-      completed = request.completed;
-    } else if (request.cpu_buffer.index != k_invalid_index) {
-      HASSERT(cpu_buffer_ready.index == k_invalid_index);
-      cpu_buffer_ready = request.cpu_buffer;
+  UploadBatch& batch = upload_batches[next_upload_batch];
+  // All the command buffers are still in use.
+  if (batch.in_flight) {
+    return;
+  }
+
+  CommandBuffer* cb = &batch.command_buffer;
+  cb->begin();
+
+  // Pack requests until the staging memory for this submit runs out. A
+  // partially recorded request goes back on top and continues next time.
+  u32 copy_count = 0;
+  while (true) {
+    UploadRequest request;
+    {
+      std::lock_guard<std::mutex> guard(upload_mutex);
+      if (upload_requests.size == 0) {
+        break;
+      }
+      request = upload_requests.back();
+      upload_requests.pop();
+    }
+
+    // Cancelled loads are dropped unless part of them is already recorded.
+    const bool started = request.uploaded_mip || request.uploaded_row;
+    if (!started && request.job.index != k_invalid_index &&
+        load_jobs.is_cancelled(request.job)) {
+      drop_upload(request, LoadJobState::Cancelled);
+      continue;
     }
-    staging_buffer_offset = 0;
+
+    if (!record_upload(cb, request, copy_count)) {
+      std::lock_guard<std::mutex> guard(upload_mutex);
+      upload_requests.push(request);
+      break;
+    }
+    batch.requests.push(request);
   }
 
-  // Process a file request
-  if (file_load_requests.size) {
-    FileLoadRequest& load_request = file_load_requests.back();
-    file_load_requests.pop();
+  cb->end();
 
-    i64 start_reading_file = Time::now();
-    // Process request
-    int x, y, comp;
-    u8* texture_data = stbi_load(load_request.path, &x, &y, &comp, 4);
+  if (copy_count == 0 && batch.requests.size == 0) {
+    return;
+  }
 
-    if (texture_data) {
-      HINFO("File {} read in {} ms", load_request.path,
-            Time::from_milliseconds(start_reading_file));
+  const u64 timeline_value = ++upload_timeline_value;
+
+  VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &cb->vk_handle;
+
+  VkTimelineSemaphoreSubmitInfo timeline_info{
+      VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+  VkFence fence = VK_NULL_HANDLE;
+  if (upload_timeline_semaphore != VK_NULL_HANDLE) {
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &timeline_value;
+    submit_info.pNext = &timeline_info;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &upload_timeline_semaphore;
+  } else {
+    fence = batch.fence;
+    vkResetFences(renderer->gpu->vulkan_device, 1, &fence);
+  }
+
+  VkQueue used_queue = renderer->gpu->vulkan_transfer_queue;
+  vkQueueSubmit(used_queue, 1, &submit_info, fence);
+
+  staging_ring.commit(timeline_value);
+  batch.timeline_value = timeline_value;
+  batch.in_flight = true;
+  next_upload_batch = (next_upload_batch + 1) % k_max_upload_batches;
+}
+
+bool AsynchronousLoader::record_upload(CommandBuffer* cb,
+                                       UploadRequest& request,
+                                       u32& copy_count) {
+  if (request.texture.index != k_invalid_texture.index) {
+    return record_texture_upload(cb, request, copy_count);
+  }
+
+  if (request.cpu_buffer.index != k_invalid_buffer.index &&
+      request.gpu_buffer.index != k_invalid_buffer.index) {
+    cb->upload_buffer_data(request.cpu_buffer, request.gpu_buffer);
+    ++copy_count;
+    return true;
+  }
+
+  return record_buffer_upload(cb, request, copy_count);
+}
+
+sizet AsynchronousLoader::allocate_staging(sizet& size, sizet min_size) {
+  // Leave room for the next submits so uploads and copies overlap.
+  const sizet batch_available =
+      max_upload_batch_size > staging_ring.uncommitted_size
+          ? max_upload_batch_size - staging_ring.uncommitted_size
+          : 0;
+  if (size > batch_available) {
+    size = batch_available;
+  }
+
+  while (size >= min_size) {
+    const sizet offset = staging_ring.allocate(size, 16);
+    if (offset != k_invalid_staging_offset) {
+      return offset;
+    }
+    size /= 2;
+  }
+  return k_invalid_staging_offset;
+}
+
+bool AsynchronousLoader::record_texture_upload(CommandBuffer* cb,
+                                               UploadRequest& request,
+                                               u32& copy_count) {
+  GpuDevice* gpu = renderer->gpu;
+  Texture* texture = gpu->access_texture(request.texture);
+  CompressedTexture* compressed_texture = request.compressed_texture;
+
+  // Uncompressed images upload mip 0 only, the rest is blitted on the
+  // graphics queue. Compressed ones upload the whole chain, copied in rows of
+  // 4x4 blocks.
+  u32 mip_count = 1;
+  u32 block_size = 1;
+  sizet block_bytes = 4;
+  if (compressed_texture) {
+    mip_count = texture->mip_level_count < compressed_texture->mip_count
+                    ? texture->mip_level_count
+                    : compressed_texture->mip_count;
+    block_size = 4;
+    block_bytes =
+        texture_compression_block_bytes(compressed_texture->format);
+  }
+
+  for (; request.uploaded_mip < mip_count; ++request.uploaded_mip) {
+    const u32 mip = request.uploaded_mip;
+    const u32 mip_width = (texture->width >> mip) ? texture->width >> mip : 1;
+    const u32 mip_height =
+        (texture->height >> mip) ? texture->height >> mip : 1;
+    const u32 row_count = (mip_height + block_size - 1) / block_size;
+    const sizet row_size =
+        ((mip_width + block_size - 1) / block_size) * block_bytes;
+    const u8* source =
+        compressed_texture
+            ? compressed_texture->data + compressed_texture->mip_offsets[mip]
+            : (const u8*)request.data;
+
+    while (request.uploaded_row < row_count) {
+      const u32 chunk_rows = staging_chunk_size > row_size
+                                 ? (u32)(staging_chunk_size / row_size)
+                                 : 1;
+      const u32 remaining_rows = row_count - request.uploaded_row;
+      sizet size =
+          (chunk_rows < remaining_rows ? chunk_rows : remaining_rows) *
+          row_size;
+      const sizet offset = allocate_staging(size, row_size);
+      if (offset == k_invalid_staging_offset) {
+        return false;
+      }
+      const u32 rows = (u32)(size / row_size);
+
+      // Transition on the first copy, so an empty submit leaves no trace.
+      if (mip == 0 && request.uploaded_row == 0) {
+        util_add_image_barrier(gpu, cb->vk_handle, texture,
+                               RESOURCE_STATE_COPY_DEST, 0, mip_count, false);
+      }
+
+      memcpy(staging_buffer->mapped_data + offset,
+             source + request.uploaded_row * row_size, rows * row_size);
+
+      const u32 first_texel_row = request.uploaded_row * block_size;
+      const u32 texel_rows = rows * block_size < mip_height - first_texel_row
+                                 ? rows * block_size
+                                 : mip_height - first_texel_row;
+      cb->copy_buffer_to_texture(staging_buffer->handle, offset,
+                                 request.texture, mip, first_texel_row,
+                                 texel_rows);
+      ++copy_count;
+
+      request.uploaded_row += rows;
+    }
+    request.uploaded_row = 0;
+  }
+
+  // Post copy memory barrier, ownership goes to the graphics queue.
+  util_add_image_barrier(gpu, cb->vk_handle, texture,
+                         RESOURCE_STATE_COPY_SOURCE, 0, mip_count, false,
+                         gpu->vulkan_transfer_queue_family,
+                         gpu->vulkan_main_queue_family,
+                         QueueType::CopyTransfer, QueueType::Graphics);
+
+  // Data has been copied in the staging buffer.
+  if (compressed_texture) {
+    texture_compressed_free(*compressed_texture);
+    hfree(compressed_texture, &io_allocator);
+  } else {
+    free(request.data);
+  }
+  request.data = nullptr;
+  request.compressed_texture = nullptr;
+
+  return true;
+}
+
+bool AsynchronousLoader::record_buffer_upload(CommandBuffer* cb,
+                                              UploadRequest& request,
+                                              u32& copy_count) {
+  GpuDevice* gpu = renderer->gpu;
+  // Requests with a cpu buffer own their data.
+  const bool owns_data = request.cpu_buffer.index != k_invalid_buffer.index;
+  const BufferHandle buffer_handle =
+      owns_data ? request.cpu_buffer : request.gpu_buffer;
+  Buffer* buffer = gpu->access_buffer(buffer_handle);
+
+  while (request.uploaded_size < buffer->size) {
+    const sizet remaining_size = buffer->size - request.uploaded_size;
+    sizet size = remaining_size < staging_chunk_size ? remaining_size
+                                                     : staging_chunk_size;
+    const sizet min_size = size < hkilo(64) ? size : hkilo(64);
+    const sizet offset = allocate_staging(size, min_size);
+    if (offset == k_invalid_staging_offset) {
+      return false;
+    }
+
+    memcpy(staging_buffer->mapped_data + offset,
+           (u8*)request.data + request.uploaded_size, size);
+    cb->copy_buffer(staging_buffer->handle, offset, buffer_handle,
+                    request.uploaded_size, size);
+    ++copy_count;
+
+    request.uploaded_size += size;
+  }
+
+  util_add_buffer_barrier_ext(
+      gpu, cb->vk_handle, buffer->vk_handle, RESOURCE_STATE_COPY_DEST,
+      RESOURCE_STATE_UNDEFINED, buffer->size, gpu->vulkan_transfer_queue_family,
+      gpu->vulkan_main_queue_family, QueueType::CopyTransfer,
+      QueueType::Graphics);
+
+  if (owns_data) {
+    free(request.data);
+    request.data = nullptr;
+  }
+
+  return true;
+}
+
+CompressedTexture* AsynchronousLoader::load_compressed_texture(
+    LoadJobHandle job, const FileLoadRequest& request) {
+  ZoneScoped;
+
+  Texture* texture = renderer->gpu->access_texture(request.texture);
+  CompressedTexture* compressed_texture =
+      hallocat(CompressedTexture, &io_allocator);
+  *compressed_texture = CompressedTexture{};
+
+  // Either the path is already a KTX2 file or it is a source image with an
+  // optional cached conversion next to it.
+  const sizet path_length = strlen(request.path);
+  const bool is_ktx2 =
+      path_length > 5 && strcmp(request.path + path_length - 5, ".ktx2") == 0;
+
+  char cache_path[512];
+  if (is_ktx2) {
+    strcpy(cache_path, request.path);
+  } else {
+    snprintf(cache_path, ArraySize(cache_path), "%s.ktx2", request.path);
+  }
+
+  // The texture can be a lower resolution version of the image.
+  const u32 first_mip = request.first_mip;
+  const u32 mip_count = first_mip + texture->mip_level_count;
+
+  if (file_exists(cache_path) &&
+      ktx2_read_file(cache_path, &io_allocator, *compressed_texture)) {
+    const bool matches =
+        (compressed_texture->width >> first_mip) == texture->width &&
+        (compressed_texture->height >> first_mip) == texture->height &&
+        compressed_texture->mip_count >= mip_count &&
+        texture_compression_to_vk_format(compressed_texture->format) ==
+            (u32)texture->vk_format;
+    if (matches) {
+      texture_compressed_skip_mips(*compressed_texture, first_mip);
+      return compressed_texture;
+    }
+    texture_compressed_free(*compressed_texture);
+
+    // The upload sizes its copies from the texture, a different file would
+    // be read out of bounds.
+    if (is_ktx2) {
+      HWARN("Texture {} does not match its image size, mips or format",
+            cache_path);
+      hfree(compressed_texture, &io_allocator);
+      return nullptr;
+    }
+    HWARN("Cached texture {} is stale, converting it again", cache_path);
+  }
+
+  if (is_ktx2) {
+    hfree(compressed_texture, &io_allocator);
+    return nullptr;
+  }
 
-      UploadRequest& upload_request = upload_requests.push_use();
-      upload_request.data = texture_data;
-      upload_request.texture = load_request.texture;
-      upload_request.cpu_buffer = k_invalid_buffer;
-    } else {  // TODO: use defualt texture if none found
-      HCRITICAL("Error reading file {}", load_request.path);
+  // First run: encode the source image with all its mips and cache it.
+  FileReadResult file = file_read_binary(request.path, &io_allocator);
+  if (file.data == nullptr || !load_jobs.advance(job, LoadJobState::Decode)) {
+    if (file.data) {
+      hfree(file.data, &io_allocator);
     }
+    hfree(compressed_texture, &io_allocator);
+    return nullptr;
   }
+
+  int x, y, comp;
+  u8* texture_data = stbi_load_from_memory((const stbi_uc*)file.data,
+                                           (int)file.size, &x, &y, &comp, 4);
+  hfree(file.data, &io_allocator);
+  if (texture_data == nullptr) {
+    hfree(compressed_texture, &io_allocator);
+    return nullptr;
+  }
+
+  i64 start_encoding = Time::now();
+  const bool encoded =
+      texture_compress(texture_data, x, y, mip_count, request.compression,
+                       request.content, &io_allocator, *compressed_texture);
+  free(texture_data);
+  if (!encoded) {
+    HWARN("Texture {} could not be encoded to {}", request.path,
+          TextureCompressionFormat::ToString(request.compression));
+    texture_compressed_free(*compressed_texture);
+    hfree(compressed_texture, &io_allocator);
+    return nullptr;
+  }
+
+  HINFO("Texture {} encoded to {} in {} ms", request.path,
+        TextureCompressionFormat::ToString(request.compression),
+        Time::from_milliseconds(start_encoding));
+
+  ktx2_write_file(cache_path, *compressed_texture, &io_allocator);
+
+  texture_compressed_skip_mips(*compressed_texture, first_mip);
+  return compressed_texture;
 }
 
-void AsynchronousLoader::request_texture_data(cstring filename,
-                                              TextureHandle texture) {
-  FileLoadRequest& request = file_load_requests.push_use();
+LoadJobHandle AsynchronousLoader::request_texture_data(cstring filename,
+                                                       TextureHandle texture,
+                                                       f32 priority,
+                                                       u32 group) {
+  FileLoadRequest request;
   strcpy(request.path, filename);
   request.texture = texture;
   request.buffer = k_invalid_buffer;
+  request.compression = TextureCompressionFormat::Count;
+  request.first_mip = 0;
+
+  return load_jobs.push(request, priority, group);
+}
+
+LoadJobHandle AsynchronousLoader::request_compressed_texture_data(
+    cstring filename, TextureHandle texture,
+    TextureCompressionFormat::Enum format, TextureContent::Enum content,
+    u32 first_mip, f32 priority, u32 group) {
+  FileLoadRequest request;
+  strcpy(request.path, filename);
+  request.texture = texture;
+  request.buffer = k_invalid_buffer;
+  request.compression = format;
+  request.content = content;
+  request.first_mip = first_mip;
+
+  return load_jobs.push(request, priority, group);
 }
 
 void AsynchronousLoader::request_buffer_upload(void* data,
                                                BufferHandle buffer) {
+  std::lock_guard<std::mutex> guard(upload_mutex);
+
   UploadRequest& upload_request = upload_requests.push_use();
+  upload_request = UploadRequest{};
   upload_request.data = data;
   upload_request.gpu_buffer = buffer;
-  upload_request.cpu_buffer = k_invalid_buffer;
-  upload_request.texture = k_invalid_texture;
 }
 
 void AsynchronousLoader::request_buffer_copy(BufferHandle src, BufferHandle dst,
                                              u32* completed) {
+  std::lock_guard<std::mutex> guard(upload_mutex);
+
   UploadRequest& upload_request = upload_requests.push_use();
+  upload_request = UploadRequest{};
   upload_request.completed = completed;
-  upload_request.data = nullptr;
   upload_request.cpu_buffer = src;
   upload_request.gpu_buffer = dst;
-  upload_request.texture = k_invalid_texture;
 }
 
 }  // namespace Helix
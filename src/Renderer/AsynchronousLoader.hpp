@@ -1,12 +1,14 @@
 #pragma once
 
-#include <atomic>
+#include <mutex>
 
 #include "Core/Array.hpp"
+#include "Core/Memory.hpp"
 #include "Core/Platform.hpp"
 #include "Renderer/CommandBuffer.hpp"
 #include "Renderer/GPUDevice.hpp"
 #include "Renderer/GPUResources.hpp"
+#include "Renderer/TextureCompression.hpp"
 
 namespace enki {
 class TaskScheduler;
@@ -26,18 +28,181 @@ struct FileLoadRequest {
   char path[512];
   TextureHandle texture = k_invalid_texture;
   BufferHandle buffer = k_invalid_buffer;
+  // When set the image is converted on first load and cached next to the
+  // source as '<path>.ktx2'.
+  TextureCompressionFormat::Enum compression = TextureCompressionFormat::Count;
+  TextureContent::Enum content = TextureContent::Color;
+  // Mip of the source image that maps to mip 0 of 'texture', used to stream
+  // lower resolutions of compressed textures.
+  u32 first_mip = 0;
 };  // struct FileLoadRequest
 
+//
+// Lifetime of a file load: the file is read, decoded (and converted when
+// compressed), uploaded and finally ready. Cancelled and Failed are final too.
+namespace LoadJobState {
+enum Enum { Queued, Read, Decode, Upload, Ready, Cancelled, Failed, Count };
+
+static cstring s_value_names[] = {"Queued", "Read",      "Decode", "Upload",
+                                  "Ready",  "Cancelled", "Failed", "Count"};
+
+static cstring ToString(Enum e) {
+  return ((u32)e < Enum::Count ? s_value_names[(int)e] : "unsupported");
+}
+}  // namespace LoadJobState
+
+//
+//
+struct LoadJobHandle {
+  u32 index = k_invalid_index;
+  u32 generation = 0;
+};  // struct LoadJobHandle
+
+static const LoadJobHandle k_invalid_load_job{k_invalid_index, 0};
+
+// Called once per job when it reaches a final state, on the loading thread or
+// on the thread cancelling a job that did not start yet.
+typedef void (*LoadJobCallback)(LoadJobHandle job, LoadJobState::Enum state,
+                                void* user_data);
+
+//
+//
+struct LoadJob {
+  FileLoadRequest request;
+
+  LoadJobCallback callback = nullptr;
+  void* user_data = nullptr;
+
+  f32 priority = 0.f;
+  // Jobs of a group are cancelled together, e.g. when a scene is unloaded.
+  u32 group = 0;
+  // Keeps jobs of the same priority in submission order.
+  u64 sequence = 0;
+  u32 generation = 0;
+  u32 heap_index = k_invalid_index;
+
+  LoadJobState::Enum state = LoadJobState::Ready;
+  bool cancel_requested = false;
+};  // struct LoadJob
+
+//
+// Thread safe queue of file loads, highest priority first. Jobs keep their
+// slot until they reach a final state so handles can be queried, cancelled
+// and reprioritized while they are read, decoded and uploaded.
+struct LoadJobQueue {
+  void init(Allocator* allocator, u32 initial_capacity);
+  void shutdown();
+
+  LoadJobHandle push(const FileLoadRequest& request, f32 priority, u32 group,
+                     LoadJobCallback callback = nullptr,
+                     void* user_data = nullptr);
+  // Takes the most important queued job and moves it to Read.
+  bool pop(LoadJobHandle& out_job, FileLoadRequest& out_request);
+
+  void set_priority(LoadJobHandle job, f32 priority);
+  // Queued jobs are finished at once, running jobs stop at their next state
+  // change.
+  void cancel(LoadJobHandle job);
+  void cancel_group(u32 group);
+  u32 create_group();
+
+  // Returns false when the job was cancelled: the caller drops its data and
+  // finishes it as Cancelled.
+  bool advance(LoadJobHandle job, LoadJobState::Enum state);
+  bool is_cancelled(LoadJobHandle job);
+  void finish(LoadJobHandle job, LoadJobState::Enum state);
+
+  // Count for stale handles.
+  LoadJobState::Enum get_state(LoadJobHandle job);
+  // Jobs not in a final state.
+  u32 get_pending_count();
+
+  // Internal methods, the mutex must be held.
+  LoadJob* access_job(LoadJobHandle job);
+  bool heap_less(u32 heap_a, u32 heap_b) const;
+  void heap_swap(u32 heap_a, u32 heap_b);
+  void heap_sift_up(u32 heap_index);
+  void heap_sift_down(u32 heap_index);
+  void heap_remove(u32 heap_index);
+
+  std::mutex mutex;
+  Array<LoadJob> jobs;
+  Array<u32> free_jobs;
+  // Indices of the queued jobs, a binary max heap on priority.
+  Array<u32> heap;
+
+  u64 next_sequence = 0;
+  u32 next_group = 0;
+  u32 pending_count = 0;
+};  // struct LoadJobQueue
+
 //
 //
 struct UploadRequest {
   void* data = nullptr;
+  CompressedTexture* compressed_texture = nullptr;
   u32* completed = nullptr;
+  // File loads complete their job once the upload is done.
+  LoadJobHandle job = k_invalid_load_job;
   TextureHandle texture = k_invalid_texture;
   BufferHandle cpu_buffer = k_invalid_buffer;
   BufferHandle gpu_buffer = k_invalid_buffer;
+
+  // Progress of uploads split over multiple submits: bytes for buffers, mip
+  // and row of texel blocks for textures.
+  sizet uploaded_size = 0;
+  u32 uploaded_mip = 0;
+  u32 uploaded_row = 0;
 };  // struct UploadRequest
 
+static const u32 k_max_upload_batches = 4;
+static const sizet k_invalid_staging_offset = u64_max;
+
+//
+// Ring allocator over the staging buffer. Allocations made between two
+// commits belong to the same submit and are given back together once its
+// timeline value is reached.
+struct StagingRingAllocator {
+  void init(sizet size);
+
+  // Returns k_invalid_staging_offset when there is no contiguous space left
+  // before older submits complete.
+  sizet allocate(sizet size, sizet alignment);
+  void commit(u64 timeline_value);
+  void release(u64 completed_timeline_value);
+
+  struct Region {
+    sizet end;
+    sizet size;
+    u64 timeline_value;
+  };  // struct Region
+
+  Region regions[k_max_upload_batches];
+  u32 first_region = 0;
+  u32 region_count = 0;
+
+  sizet capacity = 0;
+  sizet head = 0;
+  sizet tail = 0;
+  sizet used_size = 0;
+  sizet uncommitted_size = 0;
+};  // struct StagingRingAllocator
+
+//
+// Upload requests recorded in a single transfer submit.
+struct UploadBatch {
+  VkCommandPool command_pool;
+  CommandBuffer command_buffer;
+  // Used only when timeline semaphores are not supported.
+  VkFence fence;
+
+  u64 timeline_value = 0;
+  bool in_flight = false;
+
+  // Completed requests, the renderer is notified when the submit is done.
+  Array<UploadRequest> requests;
+};  // struct UploadBatch
+
 //
 //
 struct AsynchronousLoader {
@@ -46,29 +211,60 @@ struct AsynchronousLoader {
   void update(Allocator* stack_allocator);
   void shutdown();
 
-  void request_texture_data(cstring filename, TextureHandle texture);
+  LoadJobHandle request_texture_data(cstring filename, TextureHandle texture,
+                                     f32 priority = 0.f, u32 group = 0);
+  LoadJobHandle request_compressed_texture_data(
+      cstring filename, TextureHandle texture,
+      TextureCompressionFormat::Enum format, TextureContent::Enum content,
+      u32 first_mip, f32 priority = 0.f, u32 group = 0);
   void request_buffer_upload(void* data, BufferHandle buffer);
   void request_buffer_copy(BufferHandle src, BufferHandle dst, u32* completed);
 
+  void process_load_job(LoadJobHandle job, const FileLoadRequest& request);
+  // Returns nullptr on failure or when the job was cancelled.
+  CompressedTexture* load_compressed_texture(LoadJobHandle job,
+                                             const FileLoadRequest& request);
+  void push_texture_upload(LoadJobHandle job, const FileLoadRequest& request,
+                           void* data, CompressedTexture* compressed_texture);
+  // Releases the CPU memory of a texture upload that will not be recorded.
+  void drop_upload(UploadRequest& request, LoadJobState::Enum state);
+
+  void retire_upload_batches();
+  void submit_upload_batch();
+  // Record as much of the request as the staging memory allows, returning
+  // true when it is complete.
+  bool record_upload(CommandBuffer* cb, UploadRequest& request,
+                     u32& copy_count);
+  bool record_texture_upload(CommandBuffer* cb, UploadRequest& request,
+                             u32& copy_count);
+  bool record_buffer_upload(CommandBuffer* cb, UploadRequest& request,
+                            u32& copy_count);
+  // Allocates up to 'size' bytes in the staging ring, shrinking it down to
+  // 'min_size' when needed.
+  sizet allocate_staging(sizet& size, sizet min_size);
+  bool is_upload_batch_complete(const UploadBatch& batch);
+
   Allocator* allocator = nullptr;
+  // Used only by the loading thread for file and compressed texture memory.
+  MallocAllocator io_allocator;
   Renderer* renderer = nullptr;
   enki::TaskScheduler* task_scheduler = nullptr;
 
-  Array<FileLoadRequest> file_load_requests;
+  // File loads can be added, cancelled and reprioritized from any thread.
+  LoadJobQueue load_jobs;
+  std::mutex upload_mutex;
   Array<UploadRequest> upload_requests;
 
   Buffer* staging_buffer = nullptr;
+  StagingRingAllocator staging_ring;
+  // Chunk size for resources bigger than what a submit should carry.
+  sizet staging_chunk_size = hmega(8);
+  sizet max_upload_batch_size = hmega(32);
 
-  std::atomic_size_t staging_buffer_offset;
-  TextureHandle texture_ready;
-  BufferHandle cpu_buffer_ready;
-  BufferHandle gpu_buffer_ready;
-  u32* completed;
-
-  VkCommandPool command_pools[k_max_frames];
-  CommandBuffer command_buffers[k_max_frames];
-  VkSemaphore transfer_complete_semaphore;
-  VkFence transfer_fence;
+  UploadBatch upload_batches[k_max_upload_batches];
+  u32 next_upload_batch = 0;
+  VkSemaphore upload_timeline_semaphore = VK_NULL_HANDLE;
+  u64 upload_timeline_value = 0;
 
 };  // struct AsynchonousLoader
 
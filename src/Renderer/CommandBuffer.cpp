@@ -20,16 +20,10 @@ void CommandBuffer::reset() {
 
   u32 resource_count = descriptor_sets.free_indices_head;
   for (u32 i = 0; i < resource_count; ++i) {
-    DescriptorSet* v_descriptor_set =
-        (DescriptorSet*)descriptor_sets.access_resource(i);
-
-    if (v_descriptor_set) {
-      // Contains the allocation for all the resources, binding and samplers
-      // arrays.
-      hfree(v_descriptor_set->resources, device->allocator);
-    }
     descriptor_sets.release_resource(i);
   }
+  descriptor_set_allocator.clear();
+  descriptor_set_cache.clear();
 }
 
 void CommandBuffer::init(GpuDevice* gpu) {
@@ -62,6 +56,9 @@ void CommandBuffer::init(GpuDevice* gpu) {
 
   descriptor_sets.init(device->allocator, k_descriptor_sets_pool_size,
                        sizeof(DescriptorSet));
+  descriptor_set_allocator.init(hkilo(64));
+  descriptor_set_cache.init(device->allocator, 16);
+  descriptor_set_cache.set_default_value(k_invalid_index);
 
   // is_recording = false;
 
@@ -74,6 +71,8 @@ void CommandBuffer::shutdown() {
   reset();
 
   descriptor_sets.shutdown();
+  descriptor_set_allocator.shutdown();
+  descriptor_set_cache.shutdown();
 
   vkDestroyDescriptorPool(device->vulkan_device, vk_descriptor_pool,
                           device->vulkan_allocation_callbacks);
@@ -83,6 +82,20 @@ DescriptorSetHandle CommandBuffer::create_descriptor_set(
     const DescriptorSetCreation& creation) {
   ZoneScoped;
 
+  const DesciptorSetLayout* descriptor_set_layout =
+      device->access_descriptor_set_layout(creation.layout);
+
+  DescriptorSetWrites writes;
+  device->fill_descriptor_set_writes(
+      descriptor_set_layout, creation.num_resources, creation.resources,
+      creation.samplers, creation.bindings, writes);
+
+  // The same set is often created by several draws of the frame.
+  const u32 cached_index = descriptor_set_cache.get(writes.hash);
+  if (cached_index != k_invalid_index) {
+    return {cached_index};
+  }
+
   DescriptorSetHandle handle = {descriptor_sets.obtain_resource()};
   if (handle.index == k_invalid_index) {
     return handle;
@@ -90,8 +103,6 @@ DescriptorSetHandle CommandBuffer::create_descriptor_set(
 
   DescriptorSet* descriptor_set =
       (DescriptorSet*)descriptor_sets.access_resource(handle.index);
-  const DesciptorSetLayout* descriptor_set_layout =
-      device->access_descriptor_set_layout(creation.layout);
 
   // Allocate descriptor set
   VkDescriptorSetAllocateInfo alloc_info{
@@ -108,7 +119,7 @@ DescriptorSetHandle CommandBuffer::create_descriptor_set(
   u8* memory =
       hallocam((sizeof(ResourceHandle) + sizeof(SamplerHandle) + sizeof(u16)) *
                    creation.num_resources,
-               device->allocator);
+               &descriptor_set_allocator);
   descriptor_set->resources = (ResourceHandle*)memory;
   descriptor_set->samplers =
       (SamplerHandle*)(memory +
@@ -118,19 +129,8 @@ DescriptorSetHandle CommandBuffer::create_descriptor_set(
                           creation.num_resources);
   descriptor_set->num_resources = creation.num_resources;
   descriptor_set->layout = descriptor_set_layout;
-
-  // Update descriptor set
-  VkWriteDescriptorSet descriptor_write[8];
-  VkDescriptorBufferInfo buffer_info[8];
-  VkDescriptorImageInfo image_info[8];
-
-  Sampler* vk_default_sampler = device->access_sampler(device->default_sampler);
-
-  u32 num_resources = creation.num_resources;
-  GpuDevice::fill_write_descriptor_sets(
-      *device, descriptor_set_layout, descriptor_set->vk_descriptor_set,
-      descriptor_write, buffer_info, image_info, vk_default_sampler->vk_handle,
-      num_resources, creation.resources, creation.samplers, creation.bindings);
+  descriptor_set->hash = writes.hash;
+  descriptor_set->ref_count = 1;
 
   // Cache resources
   for (u32 r = 0; r < creation.num_resources; r++) {
@@ -139,8 +139,9 @@ DescriptorSetHandle CommandBuffer::create_descriptor_set(
     descriptor_set->bindings[r] = creation.bindings[r];
   }
 
-  vkUpdateDescriptorSets(device->vulkan_device, num_resources, descriptor_write,
-                         0, nullptr);
+  device->write_descriptor_set(descriptor_set_layout,
+                               descriptor_set->vk_descriptor_set, writes);
+  descriptor_set_cache.insert(writes.hash, handle.index);
 
   return handle;
 }
@@ -626,6 +627,10 @@ static ResourceState to_resource_state(PipelineStage::Enum stage) {
   return s_states[stage];
 }
 
+void CommandBuffer::barrier(const ExecutionBarrier& barrier) {
+  util_add_execution_barrier(device, vk_handle, barrier, queue_type);
+}
+
 void CommandBuffer::fill_buffer(BufferHandle buffer, u32 offset, u32 size,
                                 u32 data) {
   Buffer* vk_buffer = device->access_buffer(buffer);
@@ -651,71 +656,45 @@ void CommandBuffer::pop_marker() {
   device->pop_marker(vk_handle);
 }
 
-void CommandBuffer::upload_texture_data(TextureHandle texture_handle,
-                                        void* texture_data,
-                                        BufferHandle staging_buffer_handle,
-                                        sizet staging_buffer_offset) {
-  Texture* texture = device->access_texture(texture_handle);
-  Buffer* staging_buffer = device->access_buffer(staging_buffer_handle);
-  u32 image_size = texture->width * texture->height * 4;
+void CommandBuffer::copy_buffer_to_texture(BufferHandle src_, sizet src_offset,
+                                           TextureHandle dst_, u32 mip,
+                                           u32 first_row, u32 row_count) {
+  Buffer* src = device->access_buffer(src_);
+  Texture* dst = device->access_texture(dst_);
 
-  // Copy buffer_data to staging buffer
-  memcpy(staging_buffer->mapped_data + staging_buffer_offset, texture_data,
-         static_cast<size_t>(image_size));
+  const u32 mip_width = dst->width >> mip;
+  const u32 mip_height = dst->height >> mip;
 
-  VkBufferImageCopy region = {};
-  region.bufferOffset = staging_buffer_offset;
+  VkBufferImageCopy region{};
+  region.bufferOffset = src_offset;
   region.bufferRowLength = 0;
   region.bufferImageHeight = 0;
 
   region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.mipLevel = mip;
   region.imageSubresource.baseArrayLayer = 0;
   region.imageSubresource.layerCount = 1;
 
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {texture->width, texture->height, texture->depth};
+  region.imageOffset = {0, (i32)first_row, 0};
+  region.imageExtent = {mip_width ? mip_width : 1, row_count, 1};
+  HASSERT(first_row + row_count <= (mip_height ? mip_height : 1));
 
-  // Pre copy memory barrier to perform layout transition
-  util_add_image_barrier(device, vk_handle, texture, RESOURCE_STATE_COPY_DEST,
-                         0, 1, false);
-  // Copy from the staging buffer to the image
-  vkCmdCopyBufferToImage(vk_handle, staging_buffer->vk_handle,
-                         texture->vk_image,
+  vkCmdCopyBufferToImage(vk_handle, src->vk_handle, dst->vk_image,
                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  // Post copy memory barrier
-  util_add_image_barrier(device, vk_handle, texture, RESOURCE_STATE_COPY_SOURCE,
-                         0, 1, false, device->vulkan_transfer_queue_family,
-                         device->vulkan_main_queue_family,
-                         QueueType::CopyTransfer, QueueType::Graphics);
 }
 
-void CommandBuffer::upload_buffer_data(BufferHandle buffer_handle,
-                                       void* buffer_data,
-                                       BufferHandle staging_buffer_handle,
-                                       sizet staging_buffer_offset) {
-  Buffer* buffer = device->access_buffer(buffer_handle);
-  Buffer* staging_buffer = device->access_buffer(staging_buffer_handle);
-  u32 copy_size = buffer->size;
-
-  // Copy buffer_data to staging buffer
-  memcpy(staging_buffer->mapped_data + staging_buffer_offset, buffer_data,
-         static_cast<size_t>(copy_size));
+void CommandBuffer::copy_buffer(BufferHandle src_, sizet src_offset,
+                                BufferHandle dst_, sizet dst_offset,
+                                sizet size) {
+  Buffer* src = device->access_buffer(src_);
+  Buffer* dst = device->access_buffer(dst_);
 
   VkBufferCopy region{};
-  region.srcOffset = staging_buffer_offset;
-  region.dstOffset = 0;
-  region.size = copy_size;
+  region.srcOffset = src_offset;
+  region.dstOffset = dst_offset;
+  region.size = size;
 
-  vkCmdCopyBuffer(vk_handle, staging_buffer->vk_handle, buffer->vk_handle, 1,
-                  &region);
-
-  util_add_buffer_barrier_ext(
-      device, vk_handle, buffer->vk_handle, RESOURCE_STATE_COPY_DEST,
-      RESOURCE_STATE_UNDEFINED, copy_size, device->vulkan_transfer_queue_family,
-      device->vulkan_main_queue_family, QueueType::CopyTransfer,
-      QueueType::Graphics);
+  vkCmdCopyBuffer(vk_handle, src->vk_handle, dst->vk_handle, 1, &region);
 }
 
 void CommandBuffer::upload_buffer_data(BufferHandle src_, BufferHandle dst_) {
@@ -735,7 +714,8 @@ void CommandBuffer::upload_buffer_data(BufferHandle src_, BufferHandle dst_) {
 }
 
 // CommandBufferManager ///////////////////////////////////////////////////
-void CommandBufferManager::init(GpuDevice* gpu_, u32 num_threads) {
+void CommandBufferManager::init(GpuDevice* gpu_, u32 num_threads,
+                                QueueType::Enum queue_type) {
   gpu = gpu_;
   num_pools_per_frame = num_threads;
 
@@ -749,7 +729,9 @@ void CommandBufferManager::init(GpuDevice* gpu_, u32 num_threads) {
   for (u32 i = 0; i < total_pools; i++) {
     VkCommandPoolCreateInfo cmd_pool_info = {
         VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr};
-    cmd_pool_info.queueFamilyIndex = gpu->vulkan_main_queue_family;
+    cmd_pool_info.queueFamilyIndex = queue_type == QueueType::Compute
+                                         ? gpu->vulkan_compute_queue_family
+                                         : gpu->vulkan_main_queue_family;
     cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     vkCreateCommandPool(gpu->vulkan_device, &cmd_pool_info,
@@ -790,6 +772,7 @@ void CommandBufferManager::init(GpuDevice* gpu_, u32 num_threads) {
     // TODO(marco): move to have a ring per queue per thread
     // current_command_buffer.handle = i;
     current_command_buffer.init(gpu);
+    current_command_buffer.queue_type = queue_type;
   }
 
   u32 handle = total_buffers;
@@ -811,6 +794,7 @@ void CommandBufferManager::init(GpuDevice* gpu_, u32 num_threads) {
 
       // cb.handle = handle++;
       cb.init(gpu);
+      cb.queue_type = queue_type;
 
       // NOTE(marco): access to the descriptor pool has to be synchronized
       // across theads. Don't allow for now
@@ -859,14 +843,16 @@ CommandBuffer* CommandBufferManager::get_command_buffer(u32 frame,
                                                         bool begin) {
   const u32 pool_index = pool_from_indices(frame, thread_index);
   u32 current_used_buffer = used_buffers[pool_index];
-  // TODO: how to handle fire-and-forget command buffers ?
-  // used_buffers[ pool_index ] = current_used_buffer + 1;
   HASSERT(current_used_buffer < num_command_buffers_per_thread);
 
   CommandBuffer* cb =
       &command_buffers[(pool_index * num_command_buffers_per_thread) +
                        current_used_buffer];
+  // Fire-and-forget command buffers are submitted before the next one is
+  // taken and can be reused, the ones of the frame wait for present.
   if (begin) {
+    used_buffers[pool_index] = current_used_buffer + 1;
+
     cb->reset();
     cb->begin();
   }
@@ -3,6 +3,7 @@
 #include "Renderer/GPUDevice.hpp"
 
 namespace Helix {
+
 static const u32 k_secondary_command_buffers_count = 2;
 //
 //
@@ -69,12 +70,13 @@ struct CommandBuffer {
   void pop_marker();
 
   // Non-drawing methods
-  void upload_texture_data(TextureHandle texture, void* texture_data,
-                           BufferHandle staging_buffer,
-                           sizet staging_buffer_offset);
-  void upload_buffer_data(BufferHandle buffer, void* buffer_data,
-                          BufferHandle staging_buffer,
-                          sizet staging_buffer_offset);
+  // Copies tightly packed texel rows [first_row, first_row + row_count) of a
+  // mip, the texture must be in the COPY_DEST state.
+  void copy_buffer_to_texture(BufferHandle src, sizet src_offset,
+                              TextureHandle dst, u32 mip, u32 first_row,
+                              u32 row_count);
+  void copy_buffer(BufferHandle src, sizet src_offset, BufferHandle dst,
+                   sizet dst_offset, sizet size);
   void upload_buffer_data(BufferHandle src, BufferHandle dst);
 
   void reset();
@@ -83,6 +85,10 @@ struct CommandBuffer {
 
   VkDescriptorPool vk_descriptor_pool;
   ResourcePool descriptor_sets;
+  // Resource arrays of the descriptor sets and the sets by content, both
+  // cleared by reset.
+  LinearAllocator descriptor_set_allocator;
+  FlatHashMap<u64, u32> descriptor_set_cache;
 
   GpuDevice* device;
 
@@ -91,11 +97,16 @@ struct CommandBuffer {
   Pipeline* current_pipeline;
   VkClearValue
       clears[k_depth_stencil_clear_index + 1];  // 0 = color, 1 = depth stencil
+  // Queue of the family of the pool, the stages of the barriers depend on it.
+  QueueType::Enum queue_type = QueueType::Graphics;
   bool is_recording;
 };  // struct CommandBuffer
 
 struct CommandBufferManager {
-  void init(GpuDevice* gpu, u32 num_threads);
+  // Pools are created for the family of the queue the buffers are submitted
+  // to.
+  void init(GpuDevice* gpu, u32 num_threads,
+            QueueType::Enum queue_type = QueueType::Graphics);
   void shutdown();
 
   void reset_pools(u32 frame_index);
@@ -115,7 +126,9 @@ struct CommandBufferManager {
 
   GpuDevice* gpu = nullptr;
   u32 num_pools_per_frame = 0;
-  u32 num_command_buffers_per_thread = 3;
+  // A thread can record several frame graph chunks of a frame, see
+  // glTFDrawTask.
+  u32 num_command_buffers_per_thread = 12;
 
 };  // struct CommandBufferManager
 
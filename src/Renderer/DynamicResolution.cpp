@@ -0,0 +1,58 @@
+#include "Renderer/DynamicResolution.hpp"
+
+#include <math.h>
+
+#include "Core/Numerics.hpp"
+
+namespace Helix {
+
+f32 DynamicResolution::update(f32 gpu_frame_ms) {
+  if (!enabled) {
+    scale = max_scale;
+    time_sum = 0.f;
+    time_count = 0;
+    return scale;
+  }
+
+  if (gpu_frame_ms <= 0.f) {
+    return scale;
+  }
+
+  if (skipped_frames > 0) {
+    --skipped_frames;
+    return scale;
+  }
+
+  time_sum += gpu_frame_ms;
+  ++time_count;
+  if (time_count < sample_frames) {
+    return scale;
+  }
+
+  average_ms = time_sum / time_count;
+  time_sum = 0.f;
+  time_count = 0;
+
+  const f32 lower_ms = budget_ms * lower_threshold;
+  const f32 upper_ms = budget_ms * upper_threshold;
+  if (average_ms >= lower_ms && average_ms <= upper_ms) {
+    return scale;
+  }
+
+  // The time grows with the pixel count, the square of the scale.
+  const f32 target_ms = (lower_ms + upper_ms) * 0.5f;
+  f32 new_scale = scale * sqrtf(target_ms / average_ms);
+  new_scale = Helix::min(new_scale, scale + max_increase);
+  new_scale = Helix::clamp(new_scale, min_scale, max_scale);
+  if (new_scale != scale) {
+    scale = new_scale;
+    skipped_frames = latency_frames;
+  }
+  return scale;
+}
+
+u32 dynamic_resolution_extent(u32 extent, f32 scale) {
+  return Helix::max((u32)(extent * scale + 0.5f), 1u);
+}
+
+}  // namespace Helix
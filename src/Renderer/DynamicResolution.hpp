@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Core/Platform.hpp"
+
+namespace Helix {
+
+// Dynamic resolution ///////////////////////////////////////////////////////
+// Attachments sized by the swapchain are created for the largest scale. Each
+// frame the graph renders in the part of them given by the current scale and
+// the passes reading them scale their coordinates by the render_scale scene
+// constant, changing the scale reallocates nothing. The fullscreen pass
+// upscales the rendered part to the swapchain.
+//
+// The controller picks the scale from the GPU frame times. It keeps the
+// scale while their average stays in a band under the budget, and otherwise
+// moves it so that the time, proportional to the pixel count, lands in the
+// middle of the band.
+
+//
+//
+struct DynamicResolution {
+  // Scale for the next frame from the GPU time of the last resolved one.
+  // Times of 0, from a paused profiler, are skipped.
+  f32 update(f32 gpu_frame_ms);
+
+  bool enabled = true;
+  // GPU frame time to hold.
+  f32 budget_ms = 16.0f;
+  f32 min_scale = 0.5f;
+  f32 max_scale = 1.0f;
+  // The scale is kept while the average time is in
+  // [budget_ms * lower_threshold, budget_ms * upper_threshold].
+  f32 lower_threshold = 0.8f;
+  f32 upper_threshold = 0.95f;
+  // Largest increase of a change, decreases are not limited to get back
+  // under the budget quickly.
+  f32 max_increase = 0.05f;
+  // Frames averaged before a decision.
+  u32 sample_frames = 16;
+  // Frames skipped after a change: their timestamps, resolved a few frames
+  // late, are the ones of the previous scale.
+  u32 latency_frames = 4;
+
+  f32 scale = 1.0f;
+  // Average time of the last decision.
+  f32 average_ms = 0.f;
+
+  f32 time_sum = 0.f;
+  u32 time_count = 0;
+  u32 skipped_frames = 0;
+};  // struct DynamicResolution
+
+// Extent rendered in an attachment of the given extent, at least one pixel.
+u32 dynamic_resolution_extent(u32 extent, f32 scale);
+
+}  // namespace Helix
@@ -5,8 +5,11 @@
 #include "Core/File.hpp"
 #include "Core/Log.hpp"
 #include "Core/Memory.hpp"
+#include "Core/Numerics.hpp"
 #include "Core/String.hpp"
+#include "Core/Time.hpp"
 #include "Renderer/CommandBuffer.hpp"
+#include "Renderer/DynamicResolution.hpp"
 #include "Renderer/GPUDevice.hpp"
 
 // #include <string>
@@ -69,6 +72,11 @@ static void compute_edges(FrameGraph* frame_graph, FrameGraphNode* node,
 
     FrameGraphNode* parent_node =
         frame_graph->access_node(input_resource->producer);
+    if (!parent_node->enabled) {
+      HWARN("Node {} reads {} from the disabled node {}", node->name,
+            input_resource->name, parent_node->name);
+      continue;
+    }
 
     parent_node->edges.push(frame_graph->nodes[node_index]);
   }
@@ -212,6 +220,1092 @@ static void create_render_pass(FrameGraph* frame_graph, FrameGraphNode* node) {
       frame_graph->builder->device->create_render_pass(render_pass_creation);
 }
 
+// Render passes and framebuffers of the active graphics nodes.
+static void create_node_passes(FrameGraph* frame_graph) {
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = frame_graph->access_node(frame_graph->nodes[i]);
+    if (!node->active()) {
+      continue;
+    }
+
+    if (node->compute) {
+      continue;
+    }
+
+    if (node->render_pass.index == k_invalid_index) {
+      create_render_pass(frame_graph, node);
+    }
+
+    if (node->framebuffer.index == k_invalid_index) {
+      create_framebuffer(frame_graph, node);
+    }
+  }
+}
+
+// Resolution of scaled attachments and memory alignment of the resources
+// when a graph is planned without a device.
+static const u32 k_cpu_graph_width = 1920;
+static const u32 k_cpu_graph_height = 1080;
+static const sizet k_cpu_graph_alignment = hkilo(64);
+
+// Texel size of the attachment formats, to plan graphs without a device.
+static u32 estimate_texel_size(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+      return 16;
+    default:
+      // Every other format used by the graphs.
+      return 4;
+  }
+}
+
+static TextureCreation transient_texture_creation(
+    const FrameGraphResource* resource) {
+  const FrameGraphResourceInfo& info = resource->resource_info;
+
+  TextureCreation texture_creation{};
+  texture_creation.set_data(nullptr)
+      .set_name(resource->name)
+      .set_format_type(info.texture.format, TextureType::Enum::Texture2D)
+      .set_size(info.texture.width, info.texture.height, info.texture.depth)
+      .set_flags(1, TextureFlags::RenderTarget_mask);
+  return texture_creation;
+}
+
+static BufferCreation transient_buffer_creation(
+    const FrameGraphResource* resource) {
+  const FrameGraphResourceInfo& info = resource->resource_info;
+
+  BufferCreation buffer_creation{};
+  buffer_creation
+      .set(info.buffer.flags, ResourceUsageType::Immutable,
+           (u32)info.buffer.size)
+      .set_device_only(true)
+      .set_name(resource->name);
+  return buffer_creation;
+}
+
+// Allocates the blocks of the transient memory plan and creates the resources
+// in them. Resources flagged in created_resources were created by a previous
+// compile: the new image or buffer is swapped in their handle, which the
+// passes keep using, and the old one is destroyed. Their flag becomes 2.
+static void allocate_transient_resources(FrameGraph* frame_graph,
+                                         u8* created_resources) {
+  FrameGraphBuilder* builder = frame_graph->builder;
+  GpuDevice* gpu = builder->device;
+  const Array<FrameGraphResourceHandle>& handles =
+      frame_graph->transient_resources;
+  const Array<TransientResource>& resources =
+      frame_graph->transient_requirements;
+  const TransientMemoryPlan& plan = frame_graph->transient_plan;
+
+  for (u32 b = 0; b < plan.blocks.size; ++b) {
+    VkMemoryRequirements requirements{};
+    requirements.size = plan.blocks[b].size;
+    requirements.alignment = 1;
+    requirements.memoryTypeBits = plan.blocks[b].memory_type_bits;
+    for (u32 r = 0; r < resources.size; ++r) {
+      if (plan.placements[r].block == b) {
+        requirements.alignment =
+            Helix::max(requirements.alignment, resources[r].alignment);
+      }
+    }
+    frame_graph->transient_blocks.push(
+        gpu->allocate_memory(requirements, frame_graph->name));
+  }
+
+  for (u32 r = 0; r < handles.size; ++r) {
+    FrameGraphResource* resource = builder->access_resource(handles[r]);
+    const TransientPlacement& placement = plan.placements[r];
+    VmaAllocation memory = frame_graph->transient_blocks[placement.block];
+
+    const bool created =
+        created_resources != nullptr && created_resources[handles[r].index];
+    if (resource->type == FrameGraphResourceType_Attachment) {
+      TextureCreation texture_creation = transient_texture_creation(resource);
+      texture_creation.set_alias_memory(memory, placement.offset);
+      TextureHandle texture = gpu->create_texture(texture_creation);
+      if (created) {
+        gpu->swap_texture(resource->resource_info.texture.handle, texture);
+        gpu->destroy_texture(texture);
+      } else {
+        resource->resource_info.texture.handle = texture;
+      }
+    } else {
+      BufferCreation buffer_creation = transient_buffer_creation(resource);
+      buffer_creation.set_alias_memory(memory, placement.offset);
+      BufferHandle buffer = gpu->create_buffer(buffer_creation);
+      if (created) {
+        gpu->swap_buffer(resource->resource_info.buffer.handle, buffer);
+        gpu->destroy_buffer(buffer);
+      } else {
+        resource->resource_info.buffer.handle = buffer;
+      }
+    }
+    if (created) {
+      created_resources[handles[r].index] = 2;
+    }
+
+    HDEBUG("Output {} placed in transient block {} at offset {}",
+           resource->name, placement.block, placement.offset);
+  }
+}
+
+// Creates the attachments and sized buffers written by the active nodes.
+// They are placed in transient memory blocks by their lifetimes: resources
+// never alive during the same node can share memory.
+static void create_transient_resources(FrameGraph* frame_graph,
+                                       u8* created_resources) {
+  FrameGraphBuilder* builder = frame_graph->builder;
+  GpuDevice* gpu = builder->device;
+  Array<FrameGraphResourceHandle>& handles = frame_graph->transient_resources;
+  Array<TransientResource>& resources = frame_graph->transient_requirements;
+  handles.clear();
+  resources.clear();
+  if (frame_graph->nodes.size == 0) {
+    return;
+  }
+  const u32 last_node = frame_graph->nodes.size - 1;
+
+  // Resources of the async compute nodes are alive for the whole frame: the
+  // queues run in parallel, the execution order doesn't tell when other
+  // resources are done with the memory.
+  Array<u8> async_resources;
+  async_resources.init(&frame_graph->linear_allocator,
+                       FrameGraphBuilder::k_max_resources_count,
+                       FrameGraphBuilder::k_max_resources_count);
+  memset(async_resources.data, 0, sizeof(u8) * async_resources.size);
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(frame_graph->nodes[i]);
+    if (!node->active() || node->queue != QueueType::Compute) {
+      continue;
+    }
+
+    for (u32 j = 0; j < node->inputs.size; ++j) {
+      const FrameGraphResourceHandle handle =
+          builder->access_resource(node->inputs[j])->output_handle;
+      if (handle.index != k_invalid_index) {
+        async_resources[handle.index] = 1;
+      }
+    }
+    for (u32 j = 0; j < node->outputs.size; ++j) {
+      // References write the resource of their name.
+      FrameGraphResource* output = builder->access_resource(node->outputs[j]);
+      if (output->type == FrameGraphResourceType_Reference) {
+        output = frame_graph->get_resource(output->name);
+      }
+      if (output != nullptr) {
+        async_resources[output->output_handle.index] = 1;
+      }
+    }
+  }
+
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(frame_graph->nodes[i]);
+    if (!node->active()) {
+      continue;
+    }
+
+    for (u32 j = 0; j < node->outputs.size; ++j) {
+      FrameGraphResource* resource =
+          builder->access_resource(node->outputs[j]);
+      FrameGraphResourceInfo& info = resource->resource_info;
+      if (info.external) {
+        continue;
+      }
+
+      VkMemoryRequirements requirements{};
+      bool keep_content = false;
+      if (resource->type == FrameGraphResourceType_Attachment) {
+        // Resolve texture size if needed, again when compiled after a resize.
+        if (info.texture.width == 0 || info.texture.height == 0 ||
+            info.texture.scale_width > 0.f) {
+          const u32 width = gpu ? gpu->swapchain_width : k_cpu_graph_width;
+          const u32 height = gpu ? gpu->swapchain_height : k_cpu_graph_height;
+          info.texture.width = (u32)(width * info.texture.scale_width);
+          info.texture.height = (u32)(height * info.texture.scale_height);
+        }
+
+        if (gpu) {
+          gpu->query_memory_requirements(transient_texture_creation(resource),
+                                         requirements);
+        } else {
+          requirements.size = (sizet)info.texture.width * info.texture.height *
+                              info.texture.depth *
+                              estimate_texel_size(info.texture.format);
+          requirements.alignment = k_cpu_graph_alignment;
+          requirements.memoryTypeBits = 1;
+        }
+        // Loaded attachments keep their content from the previous frame.
+        keep_content = info.texture.load_op == RenderPassOperation::Load;
+      } else if (resource->type == FrameGraphResourceType_Buffer &&
+                 info.buffer.size > 0) {
+        if (gpu) {
+          gpu->query_memory_requirements(transient_buffer_creation(resource),
+                                         requirements);
+        } else {
+          requirements.size = info.buffer.size;
+          requirements.alignment = k_cpu_graph_alignment;
+          requirements.memoryTypeBits = 1;
+        }
+      } else {
+        continue;
+      }
+
+      // Resources keeping their content are alive for the whole frame.
+      const bool whole_frame =
+          keep_content || async_resources[node->outputs[j].index];
+      resources.push({requirements.size, requirements.alignment,
+                      requirements.memoryTypeBits,
+                      whole_frame ? 0 : resource->first_node,
+                      whole_frame ? last_node : resource->last_node});
+      handles.push(node->outputs[j]);
+    }
+  }
+
+  TransientMemoryPlan& plan = frame_graph->transient_plan;
+  transient_memory_plan(resources.data, resources.size,
+                        frame_graph->transient_block_size,
+                        frame_graph->alias_transient_memory, plan,
+                        &frame_graph->linear_allocator);
+  HASSERT(transient_memory_plan_validate(resources.data, resources.size, plan));
+  transient_memory_plan_log(plan, frame_graph->name);
+
+  // Resources sharing memory wait for the accesses of the previous user.
+  for (u32 a = 0; a < resources.size; ++a) {
+    for (u32 b = a + 1; b < resources.size; ++b) {
+      const TransientPlacement& placement_a = plan.placements[a];
+      const TransientPlacement& placement_b = plan.placements[b];
+      if (placement_a.block != placement_b.block ||
+          placement_a.offset >= placement_b.offset + resources[b].size ||
+          placement_b.offset >= placement_a.offset + resources[a].size) {
+        continue;
+      }
+
+      FrameGraphResource* resource_a = builder->access_resource(handles[a]);
+      FrameGraphResource* resource_b = builder->access_resource(handles[b]);
+      resource_a->aliased = true;
+      resource_b->aliased = true;
+      builder->access_node(frame_graph->nodes[resource_a->first_node])
+          ->aliasing_barrier = true;
+      builder->access_node(frame_graph->nodes[resource_b->first_node])
+          ->aliasing_barrier = true;
+    }
+  }
+
+  async_resources.shutdown();
+
+  if (gpu != nullptr) {
+    allocate_transient_resources(frame_graph, created_resources);
+  }
+}
+
+// Destroys what a previous compile created on the device: the render passes
+// and framebuffers of the nodes and the transient memory blocks. The frames
+// in flight still use them, they go through the deferred deletion.
+static void release_compiled_resources(FrameGraph* frame_graph) {
+  GpuDevice* gpu = frame_graph->builder->device;
+  if (gpu == nullptr) {
+    return;
+  }
+
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = frame_graph->access_node(frame_graph->nodes[i]);
+    if (node->render_pass.index != k_invalid_index) {
+      gpu->destroy_render_pass(node->render_pass);
+      node->render_pass = {k_invalid_index};
+    }
+    if (node->framebuffer.index != k_invalid_index) {
+      // The attachments are resources of the graph, they outlive the
+      // framebuffer.
+      Framebuffer* framebuffer = gpu->access_framebuffer(node->framebuffer);
+      framebuffer->num_color_attachments = 0;
+      framebuffer->depth_stencil_attachment = k_invalid_texture;
+      gpu->destroy_framebuffer(node->framebuffer);
+      node->framebuffer = k_invalid_framebuffer;
+    }
+  }
+
+  for (u32 i = 0; i < frame_graph->transient_blocks.size; ++i) {
+    gpu->free_memory(frame_graph->transient_blocks[i]);
+  }
+  frame_graph->transient_blocks.clear();
+}
+
+// Culling ///////////////////////////////////////////////////////////////////
+
+// Resource an output of a node writes, references write the resource of their
+// name.
+static FrameGraphResource* written_resource(FrameGraph* frame_graph,
+                                            FrameGraphResourceHandle output) {
+  FrameGraphResource* resource = frame_graph->access_resource(output);
+  if (resource->type == FrameGraphResourceType_Reference) {
+    return frame_graph->get_resource(resource->name);
+  }
+  return resource;
+}
+
+// Walks the enabled nodes backward from the last one: a node is needed when
+// it writes a sink, an external resource or a resource read by a needed node.
+// The others are culled. Attachment inputs are written in place, a node
+// reading a resource needs every node writing it before.
+static void cull_nodes(FrameGraph* frame_graph) {
+  FrameGraphBuilder* builder = frame_graph->builder;
+  frame_graph->culled_node_count = 0;
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    builder->access_node(frame_graph->nodes[i])->culled = false;
+  }
+  if (frame_graph->sinks.size == 0) {
+    return;
+  }
+
+  Array<u8> needed;
+  needed.init(&frame_graph->linear_allocator,
+              FrameGraphBuilder::k_max_resources_count,
+              FrameGraphBuilder::k_max_resources_count);
+  memset(needed.data, 0, sizeof(u8) * needed.size);
+
+  for (u32 s = 0; s < frame_graph->sinks.size; ++s) {
+    FrameGraphResource* sink = frame_graph->get_resource(frame_graph->sinks[s]);
+    if (sink == nullptr) {
+      HWARN("Frame graph {} sink {} is not written by any node",
+            frame_graph->name, frame_graph->sinks[s]);
+      continue;
+    }
+    needed[sink->output_handle.index] = 1;
+  }
+
+  for (i32 i = frame_graph->nodes.size - 1; i >= 0; --i) {
+    FrameGraphNode* node = builder->access_node(frame_graph->nodes[i]);
+    if (!node->enabled) {
+      continue;
+    }
+
+    bool node_needed = false;
+    for (u32 o = 0; o < node->outputs.size && !node_needed; ++o) {
+      FrameGraphResource* resource =
+          written_resource(frame_graph, node->outputs[o]);
+      node_needed = resource != nullptr &&
+                    (resource->resource_info.external ||
+                     needed[resource->output_handle.index]);
+    }
+    for (u32 r = 0; r < node->inputs.size && !node_needed; ++r) {
+      FrameGraphResource* input = frame_graph->access_resource(node->inputs[r]);
+      node_needed = input->type == FrameGraphResourceType_Attachment &&
+                    input->output_handle.index != k_invalid_index &&
+                    needed[input->output_handle.index];
+    }
+
+    if (!node_needed) {
+      node->culled = true;
+      ++frame_graph->culled_node_count;
+      HINFO("Frame graph {} culled {}: no sink depends on it",
+            frame_graph->name, node->name);
+      continue;
+    }
+
+    for (u32 r = 0; r < node->inputs.size; ++r) {
+      FrameGraphResource* input = frame_graph->access_resource(node->inputs[r]);
+      if (input->output_handle.index != k_invalid_index) {
+        needed[input->output_handle.index] = 1;
+      }
+    }
+  }
+
+  HINFO("Frame graph {}: {} of {} nodes culled", frame_graph->name,
+        frame_graph->culled_node_count, frame_graph->nodes.size);
+
+  needed.shutdown();
+}
+
+// Barrier plan //////////////////////////////////////////////////////////////
+
+static const u32 k_write_resource_states =
+    RESOURCE_STATE_RENDER_TARGET | RESOURCE_STATE_UNORDERED_ACCESS |
+    RESOURCE_STATE_DEPTH_WRITE | RESOURCE_STATE_COPY_DEST;
+
+// State the node accesses the resource in, undefined when its pass handles
+// the transitions.
+static ResourceState node_resource_state(FrameGraphNode* node,
+                                         FrameGraphResource* access,
+                                         FrameGraphResource* resource,
+                                         bool output) {
+  if (resource->resource_info.external) {
+    return RESOURCE_STATE_UNDEFINED;
+  }
+
+  switch (access->type) {
+    case FrameGraphResourceType_Texture:
+      // Written textures, as mip chains, are transitioned by their pass.
+      return output ? RESOURCE_STATE_UNDEFINED
+                    : RESOURCE_STATE_SHADER_RESOURCE;
+    case FrameGraphResourceType_Attachment:
+      if (node->compute) {
+        return output ? RESOURCE_STATE_UNORDERED_ACCESS
+                      : RESOURCE_STATE_UNDEFINED;
+      }
+      return TextureFormat::has_depth(resource->resource_info.texture.format)
+                 ? RESOURCE_STATE_DEPTH_WRITE
+                 : RESOURCE_STATE_RENDER_TARGET;
+    case FrameGraphResourceType_Buffer:
+      // Compute passes can write the buffers they read, graphics passes read
+      // them as draw arguments and from their shaders.
+      if (output || node->compute) {
+        return RESOURCE_STATE_UNORDERED_ACCESS;
+      }
+      return (ResourceState)(RESOURCE_STATE_INDIRECT_ARGUMENT |
+                             RESOURCE_STATE_SHADER_RESOURCE);
+    default:
+      return RESOURCE_STATE_UNDEFINED;
+  }
+}
+
+// One entry per resource accessed by the node, old_state is unused.
+static void gather_node_accesses(FrameGraph* frame_graph,
+                                 FrameGraphNode* node,
+                                 Array<FrameGraphBarrier>& accesses) {
+  accesses.clear();
+
+  const u32 access_count = node->inputs.size + node->outputs.size;
+  for (u32 a = 0; a < access_count; ++a) {
+    const bool output = a >= node->inputs.size;
+    FrameGraphResourceHandle handle =
+        output ? node->outputs[a - node->inputs.size] : node->inputs[a];
+    FrameGraphResource* access = frame_graph->access_resource(handle);
+    if (!output) {
+      handle = access->output_handle;
+      if (handle.index == k_invalid_index) {
+        continue;
+      }
+    }
+
+    const ResourceState state = node_resource_state(
+        node, access, frame_graph->access_resource(handle), output);
+    if (state == RESOURCE_STATE_UNDEFINED) {
+      continue;
+    }
+
+    // Resources read and written by the node get both states.
+    u32 i = 0;
+    while (i < accesses.size && accesses[i].resource.index != handle.index) {
+      ++i;
+    }
+    if (i == accesses.size) {
+      accesses.push({handle, RESOURCE_STATE_UNDEFINED, state});
+    } else {
+      accesses[i].new_state = (ResourceState)(accesses[i].new_state | state);
+    }
+  }
+}
+
+// Moves the tracked state of a resource, returns false when the access needs
+// no barrier: an image read in its current state, or a buffer read after
+// other reads. Reads merge their states so the next write waits for all of
+// them.
+static bool plan_transition(ResourceState& state, ResourceState new_state,
+                            bool buffer) {
+  const bool reads = ((state | new_state) & k_write_resource_states) == 0;
+  if (reads && (state == new_state ||
+                (buffer && state != RESOURCE_STATE_UNDEFINED))) {
+    state = (ResourceState)(state | new_state);
+    return false;
+  }
+
+  state = new_state;
+  return true;
+}
+
+// Tracks the state of every resource through the active nodes, in execution
+// order. A frame starts with the states of the previous one ended with, the
+// transitions of each node are recorded with one pipeline barrier.
+// With queue ownership transfers, a resource used by the other queue before
+// is acquired by the node and released at the end of the submission that
+// used it last.
+static void plan_barriers(FrameGraph* frame_graph) {
+  FrameGraphBuilder* builder = frame_graph->builder;
+  frame_graph->barriers.clear();
+  frame_graph->frame_start_states.clear();
+  frame_graph->queue_releases.clear();
+  frame_graph->redundant_barrier_count = 0;
+
+  Array<ResourceState> states;
+  states.init(&frame_graph->linear_allocator,
+              FrameGraphBuilder::k_max_resources_count,
+              FrameGraphBuilder::k_max_resources_count);
+  memset(states.data, 0, sizeof(ResourceState) * states.size);
+
+  // Queue and submission of the last access of every resource.
+  Array<u8> queues;
+  queues.init(&frame_graph->linear_allocator,
+              FrameGraphBuilder::k_max_resources_count,
+              FrameGraphBuilder::k_max_resources_count);
+  memset(queues.data, QueueType::Graphics, sizeof(u8) * queues.size);
+  Array<u32> owners;
+  owners.init(&frame_graph->linear_allocator,
+              FrameGraphBuilder::k_max_resources_count,
+              FrameGraphBuilder::k_max_resources_count);
+  memset(owners.data, 0, sizeof(u32) * owners.size);
+
+  Array<u32> node_submissions;
+  node_submissions.init(&frame_graph->linear_allocator,
+                        frame_graph->nodes.size, frame_graph->nodes.size);
+  for (u32 s = 0; s < frame_graph->submissions.size; ++s) {
+    const FrameGraphSubmission& submission = frame_graph->submissions[s];
+    for (u32 n = submission.first_node; n < submission.last_node; ++n) {
+      node_submissions[n] = s;
+    }
+  }
+
+  // Releases and the submission recording them.
+  Array<FrameGraphBarrier> releases;
+  releases.init(&frame_graph->linear_allocator, 8);
+  Array<u32> release_submissions;
+  release_submissions.init(&frame_graph->linear_allocator, 8);
+
+  Array<FrameGraphResourceHandle> accessed;
+  accessed.init(&frame_graph->linear_allocator, 16);
+  Array<FrameGraphBarrier> accesses;
+  accesses.init(&frame_graph->linear_allocator, 16);
+
+  // First walk: the states at the end of a frame.
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(frame_graph->nodes[i]);
+    if (!node->active()) {
+      continue;
+    }
+
+    gather_node_accesses(frame_graph, node, accesses);
+    for (u32 a = 0; a < accesses.size; ++a) {
+      const FrameGraphResourceHandle handle = accesses[a].resource;
+      if (states[handle.index] == RESOURCE_STATE_UNDEFINED) {
+        accessed.push(handle);
+      }
+      plan_transition(states[handle.index], accesses[a].new_state,
+                      builder->access_resource(handle)->type ==
+                          FrameGraphResourceType_Buffer);
+      queues[handle.index] = (u8)node->queue;
+      owners[handle.index] = node_submissions[i];
+    }
+  }
+
+  // Aliased resources start undefined, their memory was used by others.
+  for (u32 r = 0; r < accessed.size; ++r) {
+    FrameGraphResource* resource = builder->access_resource(accessed[r]);
+    ResourceState& state = states[accessed[r].index];
+    if (resource->aliased) {
+      state = RESOURCE_STATE_UNDEFINED;
+    } else if (resource->type != FrameGraphResourceType_Buffer) {
+      frame_graph->frame_start_states.push(
+          {accessed[r], RESOURCE_STATE_UNDEFINED, state});
+    }
+  }
+
+  u32 batch_count = 0;
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(frame_graph->nodes[i]);
+    node->first_barrier = frame_graph->barriers.size;
+    node->barrier_count = 0;
+    if (!node->active()) {
+      continue;
+    }
+
+    u32 image_count = 0;
+    u32 buffer_count = 0;
+    gather_node_accesses(frame_graph, node, accesses);
+    for (u32 a = 0; a < accesses.size; ++a) {
+      const FrameGraphResourceHandle handle = accesses[a].resource;
+      const bool buffer = builder->access_resource(handle)->type ==
+                          FrameGraphResourceType_Buffer;
+      ResourceState& state = states[handle.index];
+      const ResourceState old_state = state;
+      const QueueType::Enum source_queue =
+          (QueueType::Enum)queues[handle.index];
+      const bool transfer = frame_graph->queue_ownership_transfers &&
+                            source_queue != node->queue &&
+                            old_state != RESOURCE_STATE_UNDEFINED;
+      const u32 owner = owners[handle.index];
+      queues[handle.index] = (u8)node->queue;
+      owners[handle.index] = node_submissions[i];
+      if (!plan_transition(state, accesses[a].new_state, buffer) &&
+          !transfer) {
+        ++frame_graph->redundant_barrier_count;
+        continue;
+      }
+
+      const FrameGraphBarrier planned{handle, old_state, state, source_queue,
+                                      node->queue};
+      frame_graph->barriers.push(planned);
+      if (transfer) {
+        releases.push(planned);
+        release_submissions.push(owner);
+      }
+      if (buffer) {
+        ++buffer_count;
+      } else {
+        ++image_count;
+      }
+    }
+    HASSERT(image_count <= k_max_execution_barriers &&
+            buffer_count <= k_max_execution_barriers);
+
+    node->barrier_count = frame_graph->barriers.size - node->first_barrier;
+    if (node->barrier_count > 0 || node->aliasing_barrier) {
+      ++batch_count;
+    }
+  }
+
+  // Releases grouped by submission.
+  for (u32 s = 0; s < frame_graph->submissions.size; ++s) {
+    FrameGraphSubmission& submission = frame_graph->submissions[s];
+    submission.first_release = frame_graph->queue_releases.size;
+    for (u32 r = 0; r < releases.size; ++r) {
+      if (release_submissions[r] == s) {
+        frame_graph->queue_releases.push(releases[r]);
+      }
+    }
+    submission.release_count =
+        frame_graph->queue_releases.size - submission.first_release;
+  }
+
+  HINFO(
+      "Frame graph {} barriers: {} transitions in {} batches, {} redundant "
+      "transitions removed, {} queue ownership transfers",
+      frame_graph->name, frame_graph->barriers.size, batch_count,
+      frame_graph->redundant_barrier_count, frame_graph->queue_releases.size);
+
+  release_submissions.shutdown();
+  releases.shutdown();
+  node_submissions.shutdown();
+  owners.shutdown();
+  queues.shutdown();
+  accesses.shutdown();
+  accessed.shutdown();
+  states.shutdown();
+}
+
+// Textures recreated or first used since the plan was made are moved to the
+// state it expects at the start of a frame.
+static void add_frame_start_barriers(FrameGraph* frame_graph,
+                                     CommandBuffer* gpu_commands) {
+  GpuDevice* gpu = gpu_commands->device;
+
+  ExecutionBarrier barrier;
+  barrier.reset();
+  for (u32 i = 0; i < frame_graph->frame_start_states.size; ++i) {
+    const FrameGraphBarrier& start = frame_graph->frame_start_states[i];
+    const TextureHandle handle = frame_graph->access_resource(start.resource)
+                                     ->resource_info.texture.handle;
+    if (handle.index == k_invalid_index) {
+      continue;
+    }
+
+    Texture* texture = gpu->access_texture(handle);
+    if (texture->state == start.new_state) {
+      continue;
+    }
+
+    if (barrier.num_image_barriers == k_max_execution_barriers) {
+      gpu_commands->barrier(barrier);
+      barrier.reset();
+    }
+    barrier.add_image_barrier({handle, texture->state, start.new_state});
+    texture->state = start.new_state;
+  }
+
+  gpu_commands->barrier(barrier);
+}
+
+static u32 queue_family(GpuDevice* gpu, QueueType::Enum queue) {
+  return queue == QueueType::Compute ? gpu->vulkan_compute_queue_family
+                                     : gpu->vulkan_main_queue_family;
+}
+
+// Adds a planned transition, with the queue families of its ownership
+// transfer if it has one.
+static void add_planned_barrier(FrameGraph* frame_graph,
+                                const FrameGraphBarrier& planned,
+                                ExecutionBarrier& barrier) {
+  FrameGraphResource* resource =
+      frame_graph->access_resource(planned.resource);
+  const FrameGraphResourceInfo& info = resource->resource_info;
+
+  u32 source_family = VK_QUEUE_FAMILY_IGNORED;
+  u32 destination_family = VK_QUEUE_FAMILY_IGNORED;
+  if (frame_graph->queue_ownership_transfers &&
+      planned.source_queue != planned.destination_queue) {
+    GpuDevice* gpu = frame_graph->builder->device;
+    source_family = queue_family(gpu, planned.source_queue);
+    destination_family = queue_family(gpu, planned.destination_queue);
+  }
+
+  if (resource->type == FrameGraphResourceType_Buffer) {
+    // Buffers of the passes are skipped until bound.
+    if (info.buffer.handle.index != k_invalid_index) {
+      barrier.add_buffer_barrier({info.buffer.handle, planned.old_state,
+                                  planned.new_state, source_family,
+                                  destination_family});
+    }
+  } else if (info.texture.handle.index != k_invalid_index) {
+    barrier.add_image_barrier({info.texture.handle, planned.old_state,
+                               planned.new_state, source_family,
+                               destination_family});
+  }
+}
+
+// Planned transitions of the node, and the wait for the previous users of the
+// memory of its aliased outputs.
+static void add_node_barriers(FrameGraph* frame_graph, FrameGraphNode* node,
+                              CommandBuffer* gpu_commands) {
+  ExecutionBarrier barrier;
+  barrier.reset();
+  if (node->aliasing_barrier) {
+    barrier.add_memory_barrier();
+  }
+
+  for (u32 b = 0; b < node->barrier_count; ++b) {
+    add_planned_barrier(frame_graph,
+                        frame_graph->barriers[node->first_barrier + b],
+                        barrier);
+  }
+
+  gpu_commands->barrier(barrier);
+}
+
+// Resources the other queue acquires next, released once the submission is
+// done with them.
+static void add_queue_releases(FrameGraph* frame_graph,
+                               const FrameGraphSubmission& submission,
+                               CommandBuffer* gpu_commands) {
+  ExecutionBarrier barrier;
+  barrier.reset();
+  for (u32 r = 0; r < submission.release_count; ++r) {
+    if (barrier.num_image_barriers == k_max_execution_barriers ||
+        barrier.num_buffer_barriers == k_max_execution_barriers) {
+      gpu_commands->barrier(barrier);
+      barrier.reset();
+    }
+    add_planned_barrier(frame_graph,
+                        frame_graph->queue_releases[submission.first_release +
+                                                    r],
+                        barrier);
+  }
+
+  gpu_commands->barrier(barrier);
+}
+
+// Async compute /////////////////////////////////////////////////////////////
+
+// Access of a node to a resource, for the ordering of the nodes.
+struct FrameGraphNodeAccess {
+  // Output handle index of the resource.
+  u32 resource;
+  bool write;
+  // The graph plans the transitions of the access.
+  bool tracked;
+};
+
+// Every resource the node reads or writes, the ones whose transitions are
+// handled by the passes included. The order follows the accesses the graph
+// declares: outputs and attachment inputs are written, other inputs read.
+// Compute passes writing parts of a buffer they read, as the late culling
+// does with the draw counts, must not touch the parts other nodes read.
+static void gather_node_hazards(FrameGraph* frame_graph, FrameGraphNode* node,
+                                Array<FrameGraphNodeAccess>& accesses) {
+  const u32 access_count = node->inputs.size + node->outputs.size;
+  for (u32 a = 0; a < access_count; ++a) {
+    const bool output = a >= node->inputs.size;
+    const FrameGraphResourceHandle handle =
+        output ? node->outputs[a - node->inputs.size] : node->inputs[a];
+    FrameGraphResource* access = frame_graph->access_resource(handle);
+    FrameGraphResource* resource = nullptr;
+    if (output) {
+      resource = written_resource(frame_graph, handle);
+    } else if (access->output_handle.index != k_invalid_index) {
+      resource = frame_graph->access_resource(access->output_handle);
+    }
+    if (resource == nullptr) {
+      continue;
+    }
+
+    const bool write =
+        output || access->type == FrameGraphResourceType_Attachment;
+    const bool tracked = node_resource_state(node, access, resource, output) !=
+                         RESOURCE_STATE_UNDEFINED;
+    accesses.push({resource->output_handle.index, write, tracked});
+  }
+}
+
+// Moves the async compute nodes that graphics nodes can run alongside to the
+// compute queue. The nodes are reordered for the graphics work to run while
+// the compute queue works, then split in submissions: runs of nodes of one
+// queue, waiting for the last submission of the other queue they depend on.
+static void schedule_queues(FrameGraph* frame_graph) {
+  FrameGraphBuilder* builder = frame_graph->builder;
+  Allocator* allocator = &frame_graph->linear_allocator;
+  Array<FrameGraphNodeHandle>& nodes = frame_graph->nodes;
+  Array<FrameGraphSubmission>& submissions = frame_graph->submissions;
+  submissions.clear();
+  frame_graph->async_node_count = 0;
+
+  Array<u32> active;
+  active.init(allocator, nodes.size);
+  bool requested = false;
+  for (u32 i = 0; i < nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(nodes[i]);
+    node->queue = QueueType::Graphics;
+    if (node->active()) {
+      active.push(i);
+      requested = requested || (node->compute && node->async_compute);
+    }
+  }
+  if (!frame_graph->use_async_compute || !requested) {
+    submissions.push({QueueType::Graphics, 0, nodes.size});
+    active.shutdown();
+    return;
+  }
+
+  const u32 count = active.size;
+  Array<FrameGraphNodeAccess> accesses;
+  accesses.init(allocator, 64);
+  Array<u32> first_access;
+  first_access.init(allocator, count + 1);
+  for (u32 i = 0; i < count; ++i) {
+    first_access.push(accesses.size);
+    gather_node_hazards(frame_graph, builder->access_node(nodes[active[i]]),
+                        accesses);
+  }
+  first_access.push(accesses.size);
+
+  // Nodes accessing a resource one of them writes keep their order.
+  auto conflict = [&](u32 a, u32 b, bool writes) {
+    for (u32 x = first_access[a]; x < first_access[a + 1]; ++x) {
+      for (u32 y = first_access[b]; y < first_access[b + 1]; ++y) {
+        if (accesses[x].resource == accesses[y].resource &&
+            (!writes || accesses[x].write || accesses[y].write)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  // depends[i * count + j]: active node i runs after active node j, through
+  // other nodes or not.
+  Array<u8> depends;
+  depends.init(allocator, count * count, count * count);
+  memset(depends.data, 0, sizeof(u8) * depends.size);
+  for (u32 i = 0; i < count; ++i) {
+    u8* row = depends.data + i * count;
+    for (u32 j = 0; j < i; ++j) {
+      if (!conflict(i, j, true)) {
+        continue;
+      }
+      const u8* previous = depends.data + j * count;
+      for (u32 k = 0; k < j; ++k) {
+        row[k] |= previous[k];
+      }
+      row[j] = 1;
+    }
+  }
+
+  Array<u8> async;
+  async.init(allocator, count, count);
+  for (u32 i = 0; i < count; ++i) {
+    async[i] = 0;
+    FrameGraphNode* node = builder->access_node(nodes[active[i]]);
+    if (!node->compute || !node->async_compute) {
+      continue;
+    }
+
+    cstring reason = nullptr;
+    for (u32 a = first_access[i];
+         a < first_access[i + 1] && frame_graph->queue_ownership_transfers;
+         ++a) {
+      if (!accesses[a].tracked) {
+        reason = "its pass transitions resources of another queue family";
+        break;
+      }
+    }
+
+    bool overlaps = false;
+    for (u32 g = 0; g < count && !overlaps; ++g) {
+      FrameGraphNode* other = builder->access_node(nodes[active[g]]);
+      if (g == i || (other->compute && other->async_compute) ||
+          depends[i * count + g] || depends[g * count + i]) {
+        continue;
+      }
+      // Resources of another family can't be used by both queues at once.
+      overlaps = !frame_graph->queue_ownership_transfers ||
+                 !conflict(i, g, false);
+    }
+    if (reason == nullptr && !overlaps) {
+      reason = "no graphics node can run alongside it";
+    }
+
+    if (reason != nullptr) {
+      HINFO("Frame graph {} keeps {} on the graphics queue: {}",
+            frame_graph->name, node->name, reason);
+      continue;
+    }
+    async[i] = 1;
+    ++frame_graph->async_node_count;
+  }
+
+  // Ready nodes are picked in turn: async nodes first, then graphics nodes not
+  // waiting for the compute queue, then the others, in graph order.
+  Array<u32> order;
+  order.init(allocator, count);
+  Array<u32> positions;
+  positions.init(allocator, count, count);
+  Array<u8> scheduled;
+  scheduled.init(allocator, count, count);
+  memset(scheduled.data, 0, sizeof(u8) * scheduled.size);
+  // Async nodes scheduled before it are waited for by a graphics node.
+  u32 waited_position = 0;
+
+  auto ready = [&](u32 i) {
+    if (scheduled[i]) {
+      return false;
+    }
+    for (u32 j = 0; j < i; ++j) {
+      if (depends[i * count + j] && !scheduled[j]) {
+        return false;
+      }
+    }
+    return true;
+  };
+  auto waits_compute = [&](u32 i) {
+    for (u32 j = 0; j < i; ++j) {
+      if (depends[i * count + j] && async[j] &&
+          positions[j] >= waited_position) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  while (order.size < count) {
+    u32 pick = u32_max;
+    for (u32 i = 0; i < count && pick == u32_max; ++i) {
+      if (async[i] && ready(i)) {
+        pick = i;
+      }
+    }
+    for (u32 i = 0; i < count && pick == u32_max; ++i) {
+      if (!async[i] && ready(i) && !waits_compute(i)) {
+        pick = i;
+      }
+    }
+    for (u32 i = 0; i < count && pick == u32_max; ++i) {
+      if (ready(i)) {
+        pick = i;
+      }
+    }
+    HASSERT(pick != u32_max);
+
+    if (!async[pick]) {
+      for (u32 j = 0; j < pick; ++j) {
+        if (depends[pick * count + j] && async[j]) {
+          waited_position = Helix::max(waited_position, positions[j] + 1);
+        }
+      }
+    }
+    positions[pick] = order.size;
+    scheduled[pick] = 1;
+    order.push(pick);
+  }
+
+  // Submissions of the active nodes in their new order. The first one is on
+  // the graphics queue: the compute queue waits for the start of the frame.
+  i32 waited[QueueType::Count] = {-1, -1, -1};
+  Array<u32> node_submissions;
+  node_submissions.init(allocator, count, count);
+  for (u32 k = 0; k < count; ++k) {
+    const u32 i = order[k];
+    const QueueType::Enum queue =
+        async[i] ? QueueType::Compute : QueueType::Graphics;
+
+    i32 needed = -1;
+    if (queue == QueueType::Compute) {
+      if (submissions.size == 0) {
+        submissions.push({QueueType::Graphics, k, k});
+      }
+      needed = 0;
+    }
+    for (u32 l = 0; l < k; ++l) {
+      const u32 j = order[l];
+      if (depends[i * count + j] && async[j] != async[i]) {
+        needed = Helix::max(needed, (i32)node_submissions[l]);
+      }
+    }
+
+    const bool wait = needed > waited[queue];
+    if (submissions.size == 0 || submissions.back().queue != queue || wait) {
+      submissions.push({queue, k, k, wait ? (u32)needed : u32_max});
+    }
+    if (wait) {
+      waited[queue] = needed;
+      submissions[needed].signal = true;
+    }
+    submissions.back().last_node = k + 1;
+    node_submissions[k] = submissions.size - 1;
+  }
+
+  if (submissions.size > k_max_frame_graph_submissions) {
+    HWARN("Frame graph {} needs {} submissions, async compute is disabled",
+          frame_graph->name, submissions.size);
+    frame_graph->async_node_count = 0;
+    memset(async.data, 0, sizeof(u8) * async.size);
+    submissions.clear();
+  }
+  if (submissions.size == 0) {
+    submissions.push({QueueType::Graphics, 0, 0});
+  }
+  submissions.back().last_node = nodes.size;
+
+  // Active nodes in their new order, then the others.
+  Array<FrameGraphNodeHandle> sorted_nodes;
+  sorted_nodes.init(allocator, nodes.size);
+  for (u32 k = 0; k < count; ++k) {
+    sorted_nodes.push(nodes[active[order[k]]]);
+    builder->access_node(sorted_nodes.back())->queue =
+        async[order[k]] ? QueueType::Compute : QueueType::Graphics;
+  }
+  for (u32 i = 0; i < nodes.size; ++i) {
+    if (!builder->access_node(nodes[i])->active()) {
+      sorted_nodes.push(nodes[i]);
+    }
+  }
+  nodes.clear();
+  for (u32 i = 0; i < sorted_nodes.size; ++i) {
+    nodes.push(sorted_nodes[i]);
+  }
+
+  for (u32 s = 0; s < submissions.size; ++s) {
+    const FrameGraphSubmission& submission = submissions[s];
+    HINFO("Frame graph {} submission {} on the {} queue: nodes {} to {}{}",
+          frame_graph->name, s,
+          submission.queue == QueueType::Compute ? "compute" : "graphics",
+          submission.first_node, submission.last_node,
+          submission.wait_submission != u32_max ? ", waits" : "");
+  }
+  HINFO("Frame graph {}: {} nodes on the async compute queue",
+        frame_graph->name, frame_graph->async_node_count);
+
+  sorted_nodes.shutdown();
+  node_submissions.shutdown();
+  scheduled.shutdown();
+  positions.shutdown();
+  order.shutdown();
+  async.shutdown();
+  depends.shutdown();
+  first_access.shutdown();
+  accesses.shutdown();
+  active.shutdown();
+}
+
 // FrameGraphRenderPassCache
 // /////////////////////////////////////////////////////////////
 
@@ -233,21 +1327,22 @@ void FrameGraphResourceCache::init(Allocator* allocator, GpuDevice* device_) {
 
 void FrameGraphResourceCache::shutdown() {
   FlatHashMapIterator it = resource_map.iterator_begin();
-  while (it.is_valid()) {
+  // Graphs compiled without a device have no GPU resources.
+  while (device && it.is_valid()) {
     u32 resource_index = resource_map.get(it);
     FrameGraphResource* resource = resources.get(resource_index);
 
     if (resource->type == FrameGraphResourceType_Texture ||
         resource->type == FrameGraphResourceType_Attachment) {
-      Texture* texture =
-          device->access_texture(resource->resource_info.texture.handle);
-      device->destroy_texture(texture->handle);
+      // Outputs not planned by the last compile have no texture.
+      if (resource->resource_info.texture.handle.index != k_invalid_index) {
+        device->destroy_texture(resource->resource_info.texture.handle);
+      }
     } else if (resource->type == FrameGraphResourceType_Buffer) {
-      // TODO: Right now buffer resources in framegraphs are handled separately
-      // by the Scene class
-      // Buffer* buffer =
-      // device->access_buffer(resource->resource_info.buffer.handle);
-      // device->destroy_buffer(buffer->handle);
+      // Buffers without a size are created by the passes using them.
+      if (resource->resource_info.buffer.handle.index != k_invalid_index) {
+        device->destroy_buffer(resource->resource_info.buffer.handle);
+      }
     }
 
     resource_map.iterator_advance(it);
@@ -281,7 +1376,9 @@ void FrameGraphNodeCache::shutdown() {
 void FrameGraphBuilder::init(GpuDevice* device_) {
   device = device_;
 
-  allocator = device->allocator;
+  // Without a device graphs are only parsed and compiled, for CPU tools.
+  allocator = device ? device->allocator
+                     : &MemoryService::instance()->system_allocator;
 
   resource_cache.init(allocator, device);
   node_cache.init(allocator, device);
@@ -331,7 +1428,6 @@ FrameGraphResourceHandle FrameGraphBuilder::create_node_output(
     resource->resource_info = creation.resource_info;
     resource->output_handle = resource_handle;
     resource->producer = producer;
-    resource->ref_count = 0;
 
     resource_cache.resource_map.insert(
         hash_bytes((void*)resource->name, strlen(creation.name)),
@@ -359,7 +1455,6 @@ FrameGraphResourceHandle FrameGraphBuilder::create_node_input(
   resource->output_handle.index = k_invalid_index;
   resource->type = creation.type;
   resource->name = creation.name;
-  resource->ref_count = 0;
 
   return resource_handle;
 }
@@ -378,11 +1473,13 @@ FrameGraphNodeHandle FrameGraphBuilder::create_node(
   node->name = creation.name;
   node->enabled = creation.enabled;
   node->compute = creation.compute;
+  node->async_compute = creation.async_compute;
   node->inputs.init(allocator, creation.input_creations.size);
   node->outputs.init(allocator, creation.output_creations.size);
   node->edges.init(allocator, creation.output_creations.size);
   node->framebuffer = k_invalid_framebuffer;
   node->render_pass = {k_invalid_index};
+  node->graph_render_pass = nullptr;
 
   node_cache.node_map.insert(hash_bytes((void*)node->name, strlen(node->name)),
                              node_handle.index);
@@ -460,6 +1557,30 @@ void FrameGraph::init(FrameGraphBuilder* builder_) {
   builder = builder_;
 
   nodes.init(allocator, FrameGraphBuilder::k_max_nodes_count);
+
+  transient_resources.init(allocator, 16);
+  transient_requirements.init(allocator, 16);
+  transient_plan.init(allocator, 16);
+  transient_blocks.init(allocator, 4);
+
+  barriers.init(allocator, 32);
+  frame_start_states.init(allocator, 16);
+
+  sinks.init(allocator, 4);
+
+  timings.init(allocator);
+
+  // Graphs planned without a device are scheduled for a compute queue of the
+  // graphics family.
+  GpuDevice* gpu = builder->device;
+  use_async_compute =
+      gpu == nullptr ||
+      (gpu->gpu_device_features & GpuDeviceFeature_ASYNC_COMPUTE) != 0;
+  queue_ownership_transfers =
+      gpu != nullptr && use_async_compute &&
+      gpu->vulkan_compute_queue_family != gpu->vulkan_main_queue_family;
+  submissions.init(allocator, 4);
+  queue_releases.init(allocator, 8);
 }
 
 void FrameGraph::shutdown() {
@@ -467,7 +1588,9 @@ void FrameGraph::shutdown() {
     FrameGraphNodeHandle handle = nodes[i];
     FrameGraphNode* node = builder->access_node(handle);
 
-    if (!node->compute) {
+    // Nodes inactive at the last compile have no passes.
+    if (!node->compute && builder->device &&
+        node->render_pass.index != k_invalid_index) {
       builder->device->destroy_render_pass(node->render_pass);
       builder->device->destroy_framebuffer(node->framebuffer);
     }
@@ -478,6 +1601,25 @@ void FrameGraph::shutdown() {
 
   nodes.shutdown();
 
+  // The resources placed in the blocks are destroyed with the builder.
+  for (u32 i = 0; i < transient_blocks.size; ++i) {
+    builder->device->free_memory(transient_blocks[i]);
+  }
+  transient_resources.shutdown();
+  transient_requirements.shutdown();
+  transient_plan.shutdown();
+  transient_blocks.shutdown();
+
+  barriers.shutdown();
+  frame_start_states.shutdown();
+
+  sinks.shutdown();
+
+  timings.shutdown();
+
+  submissions.shutdown();
+  queue_releases.shutdown();
+
   linear_allocator.shutdown();
 }
 
@@ -503,6 +1645,12 @@ void FrameGraph::parse(cstring file_path, StackAllocator* temp_allocator) {
   std::string name_value = graph_data.value("name", "");
   name = string_buffer.append_use_f("%s", name_value.c_str());
 
+  json graph_sinks = graph_data["sinks"];
+  for (sizet i = 0; i < graph_sinks.size(); ++i) {
+    std::string sink_name = graph_sinks[i];
+    sinks.push(string_buffer.append_use_f("%s", sink_name.c_str()));
+  }
+
   json passes = graph_data["passes"];
   for (sizet i = 0; i < passes.size(); ++i) {
     json pass = passes[i];
@@ -516,6 +1664,8 @@ void FrameGraph::parse(cstring file_path, StackAllocator* temp_allocator) {
                                         (u32)pass_outputs.size());
 
     node_creation.compute = pass.value("type", "").compare("compute") == 0;
+    node_creation.async_compute =
+        node_creation.compute && pass.value("async_compute", false);
 
     for (sizet ii = 0; ii < pass_inputs.size(); ++ii) {
       json pass_input = pass_inputs[ii];
@@ -565,6 +1715,8 @@ void FrameGraph::parse(cstring file_path, StackAllocator* temp_allocator) {
 
       switch (output_creation.type) {
         case FrameGraphResourceType_Texture: {
+          // Created by the pass writing them.
+          output_creation.resource_info.texture.handle = k_invalid_texture;
         } break;
         case FrameGraphResourceType_Attachment: {
           std::string format = pass_output.value("format", "");
@@ -634,45 +1786,685 @@ void FrameGraph::parse(cstring file_path, StackAllocator* temp_allocator) {
             }
           }
 
-        } break;
-        case FrameGraphResourceType_Buffer: {
-          // TODO(marco)
-          // HASSERT_MSG(false, "ResourceType_Buffer not currently supported");
-        } break;
-      }
+        } break;
+        case FrameGraphResourceType_Buffer: {
+          // Buffers with a size are created by the graph, the others by the
+          // passes using them.
+          output_creation.resource_info.buffer.size =
+              pass_output.value("size", (u64)0);
+          output_creation.resource_info.buffer.flags =
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+              VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+          output_creation.resource_info.buffer.handle = k_invalid_buffer;
+        } break;
+      }
+
+      node_creation.output_creations.push(output_creation);
+    }
+
+    name_value = pass.value("name", "");
+    HASSERT(!name_value.empty());
+
+    bool enabled = pass.value("enabled", true);
+
+    node_creation.name = string_buffer.append_use_f("%s", name_value.c_str());
+    node_creation.enabled = enabled;
+
+    FrameGraphNodeHandle node_handle = builder->create_node(node_creation);
+    nodes.push(node_handle);
+  }
+
+  temp_allocator->free_marker(current_allocator_marker);
+}
+
+// Compiled graph cache //////////////////////////////////////////////////////
+
+static const u32 k_frame_graph_cache_magic = 0x43474648;  // 'HFGC'
+static const u32 k_frame_graph_cache_version = 1;
+
+//
+// Followed by the tables, in this order and without padding: nodes in
+// execution order, resources, barriers, frame start states, submissions,
+// queue releases, transient resources, transient blocks, sinks and strings.
+struct FrameGraphCacheHeader {
+  u32 magic;
+  u32 version;
+  u64 key;
+  u64 unaliased_size;
+  u64 aliased_size;
+  u64 peak_live_size;
+  u32 node_count;
+  u32 resource_count;
+  u32 barrier_count;
+  u32 frame_start_count;
+  u32 submission_count;
+  u32 release_count;
+  u32 transient_count;
+  u32 block_count;
+  u32 sink_count;
+  u32 string_size;
+  // Strings are offsets in the string table.
+  u32 name;
+  u32 culled_node_count;
+  u32 async_node_count;
+  u32 redundant_barrier_count;
+};  // struct FrameGraphCacheHeader
+
+static_assert(sizeof(FrameGraphCacheHeader) == 96,
+              "Frame graph cache header must be 96 bytes");
+
+//
+// Resources of the node are the next output_count + input_count ones of the
+// resource table, outputs first, in the order of the node.
+struct FrameGraphCacheNode {
+  u32 name;
+  u32 output_count;
+  u32 input_count;
+  u32 first_barrier;
+  u32 barrier_count;
+  u32 queue;
+  u8 enabled;
+  u8 compute;
+  u8 async_compute;
+  u8 culled;
+  u8 aliasing_barrier;
+  u8 padding[3];
+};  // struct FrameGraphCacheNode
+
+static_assert(sizeof(FrameGraphCacheNode) == 32,
+              "Frame graph cache node must be 32 bytes");
+
+//
+// Resources are referenced by their index in the resource table.
+struct FrameGraphCacheResource {
+  // Without the device objects, created again by load_cache.
+  FrameGraphResourceInfo info;
+  u32 name;
+  u32 type;
+  // Output read by an input, u32_max for outputs and unproduced inputs.
+  u32 output;
+  u32 first_node;
+  u32 last_node;
+  u32 aliased;
+};  // struct FrameGraphCacheResource
+
+//
+//
+struct FrameGraphCacheBarrier {
+  u32 resource;
+  u32 old_state;
+  u32 new_state;
+  u32 source_queue;
+  u32 destination_queue;
+};  // struct FrameGraphCacheBarrier
+
+//
+//
+struct FrameGraphCacheTransient {
+  TransientResource requirements;
+  TransientPlacement placement;
+  u32 resource;
+};  // struct FrameGraphCacheTransient
+
+// Graph settings the compiled plan depends on.
+static u64 frame_graph_cache_settings_key(const FrameGraph* frame_graph,
+                                          u64 key) {
+  key = hash_calculate(frame_graph->alias_transient_memory, key);
+  key = hash_calculate(frame_graph->transient_block_size, key);
+  key = hash_calculate(frame_graph->use_async_compute, key);
+  return hash_calculate(frame_graph->queue_ownership_transfers, key);
+}
+
+static FrameGraphResourceInfo frame_graph_cache_info(
+    const FrameGraphResource* resource) {
+  FrameGraphResourceInfo info{};
+  if (resource->type == FrameGraphResourceType_Reference) {
+    return info;
+  }
+
+  info = resource->resource_info;
+  if (resource->type == FrameGraphResourceType_Buffer) {
+    info.buffer.handle = k_invalid_buffer;
+  } else {
+    info.texture.handle = k_invalid_texture;
+  }
+  return info;
+}
+
+static FrameGraphBarrier frame_graph_cached_barrier(
+    const FrameGraphCacheBarrier& barrier,
+    const Array<FrameGraphResourceHandle>& handles) {
+  return {handles[barrier.resource], (ResourceState)barrier.old_state,
+          (ResourceState)barrier.new_state,
+          (QueueType::Enum)barrier.source_queue,
+          (QueueType::Enum)barrier.destination_queue};
+}
+
+static u32 frame_graph_cache_string(char* strings, u32& string_size,
+                                    cstring string) {
+  const u32 offset = string_size;
+  const u32 length = (u32)strlen(string) + 1;
+  memcpy(strings + offset, string, length);
+  string_size += length;
+  return offset;
+}
+
+// The tables are not aligned, they are copied in and out of the file.
+static void frame_graph_cache_write(u8*& cursor, const void* data,
+                                    sizet size) {
+  if (size > 0) {
+    memcpy(cursor, data, size);
+    cursor += size;
+  }
+}
+
+static void frame_graph_cache_write_barriers(
+    u8*& cursor, const Array<FrameGraphBarrier>& barriers,
+    const Array<u32>& ordinals) {
+  for (u32 i = 0; i < barriers.size; ++i) {
+    const FrameGraphBarrier& barrier = barriers[i];
+    const FrameGraphCacheBarrier cache_barrier = {
+        ordinals[barrier.resource.index], (u32)barrier.old_state,
+        (u32)barrier.new_state, (u32)barrier.source_queue,
+        (u32)barrier.destination_queue};
+    frame_graph_cache_write(cursor, &cache_barrier,
+                            sizeof(FrameGraphCacheBarrier));
+  }
+}
+
+template <typename T>
+static void frame_graph_cache_read(const u8*& cursor, Array<T>& table,
+                                   u32 count, Allocator* allocator) {
+  table.init(allocator, count, count);
+  if (count > 0) {
+    memcpy(table.data, cursor, sizeof(T) * count);
+    cursor += sizeof(T) * count;
+  }
+}
+
+static bool frame_graph_cache_barriers_valid(
+    const Array<FrameGraphCacheBarrier>& barriers, u32 resource_count) {
+  for (u32 i = 0; i < barriers.size; ++i) {
+    if (barriers[i].resource >= resource_count ||
+        barriers[i].source_queue >= QueueType::Count ||
+        barriers[i].destination_queue >= QueueType::Count) {
+      return false;
+    }
+  }
+  return true;
+}
+
+u64 frame_graph_cache_key(cstring file_path, GpuDevice* gpu,
+                          Allocator* allocator) {
+  sizet size = 0;
+  char* data = file_read_binary(file_path, allocator, &size);
+  if (data == nullptr) {
+    return 0;
+  }
+  u64 key = hash_bytes(data, size, k_frame_graph_cache_version);
+  hfree(data, allocator);
+
+  if (gpu == nullptr) {
+    return key;
+  }
+
+  const VkPhysicalDeviceProperties& properties =
+      gpu->vulkan_physical_properties;
+  key = hash_calculate(properties.vendorID, key);
+  key = hash_calculate(properties.deviceID, key);
+  key = hash_calculate(properties.driverVersion, key);
+  key = hash_calculate(gpu->gpu_device_features, key);
+  key = hash_calculate(gpu->vulkan_main_queue_family, key);
+  key = hash_calculate(gpu->vulkan_compute_queue_family, key);
+  // Scaled attachments are sized by compile.
+  key = hash_calculate(gpu->swapchain_width, key);
+  return hash_calculate(gpu->swapchain_height, key);
+}
+
+void FrameGraph::write_cache(cstring file_path, u64 key,
+                             StackAllocator* temp_allocator) {
+  sizet current_allocator_marker = temp_allocator->get_marker();
+
+  // Index in the resource table of the resources, by handle.
+  Array<u32> ordinals;
+  ordinals.init(temp_allocator, FrameGraphBuilder::k_max_resources_count,
+                FrameGraphBuilder::k_max_resources_count);
+
+  u32 resource_count = 0;
+  u32 string_capacity = (u32)strlen(name) + 1;
+  for (u32 i = 0; i < nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(nodes[i]);
+    string_capacity += (u32)strlen(node->name) + 1;
+
+    for (u32 j = 0; j < node->outputs.size; ++j) {
+      ordinals[node->outputs[j].index] = resource_count++;
+      string_capacity +=
+          (u32)strlen(builder->access_resource(node->outputs[j])->name) + 1;
+    }
+    for (u32 j = 0; j < node->inputs.size; ++j) {
+      ordinals[node->inputs[j].index] = resource_count++;
+      string_capacity +=
+          (u32)strlen(builder->access_resource(node->inputs[j])->name) + 1;
+    }
+  }
+  for (u32 i = 0; i < sinks.size; ++i) {
+    string_capacity += (u32)strlen(sinks[i]) + 1;
+  }
+
+  const sizet size =
+      sizeof(FrameGraphCacheHeader) + sizeof(FrameGraphCacheNode) * nodes.size +
+      sizeof(FrameGraphCacheResource) * resource_count +
+      sizeof(FrameGraphCacheBarrier) *
+          (barriers.size + frame_start_states.size + queue_releases.size) +
+      sizeof(FrameGraphSubmission) * submissions.size +
+      sizeof(FrameGraphCacheTransient) * transient_resources.size +
+      sizeof(TransientMemoryBlock) * transient_plan.blocks.size +
+      sizeof(u32) * sinks.size + string_capacity;
+  u8* memory = hallocam(size, temp_allocator);
+  memset(memory, 0, size);
+  char* strings = (char*)memory + size - string_capacity;
+  u32 string_size = 0;
+
+  FrameGraphCacheHeader header{};
+  header.magic = k_frame_graph_cache_magic;
+  header.version = k_frame_graph_cache_version;
+  header.key = frame_graph_cache_settings_key(this, key);
+  header.unaliased_size = transient_plan.unaliased_size;
+  header.aliased_size = transient_plan.aliased_size;
+  header.peak_live_size = transient_plan.peak_live_size;
+  header.node_count = nodes.size;
+  header.resource_count = resource_count;
+  header.barrier_count = barriers.size;
+  header.frame_start_count = frame_start_states.size;
+  header.submission_count = submissions.size;
+  header.release_count = queue_releases.size;
+  header.transient_count = transient_resources.size;
+  header.block_count = transient_plan.blocks.size;
+  header.sink_count = sinks.size;
+  header.string_size = string_capacity;
+  header.name = frame_graph_cache_string(strings, string_size, name);
+  header.culled_node_count = culled_node_count;
+  header.async_node_count = async_node_count;
+  header.redundant_barrier_count = redundant_barrier_count;
+
+  u8* cursor = memory;
+  frame_graph_cache_write(cursor, &header, sizeof(FrameGraphCacheHeader));
+
+  for (u32 i = 0; i < nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(nodes[i]);
+
+    FrameGraphCacheNode cache_node{};
+    cache_node.name =
+        frame_graph_cache_string(strings, string_size, node->name);
+    cache_node.output_count = node->outputs.size;
+    cache_node.input_count = node->inputs.size;
+    cache_node.first_barrier = node->first_barrier;
+    cache_node.barrier_count = node->barrier_count;
+    cache_node.queue = node->queue;
+    cache_node.enabled = node->enabled;
+    cache_node.compute = node->compute;
+    cache_node.async_compute = node->async_compute;
+    cache_node.culled = node->culled;
+    cache_node.aliasing_barrier = node->aliasing_barrier;
+    frame_graph_cache_write(cursor, &cache_node, sizeof(FrameGraphCacheNode));
+  }
+
+  for (u32 i = 0; i < nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(nodes[i]);
+    for (u32 j = 0; j < node->outputs.size + node->inputs.size; ++j) {
+      const bool output = j < node->outputs.size;
+      FrameGraphResource* resource = builder->access_resource(
+          output ? node->outputs[j] : node->inputs[j - node->outputs.size]);
+
+      FrameGraphCacheResource cache_resource{};
+      cache_resource.info = frame_graph_cache_info(resource);
+      cache_resource.name =
+          frame_graph_cache_string(strings, string_size, resource->name);
+      cache_resource.type = resource->type;
+      cache_resource.output =
+          output || resource->output_handle.index == k_invalid_index
+              ? u32_max
+              : ordinals[resource->output_handle.index];
+      cache_resource.first_node = resource->first_node;
+      cache_resource.last_node = resource->last_node;
+      cache_resource.aliased = resource->aliased;
+      frame_graph_cache_write(cursor, &cache_resource,
+                              sizeof(FrameGraphCacheResource));
+    }
+  }
+
+  frame_graph_cache_write_barriers(cursor, barriers, ordinals);
+  frame_graph_cache_write_barriers(cursor, frame_start_states, ordinals);
+  frame_graph_cache_write(cursor, submissions.data,
+                          sizeof(FrameGraphSubmission) * submissions.size);
+  frame_graph_cache_write_barriers(cursor, queue_releases, ordinals);
+
+  for (u32 i = 0; i < transient_resources.size; ++i) {
+    FrameGraphCacheTransient transient{};
+    transient.requirements = transient_requirements[i];
+    transient.placement = transient_plan.placements[i];
+    transient.resource = ordinals[transient_resources[i].index];
+    frame_graph_cache_write(cursor, &transient,
+                            sizeof(FrameGraphCacheTransient));
+  }
+
+  frame_graph_cache_write(
+      cursor, transient_plan.blocks.data,
+      sizeof(TransientMemoryBlock) * transient_plan.blocks.size);
+
+  for (u32 i = 0; i < sinks.size; ++i) {
+    const u32 sink = frame_graph_cache_string(strings, string_size, sinks[i]);
+    frame_graph_cache_write(cursor, &sink, sizeof(u32));
+  }
+
+  HASSERT(string_size == string_capacity && (char*)cursor == strings);
+  file_write_binary(file_path, memory, size);
+
+  temp_allocator->free_marker(current_allocator_marker);
+}
+
+bool FrameGraph::load_cache(cstring file_path, u64 key,
+                            StackAllocator* temp_allocator) {
+  HASSERT(nodes.size == 0);
+
+  sizet current_allocator_marker = temp_allocator->get_marker();
+
+  sizet size = 0;
+  const u8* memory =
+      (const u8*)file_read_binary(file_path, temp_allocator, &size);
+  if (memory == nullptr) {
+    temp_allocator->free_marker(current_allocator_marker);
+    return false;
+  }
 
-      node_creation.output_creations.push(output_creation);
-    }
+  FrameGraphCacheHeader header{};
+  bool valid = size >= sizeof(FrameGraphCacheHeader);
+  if (valid) {
+    memcpy(&header, memory, sizeof(FrameGraphCacheHeader));
+    const sizet expected_size =
+        sizeof(FrameGraphCacheHeader) +
+        sizeof(FrameGraphCacheNode) * (sizet)header.node_count +
+        sizeof(FrameGraphCacheResource) * (sizet)header.resource_count +
+        sizeof(FrameGraphCacheBarrier) *
+            ((sizet)header.barrier_count + header.frame_start_count +
+             header.release_count) +
+        sizeof(FrameGraphSubmission) * (sizet)header.submission_count +
+        sizeof(FrameGraphCacheTransient) * (sizet)header.transient_count +
+        sizeof(TransientMemoryBlock) * (sizet)header.block_count +
+        sizeof(u32) * (sizet)header.sink_count + header.string_size;
+    valid = header.magic == k_frame_graph_cache_magic &&
+            header.version == k_frame_graph_cache_version &&
+            header.key == frame_graph_cache_settings_key(this, key) &&
+            header.node_count <= FrameGraphBuilder::k_max_nodes_count &&
+            header.resource_count <=
+                FrameGraphBuilder::k_max_resources_count &&
+            header.submission_count <= k_max_frame_graph_submissions &&
+            header.string_size > 0 && expected_size == size &&
+            memory[size - 1] == 0 && header.name < header.string_size;
+  }
+  if (!valid) {
+    temp_allocator->free_marker(current_allocator_marker);
+    return false;
+  }
 
-    name_value = pass.value("name", "");
-    HASSERT(!name_value.empty());
+  const u8* cursor = memory + sizeof(FrameGraphCacheHeader);
+  Array<FrameGraphCacheNode> cache_nodes;
+  Array<FrameGraphCacheResource> cache_resources;
+  Array<FrameGraphCacheBarrier> cache_barriers;
+  Array<FrameGraphCacheBarrier> cache_frame_start_states;
+  Array<FrameGraphSubmission> cache_submissions;
+  Array<FrameGraphCacheBarrier> cache_releases;
+  Array<FrameGraphCacheTransient> cache_transients;
+  Array<TransientMemoryBlock> cache_blocks;
+  Array<u32> cache_sinks;
+  frame_graph_cache_read(cursor, cache_nodes, header.node_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_resources, header.resource_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_barriers, header.barrier_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_frame_start_states,
+                         header.frame_start_count, temp_allocator);
+  frame_graph_cache_read(cursor, cache_submissions, header.submission_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_releases, header.release_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_transients, header.transient_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_blocks, header.block_count,
+                         temp_allocator);
+  frame_graph_cache_read(cursor, cache_sinks, header.sink_count,
+                         temp_allocator);
+  const char* cache_strings = (const char*)cursor;
+
+  // Every index is checked before the graph is touched.
+  u32 resource_count = 0;
+  for (u32 i = 0; valid && i < cache_nodes.size; ++i) {
+    const FrameGraphCacheNode& node = cache_nodes[i];
+    resource_count += node.output_count + node.input_count;
+    valid = node.name < header.string_size &&
+            resource_count <= header.resource_count &&
+            node.first_barrier + node.barrier_count <= header.barrier_count &&
+            node.queue < QueueType::Count;
+  }
+  valid = valid && resource_count == header.resource_count;
+  for (u32 i = 0; valid && i < cache_resources.size; ++i) {
+    const FrameGraphCacheResource& resource = cache_resources[i];
+    valid = resource.name < header.string_size &&
+            resource.type <= (u32)FrameGraphResourceType_Reference &&
+            (resource.output == u32_max ||
+             resource.output < header.resource_count) &&
+            resource.first_node <= resource.last_node &&
+            resource.last_node < header.node_count;
+  }
+  valid = valid &&
+          frame_graph_cache_barriers_valid(cache_barriers,
+                                           header.resource_count) &&
+          frame_graph_cache_barriers_valid(cache_frame_start_states,
+                                           header.resource_count) &&
+          frame_graph_cache_barriers_valid(cache_releases,
+                                           header.resource_count);
+  for (u32 i = 0; valid && i < cache_submissions.size; ++i) {
+    const FrameGraphSubmission& submission = cache_submissions[i];
+    valid = submission.queue < QueueType::Count &&
+            submission.first_node <= submission.last_node &&
+            submission.last_node <= header.node_count &&
+            (submission.wait_submission == u32_max ||
+             submission.wait_submission < header.submission_count) &&
+            submission.first_release + submission.release_count <=
+                header.release_count;
+  }
+  for (u32 i = 0; valid && i < cache_transients.size; ++i) {
+    valid = cache_transients[i].resource < header.resource_count &&
+            cache_transients[i].placement.block < header.block_count;
+  }
+  for (u32 i = 0; valid && i < cache_sinks.size; ++i) {
+    valid = cache_sinks[i] < header.string_size;
+  }
+  if (!valid) {
+    HWARN("Frame graph cache {} is corrupted", file_path);
+    temp_allocator->free_marker(current_allocator_marker);
+    return false;
+  }
 
-    bool enabled = pass.value("enabled", true);
+  char* strings = (char*)halloca(header.string_size, &linear_allocator);
+  memcpy(strings, cache_strings, header.string_size);
+  name = strings + header.name;
 
-    node_creation.name = string_buffer.append_use_f("%s", name_value.c_str());
-    node_creation.enabled = enabled;
+  // Nodes and resources are created as parse does, the resource handles
+  // follow the order of the resource table.
+  Array<FrameGraphResourceHandle> handles;
+  handles.init(temp_allocator, header.resource_count, header.resource_count);
+
+  u32 first_resource = 0;
+  for (u32 i = 0; i < cache_nodes.size; ++i) {
+    const FrameGraphCacheNode& cache_node = cache_nodes[i];
+
+    FrameGraphNodeCreation node_creation{};
+    node_creation.output_creations.init(temp_allocator,
+                                        cache_node.output_count);
+    node_creation.input_creations.init(temp_allocator, cache_node.input_count);
+    for (u32 j = 0; j < cache_node.output_count + cache_node.input_count;
+         ++j) {
+      const FrameGraphCacheResource& resource =
+          cache_resources[first_resource + j];
+
+      FrameGraphResourceCreation creation{};
+      creation.type = (FrameGraphResourceType)resource.type;
+      creation.resource_info = resource.info;
+      creation.name = strings + resource.name;
+      if (j < cache_node.output_count) {
+        node_creation.output_creations.push(creation);
+      } else {
+        node_creation.input_creations.push(creation);
+      }
+    }
+    node_creation.enabled = cache_node.enabled;
+    node_creation.name = strings + cache_node.name;
+    node_creation.compute = cache_node.compute;
+    node_creation.async_compute = cache_node.async_compute;
 
     FrameGraphNodeHandle node_handle = builder->create_node(node_creation);
     nodes.push(node_handle);
+
+    FrameGraphNode* node = builder->access_node(node_handle);
+    node->queue = (QueueType::Enum)cache_node.queue;
+    node->culled = cache_node.culled;
+    node->aliasing_barrier = cache_node.aliasing_barrier;
+    node->first_barrier = cache_node.first_barrier;
+    node->barrier_count = cache_node.barrier_count;
+
+    for (u32 j = 0; j < node->outputs.size; ++j) {
+      handles[first_resource++] = node->outputs[j];
+    }
+    for (u32 j = 0; j < node->inputs.size; ++j) {
+      handles[first_resource++] = node->inputs[j];
+    }
+  }
+
+  // Lifetimes of the outputs, then the inputs read them as compute_edges
+  // links them.
+  first_resource = 0;
+  for (u32 i = 0; i < nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(nodes[i]);
+    for (u32 j = 0; j < node->outputs.size; ++j, ++first_resource) {
+      const FrameGraphCacheResource& cache_resource =
+          cache_resources[first_resource];
+      FrameGraphResource* resource = builder->access_resource(node->outputs[j]);
+      resource->first_node = cache_resource.first_node;
+      resource->last_node = cache_resource.last_node;
+      resource->aliased = cache_resource.aliased != 0;
+    }
+    first_resource += node->inputs.size;
+  }
+
+  first_resource = 0;
+  for (u32 i = 0; i < nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(nodes[i]);
+    first_resource += node->outputs.size;
+    for (u32 j = 0; j < node->inputs.size; ++j, ++first_resource) {
+      const FrameGraphCacheResource& cache_resource =
+          cache_resources[first_resource];
+      if (cache_resource.output == u32_max) {
+        continue;
+      }
+
+      FrameGraphResource* input = builder->access_resource(node->inputs[j]);
+      FrameGraphResource* output =
+          builder->access_resource(handles[cache_resource.output]);
+      input->producer = output->producer;
+      input->output_handle = output->output_handle;
+      input->resource_info = cache_resource.info;
+
+      FrameGraphNode* parent_node = builder->access_node(input->producer);
+      if (node->enabled && parent_node->enabled) {
+        parent_node->edges.push(nodes[i]);
+      }
+    }
+  }
+
+  for (u32 i = 0; i < cache_barriers.size; ++i) {
+    barriers.push(frame_graph_cached_barrier(cache_barriers[i], handles));
+  }
+  for (u32 i = 0; i < cache_frame_start_states.size; ++i) {
+    frame_start_states.push(
+        frame_graph_cached_barrier(cache_frame_start_states[i], handles));
+  }
+  for (u32 i = 0; i < cache_submissions.size; ++i) {
+    FrameGraphSubmission submission = cache_submissions[i];
+    submission.signal_value = 0;
+    submissions.push(submission);
+  }
+  for (u32 i = 0; i < cache_releases.size; ++i) {
+    queue_releases.push(frame_graph_cached_barrier(cache_releases[i], handles));
+  }
+
+  transient_plan.placements.set_size(cache_transients.size);
+  for (u32 i = 0; i < cache_transients.size; ++i) {
+    transient_resources.push(handles[cache_transients[i].resource]);
+    transient_requirements.push(cache_transients[i].requirements);
+    transient_plan.placements[i] = cache_transients[i].placement;
+  }
+  for (u32 i = 0; i < cache_blocks.size; ++i) {
+    transient_plan.blocks.push(cache_blocks[i]);
+  }
+  transient_plan.unaliased_size = header.unaliased_size;
+  transient_plan.aliased_size = header.aliased_size;
+  transient_plan.peak_live_size = header.peak_live_size;
+
+  for (u32 i = 0; i < cache_sinks.size; ++i) {
+    sinks.push(strings + cache_sinks[i]);
   }
+  culled_node_count = header.culled_node_count;
+  async_node_count = header.async_node_count;
+  redundant_barrier_count = header.redundant_barrier_count;
 
   temp_allocator->free_marker(current_allocator_marker);
+
+  if (builder->device != nullptr) {
+    allocate_transient_resources(this, nullptr);
+    create_node_passes(this);
+  }
+  return true;
 }
 
 void FrameGraph::enable_render_pass(cstring render_pass_name) {
   FrameGraphNode* node = builder->get_node(render_pass_name);
+  dirty = dirty || !node->enabled;
   node->enabled = true;
 }
 
 void FrameGraph::disable_render_pass(cstring render_pass_name) {
   FrameGraphNode* node = builder->get_node(render_pass_name);
+  dirty = dirty || node->enabled;
   node->enabled = false;
 }
 
+void FrameGraph::set_async_compute(cstring render_pass_name,
+                                   bool async_compute) {
+  FrameGraphNode* node = builder->get_node(render_pass_name);
+  dirty = dirty || node->async_compute != async_compute;
+  node->async_compute = async_compute;
+}
+
 void FrameGraph::compile() {
   // TODO(marco)
   // - check that input has been produced by a different node
-  // - cull inactive nodes
+
+  // Everything compile allocates from the linear allocator is temporary.
+  const sizet linear_allocator_size = linear_allocator.allocated_size;
+
+  // Resources created by the previous compile, see
+  // allocate_transient_resources.
+  Array<u8> created_resources;
+  created_resources.init(&linear_allocator,
+                         FrameGraphBuilder::k_max_resources_count,
+                         FrameGraphBuilder::k_max_resources_count);
+  memset(created_resources.data, 0, sizeof(u8) * created_resources.size);
+  for (u32 i = 0; i < transient_resources.size; ++i) {
+    created_resources[transient_resources[i].index] = 1;
+  }
+  release_compiled_resources(this);
 
   for (u32 i = 0; i < nodes.size; ++i) {
     FrameGraphNode* node = builder->access_node(nodes[i]);
@@ -748,11 +2540,21 @@ void FrameGraph::compile() {
     }
   }
 
+  // Disabled nodes go last, they are kept to be enabled by a later compile.
+  const u32 enabled_count = sorted_nodes.size;
+  for (u32 n = 0; n < nodes.size; ++n) {
+    if (!builder->access_node(nodes[n])->enabled) {
+      sorted_nodes.push(nodes[n]);
+    }
+  }
   HASSERT(sorted_nodes.size == nodes.size);
 
   nodes.clear();
 
-  for (i32 i = sorted_nodes.size - 1; i >= 0; --i) {
+  for (i32 i = enabled_count - 1; i >= 0; --i) {
+    nodes.push(sorted_nodes[i]);
+  }
+  for (u32 i = enabled_count; i < sorted_nodes.size; ++i) {
     nodes.push(sorted_nodes[i]);
   }
 
@@ -767,159 +2569,89 @@ void FrameGraph::compile() {
   stack.shutdown();
   sorted_nodes.shutdown();
 
-  // NOTE(marco): allocations and deallocations are used for verification
-  // purposes only
-  sizet resource_count = builder->resource_cache.resources.used_indices;
-  Array<FrameGraphNodeHandle> allocations;
-  allocations.init(&linear_allocator, (u32)resource_count, (u32)resource_count);
-  for (u32 i = 0; i < resource_count; ++i) {
-    allocations[i].index = k_invalid_index;
-  }
-
-  Array<FrameGraphNodeHandle> deallocations;
-  deallocations.init(&linear_allocator, (u32)resource_count,
-                     (u32)resource_count);
-  for (u32 i = 0; i < resource_count; ++i) {
-    deallocations[i].index = k_invalid_index;
-  }
-
-  Array<TextureHandle> free_list;
-  free_list.init(&linear_allocator, (u32)resource_count);
+  cull_nodes(this);
+  schedule_queues(this);
 
+  // Lifetimes of the resources in execution order, from the node writing
+  // them to their last reader.
   for (u32 i = 0; i < nodes.size; ++i) {
     FrameGraphNode* node = builder->access_node(nodes[i]);
-    if (!node->enabled) {
+    node->aliasing_barrier = false;
+    if (!node->active()) {
       continue;
     }
 
-    for (u32 j = 0; j < node->inputs.size; ++j) {
-      FrameGraphResource* input_resource =
-          builder->access_resource(node->inputs[j]);
-      FrameGraphResource* resource =
-          builder->access_resource(input_resource->output_handle);
+    for (u32 j = 0; j < node->outputs.size; ++j) {
+      FrameGraphResource* resource = builder->access_resource(node->outputs[j]);
+      if (resource->type == FrameGraphResourceType_Reference) {
+        continue;
+      }
 
-      resource->ref_count++;
+      resource->first_node = i;
+      resource->last_node = i;
+      resource->aliased = false;
     }
   }
 
   for (u32 i = 0; i < nodes.size; ++i) {
     FrameGraphNode* node = builder->access_node(nodes[i]);
-    if (!node->enabled) {
+    if (!node->active()) {
       continue;
     }
 
-    for (u32 j = 0; j < node->outputs.size; ++j) {
-      u32 resource_index = node->outputs[j].index;
-      FrameGraphResource* resource = builder->access_resource(node->outputs[j]);
-
-      if (!resource->resource_info.external &&
-          allocations[resource_index].index == k_invalid_index) {
-        HASSERT(deallocations[resource_index].index == k_invalid_index)
-        allocations[resource_index] = nodes[i];
-
-        if (resource->type == FrameGraphResourceType_Attachment) {
-          FrameGraphResourceInfo& info = resource->resource_info;
-
-          // Resolve texture size if needed
-          if (info.texture.width == 0 || info.texture.height == 0) {
-            info.texture.width = (u32)(builder->device->swapchain_width *
-                                       info.texture.scale_width);
-            info.texture.height = (u32)(builder->device->swapchain_height *
-                                        info.texture.scale_height);
-          }
-
-          if (free_list.size > 0) {
-            // TODO(marco): find best fit
-            TextureHandle alias_texture = free_list.back();
-            free_list.pop();
-
-            TextureCreation texture_creation{};
-            texture_creation.set_data(nullptr)
-                .set_alias(alias_texture)
-                .set_name(resource->name)
-                .set_format_type(info.texture.format,
-                                 TextureType::Enum::Texture2D)
-                .set_size(info.texture.width, info.texture.height,
-                          info.texture.depth)
-                .set_flags(1, TextureFlags::RenderTarget_mask);
-            TextureHandle handle =
-                builder->device->create_texture(texture_creation);
-
-            info.texture.handle = handle;
-          } else {
-            TextureCreation texture_creation{};
-            texture_creation.set_data(nullptr)
-                .set_name(resource->name)
-                .set_format_type(info.texture.format,
-                                 TextureType::Enum::Texture2D)
-                .set_size(info.texture.width, info.texture.height,
-                          info.texture.depth)
-                .set_flags(1, TextureFlags::RenderTarget_mask);
-            TextureHandle handle =
-                builder->device->create_texture(texture_creation);
-
-            info.texture.handle = handle;
-          }
-        }
-
-        HDEBUG("Output {} allocated on node {}", resource->name,
-               nodes[i].index);
-      }
-    }
-
     for (u32 j = 0; j < node->inputs.size; ++j) {
       FrameGraphResource* input_resource =
           builder->access_resource(node->inputs[j]);
+      if (input_resource->output_handle.index == k_invalid_index) {
+        continue;
+      }
 
-      u32 resource_index = input_resource->output_handle.index;
       FrameGraphResource* resource =
           builder->access_resource(input_resource->output_handle);
-
-      resource->ref_count--;
-
-      if (!resource->resource_info.external && resource->ref_count == 0) {
-        HASSERT(deallocations[resource_index].index == k_invalid_index);
-        deallocations[resource_index] = nodes[i];
-
-        if (resource->type == FrameGraphResourceType_Attachment ||
-            resource->type == FrameGraphResourceType_Texture) {
-          free_list.push(resource->resource_info.texture.handle);
-        }
-
-        HDEBUG("Output {} deallocated on node {}", resource->name,
-               nodes[i].index);
-      }
+      resource->last_node = Helix::max(resource->last_node, i);
     }
   }
 
-  allocations.shutdown();
-  deallocations.shutdown();
-  free_list.shutdown();
+  create_transient_resources(this, created_resources.data);
+  plan_barriers(this);
 
-  for (u32 i = 0; i < nodes.size; ++i) {
-    FrameGraphNode* node = builder->access_node(nodes[i]);
-    if (!node->enabled) {
-      continue;
-    }
+  GpuDevice* gpu = builder->device;
+  if (gpu != nullptr) {
+    // Resources not planned anymore, as the outputs of disabled nodes.
+    for (u32 i = 0; i < created_resources.size; ++i) {
+      if (created_resources[i] != 1) {
+        continue;
+      }
 
-    if (node->compute) {
-      continue;
+      FrameGraphResource* resource = builder->access_resource({i});
+      if (resource->type == FrameGraphResourceType_Attachment) {
+        gpu->destroy_texture(resource->resource_info.texture.handle);
+        resource->resource_info.texture.handle = k_invalid_texture;
+      } else {
+        gpu->destroy_buffer(resource->resource_info.buffer.handle);
+        resource->resource_info.buffer.handle = k_invalid_buffer;
+      }
     }
 
-    if (node->render_pass.index == k_invalid_index) {
-      create_render_pass(this, node);
-    }
+    create_node_passes(this);
 
-    if (node->framebuffer.index == k_invalid_index) {
-      create_framebuffer(this, node);
+    for (u32 i = 0; i < nodes.size; ++i) {
+      FrameGraphNode* node = builder->access_node(nodes[i]);
+      if (node->active() && node->graph_render_pass != nullptr) {
+        node->graph_render_pass->on_compile(*gpu, this);
+      }
     }
   }
+  created_resources.shutdown();
+
+  dirty = false;
+  linear_allocator.allocated_size = linear_allocator_size;
 }
 
 void FrameGraph::add_ui() {
   for (u32 n = 0; n < nodes.size; ++n) {
     FrameGraphNode* node = builder->access_node(nodes[n]);
-    if (!node->enabled) {
+    if (!node->active()) {
       continue;
     }
 
@@ -927,13 +2659,32 @@ void FrameGraph::add_ui() {
   }
 }
 
-void FrameGraph::render(u32 current_frame_index, CommandBuffer* gpu_commands,
-                        Scene* scene) {
-  gpu_commands->push_marker("Frame");
+void FrameGraph::render_begin(CommandBuffer* gpu_commands) {
+  HASSERT_MSG(!dirty, "Frame graph nodes changed, compile it again");
+  GpuDevice* gpu = gpu_commands->device;
+  gpu->push_gpu_timestamp(gpu_commands, "Frame");
 
+  add_frame_start_barriers(this, gpu_commands);
+
+  // Queries are handed out in push order, reserve them before the nodes are
+  // recorded.
   for (u32 n = 0; n < nodes.size; ++n) {
     FrameGraphNode* node = builder->access_node(nodes[n]);
-    if (!node->enabled) {
+    if (node->active()) {
+      node->start_query = gpu->reserve_gpu_timestamp(node->name,
+                                                     node->end_query);
+    }
+  }
+}
+
+void FrameGraph::render_nodes(u32 current_frame_index,
+                              CommandBuffer* gpu_commands, Scene* scene,
+                              u32 first_node, u32 last_node) {
+  GpuDevice* gpu = gpu_commands->device;
+
+  for (u32 n = first_node; n < last_node; ++n) {
+    FrameGraphNode* node = builder->access_node(nodes[n]);
+    if (!node->active()) {
       continue;
     }
     if (!node->graph_render_pass) {
@@ -941,95 +2692,39 @@ void FrameGraph::render(u32 current_frame_index, CommandBuffer* gpu_commands,
                 node->name);
     }
 
-    if (node->compute) {
-      gpu_commands->push_marker(node->name);
-
-      for (u32 i = 0; i < node->inputs.size; ++i) {
-        FrameGraphResource* input_resource =
-            builder->access_resource(node->inputs[i]);
-        FrameGraphResource* resource =
-            builder->access_resource(input_resource->output_handle);
-
-        if (resource == nullptr || resource->resource_info.external) {
-          continue;
-        }
-
-        if (input_resource->type == FrameGraphResourceType_Texture) {
-          Texture* texture = gpu_commands->device->access_texture(
-              resource->resource_info.texture.handle);
-
-          util_add_image_barrier(gpu_commands->device, gpu_commands->vk_handle,
-                                 texture, RESOURCE_STATE_SHADER_RESOURCE, 0, 1,
-                                 TextureFormat::has_depth(texture->vk_format));
-        } else if (input_resource->type == FrameGraphResourceType_Attachment) {
-          // TODO: what to do with attachments ?
-          continue;
-        }
-      }
-
-      for (u32 o = 0; o < node->outputs.size; ++o) {
-        FrameGraphResource* resource =
-            builder->access_resource(node->outputs[o]);
-
-        if (resource->type == FrameGraphResourceType_Attachment) {
-          Texture* texture = gpu_commands->device->access_texture(
-              resource->resource_info.texture.handle);
+    const i64 record_start = Time::now();
+    gpu->write_gpu_timestamp(gpu_commands, node->start_query);
+    if (gpu->debug_utils_extension_present) {
+      gpu->push_marker(gpu_commands->vk_handle, node->name);
+    }
 
-          if (TextureFormat::has_depth(texture->vk_format)) {
-            // Is this supported even ?
-            HASSERT(false);
-          } else {
-            util_add_image_barrier(
-                gpu_commands->device, gpu_commands->vk_handle, texture,
-                RESOURCE_STATE_UNORDERED_ACCESS, 0, 1, false);
-          }
-        }
-      }
+    add_node_barriers(this, node, gpu_commands);
 
+    if (node->compute) {
       node->graph_render_pass->pre_render(gpu_commands, scene);
       node->graph_render_pass->render(gpu_commands, scene);
       node->graph_render_pass->post_render(current_frame_index, gpu_commands,
                                            this);
-
-      gpu_commands->pop_marker();
     } else {
-      gpu_commands->push_marker(node->name);
-
       u32 width = 0;
       u32 height = 0;
+      // Attachments sized by the swapchain are rendered in part, at the
+      // resolution scale.
+      bool scaled = false;
 
       for (u32 i = 0; i < node->inputs.size; ++i) {
         FrameGraphResource* input_resource =
             builder->access_resource(node->inputs[i]);
-        FrameGraphResource* resource =
-            builder->access_resource(input_resource->output_handle);
 
-        if (input_resource->type == FrameGraphResourceType_Texture) {
-          Texture* texture = gpu_commands->device->access_texture(
-              resource->resource_info.texture.handle);
-
-          util_add_image_barrier(gpu_commands->device, gpu_commands->vk_handle,
-                                 texture,
-                                 /*RESOURCE_STATE_PIXEL_SHADER_RESOURCE*/
-                                 RESOURCE_STATE_SHADER_RESOURCE, 0, 1,
-                                 TextureFormat::has_depth(texture->vk_format));
-        } else if (input_resource->type == FrameGraphResourceType_Attachment) {
-          Texture* texture = gpu_commands->device->access_texture(
-              resource->resource_info.texture.handle);
+        if (input_resource->type == FrameGraphResourceType_Attachment) {
+          FrameGraphResource* resource =
+              builder->access_resource(input_resource->output_handle);
+          Texture* texture =
+              gpu->access_texture(resource->resource_info.texture.handle);
 
           width = texture->width;
           height = texture->height;
-
-          // For textures that are read-write check if a transition is needed.
-          if (!TextureFormat::has_depth_or_stencil(texture->vk_format)) {
-            util_add_image_barrier(gpu_commands->device,
-                                   gpu_commands->vk_handle, texture,
-                                   RESOURCE_STATE_RENDER_TARGET, 0, 1, false);
-          } else {
-            util_add_image_barrier(gpu_commands->device,
-                                   gpu_commands->vk_handle, texture,
-                                   RESOURCE_STATE_DEPTH_WRITE, 0, 1, true);
-          }
+          scaled = resource->resource_info.texture.scale_width > 0.f;
         }
       }
 
@@ -1038,24 +2733,18 @@ void FrameGraph::render(u32 current_frame_index, CommandBuffer* gpu_commands,
             builder->access_resource(node->outputs[o]);
 
         if (resource->type == FrameGraphResourceType_Attachment) {
-          Texture* texture = gpu_commands->device->access_texture(
-              resource->resource_info.texture.handle);
+          Texture* texture =
+              gpu->access_texture(resource->resource_info.texture.handle);
 
           width = texture->width;
           height = texture->height;
+          scaled = resource->resource_info.texture.scale_width > 0.f;
 
           if (TextureFormat::has_depth(texture->vk_format)) {
-            util_add_image_barrier(gpu_commands->device,
-                                   gpu_commands->vk_handle, texture,
-                                   RESOURCE_STATE_DEPTH_WRITE, 0, 1, true);
-
             f32* clear_color = resource->resource_info.texture.clear_values;
             gpu_commands->clear_depth_stencil(clear_color[0],
                                               (u8)clear_color[1]);
           } else {
-            util_add_image_barrier(gpu_commands->device,
-                                   gpu_commands->vk_handle, texture,
-                                   RESOURCE_STATE_RENDER_TARGET, 0, 1, false);
             f32* clear_color = resource->resource_info.texture.clear_values;
             gpu_commands->clear(clear_color[0], clear_color[1], clear_color[2],
                                 clear_color[3], o);
@@ -1063,6 +2752,11 @@ void FrameGraph::render(u32 current_frame_index, CommandBuffer* gpu_commands,
         }
       }
 
+      if (scaled) {
+        width = dynamic_resolution_extent(width, resolution_scale);
+        height = dynamic_resolution_extent(height, resolution_scale);
+      }
+
       Rect2DInt scissor{0, 0, (u16)width, (u16)height};
       gpu_commands->set_scissor(&scissor);
 
@@ -1083,16 +2777,64 @@ void FrameGraph::render(u32 current_frame_index, CommandBuffer* gpu_commands,
 
       node->graph_render_pass->post_render(current_frame_index, gpu_commands,
                                            this);
+    }
+
+    if (gpu->debug_utils_extension_present) {
+      gpu->pop_marker(gpu_commands->vk_handle);
+    }
+    gpu->write_gpu_timestamp(gpu_commands, node->end_query);
+    node->cpu_time_ms = (f32)Time::from_milliseconds(record_start);
+  }
+
+  for (u32 s = 0; s < submissions.size; ++s) {
+    const FrameGraphSubmission& submission = submissions[s];
+    if (submission.last_node == last_node && submission.release_count > 0) {
+      add_queue_releases(this, submission, gpu_commands);
+    }
+  }
+}
+
+void FrameGraph::render_end(CommandBuffer* gpu_commands) {
+  GpuDevice* gpu = gpu_commands->device;
+
+  // The nodes may have been recorded out of order, the textures get the
+  // states of their last recorded transition.
+  for (u32 n = 0; n < nodes.size; ++n) {
+    FrameGraphNode* node = builder->access_node(nodes[n]);
+    if (!node->active()) {
+      continue;
+    }
+
+    for (u32 b = 0; b < node->barrier_count; ++b) {
+      const FrameGraphBarrier& planned = barriers[node->first_barrier + b];
+      FrameGraphResource* resource = access_resource(planned.resource);
+      const TextureHandle handle = resource->resource_info.texture.handle;
+      if (resource->type == FrameGraphResourceType_Buffer ||
+          handle.index == k_invalid_index) {
+        continue;
+      }
+      gpu->access_texture(handle)->state = planned.new_state;
+    }
+  }
+
+  gpu->pop_gpu_timestamp(gpu_commands);
+}
 
-      gpu_commands->pop_marker();
+void FrameGraph::update_timings(const GPUTimestamp* timestamps,
+                                u32 timestamp_count) {
+  for (u32 n = 0; n < nodes.size; ++n) {
+    FrameGraphNode* node = builder->access_node(nodes[n]);
+    if (node->active()) {
+      timings.add_cpu_sample(node->name, node->cpu_time_ms);
     }
   }
+  timings.add_gpu_samples(timestamps, timestamp_count);
 }
 
 void FrameGraph::on_resize(GpuDevice& gpu, u32 new_width, u32 new_height) {
   for (u32 n = 0; n < nodes.size; ++n) {
     FrameGraphNode* node = builder->access_node(nodes[n]);
-    if (!node->enabled) {
+    if (!node->active()) {
       continue;
     }
 
@@ -1119,4 +2861,370 @@ FrameGraphResource* FrameGraph::access_resource(
   return builder->access_resource(handle);
 }
 
+void FrameGraph::bind_buffer(cstring resource_name, BufferHandle handle) {
+  FrameGraphResource* resource = get_resource(resource_name);
+  if (resource == nullptr) {
+    return;
+  }
+
+  HASSERT_MSG(resource->type == FrameGraphResourceType_Buffer &&
+                  resource->resource_info.buffer.size == 0,
+              "Only buffers not created by the graph can be bound");
+  resource->resource_info.buffer.handle = handle;
+}
+
+bool frame_graph_transient_memory_report(cstring file_path,
+                                         StackAllocator* temp_allocator) {
+  const sizet marker = temp_allocator->get_marker();
+
+  FrameGraphBuilder builder;
+  builder.init(nullptr);
+
+  FrameGraph frame_graph;
+  frame_graph.init(&builder);
+  frame_graph.parse(file_path, temp_allocator);
+  // Logs the plan and asserts it is valid.
+  frame_graph.compile();
+
+  // Checked again to report it when assertions are disabled. Every block
+  // holds at least the memory alive during one node.
+  const TransientMemoryPlan& plan = frame_graph.transient_plan;
+  const bool valid =
+      transient_memory_plan_validate(frame_graph.transient_requirements.data,
+                                     frame_graph.transient_requirements.size,
+                                     plan) &&
+      plan.aliased_size >= plan.peak_live_size;
+  if (!valid) {
+    HERROR("Frame graph {} has an invalid transient memory plan", file_path);
+  }
+
+  frame_graph.shutdown();
+  builder.shutdown();
+
+  temp_allocator->free_marker(marker);
+  return valid;
+}
+
+bool frame_graph_transient_memory_self_test(cstring folder,
+                                            StackAllocator* temp_allocator) {
+  const sizet marker = temp_allocator->get_marker();
+
+  StringBuffer path_buffer;
+  path_buffer.init(1024, temp_allocator);
+  StringArray files;
+  files.init(1024, temp_allocator);
+  file_find_files_in_path(path_buffer.append_use_f("%s*.json", folder), files);
+
+  bool passed = files.get_string_count() > 0;
+  FlatHashMapIterator* it = files.begin_string_iteration();
+  while (files.has_next_string(it)) {
+    cstring file_path =
+        path_buffer.append_use_f("%s%s", folder, files.get_next_string(it));
+    passed &= frame_graph_transient_memory_report(file_path, temp_allocator);
+  }
+
+  HINFO("Frame graph transient memory self test {}",
+        passed ? "passed" : "failed");
+  temp_allocator->free_marker(marker);
+  return passed;
+}
+
+// Barrier plan self test ////////////////////////////////////////////////////
+
+static bool barrier_plan_expect(bool condition, cstring what) {
+  if (!condition) {
+    HERROR("Frame graph barrier plan self test: {}", what);
+  }
+  return condition;
+}
+
+static const ResourceState k_draw_read_states = (ResourceState)(
+    RESOURCE_STATE_INDIRECT_ARGUMENT | RESOURCE_STATE_SHADER_RESOURCE);
+
+struct ExpectedBarrier {
+  cstring node;
+  cstring resource;
+  ResourceState old_state;
+  ResourceState new_state;
+};
+
+// Plan of cull_graph.json compiled without a device: the late culling and
+// the depth pyramid run on the compute queue after the gbuffer pass. The
+// graph starts a frame in the states of the previous one ended with.
+static const ExpectedBarrier k_cull_graph_barriers[] = {
+    {"mesh_cull_early_pass", "mesh_indirect_draw_early_list",
+     k_draw_read_states, RESOURCE_STATE_UNORDERED_ACCESS},
+    {"mesh_cull_early_pass", "mesh_draw_counts", k_draw_read_states,
+     RESOURCE_STATE_UNORDERED_ACCESS},
+    {"directional_shadow_map_pass", "mesh_indirect_draw_early_list",
+     RESOURCE_STATE_UNORDERED_ACCESS, k_draw_read_states},
+    {"directional_shadow_map_pass", "mesh_draw_counts",
+     RESOURCE_STATE_UNORDERED_ACCESS, k_draw_read_states},
+    {"directional_shadow_map_pass", "directional_shadow_map",
+     RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_WRITE},
+    {"gbuffer_pass", "gbuffer_colour", RESOURCE_STATE_SHADER_RESOURCE,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"gbuffer_pass", "gbuffer_normals", RESOURCE_STATE_SHADER_RESOURCE,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"gbuffer_pass", "gbuffer_occlusion_roughness_metalness",
+     RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
+    {"gbuffer_pass", "depth", RESOURCE_STATE_DEPTH_WRITE,
+     RESOURCE_STATE_DEPTH_WRITE},
+    {"depth_pyramid_pass", "depth", RESOURCE_STATE_DEPTH_WRITE,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {"mesh_cull_late_pass", "mesh_indirect_draw_early_list",
+     k_draw_read_states, RESOURCE_STATE_UNORDERED_ACCESS},
+    {"mesh_cull_late_pass", "mesh_draw_counts", k_draw_read_states,
+     RESOURCE_STATE_UNORDERED_ACCESS},
+    {"mesh_cull_late_pass", "mesh_indirect_draw_late_list",
+     k_draw_read_states, RESOURCE_STATE_UNORDERED_ACCESS},
+    {"light_clustering_pass", "light_clusters", k_draw_read_states,
+     RESOURCE_STATE_UNORDERED_ACCESS},
+    {"gbuffer_late_pass", "mesh_indirect_draw_late_list",
+     RESOURCE_STATE_UNORDERED_ACCESS, k_draw_read_states},
+    {"gbuffer_late_pass", "mesh_draw_counts", RESOURCE_STATE_UNORDERED_ACCESS,
+     k_draw_read_states},
+    {"gbuffer_late_pass", "gbuffer_colour", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"gbuffer_late_pass", "gbuffer_normals", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"gbuffer_late_pass", "gbuffer_occlusion_roughness_metalness",
+     RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_RENDER_TARGET},
+    {"gbuffer_late_pass", "depth", RESOURCE_STATE_SHADER_RESOURCE,
+     RESOURCE_STATE_DEPTH_WRITE},
+    {"lighting_pass", "gbuffer_colour", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {"lighting_pass", "gbuffer_normals", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {"lighting_pass", "gbuffer_occlusion_roughness_metalness",
+     RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE},
+    {"lighting_pass", "depth", RESOURCE_STATE_DEPTH_WRITE,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {"lighting_pass", "directional_shadow_map", RESOURCE_STATE_DEPTH_WRITE,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {"lighting_pass", "light_clusters", RESOURCE_STATE_UNORDERED_ACCESS,
+     k_draw_read_states},
+    {"lighting_pass", "final", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"transparent_pass", "final", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"transparent_pass", "depth", RESOURCE_STATE_SHADER_RESOURCE,
+     RESOURCE_STATE_DEPTH_WRITE},
+    {"transparent_pass", "mesh_indirect_draw_early_list",
+     RESOURCE_STATE_UNORDERED_ACCESS, k_draw_read_states},
+    {"debug_pass", "final", RESOURCE_STATE_RENDER_TARGET,
+     RESOURCE_STATE_RENDER_TARGET},
+    {"debug_pass", "depth", RESOURCE_STATE_DEPTH_WRITE,
+     RESOURCE_STATE_DEPTH_WRITE},
+};
+
+// Reads after reads in the same state: the early draw list and counts by the
+// gbuffer pass, the shadow map, counts and light clusters by the transparent
+// pass.
+static const u32 k_cull_graph_redundant_barriers = 5;
+
+// States of the attachments at the start of a frame, the buffers are left in
+// theirs by the previous frame.
+static const ExpectedBarrier k_cull_graph_frame_start_states[] = {
+    {nullptr, "directional_shadow_map", RESOURCE_STATE_UNDEFINED,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {nullptr, "gbuffer_colour", RESOURCE_STATE_UNDEFINED,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {nullptr, "gbuffer_normals", RESOURCE_STATE_UNDEFINED,
+     RESOURCE_STATE_SHADER_RESOURCE},
+    {nullptr, "gbuffer_occlusion_roughness_metalness",
+     RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_SHADER_RESOURCE},
+    {nullptr, "depth", RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_DEPTH_WRITE},
+    {nullptr, "final", RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_RENDER_TARGET},
+};
+
+static bool barrier_matches(FrameGraph* frame_graph,
+                            const FrameGraphBarrier& barrier,
+                            const ExpectedBarrier& expected) {
+  return strcmp(frame_graph->access_resource(barrier.resource)->name,
+                expected.resource) == 0 &&
+         barrier.old_state == expected.old_state &&
+         barrier.new_state == expected.new_state;
+}
+
+static u32 node_submission(FrameGraph* frame_graph, u32 node_index) {
+  for (u32 s = 0; s < frame_graph->submissions.size; ++s) {
+    if (node_index < frame_graph->submissions[s].last_node) {
+      return s;
+    }
+  }
+  return frame_graph->submissions.size - 1;
+}
+
+// True when the nodes of submission later run after the ones of earlier: in
+// order on one queue, through the submissions waited for across queues.
+static bool submission_follows(FrameGraph* frame_graph, u32 earlier,
+                               u32 later) {
+  if (later < earlier) {
+    return false;
+  }
+
+  bool follows[k_max_frame_graph_submissions] = {};
+  follows[earlier] = true;
+  for (u32 s = earlier + 1; s <= later; ++s) {
+    const FrameGraphSubmission& submission = frame_graph->submissions[s];
+    const u32 wait = submission.wait_submission;
+    follows[s] = wait != u32_max && wait >= earlier && follows[wait];
+    for (u32 p = earlier; p < s && !follows[s]; ++p) {
+      follows[s] =
+          follows[p] && frame_graph->submissions[p].queue == submission.queue;
+    }
+  }
+  return follows[later];
+}
+
+// Checks the barriers of every node against the rules of the plan: reads
+// never wait for other reads, a write waits for every read since the
+// previous write, from a node that runs before it. Returns the number of
+// write after read barriers checked.
+static u32 check_barrier_rules(FrameGraph* frame_graph, Allocator* allocator,
+                               bool& passed) {
+  FrameGraphBuilder* builder = frame_graph->builder;
+  Array<FrameGraphBarrier> accesses;
+  accesses.init(allocator, 16);
+
+  u32 write_after_read_count = 0;
+  for (u32 i = 0; i < frame_graph->nodes.size; ++i) {
+    FrameGraphNode* node = builder->access_node(frame_graph->nodes[i]);
+    for (u32 b = 0; b < node->barrier_count; ++b) {
+      const FrameGraphBarrier& barrier =
+          frame_graph->barriers[node->first_barrier + b];
+      const bool buffer =
+          builder->access_resource(barrier.resource)->type ==
+          FrameGraphResourceType_Buffer;
+      const bool read = barrier.old_state != RESOURCE_STATE_UNDEFINED &&
+                        (barrier.old_state & k_write_resource_states) == 0;
+      const bool write = (barrier.new_state & k_write_resource_states) != 0;
+      passed &= barrier_plan_expect(
+          write || !read || (!buffer && barrier.old_state != barrier.new_state),
+          "read to read transition");
+      if (!write || !read) {
+        continue;
+      }
+
+      ++write_after_read_count;
+      for (i32 r = (i32)i - 1; r >= 0; --r) {
+        FrameGraphNode* reader = builder->access_node(frame_graph->nodes[r]);
+        if (!reader->active()) {
+          continue;
+        }
+
+        gather_node_accesses(frame_graph, reader, accesses);
+        u32 a = 0;
+        while (a < accesses.size &&
+               accesses[a].resource.index != barrier.resource.index) {
+          ++a;
+        }
+        if (a == accesses.size) {
+          continue;
+        }
+        if ((accesses[a].new_state & k_write_resource_states) != 0) {
+          break;
+        }
+
+        passed &= barrier_plan_expect(
+            (accesses[a].new_state & ~barrier.old_state) == 0,
+            "write does not wait for all the reads before it");
+        passed &= barrier_plan_expect(
+            submission_follows(frame_graph, node_submission(frame_graph, r),
+                               node_submission(frame_graph, i)),
+            "write is not ordered after a read");
+      }
+    }
+  }
+
+  accesses.shutdown();
+  return write_after_read_count;
+}
+
+bool frame_graph_barrier_plan_self_test(cstring folder,
+                                        StackAllocator* temp_allocator) {
+  const sizet marker = temp_allocator->get_marker();
+
+  StringBuffer path_buffer;
+  path_buffer.init(1024, temp_allocator);
+
+  FrameGraphBuilder builder;
+  builder.init(nullptr);
+
+  FrameGraph frame_graph;
+  frame_graph.init(&builder);
+  frame_graph.parse(path_buffer.append_use_f("%scull_graph.json", folder),
+                    temp_allocator);
+  frame_graph.compile();
+
+  bool passed = true;
+  const u32 expected_count = ArraySize(k_cull_graph_barriers);
+  passed &= barrier_plan_expect(frame_graph.barriers.size == expected_count,
+                                "barrier count");
+  passed &= barrier_plan_expect(frame_graph.redundant_barrier_count ==
+                                    k_cull_graph_redundant_barriers,
+                                "redundant barrier count");
+
+  // Each node records the barriers expected for it, in any order.
+  u32 node_count = 0;
+  for (u32 i = 0; i < frame_graph.nodes.size; ++i) {
+    FrameGraphNode* node = frame_graph.access_node(frame_graph.nodes[i]);
+    node_count += node->active() ? 1 : 0;
+
+    u32 expected_node_count = 0;
+    for (u32 e = 0; e < expected_count; ++e) {
+      const ExpectedBarrier& expected = k_cull_graph_barriers[e];
+      if (strcmp(expected.node, node->name) != 0) {
+        continue;
+      }
+
+      ++expected_node_count;
+      bool found = false;
+      for (u32 b = 0; b < node->barrier_count && !found; ++b) {
+        found = barrier_matches(
+            &frame_graph, frame_graph.barriers[node->first_barrier + b],
+            expected);
+      }
+      if (!found) {
+        HERROR("Frame graph barrier plan self test: {} misses {} {} to {}",
+               node->name, expected.resource, (u32)expected.old_state,
+               (u32)expected.new_state);
+        passed = false;
+      }
+    }
+    passed &= barrier_plan_expect(node->barrier_count == expected_node_count,
+                                  "node barrier count");
+  }
+  passed &= barrier_plan_expect(node_count == 10, "active node count");
+
+  const u32 start_count = ArraySize(k_cull_graph_frame_start_states);
+  passed &= barrier_plan_expect(
+      frame_graph.frame_start_states.size == start_count,
+      "frame start state count");
+  for (u32 e = 0; e < start_count; ++e) {
+    bool found = false;
+    for (u32 s = 0; s < frame_graph.frame_start_states.size && !found; ++s) {
+      found = barrier_matches(&frame_graph, frame_graph.frame_start_states[s],
+                              k_cull_graph_frame_start_states[e]);
+    }
+    passed &= barrier_plan_expect(found, "frame start state");
+  }
+
+  // The late culling writes the draw list and counts the shadow map and
+  // gbuffer passes read, the late gbuffer and transparent passes write the
+  // depth the depth pyramid and lighting passes read.
+  const u32 write_after_read_count =
+      check_barrier_rules(&frame_graph, temp_allocator, passed);
+  passed &= barrier_plan_expect(write_after_read_count > 0,
+                                "no write after read checked");
+
+  frame_graph.shutdown();
+  builder.shutdown();
+
+  HINFO("Frame graph barrier plan self test {}", passed ? "passed" : "failed");
+  temp_allocator->free_marker(marker);
+  return passed;
+}
+
 }  // namespace Helix
@@ -7,6 +7,8 @@
 #include "Core/HashMap.hpp"
 #include "Core/Service.hpp"
 #include "Renderer/GPUResources.hpp"
+#include "Renderer/PassTimings.hpp"
+#include "Renderer/TransientMemory.hpp"
 
 namespace Helix {
 
@@ -15,6 +17,7 @@ struct CommandBuffer;
 struct FrameGraph;
 struct GpuDevice;
 struct Scene;
+struct StackAllocator;
 
 typedef u32 FrameGraphHandle;
 
@@ -82,11 +85,54 @@ struct FrameGraphResource {
 
   FrameGraphResourceHandle output_handle;
 
-  i32 ref_count = 0;
+  // Execution order indices of the node writing the resource and of its last
+  // reader, set by compile.
+  u32 first_node = 0;
+  u32 last_node = 0;
+  // Shares memory with other transient resources.
+  bool aliased = false;
 
   cstring name = nullptr;
 };
 
+// Transition of a resource planned by compile, recorded before a node.
+struct FrameGraphBarrier {
+  // Output handle of the resource.
+  FrameGraphResourceHandle resource;
+  ResourceState old_state;
+  ResourceState new_state;
+  // Queue the resource was used on before and queue of the node. When they
+  // differ and FrameGraph::queue_ownership_transfers is set, the barrier
+  // acquires the resource released by the other queue.
+  QueueType::Enum source_queue = QueueType::Graphics;
+  QueueType::Enum destination_queue = QueueType::Graphics;
+};
+
+// Nodes [first_node, last_node) recorded in a row for one queue, in the
+// command buffers of one GpuDevice batch. A submission waits for the one of
+// the other queue its nodes depend on, compile makes sure it comes before.
+struct FrameGraphSubmission {
+  QueueType::Enum queue;
+  u32 first_node;
+  u32 last_node;
+  // Submission of the other queue waited for, u32_max for none.
+  u32 wait_submission = u32_max;
+  // A submission of the other queue waits for this one.
+  bool signal = false;
+  // Ownership releases recorded after the nodes, in
+  // FrameGraph::queue_releases.
+  u32 first_release = 0;
+  u32 release_count = 0;
+  // Value returned by GpuDevice::queue_sync_point when the submission is
+  // queued.
+  u64 signal_value = 0;
+};
+
+static const u32 k_max_frame_graph_submissions = 8;
+
+// NOTE: passes must not change the state of graph resources, the barriers of
+// the graph are planned once in compile. Nodes can be recorded on any task
+// thread, in parallel with the other nodes.
 struct FrameGraphRenderPass {
   virtual void add_ui() {}
   virtual void pre_render(CommandBuffer* gpu_commands, Scene* scene) {}
@@ -95,6 +141,10 @@ struct FrameGraphRenderPass {
                            FrameGraph* frame_graph) {}
   virtual void on_resize(GpuDevice& gpu, FrameGraph* frame_graph, u32 new_width,
                          u32 new_height) {}
+  // Called for the active nodes by compile. Transient resources of a graph
+  // compiled again keep their handles but not their images and buffers, the
+  // descriptor sets referencing them must be updated.
+  virtual void on_compile(GpuDevice& gpu, FrameGraph* frame_graph) {}
 
   bool enabled = false;
 };
@@ -107,6 +157,7 @@ struct FrameGraphNodeCreation {
 
   cstring name;
   bool compute;
+  bool async_compute;
 };
 
 struct FrameGraphNode {
@@ -122,9 +173,31 @@ struct FrameGraphNode {
   Array<FrameGraphNodeHandle> edges;
 
   bool compute = false;
+  // The compute node can run on the compute queue, it does when compile finds
+  // graphics work independent of it.
+  bool async_compute = false;
+  // Queue the node is recorded for, set by compile.
+  QueueType::Enum queue = QueueType::Graphics;
+  // Waits for the previous users of the memory of aliased outputs.
+  bool aliasing_barrier = false;
+
+  // Range of FrameGraph::barriers recorded with one pipeline barrier before
+  // the node.
+  u32 first_barrier = 0;
+  u32 barrier_count = 0;
+
+  // Timestamp queries reserved by FrameGraph::render_begin.
+  u32 start_query = u32_max;
+  u32 end_query = u32_max;
+  // Time spent recording the node this frame.
+  f32 cpu_time_ms = 0.f;
 
   bool enabled = true;
+  // None of the sinks of the graph depends on the node, set by compile.
+  bool culled = false;
   cstring name = nullptr;
+
+  bool active() const { return enabled && !culled; }
 };
 ////////////////////////////////////////
 // Caches
@@ -197,18 +270,47 @@ struct FrameGraph {
   void shutdown();
 
   void parse(cstring file_path, StackAllocator* temp_allocator);
+  // Compiled graph cache: the nodes and resources in execution order with the
+  // results of compile. load_cache replaces parse and compile on an empty
+  // graph, it fails when the file is missing, corrupted or was written for
+  // another key, see frame_graph_cache_key.
+  bool load_cache(cstring file_path, u64 key, StackAllocator* temp_allocator);
+  void write_cache(cstring file_path, u64 key, StackAllocator* temp_allocator);
 
   // NOTE(marco): each frame we rebuild the graph so that we can enable only
   // the nodes we are interested in
   void reset();
+  // These mark the graph dirty, it must be compiled again before the next
+  // render_begin.
   void enable_render_pass(cstring render_pass_name);
   void disable_render_pass(cstring render_pass_name);
+  // Toggles async_compute of a node, used by the next compile.
+  void set_async_compute(cstring render_pass_name, bool async_compute);
+  // Can run again on a compiled graph: the node passes and transient memory
+  // of the previous compile are destroyed through the deferred deletion of
+  // the device. Transient resources planned again are recreated in place,
+  // the others are destroyed.
   void compile();
   void add_ui();
-  void render(u32 current_frame_index, CommandBuffer* gpu_commands,
-              Scene* scene);
+  // A frame can be recorded in several command buffers submitted in order:
+  // render_begin records the start of the frame, render_nodes the nodes
+  // [first_node, last_node) and render_end the end of the frame once every
+  // node is recorded. Disjoint node ranges can be recorded by render_nodes
+  // on different threads. The ranges must not cross submissions, the one
+  // ending a submission also records its ownership releases.
+  void render_begin(CommandBuffer* gpu_commands);
+  void render_nodes(u32 current_frame_index, CommandBuffer* gpu_commands,
+                    Scene* scene, u32 first_node, u32 last_node);
+  void render_end(CommandBuffer* gpu_commands);
+  // Samples the recording times of the active nodes of this frame and the
+  // node timestamps of a resolved frame in timings.
+  void update_timings(const GPUTimestamp* timestamps, u32 timestamp_count);
   void on_resize(GpuDevice& gpu, u32 new_width, u32 new_height);
 
+  // Buffer output the graph doesn't create, used by the barriers of the
+  // resource until the next bind.
+  void bind_buffer(cstring resource_name, BufferHandle handle);
+
   FrameGraphNode* get_node(cstring name);
   FrameGraphNode* access_node(FrameGraphNodeHandle handle);
 
@@ -221,6 +323,53 @@ struct FrameGraph {
   // NOTE(marco): nodes sorted in topological order
   Array<FrameGraphNodeHandle> nodes;
 
+  // Attachments and sized buffers created by compile, placed in
+  // transient_blocks as planned by transient_plan.
+  Array<FrameGraphResourceHandle> transient_resources;
+  // Memory needs and lifetimes of transient_resources.
+  Array<TransientResource> transient_requirements;
+  TransientMemoryPlan transient_plan;
+  Array<VmaAllocation> transient_blocks;
+  // Resources whose lifetimes don't overlap share memory.
+  bool alias_transient_memory = true;
+  sizet transient_block_size = hmega(256);
+  // Part of the attachments sized by the swapchain rendered this frame, see
+  // DynamicResolution.
+  f32 resolution_scale = 1.0f;
+
+  // CPU and GPU times of the nodes over the last frames.
+  PassTimings timings;
+
+  // Transitions of every node, planned by compile in execution order.
+  Array<FrameGraphBarrier> barriers;
+  // States the resources are in when a frame starts, the ones of their last
+  // access. old_state is unused.
+  Array<FrameGraphBarrier> frame_start_states;
+  u32 redundant_barrier_count = 0;
+
+  // Resources used outside of the graph, the "sinks" of its file. Enabled
+  // nodes none of them depends on are culled by compile, nothing is culled
+  // without sinks.
+  Array<cstring> sinks;
+  u32 culled_node_count = 0;
+
+  // Enabled by init when the device has an async compute queue, compile then
+  // moves the async_compute nodes with independent graphics work to the
+  // compute queue and orders the nodes so that they overlap.
+  bool use_async_compute = false;
+  // The compute queue is in another family: resources used by both queues
+  // are released and acquired, async nodes can't use the resources the graph
+  // doesn't track the states of.
+  bool queue_ownership_transfers = false;
+  u32 async_node_count = 0;
+  // The nodes split in queue submissions, a single graphics one without
+  // async nodes.
+  Array<FrameGraphSubmission> submissions;
+  Array<FrameGraphBarrier> queue_releases;
+
+  // Nodes were enabled, disabled or moved between queues since compile.
+  bool dirty = false;
+
   FrameGraphBuilder* builder;
   Allocator* allocator;
 
@@ -229,4 +378,24 @@ struct FrameGraph {
   cstring name = nullptr;
 };
 
+// Hash of the graph file and of what its compiled plan depends on: device,
+// features, queue families and swapchain size.
+u64 frame_graph_cache_key(cstring file_path, GpuDevice* gpu,
+                          Allocator* allocator);
+
+// Parses and compiles a graph without a device, then logs and validates the
+// placement of its transient resources and logs its barrier plan. Returns
+// false when the placement is invalid.
+bool frame_graph_transient_memory_report(cstring file_path,
+                                         StackAllocator* temp_allocator);
+// Runs the report on every graph file of the folder, false if any fails.
+bool frame_graph_transient_memory_self_test(cstring folder,
+                                            StackAllocator* temp_allocator);
+// Compiles cull_graph.json of the folder without a device and checks its
+// barrier plan: the transitions of every node, the states a frame starts
+// in, no read to read transitions and writes ordered after the reads before
+// them. Logs the mismatches, returns false if there are any.
+bool frame_graph_barrier_plan_self_test(cstring folder,
+                                        StackAllocator* temp_allocator);
+
 }  // namespace Helix
@@ -157,6 +157,12 @@ namespace Helix {
 
     static Helix::FlatHashMap<u64, VkRenderPass> render_pass_cache;
     static CommandBufferManager command_buffer_ring;
+    // Pools of the compute queue when it is in another family.
+    static CommandBufferManager compute_command_buffer_ring;
+
+    static bool has_compute_command_pools(const GpuDevice* gpu) {
+        return (gpu->gpu_device_features & GpuDeviceFeature_ASYNC_COMPUTE) && gpu->vulkan_compute_queue_family != gpu->vulkan_main_queue_family;
+    }
 
     static sizet            s_ubo_alignment = 256;
     static sizet            s_ssbo_alignemnt = 256;
@@ -381,6 +387,9 @@ namespace Helix {
             gpu_device_features |= GpuDeviceFeature_BINDLESS;
         //bindless_supported = indexing_features.descriptorBindingPartiallyBound && indexing_features.runtimeDescriptorArray;
 
+        if (device_features.features.textureCompressionBC)
+            gpu_device_features |= GpuDeviceFeature_TEXTURE_COMPRESSION_BC;
+
         //////// Create logical device
         u32 queue_family_count = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(vulkan_physical_device, &queue_family_count, nullptr);
@@ -423,6 +432,16 @@ namespace Helix {
             }
         }
 
+        // Without a second compute queue the main one is used, async compute needs the timeline semaphores and
+        // synchronization2 to order the two queues.
+        if (compute_queue_index == u32_max) {
+            compute_queue_family_index = main_queue_family_index;
+            compute_queue_index = 0;
+        }
+        else if ((gpu_device_features & GpuDeviceFeature_TIMELINE_SEMAPHORE) && (gpu_device_features & GpuDeviceFeature_SYNCHRONIZATION2)) {
+            gpu_device_features |= GpuDeviceFeature_ASYNC_COMPUTE;
+        }
+
         // Cache family indices
         vulkan_main_queue_family = main_queue_family_index;
         vulkan_compute_queue_family = compute_queue_family_index;
@@ -450,7 +469,7 @@ namespace Helix {
         VkDeviceQueueCreateInfo& main_queue = queue_info[queue_count++];
         main_queue.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         main_queue.queueFamilyIndex = main_queue_family_index;
-        main_queue.queueCount = compute_queue_family_index == main_queue_family_index ? 2 : 1;
+        main_queue.queueCount = compute_queue_family_index == main_queue_family_index ? compute_queue_index + 1 : 1;
         main_queue.pQueuePriorities = queue_priority;
 
         if (compute_queue_family_index != main_queue_family_index) {
@@ -475,6 +494,7 @@ namespace Helix {
         physical_features2.features.pipelineStatisticsQuery = VK_TRUE;
         physical_features2.features.shaderInt16 = VK_TRUE;
         physical_features2.features.shaderInt64 = VK_TRUE;
+        physical_features2.features.textureCompressionBC = (gpu_device_features & GpuDeviceFeature_TEXTURE_COMPRESSION_BC) ? VK_TRUE : VK_FALSE;
 
         VkPhysicalDeviceVulkan11Features vulkan_11_features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
         vulkan_11_features.storageBuffer16BitAccess = VK_TRUE;
@@ -561,7 +581,6 @@ namespace Helix {
         // Get main queue
         vkGetDeviceQueue(vulkan_device, main_queue_family_index, 0, &vulkan_main_queue);
 
-        // TODO(marco): handle case where we can't create a separate compute queue
         vkGetDeviceQueue(vulkan_device, compute_queue_family_index, compute_queue_index, &vulkan_compute_queue);
 
         // Get transfer queue if present
@@ -744,7 +763,7 @@ namespace Helix {
 
         // Init render frame informations. This includes fences, semaphores, command buffers, ...
         // TODO: memory - allocate memory of all Device render frame stuff
-        u8* memory = hallocam(sizeof(GPUTimestampManager) + sizeof(CommandBuffer*) * 128, allocator);
+        u8* memory = hallocam(sizeof(GPUTimestampManager) + sizeof(CommandBuffer*) * k_max_queued_command_buffers, allocator);
 
         VkSemaphoreCreateInfo semaphore_info{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 
@@ -772,6 +791,7 @@ namespace Helix {
 
             vkCreateSemaphore(vulkan_device, &semaphore_info, vulkan_allocation_callbacks, &vulkan_timeline_graphics_semaphore);
             vkCreateSemaphore(vulkan_device, &semaphore_info, vulkan_allocation_callbacks, &vulkan_compute_semaphore);
+            vkCreateSemaphore(vulkan_device, &semaphore_info, vulkan_allocation_callbacks, &vulkan_graphics_sync_semaphore);
         }
         else {
             vkCreateSemaphore(vulkan_device, &semaphore_info, vulkan_allocation_callbacks, &vulkan_compute_semaphore);
@@ -786,6 +806,11 @@ namespace Helix {
         gpu_timestamp_manager->init(allocator, creation.gpu_time_queries_per_frame, k_max_frames);
 
         command_buffer_ring.init(this, creation.num_threads );
+        if (has_compute_command_pools(this)) {
+            compute_command_buffer_ring.init(this, creation.num_threads, QueueType::Compute);
+        }
+        queue_batches[QueueType::Graphics][0] = {};
+        queue_batches[QueueType::Compute][0] = {};
 
         // Allocate queued command buffers array
         queued_command_buffers = (CommandBuffer**)(gpu_timestamp_manager + 1);
@@ -799,7 +824,10 @@ namespace Helix {
         timestamps_enabled = false;
 
         resource_deletion_queue.init(allocator, 16);
+        memory_deletion_queue.init(allocator, 4);
         descriptor_set_updates.init(allocator, 16);
+        descriptor_set_cache.init(allocator, 64);
+        descriptor_set_cache.set_default_value(k_invalid_index);
         texture_to_update_bindless.init(allocator, 16);
 
         // Init render pass cache
@@ -892,6 +920,9 @@ namespace Helix {
         vkDeviceWaitIdle(vulkan_device);
 
         command_buffer_ring.shutdown();
+        if (has_compute_command_pools(this)) {
+            compute_command_buffer_ring.shutdown();
+        }
 
         for (size_t i = 0; i < k_max_swapchain_images; i++) {
             vkDestroySemaphore(vulkan_device, vulkan_image_acquired_semaphore[i], vulkan_allocation_callbacks);
@@ -904,6 +935,7 @@ namespace Helix {
 
         if (gpu_device_features & GpuDeviceFeature_TIMELINE_SEMAPHORE) {
             vkDestroySemaphore(vulkan_device, vulkan_timeline_graphics_semaphore, vulkan_allocation_callbacks);
+            vkDestroySemaphore(vulkan_device, vulkan_graphics_sync_semaphore, vulkan_allocation_callbacks);
         }
 
         gpu_timestamp_manager->shutdown();
@@ -923,72 +955,13 @@ namespace Helix {
         destroy_buffer(default_constant_buffer);
         destroy_sampler(default_sampler);
 
-        // Destroy all pending resources.
-        for (u32 i = 0; i < resource_deletion_queue.size; i++) {
-            ResourceUpdate& resource_deletion = resource_deletion_queue[i];
-
-            // Skip just freed resources.
-            if (resource_deletion.current_frame == -1)
-                continue;
-
-            switch (resource_deletion.type) {
-
-            case ResourceDeletionType::Buffer:
-            {
-                destroy_buffer_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::Pipeline:
-            {
-                destroy_pipeline_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::RenderPass:
-            {
-                destroy_render_pass_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::Framebuffer:
-            {
-                destroy_framebuffer_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::DescriptorSet:
-            {
-                destroy_descriptor_set_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::DescriptorSetLayout:
-            {
-                destroy_descriptor_set_layout_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::Sampler:
-            {
-                destroy_sampler_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::ShaderState:
-            {
-                destroy_shader_state_instant(resource_deletion.handle);
-                break;
-            }
-
-            case ResourceDeletionType::Texture:
-            {
-                destroy_texture_instant(resource_deletion.handle);
-                break;
-            }
-            }
-        }
+        // Swapchain depth and framebuffers are queued for deletion too.
+        destroy_swapchain();
+        vkDestroySurfaceKHR(vulkan_instance, vulkan_window_surface, vulkan_allocation_callbacks);
 
+        // Destroy all pending resources.
+        mark_pending_deletions_submitted();
+        destroy_pending_resources(u64_max, u64_max);
 
         // Destroy render passes from the cache.
         FlatHashMapIterator it = render_pass_cache.iterator_begin();
@@ -1002,14 +975,11 @@ namespace Helix {
         }
         render_pass_cache.shutdown();
 
-        // Destroy swapchain
-        destroy_swapchain();
-        vkDestroySurfaceKHR(vulkan_instance, vulkan_window_surface, vulkan_allocation_callbacks);
-
-
         texture_to_update_bindless.shutdown();
         resource_deletion_queue.shutdown();
+        memory_deletion_queue.shutdown();
         descriptor_set_updates.shutdown();
+        descriptor_set_cache.shutdown();
 
         pipelines.shutdown();
         buffers.shutdown();
@@ -1120,27 +1090,10 @@ namespace Helix {
         gpu.set_resource_name(VK_OBJECT_TYPE_IMAGE_VIEW, (u64)texture->vk_image_view, creation.name);
     }
 
-    static void vulkan_create_texture(GpuDevice& gpu, const TextureCreation& creation, TextureHandle handle, Texture* texture) {
+    static void vulkan_fill_image_info(const TextureCreation& creation, VkImageCreateInfo& image_info) {
 
-        texture->width = creation.width;
-        texture->height = creation.height;
-        texture->depth = creation.depth;
-        // TODO:
-        texture->mip_base_level = 0;        // For new textures, we have a view that is for all mips and layers.
-        texture->array_base_layer = 0;      // For new textures, we have a view that is for all mips and layers.
-        texture->array_layer_count = creation.array_layer_count;
-        texture->mip_level_count = creation.mip_level_count;
-        texture->type = creation.type;
-        texture->name = creation.name;
-        texture->vk_format = creation.format;
-        texture->sampler = nullptr;
-        texture->flags = creation.flags;
-        texture->parent_texture = k_invalid_texture; // Only used for texture views
-        texture->handle = handle;
-
-        //// Create the image
-        VkImageCreateInfo image_info = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-        image_info.format = texture->vk_format;
+        image_info = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+        image_info.format = creation.format;
         image_info.flags = (creation.type & TextureType::Texture_Cube_Array) == TextureType::Texture_Cube_Array ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
         image_info.imageType = to_vk_image_type(creation.type);
         image_info.extent.width = creation.width;
@@ -1172,11 +1125,39 @@ namespace Helix {
 
         image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    static void vulkan_create_texture(GpuDevice& gpu, const TextureCreation& creation, TextureHandle handle, Texture* texture) {
+
+        texture->width = creation.width;
+        texture->height = creation.height;
+        texture->depth = creation.depth;
+        // TODO:
+        texture->mip_base_level = 0;        // For new textures, we have a view that is for all mips and layers.
+        texture->array_base_layer = 0;      // For new textures, we have a view that is for all mips and layers.
+        texture->array_layer_count = creation.array_layer_count;
+        texture->mip_level_count = creation.mip_level_count;
+        texture->type = creation.type;
+        texture->name = creation.name;
+        texture->vk_format = creation.format;
+        texture->sampler = nullptr;
+        texture->flags = creation.flags;
+        texture->parent_texture = k_invalid_texture; // Only used for texture views
+        texture->handle = handle;
+
+        //// Create the image
+        VkImageCreateInfo image_info;
+        vulkan_fill_image_info(creation, image_info);
 
         VmaAllocationCreateInfo memory_info{};
         memory_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-        if (creation.alias.index == k_invalid_texture.index) {
+        if (creation.alias_memory != VK_NULL_HANDLE) {
+            // Placed in transient memory owned by the caller.
+            texture->vma_allocation = 0;
+            check(vmaCreateAliasingImage2(gpu.vma_allocator, creation.alias_memory, creation.alias_offset, &image_info, &texture->vk_image));
+        }
+        else if (creation.alias.index == k_invalid_texture.index) {
             check(vmaCreateImage(gpu.vma_allocator, &image_info, &memory_info,
                 &texture->vk_image, &texture->vma_allocation, nullptr));
 
@@ -1995,6 +1976,19 @@ namespace Helix {
             memory_info.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
         }
 
+        if (creation.alias_memory != VK_NULL_HANDLE) {
+            // Placed in transient memory owned by the caller.
+            buffer->vma_allocation = 0;
+            check(vmaCreateAliasingBuffer2(vma_allocator, creation.alias_memory, creation.alias_offset, &buffer_info, &buffer->vk_handle));
+
+            set_resource_name(VK_OBJECT_TYPE_BUFFER, (u64)buffer->vk_handle, creation.name);
+
+            VmaAllocationInfo alias_info{};
+            vmaGetAllocationInfo(vma_allocator, creation.alias_memory, &alias_info);
+            buffer->vk_device_memory = alias_info.deviceMemory;
+            return handle;
+        }
+
         VmaAllocationInfo allocation_info{};
         check(vmaCreateBuffer(vma_allocator, &buffer_info, &memory_info,
             &buffer->vk_handle, &buffer->vma_allocation, &allocation_info));
@@ -2125,6 +2119,29 @@ namespace Helix {
 
         vkCreateDescriptorSetLayout(vulkan_device, &layout_info, vulkan_allocation_callbacks, &descriptor_set_layout->vk_handle);
 
+        // One template entry per binding, reading consecutive DescriptorUpdateData.
+        descriptor_set_layout->vk_update_template = VK_NULL_HANDLE;
+        descriptor_set_layout->num_update_entries = (u16)used_bindings;
+        if (used_bindings > 0) {
+            VkDescriptorUpdateTemplateEntry entries[k_max_descriptors_per_set];
+            for (u32 e = 0; e < used_bindings; ++e) {
+                const VkDescriptorSetLayoutBinding& vk_binding = descriptor_set_layout->vk_binding[e];
+                entries[e].dstBinding = vk_binding.binding;
+                entries[e].dstArrayElement = 0;
+                entries[e].descriptorCount = 1;
+                entries[e].descriptorType = vk_binding.descriptorType;
+                entries[e].offset = sizeof(DescriptorUpdateData) * e;
+                entries[e].stride = sizeof(DescriptorUpdateData);
+            }
+
+            VkDescriptorUpdateTemplateCreateInfo template_info{ VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+            template_info.descriptorUpdateEntryCount = used_bindings;
+            template_info.pDescriptorUpdateEntries = entries;
+            template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+            template_info.descriptorSetLayout = descriptor_set_layout->vk_handle;
+            check(vkCreateDescriptorUpdateTemplate(vulkan_device, &template_info, vulkan_allocation_callbacks, &descriptor_set_layout->vk_update_template));
+        }
+
         return handle;
     }
 
@@ -2271,14 +2288,76 @@ namespace Helix {
         num_resources = used_resources;
     }
 
+    void GpuDevice::fill_descriptor_set_writes(const DesciptorSetLayout* descriptor_set_layout, u32 num_resources, const ResourceHandle* resources,
+        const SamplerHandle* samplers, const u16* bindings, DescriptorSetWrites& out_writes) {
+
+        Sampler* vk_default_sampler = access_sampler(default_sampler);
+
+        out_writes.count = num_resources;
+        fill_write_descriptor_sets(*this, descriptor_set_layout, VK_NULL_HANDLE, out_writes.writes, out_writes.buffer_info, out_writes.image_info,
+            vk_default_sampler->vk_handle, out_writes.count, resources, samplers, bindings);
+
+        // Fields are hashed one by one, the padding of the image infos is not initialized.
+        u64 hash = hash_calculate(descriptor_set_layout->vk_handle);
+        for (u32 i = 0; i < out_writes.count; ++i) {
+            if (out_writes.writes[i].pImageInfo) {
+                const VkDescriptorImageInfo& image_info = out_writes.image_info[i];
+                out_writes.data[i].image = image_info;
+
+                hash = hash_calculate(image_info.sampler, hash);
+                hash = hash_calculate(image_info.imageView, hash);
+                hash = hash_calculate((u32)image_info.imageLayout, hash);
+            }
+            else {
+                const VkDescriptorBufferInfo& buffer_info = out_writes.buffer_info[i];
+                out_writes.data[i].buffer = buffer_info;
+
+                hash = hash_calculate(buffer_info.buffer, hash);
+                hash = hash_calculate(buffer_info.offset, hash);
+                hash = hash_calculate(buffer_info.range, hash);
+            }
+        }
+
+        // Dynamic uniform buffers share their parent buffer, the handles tell them apart.
+        hash = hash_bytes((void*)resources, sizeof(ResourceHandle) * num_resources, hash);
+        hash = hash_bytes((void*)bindings, sizeof(u16) * num_resources, hash);
+        out_writes.hash = hash;
+    }
+
+    void GpuDevice::write_descriptor_set(const DesciptorSetLayout* descriptor_set_layout, VkDescriptorSet vk_descriptor_set, DescriptorSetWrites& writes) {
+        if (descriptor_set_layout->vk_update_template != VK_NULL_HANDLE && writes.count == descriptor_set_layout->num_update_entries) {
+            vkUpdateDescriptorSetWithTemplate(vulkan_device, vk_descriptor_set, descriptor_set_layout->vk_update_template, writes.data);
+            return;
+        }
+
+        for (u32 i = 0; i < writes.count; ++i) {
+            writes.writes[i].dstSet = vk_descriptor_set;
+        }
+        vkUpdateDescriptorSets(vulkan_device, writes.count, writes.writes, 0, nullptr);
+    }
+
     DescriptorSetHandle GpuDevice::create_descriptor_set(const DescriptorSetCreation& creation) {
+        const DesciptorSetLayout* descriptor_set_layout = access_descriptor_set_layout(creation.layout);
+
+        DescriptorSetWrites writes;
+        fill_descriptor_set_writes(descriptor_set_layout, creation.num_resources, creation.resources, creation.samplers, creation.bindings, writes);
+
+        // Sets with the same content are shared, as the per frame sets of passes reading the same resources.
+        const u32 cached_index = descriptor_set_cache.get(writes.hash);
+        if (cached_index != k_invalid_index) {
+            DescriptorSet* cached_descriptor_set = access_descriptor_set({ cached_index });
+            HASSERT(cached_descriptor_set->layout == descriptor_set_layout);
+
+            ++cached_descriptor_set->ref_count;
+            return { cached_index };
+        }
+
         DescriptorSetHandle handle = { descriptor_sets.obtain_resource() };
         if (handle.index == k_invalid_index) {
             return handle;
         }
 
         DescriptorSet* descriptor_set = access_descriptor_set(handle);
-        const DesciptorSetLayout* descriptor_set_layout = access_descriptor_set_layout(creation.layout);
 
         // Allocate descriptor set
         VkDescriptorSetAllocateInfo alloc_info{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
@@ -2294,17 +2373,8 @@ namespace Helix {
         descriptor_set->bindings = (u16*)(memory + (sizeof(ResourceHandle) + sizeof(SamplerHandle)) * creation.num_resources);
         descriptor_set->num_resources = creation.num_resources;
         descriptor_set->layout = descriptor_set_layout;
-
-        // Update descriptor set
-        VkWriteDescriptorSet descriptor_write[16];
-        VkDescriptorBufferInfo buffer_info[16];
-        VkDescriptorImageInfo image_info[16];
-
-        Sampler* vk_default_sampler = access_sampler(default_sampler);
-
-        u32 num_resources = creation.num_resources;
-        fill_write_descriptor_sets(*this, descriptor_set_layout, descriptor_set->vk_descriptor_set, descriptor_write, buffer_info, image_info, vk_default_sampler->vk_handle,
-            num_resources, creation.resources, creation.samplers, creation.bindings);
+        descriptor_set->hash = writes.hash;
+        descriptor_set->ref_count = 1;
 
         // Cache resources
         for (u32 r = 0; r < creation.num_resources; r++) {
@@ -2313,7 +2383,8 @@ namespace Helix {
             descriptor_set->bindings[r] = creation.bindings[r];
         }
 
-        vkUpdateDescriptorSets(vulkan_device, num_resources, descriptor_write, 0, nullptr);
+        write_descriptor_set(descriptor_set_layout, descriptor_set->vk_descriptor_set, writes);
+        descriptor_set_cache.insert(writes.hash, handle.index);
 
         return handle;
     }
@@ -2613,6 +2684,17 @@ namespace Helix {
 
     void GpuDevice::destroy_descriptor_set(DescriptorSetHandle descriptor_set) {
         if (descriptor_set.index < descriptor_sets.pool_size) {
+            DescriptorSet* v_descriptor_set = access_descriptor_set(descriptor_set);
+            if (v_descriptor_set->ref_count > 1) {
+                --v_descriptor_set->ref_count;
+                return;
+            }
+            v_descriptor_set->ref_count = 0;
+            // No more shared, it can be in use until it is deleted.
+            if (descriptor_set_cache.get(v_descriptor_set->hash) == descriptor_set.index) {
+                descriptor_set_cache.remove(v_descriptor_set->hash);
+            }
+
             resource_deletion_queue.push({ ResourceDeletionType::DescriptorSet, descriptor_set.index, current_frame });
         }
         else {
@@ -2709,6 +2791,9 @@ namespace Helix {
 
         if (v_descriptor_set_layout) {
             vkDestroyDescriptorSetLayout(vulkan_device, v_descriptor_set_layout->vk_handle, vulkan_allocation_callbacks);
+            if (v_descriptor_set_layout->vk_update_template != VK_NULL_HANDLE) {
+                vkDestroyDescriptorUpdateTemplate(vulkan_device, v_descriptor_set_layout->vk_update_template, vulkan_allocation_callbacks);
+            }
 
             // This contains also vk_binding allocation.
             hfree(v_descriptor_set_layout->bindings, allocator);
@@ -2722,8 +2807,8 @@ namespace Helix {
         if (v_descriptor_set) {
             // Contains the allocation for all the resources, binding and samplers arrays.
             hfree(v_descriptor_set->resources, allocator);
-            // This is freed with the DescriptorSet pool.
-            //vkFreeDescriptorSets
+            // Back to the pool, sets destroyed on resize and reload would exhaust it.
+            vkFreeDescriptorSets(vulkan_device, vulkan_descriptor_pool, 1, &v_descriptor_set->vk_descriptor_set);
         }
         descriptor_sets.release_resource(descriptor_set);
     }
@@ -2960,15 +3045,15 @@ namespace Helix {
                 textures.release_resource(vk_framebuffer->color_attachments[a].index);
             }
 
+            // Swapchain images are owned by the swapchain, only the depth texture and
+            // the framebuffer go through the deferred deletion.
+            vk_framebuffer->num_color_attachments = 0;
             if (vk_framebuffer->depth_stencil_attachment.index != k_invalid_index) {
-                destroy_texture_instant(vk_framebuffer->depth_stencil_attachment.index);
-            }
-
-            if (!(gpu_device_features & GpuDeviceFeature_DYNAMIC_RENDERING)) {
-                vkDestroyFramebuffer(vulkan_device, vk_framebuffer->vk_handle, vulkan_allocation_callbacks);
+                destroy_texture(vk_framebuffer->depth_stencil_attachment);
+                vk_framebuffer->depth_stencil_attachment.index = k_invalid_index;
             }
 
-            framebuffers.release_resource(vulkan_swapchain_framebuffers[iv].index);
+            destroy_framebuffer(vulkan_swapchain_framebuffers[iv]);
         }
 
         vkDestroySwapchainKHR(vulkan_device, vulkan_swapchain, vulkan_allocation_callbacks);
@@ -2991,6 +3076,7 @@ namespace Helix {
 
     void GpuDevice::resize_swapchain() {
 
+        // The old swapchain images must not be in use when the swapchain is destroyed.
         vkDeviceWaitIdle(vulkan_device);
 
         VkSurfaceCapabilitiesKHR surface_capabilities;
@@ -3018,10 +3104,6 @@ namespace Helix {
         Framebuffer* vk_framebuffer = access_framebuffer(fullscreen_framebuffer);
         vk_framebuffer->resize = true;
         resize_output_textures(fullscreen_framebuffer, swapchain_width, swapchain_height);
-
-        
-
-        vkDeviceWaitIdle(vulkan_device);
     }
 
     // Descriptor Set /////////////////////////////////////////////////////////
@@ -3054,27 +3136,33 @@ namespace Helix {
         dummy_delete_descriptor_set->resources = nullptr;
         dummy_delete_descriptor_set->samplers = nullptr;
         dummy_delete_descriptor_set->num_resources = 0;
+        dummy_delete_descriptor_set->hash = 0;
+        dummy_delete_descriptor_set->ref_count = 1;
 
         destroy_descriptor_set(dummy_delete_descriptor_set_handle);
 
         // Allocate the new descriptor set and update its content.
-        VkWriteDescriptorSet descriptor_write[8];
-        VkDescriptorBufferInfo buffer_info[8];
-        VkDescriptorImageInfo image_info[8];
-
-        Sampler* vk_default_sampler = access_sampler(default_sampler);
-
         VkDescriptorSetAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
         allocInfo.descriptorPool = vulkan_descriptor_pool;
         allocInfo.descriptorSetCount = 1;
         allocInfo.pSetLayouts = &descriptor_set->layout->vk_handle;
         vkAllocateDescriptorSets(vulkan_device, &allocInfo, &descriptor_set->vk_descriptor_set);
 
-        u32 num_resources = descriptor_set_layout->num_bindings;
-        fill_write_descriptor_sets(*this, descriptor_set_layout, descriptor_set->vk_descriptor_set, descriptor_write, buffer_info, image_info, vk_default_sampler->vk_handle,
-            num_resources, descriptor_set->resources, descriptor_set->samplers, descriptor_set->bindings);
+        DescriptorSetWrites writes;
+        fill_descriptor_set_writes(descriptor_set_layout, descriptor_set_layout->num_bindings, descriptor_set->resources, descriptor_set->samplers,
+            descriptor_set->bindings, writes);
+        write_descriptor_set(descriptor_set_layout, descriptor_set->vk_descriptor_set, writes);
 
-        vkUpdateDescriptorSets(vulkan_device, num_resources, descriptor_write, 0, nullptr);
+        // The descriptors changed, so does the content the set is shared by.
+        if (descriptor_set->ref_count > 0) {
+            if (descriptor_set_cache.get(descriptor_set->hash) == update.descriptor_set.index) {
+                descriptor_set_cache.remove(descriptor_set->hash);
+            }
+            if (descriptor_set_cache.get(writes.hash) == k_invalid_index) {
+                descriptor_set_cache.insert(writes.hash, update.descriptor_set.index);
+            }
+        }
+        descriptor_set->hash = writes.hash;
     }
 
     u32 GpuDevice::get_memory_heap_count() {
@@ -3165,6 +3253,256 @@ namespace Helix {
         destroy_texture(texture_to_delete);
     }
 
+    void GpuDevice::resize_buffer(BufferHandle buffer, u32 size) {
+
+        Buffer* vk_buffer = access_buffer(buffer);
+
+        if (vk_buffer->size == size) {
+            return;
+        }
+        if (vk_buffer->parent_buffer.index != k_invalid_index) {
+            HWARN("Graphics warning: buffer {} is part of the dynamic buffer and can't be resized", vk_buffer->name);
+            return;
+        }
+
+        // Queue deletion of buffer by creating a temporary one, the frames in flight keep reading it.
+        BufferHandle buffer_to_delete = { buffers.obtain_resource() };
+        // The pool can grow, access the buffer again.
+        vk_buffer = access_buffer(buffer);
+        Buffer* vk_buffer_to_delete = access_buffer(buffer_to_delete);
+        memory_copy(vk_buffer_to_delete, vk_buffer, sizeof(Buffer));
+        vk_buffer_to_delete->handle = buffer_to_delete;
+
+        VkMemoryPropertyFlags memory_properties = 0;
+        vmaGetAllocationMemoryProperties(vma_allocator, vk_buffer->vma_allocation, &memory_properties);
+
+        // Re-create buffer in place with the same usage and memory.
+        VkBufferCreateInfo buffer_info{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | vk_buffer->type_flags;
+        buffer_info.size = size > 0 ? size : 1;
+
+        VmaAllocationCreateInfo memory_info{};
+        memory_info.flags = VMA_ALLOCATION_CREATE_STRATEGY_BEST_FIT_BIT;
+        if (vk_buffer->mapped_data) {
+            memory_info.flags = memory_info.flags | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        }
+        memory_info.usage = (memory_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? VMA_MEMORY_USAGE_GPU_TO_CPU : VMA_MEMORY_USAGE_GPU_ONLY;
+
+        VmaAllocationInfo allocation_info{};
+        check(vmaCreateBuffer(vma_allocator, &buffer_info, &memory_info,
+            &vk_buffer->vk_handle, &vk_buffer->vma_allocation, &allocation_info));
+
+        set_resource_name(VK_OBJECT_TYPE_BUFFER, (u64)vk_buffer->vk_handle, vk_buffer->name);
+
+        vk_buffer->vk_device_memory = allocation_info.deviceMemory;
+        vk_buffer->size = size;
+
+        // Persistently mapped content is kept, device only content is undefined.
+        if (vk_buffer->mapped_data) {
+            vk_buffer->mapped_data = static_cast<uint8_t*>(allocation_info.pMappedData);
+            memcpy(vk_buffer->mapped_data, vk_buffer_to_delete->mapped_data, helix_min(size, vk_buffer_to_delete->size));
+        }
+
+        destroy_buffer(buffer_to_delete);
+    }
+
+    void GpuDevice::query_memory_requirements(const TextureCreation& creation, VkMemoryRequirements& out_requirements) {
+
+        // Requirements of a temporary image with the same parameters.
+        VkImageCreateInfo image_info;
+        vulkan_fill_image_info(creation, image_info);
+
+        VkImage image;
+        check(vkCreateImage(vulkan_device, &image_info, vulkan_allocation_callbacks, &image));
+        vkGetImageMemoryRequirements(vulkan_device, image, &out_requirements);
+        vkDestroyImage(vulkan_device, image, vulkan_allocation_callbacks);
+    }
+
+    void GpuDevice::query_memory_requirements(const BufferCreation& creation, VkMemoryRequirements& out_requirements) {
+
+        VkBufferCreateInfo buffer_info{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | creation.type_flags;
+        buffer_info.size = creation.size > 0 ? creation.size : 1;
+
+        VkBuffer buffer;
+        check(vkCreateBuffer(vulkan_device, &buffer_info, vulkan_allocation_callbacks, &buffer));
+        vkGetBufferMemoryRequirements(vulkan_device, buffer, &out_requirements);
+        vkDestroyBuffer(vulkan_device, buffer, vulkan_allocation_callbacks);
+    }
+
+    VmaAllocation GpuDevice::allocate_memory(const VkMemoryRequirements& requirements, cstring name) {
+
+        VmaAllocationCreateInfo memory_info{};
+        memory_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        // Blocks are big, keep them out of the shared pools.
+        memory_info.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        VmaAllocation allocation;
+        check(vmaAllocateMemory(vma_allocator, &requirements, &memory_info, &allocation, nullptr));
+
+#if defined (_DEBUG)
+        vmaSetAllocationName(vma_allocator, allocation, name);
+#endif // _DEBUG
+        return allocation;
+    }
+
+    void GpuDevice::free_memory(VmaAllocation allocation) {
+
+        memory_deletion_queue.push({ allocation, 0, 0 });
+    }
+
+    void GpuDevice::mark_pending_deletions_submitted() {
+        // Values signaled once the submissions of the current frame complete.
+        const u64 graphics_value = absolute_frame + 1;
+        const u64 compute_value = last_compute_semaphore_value;
+
+        for (u32 i = 0; i < resource_deletion_queue.size; ++i) {
+            ResourceUpdate& resource_deletion = resource_deletion_queue[i];
+            if (resource_deletion.graphics_value == 0) {
+                resource_deletion.graphics_value = graphics_value;
+                resource_deletion.compute_value = compute_value;
+            }
+        }
+        for (u32 i = 0; i < memory_deletion_queue.size; ++i) {
+            MemoryDeletion& memory_deletion = memory_deletion_queue[i];
+            if (memory_deletion.graphics_value == 0) {
+                memory_deletion.graphics_value = graphics_value;
+                memory_deletion.compute_value = compute_value;
+            }
+        }
+    }
+
+    void GpuDevice::destroy_pending_resources(u64 completed_graphics_value, u64 completed_compute_value) {
+        auto completed = [&](u64 graphics_value, u64 compute_value) {
+            return graphics_value > 0 && graphics_value <= completed_graphics_value && compute_value <= completed_compute_value;
+        };
+
+        // Reverse iteration, destroyed entries are swapped with the last one.
+        for (i32 i = resource_deletion_queue.size - 1; i >= 0; i--) {
+            const ResourceUpdate resource_deletion = resource_deletion_queue[i];
+            if (!completed(resource_deletion.graphics_value, resource_deletion.compute_value)) {
+                continue;
+            }
+            resource_deletion_queue.delete_swap(i);
+
+            switch (resource_deletion.type) {
+
+            case ResourceDeletionType::Buffer:
+            {
+                destroy_buffer_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::Pipeline:
+            {
+                destroy_pipeline_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::RenderPass:
+            {
+                destroy_render_pass_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::Framebuffer:
+            {
+                destroy_framebuffer_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::DescriptorSet:
+            {
+                destroy_descriptor_set_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::DescriptorSetLayout:
+            {
+                destroy_descriptor_set_layout_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::Sampler:
+            {
+                destroy_sampler_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::ShaderState:
+            {
+                destroy_shader_state_instant(resource_deletion.handle);
+                break;
+            }
+
+            case ResourceDeletionType::Texture:
+            {
+                destroy_texture_instant(resource_deletion.handle);
+                break;
+            }
+            }
+        }
+
+        // Memory is given back to VMA with a call per batch.
+        static const u32 k_memory_batch_size = 32;
+        VmaAllocation allocations[k_memory_batch_size];
+        u32 allocation_count = 0;
+        for (i32 i = memory_deletion_queue.size - 1; i >= 0; i--) {
+            const MemoryDeletion& memory_deletion = memory_deletion_queue[i];
+            if (!completed(memory_deletion.graphics_value, memory_deletion.compute_value)) {
+                continue;
+            }
+            allocations[allocation_count++] = memory_deletion.allocation;
+            memory_deletion_queue.delete_swap(i);
+
+            if (allocation_count == k_memory_batch_size) {
+                vmaFreeMemoryPages(vma_allocator, allocation_count, allocations);
+                allocation_count = 0;
+            }
+        }
+        if (allocation_count > 0) {
+            vmaFreeMemoryPages(vma_allocator, allocation_count, allocations);
+        }
+    }
+
+    void GpuDevice::swap_texture(TextureHandle texture, TextureHandle other) {
+
+        Texture* vk_texture = access_texture(texture);
+        Texture* vk_other = access_texture(other);
+
+        Texture temp;
+        memory_copy(&temp, vk_texture, sizeof(Texture));
+        memory_copy(vk_texture, vk_other, sizeof(Texture));
+        memory_copy(vk_other, &temp, sizeof(Texture));
+
+        // Handles and samplers stay with the slot, only images move.
+        vk_texture->handle = texture;
+        vk_other->handle = other;
+        vk_other->sampler = vk_texture->sampler;
+        vk_texture->sampler = temp.sampler;
+
+        if (gpu_device_features & GpuDeviceFeature_BINDLESS) {
+            ResourceUpdate resource_update{ ResourceDeletionType::Texture, texture.index, current_frame };
+            texture_to_update_bindless.push(resource_update);
+            resource_update.handle = other.index;
+            texture_to_update_bindless.push(resource_update);
+        }
+    }
+
+    void GpuDevice::swap_buffer(BufferHandle buffer, BufferHandle other) {
+
+        Buffer* vk_buffer = access_buffer(buffer);
+        Buffer* vk_other = access_buffer(other);
+
+        Buffer temp;
+        memory_copy(&temp, vk_buffer, sizeof(Buffer));
+        memory_copy(vk_buffer, vk_other, sizeof(Buffer));
+        memory_copy(vk_other, &temp, sizeof(Buffer));
+
+        vk_buffer->handle = buffer;
+        vk_other->handle = other;
+    }
+
     void GpuDevice::new_frame() {
 
         if (gpu_device_features & GpuDeviceFeature_TIMELINE_SEMAPHORE) {
@@ -3203,8 +3541,24 @@ namespace Helix {
             resize_swapchain();
         }
 
+        // Everything the GPU is done with is destroyed in one batch.
+        u64 completed_graphics_value = 0;
+        u64 completed_compute_value = u64_max;
+        if (gpu_device_features & GpuDeviceFeature_TIMELINE_SEMAPHORE) {
+            vkGetSemaphoreCounterValue(vulkan_device, vulkan_timeline_graphics_semaphore, &completed_graphics_value);
+            vkGetSemaphoreCounterValue(vulkan_device, vulkan_compute_semaphore, &completed_compute_value);
+        }
+        else if (absolute_frame >= vulkan_swapchain_image_count) {
+            // The fence just waited for is of the frame submitted a swapchain length ago.
+            completed_graphics_value = absolute_frame + 1 - vulkan_swapchain_image_count;
+        }
+        destroy_pending_resources(completed_graphics_value, completed_compute_value);
+
         // Command pool reset
         command_buffer_ring.reset_pools(current_frame);
+        if (has_compute_command_pools(this)) {
+            compute_command_buffer_ring.reset_pools(current_frame);
+        }
         // Dynamic memory update
         const u32 used_size = dynamic_allocated_size - (dynamic_per_frame_size * previous_frame);
         dynamic_max_per_frame_size = helix_max(used_size, dynamic_max_per_frame_size);
@@ -3231,7 +3585,7 @@ namespace Helix {
         VkSemaphore* render_complete_semaphore = &vulkan_render_complete_semaphore[current_frame];
 
         // Copy all commands
-        VkCommandBuffer enqueued_command_buffers[4];
+        VkCommandBuffer enqueued_command_buffers[k_max_queued_command_buffers];
         for (u32 c = 0; c < num_queued_command_buffers; c++) {
 
             CommandBuffer* command_buffer = queued_command_buffers[c];
@@ -3320,31 +3674,65 @@ namespace Helix {
             if (has_async_work) wait_semaphore_count++;
 
             if (gpu_device_features & GpuDeviceFeature_SYNCHRONIZATION2) {
-                VkCommandBufferSubmitInfo command_buffer_info[4]{ }; // TODO: Maybe have a max queue count for command buffers
+                // Compute batches are submitted first, timeline semaphores let them wait for the values of the
+                // graphics batches submitted below.
+                const bool compute_batches = num_queued_compute_command_buffers > 0 || num_queue_batches[QueueType::Compute] > 1;
+                if (compute_batches) {
+                    submit_compute_batches();
+                    // The end of the frame waits for the last compute batch.
+                    has_async_work = true;
+                    wait_semaphore_count = 2;
+                }
+
+                VkCommandBufferSubmitInfo command_buffer_info[k_max_queued_command_buffers]{ };
                 for (u32 c = 0; c < num_queued_command_buffers; c++) {
                     command_buffer_info[c].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
                     command_buffer_info[c].commandBuffer = enqueued_command_buffers[c];
                 }
 
-                VkSemaphoreSubmitInfoKHR wait_semaphores[]{
-                    { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_image_acquired_semaphore[current_frame], 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, 0},
-                    { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_compute_semaphore, last_compute_semaphore_value, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR, 0 },
-                };
-
-                VkSemaphoreSubmitInfoKHR signal_semaphores[]{
-                    { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, *render_complete_semaphore, 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, 0 },
-                    { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_timeline_graphics_semaphore, absolute_frame + 1, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR , 0 }
-                };
+                // Batches split by queue_sync_point, the first one waits for the swapchain image and the last one
+                // signals the end of the frame.
+                const u32 batch_count = num_queue_batches[QueueType::Graphics];
+                VkSemaphoreSubmitInfoKHR wait_semaphores[k_max_queue_batches][3]{ };
+                VkSemaphoreSubmitInfoKHR signal_semaphores[k_max_queue_batches][3]{ };
+                VkSubmitInfo2 submit_infos[k_max_queue_batches]{ };
+                for (u32 b = 0; b < batch_count; ++b) {
+                    const GpuQueueBatch& batch = queue_batches[QueueType::Graphics][b];
+                    const u32 last_command_buffer = b + 1 < batch_count ? queue_batches[QueueType::Graphics][b + 1].first_command_buffer : num_queued_command_buffers;
+
+                    u32 wait_count = 0;
+                    u32 signal_count = 0;
+                    if (b == 0) {
+                        wait_semaphores[b][wait_count++] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_image_acquired_semaphore[current_frame], 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, 0 };
+                    }
+                    if (batch.wait_value > 0) {
+                        wait_semaphores[b][wait_count++] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_compute_semaphore, batch.wait_value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0 };
+                    }
+                    if (batch.signal_value > 0) {
+                        signal_semaphores[b][signal_count++] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_graphics_sync_semaphore, batch.signal_value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0 };
+                    }
+                    if (b == batch_count - 1) {
+                        if (wait_semaphore_count > 1) {
+                            // Work of the compute batches can be read by any stage of the next frames.
+                            const VkPipelineStageFlags2KHR compute_wait_stage = compute_batches ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR : VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR;
+                            wait_semaphores[b][wait_count++] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_compute_semaphore, last_compute_semaphore_value, compute_wait_stage, 0 };
+                        }
+                        signal_semaphores[b][signal_count++] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, *render_complete_semaphore, 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, 0 };
+                        // Deferred deletions and frame reuse wait on this value, it must cover every stage of the frame.
+                        signal_semaphores[b][signal_count++] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_timeline_graphics_semaphore, absolute_frame + 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0 };
+                    }
 
-                VkSubmitInfo2 submit_info{ VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR };
-                submit_info.waitSemaphoreInfoCount = wait_semaphore_count;
-                submit_info.pWaitSemaphoreInfos = wait_semaphores;
-                submit_info.commandBufferInfoCount = num_queued_command_buffers;
-                submit_info.pCommandBufferInfos = command_buffer_info;
-                submit_info.signalSemaphoreInfoCount = 2;
-                submit_info.pSignalSemaphoreInfos = signal_semaphores;
+                    VkSubmitInfo2& submit_info = submit_infos[b];
+                    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+                    submit_info.waitSemaphoreInfoCount = wait_count;
+                    submit_info.pWaitSemaphoreInfos = wait_semaphores[b];
+                    submit_info.commandBufferInfoCount = last_command_buffer - batch.first_command_buffer;
+                    submit_info.pCommandBufferInfos = command_buffer_info + batch.first_command_buffer;
+                    submit_info.signalSemaphoreInfoCount = signal_count;
+                    submit_info.pSignalSemaphoreInfos = signal_semaphores[b];
+                }
 
-                vkQueueSubmit2(vulkan_main_queue, 1, &submit_info, VK_NULL_HANDLE);
+                vkQueueSubmit2(vulkan_main_queue, batch_count, submit_infos, VK_NULL_HANDLE);
             }
             else {
                 VkSemaphore wait_semaphores[] = { vulkan_image_acquired_semaphore[current_frame], vulkan_compute_semaphore };
@@ -3383,7 +3771,7 @@ namespace Helix {
             if (has_async_work) wait_semaphore_count++;
 
             if (gpu_device_features & GpuDeviceFeature_SYNCHRONIZATION2) {
-                VkCommandBufferSubmitInfo command_buffer_info[4]{ };
+                VkCommandBufferSubmitInfo command_buffer_info[k_max_queued_command_buffers]{ };
                 for (u32 c = 0; c < num_queued_command_buffers; c++) {
                     command_buffer_info[c].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
                     command_buffer_info[c].commandBuffer = enqueued_command_buffers[c];
@@ -3426,6 +3814,12 @@ namespace Helix {
         }
 
         has_async_work = false;
+        HASSERT((num_queue_batches[QueueType::Graphics] == 1 && num_queued_compute_command_buffers == 0) || (gpu_device_features & GpuDeviceFeature_ASYNC_COMPUTE));
+        num_queued_compute_command_buffers = 0;
+        for (u32 q = 0; q < 2; ++q) {
+            num_queue_batches[q] = 1;
+            queue_batches[q][0] = {};
+        }
 
         if (async_compute_command_buffer != nullptr) {
             submit_compute_load(async_compute_command_buffer);
@@ -3445,6 +3839,9 @@ namespace Helix {
 
         num_queued_command_buffers = 0;
 
+        // Resources destroyed during the frame were last used by its submissions.
+        mark_pending_deletions_submitted();
+
         //
         // GPU Timestamp resolve
         if (timestamps_enabled) {
@@ -3477,6 +3874,12 @@ namespace Helix {
                 HERROR("Asymmetrical GPU queries, missing pop of some markers!");
             }
 
+            // Room for every timestamp of the frame from the next one.
+            if (gpu_timestamp_manager->dropped_queries > 0) {
+                const u32 queries_per_frame = gpu_timestamp_manager->current_query + gpu_timestamp_manager->dropped_queries;
+                resize_gpu_timestamps(helix_min(queries_per_frame + queries_per_frame / 2, (u32)u16_max));
+            }
+
             gpu_timestamp_manager->reset();
             gpu_timestamp_reset = true;
         }
@@ -3499,79 +3902,46 @@ namespace Helix {
 
         // This is called inside resize_swapchain as well to correctly work.
         frame_counters_advance();
+    }
 
-        // Resource deletion using reverse iteration and swap with last element.
-        if (resource_deletion_queue.size > 0) {
-            for (i32 i = resource_deletion_queue.size - 1; i >= 0; i--) {
-                ResourceUpdate& resource_deletion = resource_deletion_queue[i];
-
-                if (resource_deletion.current_frame == current_frame) {
-
-                    switch (resource_deletion.type) {
-
-                    case ResourceDeletionType::Buffer:
-                    {
-                        destroy_buffer_instant(resource_deletion.handle);
-                        break;
-                    }
-
-                    case ResourceDeletionType::Pipeline:
-                    {
-                        destroy_pipeline_instant(resource_deletion.handle);
-                        break;
-                    }
-
-                    case ResourceDeletionType::RenderPass:
-                    {
-                        destroy_render_pass_instant(resource_deletion.handle);
-                        break;
-                    }
-
-                    case ResourceDeletionType::Framebuffer:
-                    {
-                        destroy_framebuffer_instant(resource_deletion.handle);
-                        break;
-                    }
-
-                    case ResourceDeletionType::DescriptorSet:
-                    {
-                        destroy_descriptor_set_instant(resource_deletion.handle);
-                        break;
-                    }
-
-                    case ResourceDeletionType::DescriptorSetLayout:
-                    {
-                        destroy_descriptor_set_layout_instant(resource_deletion.handle);
-                        break;
-                    }
+    void GpuDevice::submit_compute_batches() {
+        VkCommandBufferSubmitInfo command_buffer_info[k_max_queued_command_buffers]{ };
+        for (u32 c = 0; c < num_queued_compute_command_buffers; c++) {
+            CommandBuffer* command_buffer = queued_compute_command_buffers[c];
+            command_buffer->end();
 
-                    case ResourceDeletionType::Sampler:
-                    {
-                        destroy_sampler_instant(resource_deletion.handle);
-                        break;
-                    }
+            command_buffer_info[c].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+            command_buffer_info[c].commandBuffer = command_buffer->vk_handle;
+        }
 
-                    case ResourceDeletionType::ShaderState:
-                    {
-                        destroy_shader_state_instant(resource_deletion.handle);
-                        break;
-                    }
+        // The last batch signals the value the end of the frame waits for.
+        const u32 batch_count = num_queue_batches[QueueType::Compute];
+        GpuQueueBatch& last_batch = queue_batches[QueueType::Compute][batch_count - 1];
+        if (last_batch.signal_value == 0) {
+            last_batch.signal_value = ++last_compute_semaphore_value;
+        }
 
-                    case ResourceDeletionType::Texture:
-                    {
-                        destroy_texture_instant(resource_deletion.handle);
-                        break;
-                    }
-                    }
+        VkSemaphoreSubmitInfoKHR wait_semaphores[k_max_queue_batches]{ };
+        VkSemaphoreSubmitInfoKHR signal_semaphores[k_max_queue_batches]{ };
+        VkSubmitInfo2 submit_infos[k_max_queue_batches]{ };
+        for (u32 b = 0; b < batch_count; ++b) {
+            const GpuQueueBatch& batch = queue_batches[QueueType::Compute][b];
+            const u32 last_command_buffer = b + 1 < batch_count ? queue_batches[QueueType::Compute][b + 1].first_command_buffer : num_queued_compute_command_buffers;
 
-                    // Mark resource as free
-                    resource_deletion.current_frame = u32_max;
+            wait_semaphores[b] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_graphics_sync_semaphore, batch.wait_value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0 };
+            signal_semaphores[b] = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR, nullptr, vulkan_compute_semaphore, batch.signal_value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0 };
 
-                    // Swap element
-                    resource_deletion_queue.delete_swap(i);
-                }
-            }
+            VkSubmitInfo2& submit_info = submit_infos[b];
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+            submit_info.waitSemaphoreInfoCount = batch.wait_value > 0 ? 1 : 0;
+            submit_info.pWaitSemaphoreInfos = &wait_semaphores[b];
+            submit_info.commandBufferInfoCount = last_command_buffer - batch.first_command_buffer;
+            submit_info.pCommandBufferInfos = command_buffer_info + batch.first_command_buffer;
+            submit_info.signalSemaphoreInfoCount = batch.signal_value > 0 ? 1 : 0;
+            submit_info.pSignalSemaphoreInfos = &signal_semaphores[b];
         }
+
+        vkQueueSubmit2(vulkan_compute_queue, batch_count, submit_infos, VK_NULL_HANDLE);
     }
 
     void GpuDevice::submit_compute_load(CommandBuffer* command_buffer) {
@@ -3733,10 +4103,47 @@ namespace Helix {
     //
     //
     void GpuDevice::queue_command_buffer(CommandBuffer* command_buffer) {
-
+        HASSERT(num_queued_command_buffers < k_max_queued_command_buffers);
         queued_command_buffers[num_queued_command_buffers++] = command_buffer;
     }
 
+    void GpuDevice::queue_compute_command_buffer(CommandBuffer* command_buffer) {
+        HASSERT(gpu_device_features & GpuDeviceFeature_ASYNC_COMPUTE);
+        HASSERT(num_queued_compute_command_buffers < k_max_queued_command_buffers);
+        queued_compute_command_buffers[num_queued_compute_command_buffers++] = command_buffer;
+    }
+
+    u64 GpuDevice::queue_sync_point(QueueType::Enum queue) {
+        HASSERT(gpu_device_features & GpuDeviceFeature_ASYNC_COMPUTE);
+        u32& batch_count = num_queue_batches[queue];
+        HASSERT(batch_count < k_max_queue_batches);
+
+        // Graphics batches signal their own semaphore, the frame timeline one is signaled once per frame.
+        u64& last_value = queue == QueueType::Compute ? last_compute_semaphore_value : last_graphics_sync_value;
+        GpuQueueBatch& batch = queue_batches[queue][batch_count - 1];
+        batch.signal_value = ++last_value;
+
+        const u32 queued_count = queue == QueueType::Compute ? num_queued_compute_command_buffers : num_queued_command_buffers;
+        queue_batches[queue][batch_count++] = { queued_count, 0, 0 };
+
+        return batch.signal_value;
+    }
+
+    void GpuDevice::queue_wait(QueueType::Enum queue, u64 value) {
+        HASSERT(gpu_device_features & GpuDeviceFeature_ASYNC_COMPUTE);
+        u32& batch_count = num_queue_batches[queue];
+
+        // The wait applies to the command buffers queued after it.
+        const u32 queued_count = queue == QueueType::Compute ? num_queued_compute_command_buffers : num_queued_command_buffers;
+        if (queue_batches[queue][batch_count - 1].first_command_buffer < queued_count) {
+            HASSERT(batch_count < k_max_queue_batches);
+            queue_batches[queue][batch_count++] = { queued_count, 0, 0 };
+        }
+
+        GpuQueueBatch& batch = queue_batches[queue][batch_count - 1];
+        batch.wait_value = helix_max(batch.wait_value, value);
+    }
+
     //
     //
     CommandBuffer* GpuDevice::get_command_buffer(u32 thread_index, bool begin) {
@@ -3745,7 +4152,7 @@ namespace Helix {
         // The first commandbuffer issued in the frame is used to reset the timestamp queries used.
         if (gpu_timestamp_reset && begin) {
             // These are currently indices!
-            vkCmdResetQueryPool(cb->vk_handle, vulkan_timestamp_query_pool, current_frame * gpu_timestamp_manager->queries_per_frame * 2, gpu_timestamp_manager->queries_per_frame);
+            vkCmdResetQueryPool(cb->vk_handle, vulkan_timestamp_query_pool, current_frame * gpu_timestamp_manager->queries_per_frame * 2, gpu_timestamp_manager->queries_per_frame * 2);
 
             gpu_timestamp_reset = false;
         }
@@ -3758,6 +4165,15 @@ namespace Helix {
 
         return cb;
     }
+
+    CommandBuffer* GpuDevice::get_compute_command_buffer(u32 thread_index, bool begin) {
+        // A compute queue of the main family shares its pools.
+        if (!has_compute_command_pools(this)) {
+            return get_command_buffer(thread_index, begin);
+        }
+
+        return compute_command_buffer_ring.get_command_buffer(current_frame, thread_index, begin);
+    }
  
 
     // Resource Description Query ///////////////////////////////////////////////////
@@ -3903,7 +4319,7 @@ namespace Helix {
             return;
 
         u32 query_index = gpu_timestamp_manager->push(current_frame, name);
-        vkCmdWriteTimestamp(command_buffer->vk_handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, vulkan_timestamp_query_pool, query_index);
+        write_gpu_timestamp(command_buffer, query_index);
     }
 
     void GpuDevice::pop_gpu_timestamp(CommandBuffer* command_buffer) {
@@ -3911,9 +4327,46 @@ namespace Helix {
             return;
 
         u32 query_index = gpu_timestamp_manager->pop(current_frame);
+        write_gpu_timestamp(command_buffer, query_index);
+    }
+
+    u32 GpuDevice::reserve_gpu_timestamp(cstring name, u32& end_query) {
+        if (!timestamps_enabled) {
+            end_query = u32_max;
+            return u32_max;
+        }
+
+        u32 start_query = gpu_timestamp_manager->push(current_frame, name);
+        end_query = gpu_timestamp_manager->pop(current_frame);
+        return start_query;
+    }
+
+    void GpuDevice::write_gpu_timestamp(CommandBuffer* command_buffer, u32 query_index) {
+        if (query_index == u32_max)
+            return;
+
         vkCmdWriteTimestamp(command_buffer->vk_handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, vulkan_timestamp_query_pool, query_index);
     }
 
+    void GpuDevice::resize_gpu_timestamps(u32 queries_per_frame) {
+        vkDeviceWaitIdle(vulkan_device);
+
+        vkDestroyQueryPool(vulkan_device, vulkan_timestamp_query_pool, vulkan_allocation_callbacks);
+        VkQueryPoolCreateInfo vqpci{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, nullptr, 0, VK_QUERY_TYPE_TIMESTAMP, queries_per_frame * 2u * k_max_frames, 0 };
+        check_result(vkCreateQueryPool(vulkan_device, &vqpci, vulkan_allocation_callbacks, &vulkan_timestamp_query_pool));
+
+        // Keep the frame just resolved, the profiler reads it next frame.
+        GPUTimestampManager resized{};
+        resized.init(allocator, (u16)queries_per_frame, k_max_frames);
+        memset(resized.timestamps, 0, sizeof(GPUTimestamp) * queries_per_frame * k_max_frames);
+        Helix::memory_copy(&resized.timestamps[current_frame * queries_per_frame], &gpu_timestamp_manager->timestamps[current_frame * gpu_timestamp_manager->queries_per_frame], sizeof(GPUTimestamp) * gpu_timestamp_manager->current_query);
+
+        gpu_timestamp_manager->shutdown();
+        *gpu_timestamp_manager = resized;
+
+        HINFO("GPU timestamp queries resized to {} per frame", queries_per_frame);
+    }
+
 
     // Utility methods //////////////////////////////////////////////////////////////
 
@@ -4075,6 +4528,8 @@ namespace Helix {
         parent_index = 0;
         current_frame_resolved = false;
         depth = 0;
+        dropped_queries = 0;
+        dropped_depth = 0;
     }
 
     bool GPUTimestampManager::has_valid_queries() const {
@@ -4088,6 +4543,14 @@ namespace Helix {
     }
 
     u32 GPUTimestampManager::push(u32 current_frame, cstring name) {
+        // Once the queries ran out every push of the frame is dropped, so the
+        // dropped ones are the innermost open timestamps.
+        if (current_query >= queries_per_frame) {
+            ++dropped_queries;
+            ++dropped_depth;
+            return u32_max;
+        }
+
         u32 query_index = (current_frame * queries_per_frame) + current_query;
 
         GPUTimestamp& timestamp = timestamps[query_index];
@@ -4104,6 +4567,10 @@ namespace Helix {
     }
 
     u32 GPUTimestampManager::pop(u32 current_frame) {
+        if (dropped_depth > 0) {
+            --dropped_depth;
+            return u32_max;
+        }
 
         u32 query_index = (current_frame * queries_per_frame) + parent_index;
         GPUTimestamp& timestamp = timestamps[query_index];
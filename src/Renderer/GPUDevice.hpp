@@ -12,6 +12,7 @@
 
 #include "Core/Array.hpp"
 #include "Core/DataStructures.hpp"
+#include "Core/HashMap.hpp"
 #include "Core/Service.hpp"
 #include "Core/String.hpp"
 #include "Renderer/GPUResources.hpp"
@@ -68,6 +69,11 @@ struct GPUTimestampManager {
   u32 current_query = 0;
   u32 parent_index = 0;
   u32 depth = 0;
+  // Timestamps pushed once the frame queries ran out, and how many of them
+  // are still open. Their queries are u32_max and are not written, present
+  // grows the query pool to fit them the next frames.
+  u32 dropped_queries = 0;
+  u32 dropped_depth = 0;
 
   bool current_frame_resolved =
       false;  // Used to query the GPU only once per frame if get_gpu_timestamps
@@ -76,6 +82,21 @@ struct GPUTimestampManager {
 };  // struct GPUTimestampManager
 
 static const uint32_t k_max_frames = 3;
+// Command buffers submitted together in a frame.
+static const uint32_t k_max_queued_command_buffers = 32;
+// Submissions of a queue in a frame, see GpuDevice::queue_sync_point.
+static const uint32_t k_max_queue_batches = 16;
+
+//
+// Command buffers submitted together on a queue, from first_command_buffer to
+// the first one of the next batch. Values are of the timeline semaphores of
+// the queues, 0 when the batch doesn't wait or signal.
+struct GpuQueueBatch {
+  u32 first_command_buffer;
+  // Value of the other queue waited for.
+  u64 wait_value;
+  u64 signal_value;
+};  // struct GpuQueueBatch
 
 //
 //
@@ -105,6 +126,10 @@ enum GpuDeviceFeature : u8 {
   GpuDeviceFeature_TIMELINE_SEMAPHORE = 1 << 2,
   GpuDeviceFeature_SYNCHRONIZATION2 = 1 << 3,
   GpuDeviceFeature_MESH_SHADER = 1 << 4,
+  GpuDeviceFeature_TEXTURE_COMPRESSION_BC = 1 << 5,
+  // A compute queue runs beside the main one, synchronized with timeline
+  // semaphores.
+  GpuDeviceFeature_ASYNC_COMPUTE = 1 << 6,
 
 };
 inline GpuDeviceFeature operator|(GpuDeviceFeature a, GpuDeviceFeature b) {
@@ -125,6 +150,34 @@ inline GpuDeviceFeature operator&=(GpuDeviceFeature& a, GpuDeviceFeature b) {
   return a;
 }
 
+//
+// Descriptor as read by the update template of a layout.
+union DescriptorUpdateData {
+  VkDescriptorImageInfo image;
+  VkDescriptorBufferInfo buffer;
+};  // union DescriptorUpdateData
+
+//
+// Descriptors of a set, written with the update template of the layout or
+// with the writes when the set doesn't fill every templated binding.
+struct DescriptorSetWrites {
+  VkWriteDescriptorSet writes[k_max_descriptors_per_set];
+  VkDescriptorBufferInfo buffer_info[k_max_descriptors_per_set];
+  VkDescriptorImageInfo image_info[k_max_descriptors_per_set];
+  DescriptorUpdateData data[k_max_descriptors_per_set];
+  u32 count = 0;
+  // Of the layout, the resources and the descriptors.
+  u64 hash = 0;
+};  // struct DescriptorSetWrites
+
+//
+// Memory freed with free_memory, given back once the GPU reached the values.
+struct MemoryDeletion {
+  VmaAllocation allocation;
+  u64 graphics_value;
+  u64 compute_value;
+};  // struct MemoryDeletion
+
 //
 //
 struct GpuDevice : public Service {
@@ -138,6 +191,13 @@ struct GpuDevice : public Service {
       VkSampler vk_default_sampler, u32& num_resources,
       const ResourceHandle* resources, const SamplerHandle* samplers,
       const u16* bindings);
+  void fill_descriptor_set_writes(
+      const DesciptorSetLayout* descriptor_set_layout, u32 num_resources,
+      const ResourceHandle* resources, const SamplerHandle* samplers,
+      const u16* bindings, DescriptorSetWrites& out_writes);
+  void write_descriptor_set(const DesciptorSetLayout* descriptor_set_layout,
+                            VkDescriptorSet vk_descriptor_set,
+                            DescriptorSetWrites& writes);
 
   // Init/Terminate methods
   void init(const DeviceCreation& creation);
@@ -189,9 +249,32 @@ struct GpuDevice : public Service {
   void resize_output_textures(FramebufferHandle framebuffer, u32 width,
                               u32 height);
   void resize_texture(TextureHandle texture, u32 width, u32 height);
+  // Exchanges the images of two textures keeping handles and samplers, so
+  // bindless indices of 'texture' now see the image of 'other'.
+  void swap_texture(TextureHandle texture, TextureHandle other);
+  // Exchanges the buffers of two handles. Descriptor sets referencing them
+  // must be updated.
+  void swap_buffer(BufferHandle buffer, BufferHandle other);
+  // Re-creates the buffer with a new size keeping its handle. Persistently
+  // mapped content is copied, the old buffer is freed once the frames in
+  // flight are done. Descriptor sets referencing it must be updated.
+  void resize_buffer(BufferHandle buffer, u32 size);
 
   void update_descriptor_set(DescriptorSetHandle set);
 
+  // Transient memory //////////////////////////////////////////////////
+  // Memory a resource created with these parameters needs.
+  void query_memory_requirements(const TextureCreation& creation,
+                                 VkMemoryRequirements& out_requirements);
+  void query_memory_requirements(const BufferCreation& creation,
+                                 VkMemoryRequirements& out_requirements);
+  // Device memory textures and buffers can be placed in with
+  // set_alias_memory. The memory is freed once the frames in flight are done,
+  // resources placed in it must not be used by the next frames.
+  VmaAllocation allocate_memory(const VkMemoryRequirements& requirements,
+                                cstring name);
+  void free_memory(VmaAllocation allocation);
+
   // Misc //////////////////////////////////////////////////////////////
   void link_texture_sampler(
       TextureHandle texture,
@@ -224,10 +307,20 @@ struct GpuDevice : public Service {
   // Command Buffers ///////////////////////////////////////////////////
   CommandBuffer* get_command_buffer(u32 thread_index, bool begin);
   CommandBuffer* get_secondary_command_buffer(u32 thread_index);
+  // Command buffer submitted to the compute queue.
+  CommandBuffer* get_compute_command_buffer(u32 thread_index, bool begin);
 
   void queue_command_buffer(
       CommandBuffer* command_buffer);  // Queue command buffer that will not be
                                        // executed until present is called.
+  // Queues on the compute queue, needs GpuDeviceFeature_ASYNC_COMPUTE.
+  void queue_compute_command_buffer(CommandBuffer* command_buffer);
+  // The command buffers queued on a queue are submitted by present in
+  // batches. A sync point ends the current batch of the queue and returns the
+  // value it signals, the next batch of the other queue can wait for it with
+  // queue_wait. Needs GpuDeviceFeature_ASYNC_COMPUTE.
+  u64 queue_sync_point(QueueType::Enum queue);
+  void queue_wait(QueueType::Enum queue, u64 value);
 
   // Rendering /////////////////////////////////////////////////////////
   void new_frame();
@@ -258,6 +351,8 @@ struct GpuDevice : public Service {
 
   // Compute ///////////////////////////////////////////////////////////
   void submit_compute_load(CommandBuffer* command_buffer);
+  // Submits the batches of queue_compute_command_buffer, called by present.
+  void submit_compute_batches();
 
   // Names and markers /////////////////////////////////////////////////
   void set_resource_name(VkObjectType object_type, uint64_t handle,
@@ -271,6 +366,14 @@ struct GpuDevice : public Service {
   u32 get_gpu_timestamps(GPUTimestamp* out_timestamps);
   void push_gpu_timestamp(CommandBuffer* command_buffer, cstring name);
   void pop_gpu_timestamp(CommandBuffer* command_buffer);
+  // Pushes and pops a timestamp without writing it, for command buffers
+  // recorded by other threads. Returns its start query, written with
+  // write_gpu_timestamp as the end query.
+  u32 reserve_gpu_timestamp(cstring name, u32& end_query);
+  void write_gpu_timestamp(CommandBuffer* command_buffer, u32 query_index);
+  // Recreates the query pool with room for queries_per_frame timestamps per
+  // frame, waits for the device.
+  void resize_gpu_timestamps(u32 queries_per_frame);
 
   // Instant methods ///////////////////////////////////////////////////
   void destroy_buffer_instant(ResourceHandle buffer);
@@ -285,6 +388,12 @@ struct GpuDevice : public Service {
 
   void update_descriptor_set_instant(const DescriptorSetUpdate& update);
 
+  // Deferred deletions are tagged with the timeline values the submissions of
+  // the frame signal, and destroyed together once both values are reached.
+  void mark_pending_deletions_submitted();
+  void destroy_pending_resources(u64 completed_graphics_value,
+                                 u64 completed_compute_value);
+
   // Memory Statistics //////////////////////////////////////////////////
   u32 get_memory_heap_count();
 
@@ -331,6 +440,13 @@ struct GpuDevice : public Service {
   u32 num_allocated_command_buffers = 0;
   u32 num_queued_command_buffers = 0;
 
+  CommandBuffer* queued_compute_command_buffers[k_max_queued_command_buffers];
+  u32 num_queued_compute_command_buffers = 0;
+  // Batches of the graphics and compute queues, the last one is being
+  // queued.
+  GpuQueueBatch queue_batches[2][k_max_queue_batches];
+  u32 num_queue_batches[2] = {1, 1};
+
   PresentMode::Enum present_mode = PresentMode::Immediate;
   u32 current_frame;
   u32 previous_frame;
@@ -385,6 +501,9 @@ struct GpuDevice : public Service {
   VkFence vulkan_compute_fence;
   u64 last_compute_semaphore_value = 0;
   bool has_async_work = false;
+  // Signaled by the graphics batches waited for by the compute queue.
+  VkSemaphore vulkan_graphics_sync_semaphore;
+  u64 last_graphics_sync_value = 0;
 
   // Windows specific
   VkSurfaceKHR vulkan_window_surface;
@@ -414,7 +533,10 @@ struct GpuDevice : public Service {
 
   // These are dynamic - so that workload can be handled correctly.
   Array<ResourceUpdate> resource_deletion_queue;
+  Array<MemoryDeletion> memory_deletion_queue;
   Array<DescriptorSetUpdate> descriptor_set_updates;
+  // Live descriptor sets by DescriptorSet::hash.
+  FlatHashMap<u64, u32> descriptor_set_cache;
   // [TAG: BINDLESS]
   Array<ResourceUpdate> texture_to_update_bindless;
 
@@ -17,16 +17,26 @@ Helix::FlatHashMap<u64, u32> name_to_color;
 
 static u32 initial_frames_paused = 3;
 
+static void gpu_profiler_allocate_timestamps(GPUProfiler& profiler,
+                                             u32 queries_per_frame) {
+  const sizet size =
+      sizeof(GPUTimestamp) * profiler.max_frames * queries_per_frame;
+  profiler.timestamps = (GPUTimestamp*)halloca(size, profiler.allocator);
+  memset(profiler.timestamps, 0, size);
+  profiler.queries_per_frame = queries_per_frame;
+}
+
 void GPUProfiler::init(Allocator* allocator_, u32 max_frames_) {
   allocator = allocator_;
   max_frames = max_frames_;
-  timestamps =
-      (GPUTimestamp*)halloca(sizeof(GPUTimestamp) * max_frames * 32, allocator);
+  gpu_profiler_allocate_timestamps(*this, 32);
   per_frame_active = (u16*)halloca(sizeof(u16) * max_frames, allocator);
 
   max_duration = 16.666f;
   current_frame = 0;
   min_time = max_time = average_time = 0.f;
+  frame_time_ms = 0.f;
+  resolved_timestamps = 0;
   paused = false;
 
   memset(per_frame_active, 0, 2 * max_frames);
@@ -44,6 +54,8 @@ void GPUProfiler::shutdown() {
 
 void GPUProfiler::update(GpuDevice& gpu) {
   gpu.set_gpu_timestamps_enable(!paused);
+  frame_time_ms = 0.f;
+  resolved_timestamps = 0;
 
   if (initial_frames_paused) {
     --initial_frames_paused;
@@ -52,13 +64,27 @@ void GPUProfiler::update(GpuDevice& gpu) {
 
   if (paused && !gpu.resized) return;
 
-  u32 active_timestamps =
-      gpu.get_gpu_timestamps(&timestamps[32 * current_frame]);
+  // The graph history restarts when the device queries grew.
+  if (gpu.gpu_timestamp_manager->queries_per_frame > queries_per_frame) {
+    hfree(timestamps, allocator);
+    gpu_profiler_allocate_timestamps(
+        *this, gpu.gpu_timestamp_manager->queries_per_frame);
+    memset(per_frame_active, 0, sizeof(u16) * max_frames);
+  }
+
+  GPUTimestamp* frame_timestamps =
+      &timestamps[queries_per_frame * current_frame];
+  u32 active_timestamps = gpu.get_gpu_timestamps(frame_timestamps);
   per_frame_active[current_frame] = (u16)active_timestamps;
+  resolved_timestamps = active_timestamps;
+  if (active_timestamps > 0) {
+    // The first timestamp spans the frame.
+    frame_time_ms = (f32)frame_timestamps[0].elapsed_ms;
+  }
 
   // Get colors
   for (u32 i = 0; i < active_timestamps; ++i) {
-    GPUTimestamp& timestamp = timestamps[32 * current_frame + i];
+    GPUTimestamp& timestamp = frame_timestamps[i];
 
     u64 hashed_name = Helix::hash_calculate(timestamp.name);
     u32 color_index = name_to_color.get(hashed_name);
@@ -81,6 +107,12 @@ void GPUProfiler::update(GpuDevice& gpu) {
   }
 }
 
+const GPUTimestamp* GPUProfiler::last_frame_timestamps(u32& count) const {
+  count = resolved_timestamps;
+  const u32 last_frame = (current_frame + max_frames - 1) % max_frames;
+  return &timestamps[queries_per_frame * last_frame];
+}
+
 void GPUProfiler::imgui_draw() {
   if (initial_frames_paused) {
     return;
@@ -126,7 +158,8 @@ void GPUProfiler::imgui_draw() {
       u32 frame_index = (current_frame - 1 - i) % max_frames;
 
       f32 frame_x = cursor_pos.x + rect_x;
-      GPUTimestamp* frame_timestamps = &timestamps[frame_index * 32];
+      GPUTimestamp* frame_timestamps =
+          &timestamps[frame_index * queries_per_frame];
       f32 frame_time = (f32)frame_timestamps[0].elapsed_ms;
       // Clamp values to not destroy the frame data
       frame_time = Helix::clamp(frame_time, 0.00001f, 1000.f);
@@ -185,7 +218,8 @@ void GPUProfiler::imgui_draw() {
     selected_frame = selected_frame == -1 ? (current_frame - 1) % max_frames
                                           : selected_frame;
     if (selected_frame >= 0) {
-      GPUTimestamp* frame_timestamps = &timestamps[selected_frame * 32];
+      GPUTimestamp* frame_timestamps =
+          &timestamps[selected_frame * queries_per_frame];
 
       f32 x = cursor_pos.x + graph_width;
       f32 y = cursor_pos.y;
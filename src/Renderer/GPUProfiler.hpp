@@ -15,18 +15,27 @@ struct GPUProfiler {
 
   void imgui_draw();
 
+  // Timestamps resolved by the last update, count is 0 when none were.
+  const GPUTimestamp* last_frame_timestamps(u32& count) const;
+
   Allocator* allocator;
   GPUTimestamp* timestamps;
   u16* per_frame_active;
 
   u32 max_frames;
   u32 current_frame;
+  // Follows the queries per frame of the device, which grow with the frame
+  // graph.
+  u32 queries_per_frame;
+  u32 resolved_timestamps;
 
   f32 max_time;
   f32 min_time;
   f32 average_time;
 
   f32 max_duration;
+  // GPU time of the last resolved frame, 0 when none was resolved.
+  f32 frame_time_ms;
   bool paused;
 
 };  // struct GPUProfiler
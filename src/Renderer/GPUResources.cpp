@@ -66,6 +66,8 @@ BufferCreation& BufferCreation::reset() {
   persistent = 0;
   device_only = 0;
   initial_data = nullptr;
+  alias_memory = VK_NULL_HANDLE;
+  alias_offset = 0;
 
   name = nullptr;
 
@@ -103,6 +105,13 @@ BufferCreation& BufferCreation::set_device_only(bool value) {
   return *this;
 }
 
+BufferCreation& BufferCreation::set_alias_memory(VmaAllocation memory,
+                                                 sizet offset) {
+  alias_memory = memory;
+  alias_offset = offset;
+  return *this;
+}
+
 // TextureCreation /////////////////////////////////////////
 TextureCreation& TextureCreation::set_size(u16 width_, u16 height_,
                                            u16 depth_) {
@@ -152,6 +161,14 @@ TextureCreation& TextureCreation::set_alias(TextureHandle alias_) {
   return *this;
 }
 
+TextureCreation& TextureCreation::set_alias_memory(VmaAllocation memory,
+                                                   sizet offset) {
+  alias_memory = memory;
+  alias_offset = offset;
+
+  return *this;
+}
+
 // TextureViewCreation ////////////////////////////////////////////////////
 TextureViewCreation& TextureViewCreation::set_parent_texture(
     TextureHandle parent_texture_) {
@@ -541,6 +558,7 @@ FramebufferCreation& FramebufferCreation::set_name(const char* name_) {
 // ExecutionBarrier ////////////////////////////////////////
 ExecutionBarrier& ExecutionBarrier::reset() {
   num_image_barriers = num_buffer_barriers = 0;
+  memory_barrier = false;
   source_pipeline_stage = PipelineStage::DrawIndirect;
   destination_pipeline_stage = PipelineStage::DrawIndirect;
   return *this;
@@ -556,6 +574,7 @@ ExecutionBarrier& ExecutionBarrier::set(PipelineStage::Enum source,
 
 ExecutionBarrier& ExecutionBarrier::add_image_barrier(
     const ImageBarrier& image_barrier) {
+  HASSERT(num_image_barriers < k_max_execution_barriers);
   image_barriers[num_image_barriers++] = image_barrier;
 
   return *this;
@@ -563,11 +582,18 @@ ExecutionBarrier& ExecutionBarrier::add_image_barrier(
 
 ExecutionBarrier& ExecutionBarrier::add_buffer_barrier(
     const BufferBarrier& buffer_barrier) {
+  HASSERT(num_buffer_barriers < k_max_execution_barriers);
   buffer_barriers[num_buffer_barriers++] = buffer_barrier;
 
   return *this;
 }
 
+ExecutionBarrier& ExecutionBarrier::add_memory_barrier() {
+  memory_barrier = true;
+
+  return *this;
+}
+
 //
 // Utils
 
@@ -669,6 +695,8 @@ void util_add_buffer_barrier_ext(GpuDevice* gpu, VkCommandBuffer command_buffer,
     barrier.dstAccessMask = util_to_vk_access_flags2(new_state);
     barrier.dstStageMask = util_determine_pipeline_stage_flags2(
         barrier.dstAccessMask, destination_queue_type);
+    barrier.srcQueueFamilyIndex = source_family;
+    barrier.dstQueueFamilyIndex = destination_family;
     barrier.buffer = buffer;
     barrier.offset = 0;
     barrier.size = buffer_size;
@@ -701,6 +729,158 @@ void util_add_buffer_barrier_ext(GpuDevice* gpu, VkCommandBuffer command_buffer,
   }
 }
 
+void util_add_execution_barrier(GpuDevice* gpu, VkCommandBuffer command_buffer,
+                                const ExecutionBarrier& barrier,
+                                QueueType::Enum queue_type) {
+  if (barrier.empty()) {
+    return;
+  }
+
+  if (gpu->gpu_device_features & GpuDeviceFeature_SYNCHRONIZATION2) {
+    VkImageMemoryBarrier2 image_barriers[k_max_execution_barriers];
+    for (u32 i = 0; i < barrier.num_image_barriers; ++i) {
+      const ImageBarrier& image_barrier = barrier.image_barriers[i];
+      Texture* texture = gpu->access_texture(image_barrier.texture);
+
+      VkImageMemoryBarrier2& vk_barrier = image_barriers[i];
+      vk_barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+      vk_barrier.srcAccessMask =
+          util_to_vk_access_flags2(image_barrier.old_state);
+      vk_barrier.srcStageMask = util_determine_pipeline_stage_flags2(
+          vk_barrier.srcAccessMask, queue_type);
+      vk_barrier.dstAccessMask =
+          util_to_vk_access_flags2(image_barrier.new_state);
+      vk_barrier.dstStageMask = util_determine_pipeline_stage_flags2(
+          vk_barrier.dstAccessMask, queue_type);
+      vk_barrier.oldLayout = util_to_vk_image_layout2(image_barrier.old_state);
+      vk_barrier.newLayout = util_to_vk_image_layout2(image_barrier.new_state);
+      vk_barrier.srcQueueFamilyIndex = image_barrier.source_family;
+      vk_barrier.dstQueueFamilyIndex = image_barrier.destination_family;
+      vk_barrier.image = texture->vk_image;
+      vk_barrier.subresourceRange.aspectMask =
+          TextureFormat::has_depth(texture->vk_format)
+              ? VK_IMAGE_ASPECT_DEPTH_BIT
+              : VK_IMAGE_ASPECT_COLOR_BIT;
+      vk_barrier.subresourceRange.baseArrayLayer = 0;
+      vk_barrier.subresourceRange.layerCount = 1;
+      vk_barrier.subresourceRange.baseMipLevel = 0;
+      vk_barrier.subresourceRange.levelCount = texture->mip_level_count;
+    }
+
+    VkBufferMemoryBarrier2 buffer_barriers[k_max_execution_barriers];
+    for (u32 i = 0; i < barrier.num_buffer_barriers; ++i) {
+      const BufferBarrier& buffer_barrier = barrier.buffer_barriers[i];
+      Buffer* buffer = gpu->access_buffer(buffer_barrier.buffer);
+
+      VkBufferMemoryBarrier2& vk_barrier = buffer_barriers[i];
+      vk_barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+      vk_barrier.srcAccessMask =
+          util_to_vk_access_flags2(buffer_barrier.old_state);
+      vk_barrier.srcStageMask = util_determine_pipeline_stage_flags2(
+          vk_barrier.srcAccessMask, queue_type);
+      vk_barrier.dstAccessMask =
+          util_to_vk_access_flags2(buffer_barrier.new_state);
+      vk_barrier.dstStageMask = util_determine_pipeline_stage_flags2(
+          vk_barrier.dstAccessMask, queue_type);
+      vk_barrier.srcQueueFamilyIndex = buffer_barrier.source_family;
+      vk_barrier.dstQueueFamilyIndex = buffer_barrier.destination_family;
+      vk_barrier.buffer = buffer->vk_handle;
+      vk_barrier.offset = 0;
+      vk_barrier.size = VK_WHOLE_SIZE;
+    }
+
+    VkMemoryBarrier2 memory_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memory_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memory_barrier.dstAccessMask =
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    VkDependencyInfo dependency_info{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency_info.memoryBarrierCount = barrier.memory_barrier ? 1 : 0;
+    dependency_info.pMemoryBarriers = &memory_barrier;
+    dependency_info.bufferMemoryBarrierCount = barrier.num_buffer_barriers;
+    dependency_info.pBufferMemoryBarriers = buffer_barriers;
+    dependency_info.imageMemoryBarrierCount = barrier.num_image_barriers;
+    dependency_info.pImageMemoryBarriers = image_barriers;
+
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+  } else {
+    // The stages of every transition are merged in one dependency.
+    VkPipelineStageFlags source_stage_mask = 0;
+    VkPipelineStageFlags destination_stage_mask = 0;
+
+    VkImageMemoryBarrier image_barriers[k_max_execution_barriers];
+    for (u32 i = 0; i < barrier.num_image_barriers; ++i) {
+      const ImageBarrier& image_barrier = barrier.image_barriers[i];
+      Texture* texture = gpu->access_texture(image_barrier.texture);
+
+      VkImageMemoryBarrier& vk_barrier = image_barriers[i];
+      vk_barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+      vk_barrier.image = texture->vk_image;
+      vk_barrier.srcQueueFamilyIndex = image_barrier.source_family;
+      vk_barrier.dstQueueFamilyIndex = image_barrier.destination_family;
+      vk_barrier.subresourceRange.aspectMask =
+          TextureFormat::has_depth(texture->vk_format)
+              ? VK_IMAGE_ASPECT_DEPTH_BIT
+              : VK_IMAGE_ASPECT_COLOR_BIT;
+      vk_barrier.subresourceRange.baseArrayLayer = 0;
+      vk_barrier.subresourceRange.layerCount = 1;
+      vk_barrier.subresourceRange.baseMipLevel = 0;
+      vk_barrier.subresourceRange.levelCount = texture->mip_level_count;
+      vk_barrier.oldLayout = util_to_vk_image_layout(image_barrier.old_state);
+      vk_barrier.newLayout = util_to_vk_image_layout(image_barrier.new_state);
+      vk_barrier.srcAccessMask =
+          util_to_vk_access_flags(image_barrier.old_state);
+      vk_barrier.dstAccessMask =
+          util_to_vk_access_flags(image_barrier.new_state);
+
+      source_stage_mask |= util_determine_pipeline_stage_flags(
+          vk_barrier.srcAccessMask, queue_type);
+      destination_stage_mask |= util_determine_pipeline_stage_flags(
+          vk_barrier.dstAccessMask, queue_type);
+    }
+
+    VkBufferMemoryBarrier buffer_barriers[k_max_execution_barriers];
+    for (u32 i = 0; i < barrier.num_buffer_barriers; ++i) {
+      const BufferBarrier& buffer_barrier = barrier.buffer_barriers[i];
+      Buffer* buffer = gpu->access_buffer(buffer_barrier.buffer);
+
+      VkBufferMemoryBarrier& vk_barrier = buffer_barriers[i];
+      vk_barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+      vk_barrier.buffer = buffer->vk_handle;
+      vk_barrier.srcQueueFamilyIndex = buffer_barrier.source_family;
+      vk_barrier.dstQueueFamilyIndex = buffer_barrier.destination_family;
+      vk_barrier.offset = 0;
+      vk_barrier.size = VK_WHOLE_SIZE;
+      vk_barrier.srcAccessMask =
+          util_to_vk_access_flags(buffer_barrier.old_state);
+      vk_barrier.dstAccessMask =
+          util_to_vk_access_flags(buffer_barrier.new_state);
+
+      source_stage_mask |= util_determine_pipeline_stage_flags(
+          vk_barrier.srcAccessMask, queue_type);
+      destination_stage_mask |= util_determine_pipeline_stage_flags(
+          vk_barrier.dstAccessMask, queue_type);
+    }
+
+    VkMemoryBarrier memory_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    memory_barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memory_barrier.dstAccessMask =
+        VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    if (barrier.memory_barrier) {
+      source_stage_mask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+      destination_stage_mask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    vkCmdPipelineBarrier(command_buffer, source_stage_mask,
+                         destination_stage_mask, 0,
+                         barrier.memory_barrier ? 1 : 0, &memory_barrier,
+                         barrier.num_buffer_barriers, buffer_barriers,
+                         barrier.num_image_barriers, image_barriers);
+  }
+}
+
 VkFormat util_string_to_vk_format(cstring format) {
   if (strcmp(format, "VK_FORMAT_R4G4_UNORM_PACK8") == 0) {
     return VK_FORMAT_R4G4_UNORM_PACK8;
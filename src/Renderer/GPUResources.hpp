@@ -107,7 +107,7 @@ static const u8 k_max_shader_stages =
     5;  // Maximum simultaneous shader stages. Applicable to all different type
         // of pipelines.
 static const u8 k_max_descriptors_per_set =
-    16;  // Maximum list elements for both descriptor set layout and descriptor
+    32;  // Maximum list elements for both descriptor set layout and descriptor
          // sets.
 static const u8 k_max_vertex_streams = 16;
 static const u8 k_max_vertex_attributes = 16;
@@ -241,6 +241,10 @@ struct BufferCreation {
   u32 device_only = 0;
   void* initial_data = nullptr;
 
+  // Memory the buffer is placed in, from GpuDevice::allocate_memory.
+  VmaAllocation alias_memory = VK_NULL_HANDLE;
+  sizet alias_offset = 0;
+
   cstring name = nullptr;
 
   BufferCreation& reset();
@@ -250,6 +254,7 @@ struct BufferCreation {
   BufferCreation& set_name(cstring name);
   BufferCreation& set_persistent(bool value);
   BufferCreation& set_device_only(bool value);
+  BufferCreation& set_alias_memory(VmaAllocation memory, sizet offset);
 
 };  // struct BufferCreation
 
@@ -268,6 +273,9 @@ struct TextureCreation {
   TextureType::Enum type = TextureType::Texture2D;
 
   TextureHandle alias = k_invalid_texture;
+  // Memory the image is placed in, from GpuDevice::allocate_memory.
+  VmaAllocation alias_memory = VK_NULL_HANDLE;
+  sizet alias_offset = 0;
 
   cstring name = nullptr;
 
@@ -278,6 +286,7 @@ struct TextureCreation {
   TextureCreation& set_name(cstring name);
   TextureCreation& set_data(void* data);
   TextureCreation& set_alias(TextureHandle alias);
+  TextureCreation& set_alias_memory(VmaAllocation memory, sizet offset);
 
 };  // struct TextureCreation
 
@@ -586,6 +595,11 @@ inline bool has_depth_or_stencil(VkFormat value) {
   return value >= VK_FORMAT_D16_UNORM && value <= VK_FORMAT_D32_SFLOAT_S8_UINT;
 }
 
+inline bool is_block_compressed(VkFormat value) {
+  return value >= VK_FORMAT_BC1_RGB_UNORM_BLOCK &&
+         value <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+}
+
 }  // namespace TextureFormat
 
 struct ResourceData {
@@ -694,10 +708,17 @@ struct MapBufferParameters {
 
 // Synchronization ////////////////////////////////////////////////////////
 
+static const u32 k_max_execution_barriers = 16;
+
 //
-//
+// The texture state is updated to new_state when the barrier is recorded.
 struct ImageBarrier {
   TextureHandle texture;
+  ResourceState old_state;
+  ResourceState new_state;
+  // Queue family ownership transfer, none when both are ignored.
+  u32 source_family = VK_QUEUE_FAMILY_IGNORED;
+  u32 destination_family = VK_QUEUE_FAMILY_IGNORED;
 
 };  // struct ImageBarrier
 
@@ -705,11 +726,15 @@ struct ImageBarrier {
 //
 struct BufferBarrier {
   BufferHandle buffer;
+  ResourceState old_state;
+  ResourceState new_state;
+  u32 source_family = VK_QUEUE_FAMILY_IGNORED;
+  u32 destination_family = VK_QUEUE_FAMILY_IGNORED;
 
 };  // struct MemoryBarrier
 
 //
-//
+// Transitions recorded with a single pipeline barrier.
 struct ExecutionBarrier {
   PipelineStage::Enum source_pipeline_stage;
   PipelineStage::Enum destination_pipeline_stage;
@@ -719,15 +744,24 @@ struct ExecutionBarrier {
 
   u32 num_image_barriers;
   u32 num_buffer_barriers;
+  // Also waits for every previous access, before memory is reused by another
+  // resource.
+  bool memory_barrier;
 
-  ImageBarrier image_barriers[8];
-  BufferBarrier buffer_barriers[8];
+  ImageBarrier image_barriers[k_max_execution_barriers];
+  BufferBarrier buffer_barriers[k_max_execution_barriers];
 
   ExecutionBarrier& reset();
   ExecutionBarrier& set(PipelineStage::Enum source,
                         PipelineStage::Enum destination);
   ExecutionBarrier& add_image_barrier(const ImageBarrier& image_barrier);
   ExecutionBarrier& add_buffer_barrier(const BufferBarrier& buffer_barrier);
+  ExecutionBarrier& add_memory_barrier();
+
+  bool empty() const {
+    return num_image_barriers == 0 && num_buffer_barriers == 0 &&
+           !memory_barrier;
+  }
 
 };  // struct Barrier
 
@@ -737,6 +771,10 @@ struct ResourceUpdate {
   ResourceDeletionType::Enum type;
   ResourceHandle handle;
   u32 current_frame;
+  // Of deletions, values of the graphics and compute timelines signaled by
+  // the last frame that can use the resource. 0 until it is submitted.
+  u64 graphics_value = 0;
+  u64 compute_value = 0;
 };  // struct ResourceUpdate
 
 // Resources //////////////////////////////////////////////////////////////
@@ -839,6 +877,10 @@ struct DescriptorBinding {
 //
 struct DesciptorSetLayout {
   VkDescriptorSetLayout vk_handle;
+  // Reads the descriptors of the non bindless bindings, in binding order, from
+  // an array of DescriptorUpdateData. Null without such bindings.
+  VkDescriptorUpdateTemplate vk_update_template = VK_NULL_HANDLE;
+  u16 num_update_entries = 0;
 
   VkDescriptorSetLayoutBinding* vk_binding = nullptr;
   DescriptorBinding* bindings = nullptr;
@@ -860,6 +902,11 @@ struct DescriptorSet {
 
   const DesciptorSetLayout* layout = nullptr;
   u32 num_resources = 0;
+
+  // Layout, resources and descriptors of the set, sets created with the same
+  // ones are shared and destroyed with their last user.
+  u64 hash = 0;
+  u32 ref_count = 0;
 };  // struct DesciptorSetVulkan
 
 //
@@ -1116,5 +1163,13 @@ void util_add_buffer_barrier_ext(GpuDevice* gpu, VkCommandBuffer command_buffer,
                                  QueueType::Enum source_queue_type,
                                  QueueType::Enum destination_queue_type);
 
+// Texture states are left to the caller, the barriers can be recorded on
+// several threads. The stages are the ones of the queue the command buffer is
+// submitted to.
+void util_add_execution_barrier(
+    GpuDevice* gpu, VkCommandBuffer command_buffer,
+    const ExecutionBarrier& barrier,
+    QueueType::Enum queue_type = QueueType::Graphics);
+
 VkFormat util_string_to_vk_format(cstring format);
 }  // namespace Helix
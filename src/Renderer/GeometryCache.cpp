@@ -0,0 +1,297 @@
+#include "Renderer/GeometryCache.hpp"
+
+#include <string.h>
+
+#include "Core/Assert.hpp"
+#include "Core/File.hpp"
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "vendor/meshoptimizer/meshoptimizer.h"
+
+namespace Helix {
+
+static const u32 k_geometry_cache_magic = 0x4f454748;  // 'HGEO'
+static const u32 k_geometry_cache_version = 1;
+
+//
+//
+struct GeometryCacheHeader {
+  u32 magic;
+  u32 version;
+  u64 source_hash;
+  u32 stream_count;
+  u32 block_count;
+};  // struct GeometryCacheHeader
+
+static_assert(sizeof(GeometryCacheHeader) == 24,
+              "Geometry cache header must be 24 bytes");
+
+static bool geometry_stream_is_valid(const GeometryStreamData& stream) {
+  switch (stream.codec) {
+    case GeometryCodec::Vertex:
+      return stream.stride > 0 && stream.stride <= 256 &&
+             stream.stride % 4 == 0;
+    case GeometryCodec::Octahedral:
+      return stream.stride == 4 || stream.stride == 8;
+    case GeometryCodec::Index:
+      return (stream.stride == 2 || stream.stride == 4) &&
+             stream.count % 3 == 0;
+    default:
+      return false;
+  }
+}
+
+// Index blocks must hold whole triangles.
+static u32 geometry_block_elements(GeometryCodec::Enum codec) {
+  return codec == GeometryCodec::Index
+             ? k_geometry_cache_block_elements / 3 * 3
+             : k_geometry_cache_block_elements;
+}
+
+static sizet geometry_block_bound(const GeometryStreamData& stream,
+                                  u32 element_count) {
+  if (stream.codec == GeometryCodec::Index) {
+    // Worst case as the biggest index is not known.
+    return meshopt_encodeIndexBufferBound(element_count, (sizet)u32_max + 1);
+  }
+  return meshopt_encodeVertexBufferBound(element_count, stream.stride);
+}
+
+static sizet geometry_encode_block(const GeometryStreamData& stream,
+                                   u32 first_element, u32 element_count,
+                                   u8* scratch, u8* out_data,
+                                   sizet out_capacity) {
+  switch (stream.codec) {
+    case GeometryCodec::Vertex: {
+      const u8* data =
+          (const u8*)stream.data + (sizet)first_element * stream.stride;
+      return meshopt_encodeVertexBuffer(out_data, out_capacity, data,
+                                        element_count, stream.stride);
+    }
+    case GeometryCodec::Octahedral: {
+      // Filtered data is smaller than the floats it comes from.
+      const f32* data = (const f32*)stream.data + (sizet)first_element * 4;
+      meshopt_encodeFilterOct(scratch, element_count, stream.stride,
+                              stream.stride == 4 ? 8 : 16, data);
+      return meshopt_encodeVertexBuffer(out_data, out_capacity, scratch,
+                                        element_count, stream.stride);
+    }
+    case GeometryCodec::Index: {
+      u32* indices = (u32*)scratch;
+      const u8* data =
+          (const u8*)stream.data + (sizet)first_element * stream.stride;
+      for (u32 i = 0; i < element_count; ++i) {
+        indices[i] = stream.stride == 2 ? ((const u16*)data)[i]
+                                        : ((const u32*)data)[i];
+      }
+      return meshopt_encodeIndexBuffer(out_data, out_capacity, indices,
+                                       element_count);
+    }
+    default:
+      return 0;
+  }
+}
+
+bool geometry_cache_write_file(cstring filename, u64 source_hash,
+                               const GeometryStreamData* streams,
+                               u32 stream_count, Allocator* temp_allocator,
+                               sizet* out_encoded_size) {
+  if (stream_count == 0 || stream_count > k_max_geometry_cache_streams) {
+    return false;
+  }
+
+  // Worst case size and block count.
+  u32 block_count = 0;
+  sizet data_capacity = 0;
+  sizet scratch_size = 0;
+  for (u32 s = 0; s < stream_count; ++s) {
+    const GeometryStreamData& stream = streams[s];
+    if (!geometry_stream_is_valid(stream)) {
+      HERROR("Invalid geometry cache stream {} ({})", s,
+             GeometryCodec::ToString(stream.codec));
+      return false;
+    }
+
+    const u32 block_elements = geometry_block_elements(stream.codec);
+    const u32 stream_blocks =
+        (stream.count + block_elements - 1) / block_elements;
+    block_count += stream_blocks;
+    for (u32 b = 0; b < stream_blocks; ++b) {
+      const u32 first_element = b * block_elements;
+      const u32 element_count = stream.count - first_element < block_elements
+                                    ? stream.count - first_element
+                                    : block_elements;
+      data_capacity += geometry_block_bound(stream, element_count);
+    }
+
+    const sizet block_scratch = (sizet)block_elements * 8;
+    scratch_size = block_scratch > scratch_size ? block_scratch : scratch_size;
+  }
+
+  const sizet tables_size = sizeof(GeometryCacheHeader) +
+                            sizeof(GeometryCacheStream) * stream_count +
+                            sizeof(GeometryCacheBlock) * block_count;
+  u8* memory = hallocam(tables_size + data_capacity, temp_allocator);
+  u8* scratch = hallocam(scratch_size, temp_allocator);
+
+  GeometryCacheHeader* header = (GeometryCacheHeader*)memory;
+  header->magic = k_geometry_cache_magic;
+  header->version = k_geometry_cache_version;
+  header->source_hash = source_hash;
+  header->stream_count = stream_count;
+  header->block_count = block_count;
+
+  GeometryCacheStream* cache_streams =
+      (GeometryCacheStream*)(memory + sizeof(GeometryCacheHeader));
+  GeometryCacheBlock* cache_blocks =
+      (GeometryCacheBlock*)(cache_streams + stream_count);
+
+  sizet offset = tables_size;
+  u32 block_index = 0;
+  for (u32 s = 0; s < stream_count; ++s) {
+    const GeometryStreamData& stream = streams[s];
+    const u32 block_elements = geometry_block_elements(stream.codec);
+
+    GeometryCacheStream& cache_stream = cache_streams[s];
+    cache_stream.codec = stream.codec;
+    cache_stream.stride = stream.stride;
+    cache_stream.count = stream.count;
+    cache_stream.first_block = block_index;
+    cache_stream.block_count = 0;
+    cache_stream.padding = 0;
+
+    for (u32 first_element = 0; first_element < stream.count;
+         first_element += block_elements) {
+      const u32 element_count = stream.count - first_element < block_elements
+                                    ? stream.count - first_element
+                                    : block_elements;
+      const sizet encoded_size = geometry_encode_block(
+          stream, first_element, element_count, scratch, memory + offset,
+          tables_size + data_capacity - offset);
+      if (encoded_size == 0) {
+        hfree(scratch, temp_allocator);
+        hfree(memory, temp_allocator);
+        return false;
+      }
+
+      GeometryCacheBlock& block = cache_blocks[block_index++];
+      block.offset = offset;
+      block.size = encoded_size;
+      block.stream = s;
+      block.first_element = first_element;
+      block.element_count = element_count;
+      block.padding = 0;
+
+      offset += encoded_size;
+      ++cache_stream.block_count;
+    }
+  }
+  HASSERT(block_index == block_count);
+
+  file_write_binary(filename, memory, offset);
+  if (out_encoded_size) {
+    *out_encoded_size = offset;
+  }
+
+  hfree(scratch, temp_allocator);
+  hfree(memory, temp_allocator);
+  return true;
+}
+
+bool geometry_cache_read_file(cstring filename, u64 source_hash,
+                              Allocator* allocator, GeometryCache& out_cache) {
+  sizet size = 0;
+  u8* memory = (u8*)file_read_binary(filename, allocator, &size);
+  if (memory == nullptr) {
+    return false;
+  }
+
+  GeometryCacheHeader header;
+  bool valid = size >= sizeof(GeometryCacheHeader);
+  if (valid) {
+    memcpy(&header, memory, sizeof(GeometryCacheHeader));
+    const sizet tables_size =
+        sizeof(GeometryCacheHeader) +
+        sizeof(GeometryCacheStream) * (sizet)header.stream_count +
+        sizeof(GeometryCacheBlock) * (sizet)header.block_count;
+    valid = header.magic == k_geometry_cache_magic &&
+            header.version == k_geometry_cache_version &&
+            header.source_hash == source_hash &&
+            header.stream_count <= k_max_geometry_cache_streams &&
+            tables_size <= size;
+  }
+
+  if (valid) {
+    out_cache.memory = memory;
+    out_cache.size = size;
+    out_cache.source_hash = header.source_hash;
+    out_cache.stream_count = header.stream_count;
+    out_cache.block_count = header.block_count;
+    out_cache.streams =
+        (const GeometryCacheStream*)(memory + sizeof(GeometryCacheHeader));
+    out_cache.blocks =
+        (const GeometryCacheBlock*)(out_cache.streams + header.stream_count);
+    out_cache.allocator = allocator;
+
+    for (u32 b = 0; b < header.block_count && valid; ++b) {
+      const GeometryCacheBlock& block = out_cache.blocks[b];
+      valid = block.stream < header.stream_count &&
+              block.offset + block.size <= size &&
+              (u64)block.first_element + block.element_count <=
+                  out_cache.streams[block.stream].count;
+    }
+  }
+
+  if (!valid) {
+    hfree(memory, allocator);
+    out_cache = GeometryCache{};
+    return false;
+  }
+  return true;
+}
+
+void geometry_cache_free(GeometryCache& cache) {
+  if (cache.memory) {
+    hfree(cache.memory, cache.allocator);
+  }
+  cache = GeometryCache{};
+}
+
+sizet geometry_cache_stream_size(const GeometryCache& cache, u32 stream) {
+  const GeometryCacheStream& cache_stream = cache.streams[stream];
+  return (sizet)cache_stream.count * cache_stream.stride;
+}
+
+bool geometry_cache_decode_block(const GeometryCache& cache, u32 block_index,
+                                 void* destination) {
+  const GeometryCacheBlock& block = cache.blocks[block_index];
+  const GeometryCacheStream& stream = cache.streams[block.stream];
+
+  u8* block_destination =
+      (u8*)destination + (sizet)block.first_element * stream.stride;
+  const u8* encoded = cache.memory + block.offset;
+
+  switch (stream.codec) {
+    case GeometryCodec::Vertex:
+      return meshopt_decodeVertexBuffer(block_destination, block.element_count,
+                                        stream.stride, encoded,
+                                        block.size) == 0;
+    case GeometryCodec::Octahedral:
+      if (meshopt_decodeVertexBuffer(block_destination, block.element_count,
+                                     stream.stride, encoded,
+                                     block.size) != 0) {
+        return false;
+      }
+      meshopt_decodeFilterOct(block_destination, block.element_count,
+                              stream.stride);
+      return true;
+    case GeometryCodec::Index:
+      return meshopt_decodeIndexBuffer(block_destination, block.element_count,
+                                       stream.stride, encoded,
+                                       block.size) == 0;
+    default:
+      return false;
+  }
+}
+
+}  // namespace Helix
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+
+//
+// meshoptimizer codec used for a stream of a geometry cache.
+namespace GeometryCodec {
+enum Enum { Vertex, Octahedral, Index, Count };
+
+static cstring s_value_names[] = {"Vertex", "Octahedral", "Index", "Count"};
+
+static cstring ToString(Enum e) {
+  return ((u32)e < Enum::Count ? s_value_names[(int)e] : "unsupported");
+}
+}  // namespace GeometryCodec
+
+// Streams are encoded in blocks of this many elements so they can be decoded
+// by multiple threads.
+static const u32 k_geometry_cache_block_elements = 16384;
+static const u32 k_max_geometry_cache_streams = 8;
+
+//
+// Uncompressed stream given to the writer: count elements of stride bytes.
+// Octahedral streams take four floats per element and store them with the
+// meshopt oct filter as 8 bit (stride 4) or 16 bit (stride 8) vectors. Index
+// streams hold triangle lists with a stride of 2 or 4, the codec keeps the
+// winding but can rotate the vertices of a triangle.
+struct GeometryStreamData {
+  const void* data = nullptr;
+  u32 count = 0;
+  u32 stride = 0;
+  GeometryCodec::Enum codec = GeometryCodec::Vertex;
+};  // struct GeometryStreamData
+
+//
+//
+struct GeometryCacheStream {
+  u32 codec;
+  u32 stride;
+  u32 count;
+  u32 first_block;
+  u32 block_count;
+  u32 padding;
+};  // struct GeometryCacheStream
+
+//
+//
+struct GeometryCacheBlock {
+  u64 offset;
+  u64 size;
+  u32 stream;
+  u32 first_element;
+  u32 element_count;
+  u32 padding;
+};  // struct GeometryCacheBlock
+
+//
+// Compressed geometry read from disk. The tables point inside the file
+// memory, which is owned by the cache.
+struct GeometryCache {
+  u8* memory = nullptr;
+  sizet size = 0;
+
+  u64 source_hash = 0;
+  u32 stream_count = 0;
+  u32 block_count = 0;
+  const GeometryCacheStream* streams = nullptr;
+  const GeometryCacheBlock* blocks = nullptr;
+
+  Allocator* allocator = nullptr;
+};  // struct GeometryCache
+
+// Encodes the streams and writes them. out_encoded_size is optional and
+// receives the file size.
+bool geometry_cache_write_file(cstring filename, u64 source_hash,
+                               const GeometryStreamData* streams,
+                               u32 stream_count, Allocator* temp_allocator,
+                               sizet* out_encoded_size = nullptr);
+// Fails when the file is missing, corrupted or was built from other sources.
+bool geometry_cache_read_file(cstring filename, u64 source_hash,
+                              Allocator* allocator, GeometryCache& out_cache);
+void geometry_cache_free(GeometryCache& cache);
+
+// Size of the decoded stream in bytes.
+sizet geometry_cache_stream_size(const GeometryCache& cache, u32 stream);
+// Decodes a block into 'destination', the memory of its whole stream.
+// Octahedral vectors come out as signed normalized xyz, w is preserved. Can
+// be called from any thread.
+bool geometry_cache_decode_block(const GeometryCache& cache, u32 block_index,
+                                 void* destination);
+
+}  // namespace Helix
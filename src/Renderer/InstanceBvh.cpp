@@ -0,0 +1,804 @@
+#include "Renderer/InstanceBvh.hpp"
+
+#include <float.h>
+#include <vendor/glm/glm/gtc/matrix_transform.hpp>
+#include <vendor/tracy/tracy/Tracy.hpp>
+
+#include "Core/Assert.hpp"
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "Core/Time.hpp"
+#include "vendor/enkiTS/TaskScheduler.h"
+
+namespace Helix {
+
+static const u32 k_bvh_bin_count = 16;
+// Smallest range built or refitted by a task.
+static const u32 k_bvh_parallel_min_items = 2048;
+static const u32 k_bvh_stack_size = 64;
+
+//
+//
+struct BvhBuildItem {
+  glm::vec3 aabb_min;
+  u32 item;
+  glm::vec3 aabb_max;
+  f32 padding;
+};  // struct BvhBuildItem
+
+// Half the surface area, enough to compare SAH costs.
+static inline f32 bvh_area(const glm::vec3& aabb_min,
+                           const glm::vec3& aabb_max) {
+  const glm::vec3 d = aabb_max - aabb_min;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static inline void bvh_union(InstanceBvhNode& node, const InstanceBvhNode& a,
+                             const InstanceBvhNode& b) {
+  node.aabb_min = glm::min(a.aabb_min, b.aabb_min);
+  node.aabb_max = glm::max(a.aabb_max, b.aabb_max);
+}
+
+static inline bool bvh_frustum_overlaps(const glm::vec4* planes,
+                                        u32 plane_count,
+                                        const glm::vec3& aabb_min,
+                                        const glm::vec3& aabb_max) {
+  for (u32 i = 0; i < plane_count; ++i) {
+    const glm::vec4& plane = planes[i];
+    // Corner furthest along the plane normal.
+    const glm::vec3 corner(plane.x >= 0.f ? aabb_max.x : aabb_min.x,
+                           plane.y >= 0.f ? aabb_max.y : aabb_min.y,
+                           plane.z >= 0.f ? aabb_max.z : aabb_min.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline bool bvh_sphere_overlaps(const glm::vec3& center, f32 radius,
+                                       const glm::vec3& aabb_min,
+                                       const glm::vec3& aabb_max) {
+  const glm::vec3 d = center - glm::clamp(center, aabb_min, aabb_max);
+  return glm::dot(d, d) <= radius * radius;
+}
+
+// Entry distance of the ray in the box, FLT_MAX when it misses.
+static inline f32 bvh_ray_distance(const glm::vec3& origin,
+                                   const glm::vec3& inverse_direction,
+                                   const glm::vec3& aabb_min,
+                                   const glm::vec3& aabb_max) {
+  const glm::vec3 t0 = (aabb_min - origin) * inverse_direction;
+  const glm::vec3 t1 = (aabb_max - origin) * inverse_direction;
+  const glm::vec3 near_t = glm::min(t0, t1);
+  const glm::vec3 far_t = glm::max(t0, t1);
+  const f32 enter =
+      glm::max(glm::max(near_t.x, near_t.y), glm::max(near_t.z, 0.f));
+  const f32 exit = glm::min(far_t.x, glm::min(far_t.y, far_t.z));
+  return enter <= exit ? enter : FLT_MAX;
+}
+
+// Visits the nodes accepted by the visitor. Trees deeper than the stack
+// recurse instead of growing it, so that queries don't allocate.
+template <typename Visitor>
+static void bvh_traverse(const InstanceBvhNode* nodes, u32 start,
+                         Visitor& visitor) {
+  u32 stack[k_bvh_stack_size];
+  u32 stack_size = 0;
+  stack[stack_size++] = start;
+
+  while (stack_size) {
+    const InstanceBvhNode& node = nodes[stack[--stack_size]];
+    if (!visitor.overlaps(node)) {
+      continue;
+    }
+    if (node.is_leaf()) {
+      visitor.leaf(node);
+      continue;
+    }
+    for (u32 c = 0; c < 2; ++c) {
+      if (stack_size < k_bvh_stack_size) {
+        stack[stack_size++] = node.children[c];
+      } else {
+        bvh_traverse(nodes, node.children[c], visitor);
+      }
+    }
+  }
+}
+
+void InstanceBvh::init(Allocator* allocator_, u32 initial_capacity) {
+  allocator = allocator_;
+  nodes.init(allocator, initial_capacity * 2);
+  free_nodes.init(allocator, 16);
+  item_leaves.init(allocator, initial_capacity);
+  updated_leaves.init(allocator, initial_capacity);
+  subtrees.init(allocator, 16);
+  top_nodes.init(allocator, 16);
+
+  root = u32_max;
+  leaf_count = 0;
+  topology_changes = 0;
+}
+
+void InstanceBvh::shutdown() {
+  top_nodes.shutdown();
+  subtrees.shutdown();
+  updated_leaves.shutdown();
+  item_leaves.shutdown();
+  free_nodes.shutdown();
+  nodes.shutdown();
+}
+
+u32 InstanceBvh::allocate_node() {
+  if (free_nodes.size) {
+    const u32 node_index = free_nodes[free_nodes.size - 1];
+    free_nodes.pop();
+    return node_index;
+  }
+  nodes.push(InstanceBvhNode{});
+  return nodes.size - 1;
+}
+
+void InstanceBvh::refit_ancestors(u32 node_index) {
+  while (node_index != u32_max) {
+    InstanceBvhNode& node = nodes[node_index];
+    const InstanceBvhNode& left = nodes[node.children[0]];
+    const InstanceBvhNode& right = nodes[node.children[1]];
+    const glm::vec3 aabb_min = glm::min(left.aabb_min, right.aabb_min);
+    const glm::vec3 aabb_max = glm::max(left.aabb_max, right.aabb_max);
+    // Ancestors don't depend on this leaf anymore.
+    if (aabb_min == node.aabb_min && aabb_max == node.aabb_max) {
+      break;
+    }
+    node.aabb_min = aabb_min;
+    node.aabb_max = aabb_max;
+    node_index = node.parent;
+  }
+}
+
+bool InstanceBvh::contains(u32 item) const {
+  return item < item_leaves.size && item_leaves[item] != u32_max;
+}
+
+void InstanceBvh::insert(u32 item, const glm::vec3& aabb_min,
+                         const glm::vec3& aabb_max) {
+  if (contains(item)) {
+    update(item, aabb_min, aabb_max);
+    return;
+  }
+  while (item_leaves.size <= item) {
+    item_leaves.push(u32_max);
+  }
+
+  const u32 leaf = allocate_node();
+  InstanceBvhNode& leaf_node = nodes[leaf];
+  leaf_node.aabb_min = aabb_min;
+  leaf_node.aabb_max = aabb_max;
+  leaf_node.parent = u32_max;
+  leaf_node.item = item;
+  leaf_node.children[0] = u32_max;
+  leaf_node.children[1] = u32_max;
+  item_leaves[item] = leaf;
+  ++leaf_count;
+  ++topology_changes;
+
+  if (root == u32_max) {
+    root = leaf;
+    return;
+  }
+
+  // Descend to the sibling with the lowest SAH cost, each level pays for
+  // the growth of its bounds.
+  u32 sibling = root;
+  while (!nodes[sibling].is_leaf()) {
+    const InstanceBvhNode& node = nodes[sibling];
+    const f32 area = bvh_area(node.aabb_min, node.aabb_max);
+    const f32 combined_area = bvh_area(glm::min(node.aabb_min, aabb_min),
+                                       glm::max(node.aabb_max, aabb_max));
+    const f32 cost = 2.f * combined_area;
+    const f32 inheritance_cost = 2.f * (combined_area - area);
+
+    f32 child_costs[2];
+    for (u32 c = 0; c < 2; ++c) {
+      const InstanceBvhNode& child = nodes[node.children[c]];
+      const f32 union_area = bvh_area(glm::min(child.aabb_min, aabb_min),
+                                      glm::max(child.aabb_max, aabb_max));
+      child_costs[c] =
+          (child.is_leaf() ? union_area
+                           : union_area -
+                                 bvh_area(child.aabb_min, child.aabb_max)) +
+          inheritance_cost;
+    }
+
+    if (cost < child_costs[0] && cost < child_costs[1]) {
+      break;
+    }
+    sibling = child_costs[0] <= child_costs[1] ? node.children[0]
+                                               : node.children[1];
+  }
+
+  const u32 old_parent = nodes[sibling].parent;
+  const u32 new_parent = allocate_node();
+  InstanceBvhNode& parent_node = nodes[new_parent];
+  bvh_union(parent_node, nodes[sibling], nodes[leaf]);
+  parent_node.parent = old_parent;
+  parent_node.item = u32_max;
+  parent_node.children[0] = sibling;
+  parent_node.children[1] = leaf;
+  nodes[sibling].parent = new_parent;
+  nodes[leaf].parent = new_parent;
+
+  if (old_parent == u32_max) {
+    root = new_parent;
+  } else {
+    InstanceBvhNode& grand_parent = nodes[old_parent];
+    grand_parent.children[grand_parent.children[0] == sibling ? 0 : 1] =
+        new_parent;
+    refit_ancestors(old_parent);
+  }
+}
+
+void InstanceBvh::remove(u32 item) {
+  if (!contains(item)) {
+    return;
+  }
+
+  const u32 leaf = item_leaves[item];
+  item_leaves[item] = u32_max;
+  --leaf_count;
+  ++topology_changes;
+
+  const u32 parent = nodes[leaf].parent;
+  nodes[leaf].parent = u32_max;
+  free_nodes.push(leaf);
+  if (parent == u32_max) {
+    root = u32_max;
+    return;
+  }
+
+  // The sibling takes the place of the parent.
+  InstanceBvhNode& parent_node = nodes[parent];
+  const u32 sibling = parent_node.children[parent_node.children[0] == leaf];
+  const u32 grand_parent = parent_node.parent;
+  parent_node.parent = u32_max;
+  free_nodes.push(parent);
+
+  nodes[sibling].parent = grand_parent;
+  if (grand_parent == u32_max) {
+    root = sibling;
+  } else {
+    InstanceBvhNode& grand_parent_node = nodes[grand_parent];
+    grand_parent_node
+        .children[grand_parent_node.children[0] == parent ? 0 : 1] = sibling;
+    refit_ancestors(grand_parent);
+  }
+}
+
+void InstanceBvh::update(u32 item, const glm::vec3& aabb_min,
+                         const glm::vec3& aabb_max) {
+  HASSERT(contains(item));
+  const u32 leaf = item_leaves[item];
+  nodes[leaf].aabb_min = aabb_min;
+  nodes[leaf].aabb_max = aabb_max;
+  updated_leaves.push(leaf);
+}
+
+bool InstanceBvh::needs_rebuild() const {
+  return topology_changes > 64 && topology_changes * 4 > leaf_count;
+}
+
+// Bounds of the range into node and binned SAH split, returns the first item
+// of the right child.
+static u32 bvh_split(BvhBuildItem* items, u32 begin, u32 end,
+                     InstanceBvhNode& node) {
+  glm::vec3 centroid_min(FLT_MAX);
+  glm::vec3 centroid_max(-FLT_MAX);
+  node.aabb_min = glm::vec3(FLT_MAX);
+  node.aabb_max = glm::vec3(-FLT_MAX);
+  for (u32 i = begin; i < end; ++i) {
+    // Centroids are kept doubled.
+    const glm::vec3 centroid = items[i].aabb_min + items[i].aabb_max;
+    centroid_min = glm::min(centroid_min, centroid);
+    centroid_max = glm::max(centroid_max, centroid);
+    node.aabb_min = glm::min(node.aabb_min, items[i].aabb_min);
+    node.aabb_max = glm::max(node.aabb_max, items[i].aabb_max);
+  }
+
+  const glm::vec3 extent = centroid_max - centroid_min;
+  const u32 axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                       : (extent.y > extent.z ? 1 : 2);
+  // Same centroids, any split is as good.
+  if (end - begin == 2 || extent[axis] <= 0.f) {
+    return (begin + end) / 2;
+  }
+
+  u32 bin_counts[k_bvh_bin_count] = {};
+  glm::vec3 bin_min[k_bvh_bin_count];
+  glm::vec3 bin_max[k_bvh_bin_count];
+  for (u32 b = 0; b < k_bvh_bin_count; ++b) {
+    bin_min[b] = glm::vec3(FLT_MAX);
+    bin_max[b] = glm::vec3(-FLT_MAX);
+  }
+
+  const f32 bin_scale = k_bvh_bin_count / extent[axis];
+  const f32 axis_min = centroid_min[axis];
+  auto bin_of = [&](const BvhBuildItem& item) {
+    const f32 centroid = item.aabb_min[axis] + item.aabb_max[axis];
+    const u32 bin = (u32)((centroid - axis_min) * bin_scale);
+    return bin < k_bvh_bin_count ? bin : k_bvh_bin_count - 1;
+  };
+
+  for (u32 i = begin; i < end; ++i) {
+    const u32 bin = bin_of(items[i]);
+    ++bin_counts[bin];
+    bin_min[bin] = glm::min(bin_min[bin], items[i].aabb_min);
+    bin_max[bin] = glm::max(bin_max[bin], items[i].aabb_max);
+  }
+
+  // Cost of the right side of each split plane, swept from the end.
+  f32 right_costs[k_bvh_bin_count];
+  glm::vec3 sweep_min(FLT_MAX);
+  glm::vec3 sweep_max(-FLT_MAX);
+  u32 sweep_count = 0;
+  for (u32 b = k_bvh_bin_count - 1; b > 0; --b) {
+    sweep_min = glm::min(sweep_min, bin_min[b]);
+    sweep_max = glm::max(sweep_max, bin_max[b]);
+    sweep_count += bin_counts[b];
+    right_costs[b - 1] =
+        sweep_count ? sweep_count * bvh_area(sweep_min, sweep_max) : FLT_MAX;
+  }
+
+  u32 best_split = 0;
+  f32 best_cost = FLT_MAX;
+  sweep_min = glm::vec3(FLT_MAX);
+  sweep_max = glm::vec3(-FLT_MAX);
+  sweep_count = 0;
+  for (u32 b = 0; b < k_bvh_bin_count - 1; ++b) {
+    sweep_min = glm::min(sweep_min, bin_min[b]);
+    sweep_max = glm::max(sweep_max, bin_max[b]);
+    sweep_count += bin_counts[b];
+    if (sweep_count == 0 || right_costs[b] == FLT_MAX) {
+      continue;
+    }
+    const f32 cost =
+        sweep_count * bvh_area(sweep_min, sweep_max) + right_costs[b];
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_split = b;
+    }
+  }
+
+  u32 left = begin;
+  u32 right = end;
+  while (left < right) {
+    if (bin_of(items[left]) <= best_split) {
+      ++left;
+    } else {
+      const BvhBuildItem swap = items[left];
+      items[left] = items[--right];
+      items[right] = swap;
+    }
+  }
+  return left == begin || left == end ? (begin + end) / 2 : left;
+}
+
+// Depth first build of a range, the stack must hold end - begin jobs.
+static void bvh_build_subtree(InstanceBvhNode* nodes, BvhBuildItem* items,
+                              InstanceBvhBuildJob* stack,
+                              const InstanceBvhBuildJob& subtree,
+                              u32* item_leaves) {
+  u32 stack_size = 0;
+  stack[stack_size++] = subtree;
+
+  while (stack_size) {
+    const InstanceBvhBuildJob job = stack[--stack_size];
+    InstanceBvhNode& node = nodes[job.node];
+    node.parent = job.parent;
+
+    if (job.end - job.begin == 1) {
+      const BvhBuildItem& item = items[job.begin];
+      node.aabb_min = item.aabb_min;
+      node.aabb_max = item.aabb_max;
+      node.item = item.item;
+      node.children[0] = u32_max;
+      node.children[1] = u32_max;
+      item_leaves[item.item] = job.node;
+      continue;
+    }
+
+    const u32 split = bvh_split(items, job.begin, job.end, node);
+    node.item = u32_max;
+    node.children[0] = job.node + 1;
+    node.children[1] = job.node + 2 * (split - job.begin);
+    stack[stack_size++] = {split, job.end, node.children[1], job.node};
+    stack[stack_size++] = {job.begin, split, node.children[0], job.node};
+  }
+}
+
+//
+//
+struct InstanceBvhBuildTask : public enki::ITaskSet {
+  InstanceBvh* bvh = nullptr;
+  BvhBuildItem* items = nullptr;
+  InstanceBvhBuildJob* stack = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_, u32) override {
+    ZoneScoped;
+    for (u32 i = range_.start; i < range_.end; ++i) {
+      const InstanceBvhBuildJob& subtree = bvh->subtrees[i];
+      bvh_build_subtree(bvh->nodes.data, items, stack + subtree.begin,
+                        subtree, bvh->item_leaves.data);
+    }
+  }
+};  // struct InstanceBvhBuildTask
+
+//
+//
+struct InstanceBvhRefitTask : public enki::ITaskSet {
+  InstanceBvh* bvh = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_, u32) override {
+    ZoneScoped;
+    for (u32 i = range_.start; i < range_.end; ++i) {
+      bvh->refit_subtree(bvh->subtrees[i]);
+    }
+  }
+};  // struct InstanceBvhRefitTask
+
+void InstanceBvh::build(enki::TaskScheduler* task_scheduler) {
+  ZoneScoped;
+
+  const u32 count = leaf_count;
+  BvhBuildItem* items = (BvhBuildItem*)halloca(
+      sizeof(BvhBuildItem) * glm::max(count, 1u), allocator);
+  InstanceBvhBuildJob* stack = (InstanceBvhBuildJob*)halloca(
+      sizeof(InstanceBvhBuildJob) * glm::max(count, 1u), allocator);
+
+  u32 item_count = 0;
+  for (u32 item = 0; item < item_leaves.size; ++item) {
+    const u32 leaf = item_leaves[item];
+    if (leaf != u32_max) {
+      items[item_count++] = {nodes[leaf].aabb_min, item, nodes[leaf].aabb_max,
+                             0.f};
+    }
+  }
+  HASSERT(item_count == count);
+
+  free_nodes.clear();
+  updated_leaves.clear();
+  subtrees.clear();
+  top_nodes.clear();
+  topology_changes = 0;
+  nodes.set_size(count ? count * 2 - 1 : 0);
+  root = count ? 0 : u32_max;
+
+  if (count) {
+    // Splits the top of the tree until the ranges are small enough to be
+    // built by a task each.
+    const u32 task_count =
+        task_scheduler ? task_scheduler->GetNumTaskThreads() * 4 : 1;
+    const u32 split_threshold =
+        task_scheduler ? glm::max(k_bvh_parallel_min_items, count / task_count)
+                       : u32_max;
+
+    u32 stack_size = 0;
+    stack[stack_size++] = {0, count, 0, u32_max};
+    while (stack_size) {
+      const InstanceBvhBuildJob job = stack[--stack_size];
+      if (job.end - job.begin <= split_threshold) {
+        subtrees.push(job);
+        continue;
+      }
+
+      InstanceBvhNode& node = nodes[job.node];
+      node.parent = job.parent;
+      const u32 split = bvh_split(items, job.begin, job.end, node);
+      node.item = u32_max;
+      node.children[0] = job.node + 1;
+      node.children[1] = job.node + 2 * (split - job.begin);
+      top_nodes.push(job.node);
+      stack[stack_size++] = {split, job.end, node.children[1], job.node};
+      stack[stack_size++] = {job.begin, split, node.children[0], job.node};
+    }
+
+    if (task_scheduler && subtrees.size > 1) {
+      InstanceBvhBuildTask task;
+      task.bvh = this;
+      task.items = items;
+      task.stack = stack;
+      task.m_SetSize = subtrees.size;
+      task.m_MinRange = 1;
+      task_scheduler->AddTaskSetToPipe(&task);
+      task_scheduler->WaitforTask(&task);
+    } else {
+      for (u32 i = 0; i < subtrees.size; ++i) {
+        bvh_build_subtree(nodes.data, items, stack + subtrees[i].begin,
+                          subtrees[i], item_leaves.data);
+      }
+    }
+  }
+
+  hfree(stack, allocator);
+  hfree(items, allocator);
+}
+
+void InstanceBvh::refit_subtree(const InstanceBvhBuildJob& subtree) {
+  // Children follow their parent in a built range.
+  const u32 last_node = subtree.node + 2 * (subtree.end - subtree.begin) - 2;
+  for (u32 node_index = last_node + 1; node_index-- > subtree.node;) {
+    InstanceBvhNode& node = nodes[node_index];
+    if (!node.is_leaf()) {
+      bvh_union(node, nodes[node.children[0]], nodes[node.children[1]]);
+    }
+  }
+}
+
+void InstanceBvh::refit(enki::TaskScheduler* task_scheduler) {
+  if (updated_leaves.size == 0) {
+    return;
+  }
+  ZoneScoped;
+
+  if (topology_changes == 0 && updated_leaves.size * 8 > leaf_count) {
+    if (task_scheduler && subtrees.size > 1) {
+      InstanceBvhRefitTask task;
+      task.bvh = this;
+      task.m_SetSize = subtrees.size;
+      task.m_MinRange = 1;
+      task_scheduler->AddTaskSetToPipe(&task);
+      task_scheduler->WaitforTask(&task);
+    } else {
+      for (u32 i = 0; i < subtrees.size; ++i) {
+        refit_subtree(subtrees[i]);
+      }
+    }
+
+    // Top nodes were pushed before their children.
+    for (u32 i = top_nodes.size; i-- > 0;) {
+      InstanceBvhNode& node = nodes[top_nodes[i]];
+      bvh_union(node, nodes[node.children[0]], nodes[node.children[1]]);
+    }
+  } else {
+    for (u32 i = 0; i < updated_leaves.size; ++i) {
+      refit_ancestors(nodes[updated_leaves[i]].parent);
+    }
+  }
+  updated_leaves.clear();
+}
+
+//
+//
+struct BvhFrustumVisitor {
+  const glm::vec4* planes;
+  u32 plane_count;
+  Array<u32>* items;
+
+  bool overlaps(const InstanceBvhNode& node) const {
+    return bvh_frustum_overlaps(planes, plane_count, node.aabb_min,
+                                node.aabb_max);
+  }
+  void leaf(const InstanceBvhNode& node) { items->push(node.item); }
+};  // struct BvhFrustumVisitor
+
+//
+//
+struct BvhSphereVisitor {
+  glm::vec3 center;
+  f32 radius;
+  Array<u32>* items;
+
+  bool overlaps(const InstanceBvhNode& node) const {
+    return bvh_sphere_overlaps(center, radius, node.aabb_min, node.aabb_max);
+  }
+  void leaf(const InstanceBvhNode& node) { items->push(node.item); }
+};  // struct BvhSphereVisitor
+
+//
+//
+struct BvhRayVisitor {
+  glm::vec3 origin;
+  glm::vec3 inverse_direction;
+  f32 closest_distance;
+  u32 closest_item;
+
+  bool overlaps(const InstanceBvhNode& node) const {
+    return bvh_ray_distance(origin, inverse_direction, node.aabb_min,
+                            node.aabb_max) < closest_distance;
+  }
+  void leaf(const InstanceBvhNode& node) {
+    closest_distance = bvh_ray_distance(origin, inverse_direction,
+                                        node.aabb_min, node.aabb_max);
+    closest_item = node.item;
+  }
+};  // struct BvhRayVisitor
+
+void InstanceBvh::frustum_query(const glm::vec4* planes, u32 plane_count,
+                                Array<u32>& out_items) const {
+  if (root == u32_max) {
+    return;
+  }
+  BvhFrustumVisitor visitor{planes, plane_count, &out_items};
+  bvh_traverse(nodes.data, root, visitor);
+}
+
+void InstanceBvh::sphere_query(const glm::vec3& center, f32 radius,
+                               Array<u32>& out_items) const {
+  if (root == u32_max) {
+    return;
+  }
+  BvhSphereVisitor visitor{center, radius, &out_items};
+  bvh_traverse(nodes.data, root, visitor);
+}
+
+u32 InstanceBvh::ray_cast(const glm::vec3& origin, const glm::vec3& direction,
+                          f32 max_distance, f32* out_distance) const {
+  if (root == u32_max) {
+    return u32_max;
+  }
+  BvhRayVisitor visitor{origin, 1.0f / direction, max_distance, u32_max};
+  bvh_traverse(nodes.data, root, visitor);
+  if (out_distance && visitor.closest_item != u32_max) {
+    *out_distance = visitor.closest_distance;
+  }
+  return visitor.closest_item;
+}
+
+void bvh_frustum_planes(const glm::mat4& view_projection,
+                        glm::vec4 out_planes[6]) {
+  const glm::mat4 rows = glm::transpose(view_projection);
+  out_planes[0] = rows[3] + rows[0];
+  out_planes[1] = rows[3] - rows[0];
+  out_planes[2] = rows[3] + rows[1];
+  out_planes[3] = rows[3] - rows[1];
+  out_planes[4] = rows[2];
+  out_planes[5] = rows[3] - rows[2];
+}
+
+void instance_bvh_benchmark(enki::TaskScheduler* task_scheduler,
+                            Allocator* allocator, u32 count) {
+  glm::vec3* aabb_min =
+      (glm::vec3*)halloca(sizeof(glm::vec3) * count, allocator);
+  glm::vec3* aabb_max =
+      (glm::vec3*)halloca(sizeof(glm::vec3) * count, allocator);
+
+  // Boxes of 1 to 5 units in a 1000 units cube.
+  u32 seed = 12345;
+  auto random = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+  };
+  for (u32 i = 0; i < count; ++i) {
+    const glm::vec3 center(random() * 1000.f - 500.f,
+                           random() * 1000.f - 500.f,
+                           random() * 1000.f - 500.f);
+    const glm::vec3 half_size(0.5f + random() * 2.f);
+    aabb_min[i] = center - half_size;
+    aabb_max[i] = center + half_size;
+  }
+
+  InstanceBvh bvh;
+  bvh.init(allocator, count);
+
+  i64 start = Time::now();
+  for (u32 i = 0; i < count; ++i) {
+    bvh.insert(i, aabb_min[i], aabb_max[i]);
+  }
+  const f64 insert_ms = Time::from_milliseconds(start);
+
+  start = Time::now();
+  bvh.build(nullptr);
+  const f64 build_ms = Time::from_milliseconds(start);
+
+  start = Time::now();
+  bvh.build(task_scheduler);
+  const f64 parallel_build_ms = Time::from_milliseconds(start);
+
+  start = Time::now();
+  const glm::vec3 offset(0.25f, -0.25f, 0.5f);
+  for (u32 i = 0; i < count; ++i) {
+    aabb_min[i] += offset;
+    aabb_max[i] += offset;
+    bvh.update(i, aabb_min[i], aabb_max[i]);
+  }
+  bvh.refit(task_scheduler);
+  const f64 refit_ms = Time::from_milliseconds(start);
+
+  Array<u32> results;
+  results.init(allocator, count);
+  u32 mismatches = 0;
+
+  // Camera at the center looking down z.
+  const glm::mat4 view_projection =
+      glm::perspectiveRH_ZO(glm::radians(60.f), 16.f / 9.f, 0.1f, 400.f) *
+      glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f),
+                  glm::vec3(0.f, 1.f, 0.f));
+  glm::vec4 planes[6];
+  bvh_frustum_planes(view_projection, planes);
+
+  start = Time::now();
+  bvh.frustum_query(planes, 6, results);
+  const f64 frustum_ms = Time::from_milliseconds(start);
+  const u32 frustum_count = results.size;
+
+  start = Time::now();
+  u32 linear_count = 0;
+  for (u32 i = 0; i < count; ++i) {
+    linear_count += bvh_frustum_overlaps(planes, 6, aabb_min[i], aabb_max[i]);
+  }
+  const f64 linear_frustum_ms = Time::from_milliseconds(start);
+  mismatches += linear_count != frustum_count;
+
+  const u32 query_count = 1000;
+  glm::vec3* query_points =
+      (glm::vec3*)halloca(sizeof(glm::vec3) * query_count, allocator);
+  for (u32 q = 0; q < query_count; ++q) {
+    query_points[q] = glm::vec3(random() * 1000.f - 500.f,
+                                random() * 1000.f - 500.f,
+                                random() * 1000.f - 500.f);
+  }
+
+  // Light sized spheres.
+  const f32 radius = 25.f;
+  u32 sphere_count = 0;
+  start = Time::now();
+  for (u32 q = 0; q < query_count; ++q) {
+    results.clear();
+    bvh.sphere_query(query_points[q], radius, results);
+    sphere_count += results.size;
+  }
+  const f64 sphere_ms = Time::from_milliseconds(start);
+
+  linear_count = 0;
+  start = Time::now();
+  for (u32 q = 0; q < query_count; ++q) {
+    for (u32 i = 0; i < count; ++i) {
+      linear_count += bvh_sphere_overlaps(query_points[q], radius,
+                                          aabb_min[i], aabb_max[i]);
+    }
+  }
+  const f64 linear_sphere_ms = Time::from_milliseconds(start);
+  mismatches += linear_count != sphere_count;
+
+  // Rays from the origin, as picking from the camera.
+  start = Time::now();
+  for (u32 q = 0; q < query_count; ++q) {
+    results.push(bvh.ray_cast(glm::vec3(0.f), glm::normalize(query_points[q]),
+                              FLT_MAX));
+  }
+  const f64 ray_ms = Time::from_milliseconds(start);
+
+  start = Time::now();
+  for (u32 q = 0; q < query_count; ++q) {
+    const glm::vec3 inverse_direction = 1.0f / glm::normalize(query_points[q]);
+    f32 closest_distance = FLT_MAX;
+    u32 closest_item = u32_max;
+    for (u32 i = 0; i < count; ++i) {
+      const f32 distance = bvh_ray_distance(glm::vec3(0.f), inverse_direction,
+                                            aabb_min[i], aabb_max[i]);
+      if (distance < closest_distance) {
+        closest_distance = distance;
+        closest_item = i;
+      }
+    }
+    mismatches += closest_item != results[results.size - query_count + q];
+  }
+  const f64 linear_ray_ms = Time::from_milliseconds(start);
+
+  HINFO(
+      "Instance BVH {} boxes: insert {:.3f} ms, build {:.3f} ms, parallel "
+      "build {:.3f} ms, refit {:.3f} ms",
+      count, insert_ms, build_ms, parallel_build_ms, refit_ms);
+  HINFO(
+      "Instance BVH queries (bvh / linear): frustum {:.3f} / {:.3f} ms, {} "
+      "spheres {:.3f} / {:.3f} ms, {} rays {:.3f} / {:.3f} ms, {} mismatches",
+      frustum_ms, linear_frustum_ms, query_count, sphere_ms, linear_sphere_ms,
+      query_count, ray_ms, linear_ray_ms, mismatches);
+
+  results.shutdown();
+  bvh.shutdown();
+  hfree(query_points, allocator);
+  hfree(aabb_max, allocator);
+  hfree(aabb_min, allocator);
+}
+
+}  // namespace Helix
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vendor/glm/glm/glm.hpp>
+
+#include "Core/Array.hpp"
+#include "Core/Platform.hpp"
+
+namespace enki {
+class TaskScheduler;
+}
+
+namespace Helix {
+struct Allocator;
+
+//
+// Leaves have no children and hold an item.
+struct InstanceBvhNode {
+  glm::vec3 aabb_min;
+  u32 parent;
+  glm::vec3 aabb_max;
+  u32 item;
+  u32 children[2];
+
+  bool is_leaf() const { return children[0] == u32_max; }
+};  // struct InstanceBvhNode
+
+//
+// Range of items built into the nodes [node, node + 2 * count - 1).
+struct InstanceBvhBuildJob {
+  u32 begin;
+  u32 end;
+  u32 node;
+  u32 parent;
+};  // struct InstanceBvhBuildJob
+
+//
+// Dynamic bounding volume hierarchy over the bounds of small dense item ids,
+// the mesh instance slots for the scene. Items are inserted with a SAH cost
+// descent and the whole tree can be rebuilt with a binned SAH, subtrees being
+// built and refitted by separate tasks.
+struct InstanceBvh {
+  void init(Allocator* allocator, u32 initial_capacity);
+  void shutdown();
+
+  void insert(u32 item, const glm::vec3& aabb_min, const glm::vec3& aabb_max);
+  void remove(u32 item);
+  // Ancestors are enlarged by the next refit.
+  void update(u32 item, const glm::vec3& aabb_min, const glm::vec3& aabb_max);
+  bool contains(u32 item) const;
+
+  void build(enki::TaskScheduler* task_scheduler);
+  // Walks up from the updated leaves, or refits the subtrees of the last
+  // build in parallel when many leaves moved and no item was inserted or
+  // removed since.
+  void refit(enki::TaskScheduler* task_scheduler);
+  // Inserts and removes degrade the tree over time.
+  bool needs_rebuild() const;
+
+  // Planes point inside: dot(plane.xyz, p) + plane.w >= 0.
+  void frustum_query(const glm::vec4* planes, u32 plane_count,
+                     Array<u32>& out_items) const;
+  void sphere_query(const glm::vec3& center, f32 radius,
+                    Array<u32>& out_items) const;
+  // Item with the closest bounds along the ray, u32_max when none is hit.
+  u32 ray_cast(const glm::vec3& origin, const glm::vec3& direction,
+               f32 max_distance, f32* out_distance = nullptr) const;
+
+  u32 allocate_node();
+  void refit_ancestors(u32 node_index);
+  void refit_subtree(const InstanceBvhBuildJob& subtree);
+
+  Array<InstanceBvhNode> nodes;
+  Array<u32> free_nodes;
+  // Leaf of each item, u32_max when the item is not in the tree.
+  Array<u32> item_leaves;
+  Array<u32> updated_leaves;
+  // Subtrees built by tasks and the nodes above them, in build order.
+  Array<InstanceBvhBuildJob> subtrees;
+  Array<u32> top_nodes;
+
+  u32 root = u32_max;
+  u32 leaf_count = 0;
+  // Inserts and removes since the last build, the node layout is only
+  // linear before them.
+  u32 topology_changes = 0;
+
+  Allocator* allocator = nullptr;
+};  // struct InstanceBvh
+
+// World space planes of a view projection with a 0..1 depth range.
+void bvh_frustum_planes(const glm::mat4& view_projection,
+                        glm::vec4 out_planes[6]);
+
+// Logs build, refit and query timings against linear loops on count random
+// boxes.
+void instance_bvh_benchmark(enki::TaskScheduler* task_scheduler,
+                            Allocator* allocator, u32 count = 100000);
+
+}  // namespace Helix
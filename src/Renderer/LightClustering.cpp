@@ -0,0 +1,230 @@
+#include "Renderer/LightClustering.hpp"
+
+#include <float.h>
+#include <math.h>
+
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "Renderer/Scene.hpp"
+
+namespace Helix {
+
+void light_cluster_view_init(LightClusterView& view,
+                             const GPUSceneData& scene_data) {
+  view.world_to_camera = scene_data.view_matrix;
+  view.z_near = scene_data.z_near;
+  view.z_far = scene_data.z_far;
+  view.projection_00 = scene_data.projection_00;
+  view.projection_11 = scene_data.projection_11;
+}
+
+void light_clusters_build_bounds(const LightClusterView& view,
+                                 GPULightClusterBounds* bounds) {
+  // Slice depths grow exponentially from z_near to z_far.
+  const f32 depth_ratio = view.z_far / view.z_near;
+  auto slice_depth = [&](u32 slice) {
+    return view.z_near * powf(depth_ratio, (f32)slice / k_light_cluster_slices);
+  };
+
+  for (u32 slice = 0; slice < k_light_cluster_slices; ++slice) {
+    const f32 near_depth = slice_depth(slice);
+    const f32 far_depth = slice_depth(slice + 1);
+
+    for (u32 y = 0; y < k_light_cluster_tiles_y; ++y) {
+      const f32 ndc_y0 = (f32)y / k_light_cluster_tiles_y * 2.0f - 1.0f;
+      const f32 ndc_y1 = (f32)(y + 1) / k_light_cluster_tiles_y * 2.0f - 1.0f;
+
+      for (u32 x = 0; x < k_light_cluster_tiles_x; ++x) {
+        const f32 ndc_x0 = (f32)x / k_light_cluster_tiles_x * 2.0f - 1.0f;
+        const f32 ndc_x1 =
+            (f32)(x + 1) / k_light_cluster_tiles_x * 2.0f - 1.0f;
+
+        // Corners of the tile on the near and far planes of the slice, the
+        // projection can flip y.
+        glm::vec3 min_corner{FLT_MAX, FLT_MAX, -far_depth};
+        glm::vec3 max_corner{-FLT_MAX, -FLT_MAX, -near_depth};
+        const f32 depths[2] = {near_depth, far_depth};
+        for (u32 d = 0; d < 2; ++d) {
+          const f32 view_x0 = ndc_x0 * depths[d] / view.projection_00;
+          const f32 view_x1 = ndc_x1 * depths[d] / view.projection_00;
+          const f32 view_y0 = ndc_y0 * depths[d] / view.projection_11;
+          const f32 view_y1 = ndc_y1 * depths[d] / view.projection_11;
+          min_corner.x = glm::min(min_corner.x, glm::min(view_x0, view_x1));
+          max_corner.x = glm::max(max_corner.x, glm::max(view_x0, view_x1));
+          min_corner.y = glm::min(min_corner.y, glm::min(view_y0, view_y1));
+          max_corner.y = glm::max(max_corner.y, glm::max(view_y0, view_y1));
+        }
+
+        GPULightClusterBounds& cluster =
+            bounds[(slice * k_light_cluster_tiles_y + y) *
+                       k_light_cluster_tiles_x +
+                   x];
+        cluster.min = glm::vec4(min_corner, 0.f);
+        cluster.max = glm::vec4(max_corner, 0.f);
+      }
+    }
+  }
+}
+
+u32 light_cluster_index(const LightClusterView& view,
+                        const glm::vec3& view_position) {
+  const f32 depth = -view_position.z;
+  const f32 ndc_x = view_position.x * view.projection_00 / depth;
+  const f32 ndc_y = view_position.y * view.projection_11 / depth;
+
+  const u32 tile_x = (u32)glm::clamp((ndc_x * 0.5f + 0.5f) *
+                                         k_light_cluster_tiles_x,
+                                     0.f, k_light_cluster_tiles_x - 1.f);
+  const u32 tile_y = (u32)glm::clamp((ndc_y * 0.5f + 0.5f) *
+                                         k_light_cluster_tiles_y,
+                                     0.f, k_light_cluster_tiles_y - 1.f);
+  const u32 slice = (u32)glm::clamp(
+      logf(depth / view.z_near) *
+          (k_light_cluster_slices / logf(view.z_far / view.z_near)),
+      0.f, k_light_cluster_slices - 1.f);
+  return (slice * k_light_cluster_tiles_y + tile_y) * k_light_cluster_tiles_x +
+         tile_x;
+}
+
+glm::vec4 light_cluster_view_sphere(const LightClusterView& view,
+                                    const GPUPointLight& light) {
+  // Summed left to right as the shader does.
+  const glm::mat4& m = view.world_to_camera;
+  const glm::vec4& p = light.position;
+  const f32 x = m[0].x * p.x + m[1].x * p.y + m[2].x * p.z + m[3].x;
+  const f32 y = m[0].y * p.x + m[1].y * p.y + m[2].y * p.z + m[3].y;
+  const f32 z = m[0].z * p.x + m[1].z * p.y + m[2].z * p.z + m[3].z;
+  return glm::vec4(x, y, z, light.range);
+}
+
+bool light_cluster_test_sphere(const GPULightClusterBounds& bounds,
+                               const glm::vec4& view_sphere) {
+  // Distance from the center to the closest point of the box.
+  const f32 dx = view_sphere.x - glm::min(glm::max(view_sphere.x, bounds.min.x),
+                                          bounds.max.x);
+  const f32 dy = view_sphere.y - glm::min(glm::max(view_sphere.y, bounds.min.y),
+                                          bounds.max.y);
+  const f32 dz = view_sphere.z - glm::min(glm::max(view_sphere.z, bounds.min.z),
+                                          bounds.max.z);
+  const f32 distance_squared = dx * dx + dy * dy + dz * dz;
+  const f32 radius_squared = view_sphere.w * view_sphere.w;
+  return distance_squared <= radius_squared;
+}
+
+void light_clusters_assign(const LightClusterView& view,
+                           const GPUPointLight* lights, u32 light_count,
+                           const GPULightClusterBounds* bounds,
+                           u32* cluster_light_counts,
+                           u32* cluster_light_indices,
+                           Allocator* temp_allocator) {
+  glm::vec4* view_spheres = (glm::vec4*)halloca(
+      sizeof(glm::vec4) * (light_count ? light_count : 1), temp_allocator);
+  for (u32 i = 0; i < light_count; ++i) {
+    view_spheres[i] = light_cluster_view_sphere(view, lights[i]);
+  }
+
+  for (u32 cluster = 0; cluster < k_light_cluster_count; ++cluster) {
+    u32* indices = cluster_light_indices + cluster * k_max_lights_per_cluster;
+    u32 count = 0;
+    for (u32 i = 0; i < light_count && count < k_max_lights_per_cluster;
+         ++i) {
+      if (light_cluster_test_sphere(bounds[cluster], view_spheres[i])) {
+        indices[count++] = i;
+      }
+    }
+    cluster_light_counts[cluster] = count;
+  }
+
+  hfree(view_spheres, temp_allocator);
+}
+
+// Self test ////////////////////////////////////////////////////////////////
+
+static bool clustering_expect(bool condition, cstring what) {
+  if (!condition) {
+    HERROR("Light clustering self test: {}", what);
+  }
+  return condition;
+}
+
+bool light_clustering_self_test(Allocator* allocator) {
+  // Camera at the origin looking down -z with a 90 degrees field of view,
+  // slice 12 spans the depths [10, 12.12].
+  LightClusterView view;
+  view.world_to_camera = glm::mat4(1.0f);
+  view.z_near = 1.0f;
+  view.z_far = 100.f;
+  view.projection_00 = 1.0f;
+  view.projection_11 = 1.0f;
+
+  // Tile (10, 5) of slice 12.
+  static const u32 k_inside_cluster = (12 * k_light_cluster_tiles_y + 5) *
+                                          k_light_cluster_tiles_x +
+                                      10;
+  static const u32 k_light_count = k_max_lights_per_cluster + 3;
+  GPUPointLight* lights = (GPUPointLight*)halloca(
+      sizeof(GPUPointLight) * k_light_count, allocator);
+  lights[0].position = glm::vec4(0.3125f * 11.f, 0.375f * 11.f, -11.f, 0.f);
+  lights[0].range = 0.1f;
+  lights[1].position = glm::vec4(0.f, 0.f, 0.f, 1.f);
+  lights[1].range = 1000.f;
+  lights[2].position = glm::vec4(0.f, 0.f, 10.f, 2.f);
+  lights[2].range = 1.0f;
+  for (u32 i = 3; i < k_light_count; ++i) {
+    lights[i].position = glm::vec4(0.f, 0.f, -50.f, (f32)i);
+    lights[i].range = 1000.f;
+  }
+
+  GPULightClusterBounds* bounds = (GPULightClusterBounds*)halloca(
+      sizeof(GPULightClusterBounds) * k_light_cluster_count, allocator);
+  u32* counts =
+      (u32*)halloca(sizeof(u32) * k_light_cluster_count, allocator);
+  u32* indices = (u32*)halloca(
+      sizeof(u32) * k_light_cluster_count * k_max_lights_per_cluster,
+      allocator);
+  light_clusters_build_bounds(view, bounds);
+  bool passed = true;
+
+  passed &= clustering_expect(
+      light_cluster_index(view, glm::vec3(lights[0].position)) ==
+          k_inside_cluster,
+      "cluster index");
+
+  // The small light is only in its cluster, the large one everywhere and the
+  // one behind the camera nowhere.
+  light_clusters_assign(view, lights, 3, bounds, counts, indices, allocator);
+  bool lists_match = true;
+  for (u32 c = 0; c < k_light_cluster_count; ++c) {
+    const u32* list = indices + c * k_max_lights_per_cluster;
+    if (c == k_inside_cluster) {
+      lists_match &= counts[c] == 2 && list[0] == 0 && list[1] == 1;
+    } else {
+      lists_match &= counts[c] == 1 && list[0] == 1;
+    }
+  }
+  passed &= clustering_expect(lists_match, "cluster lists");
+
+  // Full lists keep the first lights in index order.
+  light_clusters_assign(view, lights, k_light_count, bounds, counts, indices,
+                        allocator);
+  lists_match = true;
+  for (u32 c = 0; c < k_light_cluster_count; ++c) {
+    const u32* list = indices + c * k_max_lights_per_cluster;
+    const u32 first = c == k_inside_cluster ? 0 : 1;
+    lists_match &= counts[c] == k_max_lights_per_cluster &&
+                   list[0] == first &&
+                   list[k_max_lights_per_cluster - 1] ==
+                       k_max_lights_per_cluster + first;
+  }
+  passed &= clustering_expect(lists_match, "full cluster lists");
+
+  hfree(indices, allocator);
+  hfree(counts, allocator);
+  hfree(bounds, allocator);
+  hfree(lights, allocator);
+
+  HINFO("Light clustering self test {}", passed ? "passed" : "failed");
+  return passed;
+}
+
+}  // namespace Helix
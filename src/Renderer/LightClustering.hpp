@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vendor/glm/glm/glm.hpp>
+
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+struct GPUPointLight;
+struct GPUSceneData;
+
+// Light clusters ///////////////////////////////////////////////////////////
+// The view frustum is split in screen tiles and exponential depth slices.
+// light_clustering.glsl lists the point lights touching each cluster and the
+// lighting shaders only loop over the list of their pixel cluster. The
+// constants must match light_clusters.h.
+//
+// The CPU version below is the reference of the compute shader: it runs the
+// same operations in the same order, which the shader marks as precise, so
+// both produce the same lists.
+
+static const u32 k_light_cluster_tiles_x = 16;
+static const u32 k_light_cluster_tiles_y = 8;
+static const u32 k_light_cluster_slices = 24;
+static const u32 k_light_cluster_count =
+    k_light_cluster_tiles_x * k_light_cluster_tiles_y * k_light_cluster_slices;
+// Lights past this count are dropped from the cluster.
+static const u32 k_max_lights_per_cluster = 128;
+
+// Cluster data buffer: the light count of every cluster followed by their
+// light index lists, k_max_lights_per_cluster entries each.
+static const u32 k_light_cluster_data_size =
+    sizeof(u32) * k_light_cluster_count * (1 + k_max_lights_per_cluster);
+
+//
+// View space AABB of a cluster, w is unused.
+struct GPULightClusterBounds {
+  glm::vec4 min;
+  glm::vec4 max;
+};  // struct GPULightClusterBounds
+
+//
+// Camera of the light clustering, the scene constants read by the shader.
+struct LightClusterView {
+  glm::mat4 world_to_camera;
+
+  f32 z_near = 0.1f;
+  f32 z_far = 1000.f;
+  f32 projection_00 = 1.0f;
+  f32 projection_11 = 1.0f;
+};  // struct LightClusterView
+
+void light_cluster_view_init(LightClusterView& view,
+                             const GPUSceneData& scene_data);
+// The bounds only depend on the projection. They are built on the CPU and
+// read by both versions of the clustering.
+void light_clusters_build_bounds(const LightClusterView& view,
+                                 GPULightClusterBounds* bounds);
+
+// Same as light_cluster_index in light_clusters.h.
+u32 light_cluster_index(const LightClusterView& view,
+                        const glm::vec3& view_position);
+// View space center of the light and its range in w.
+glm::vec4 light_cluster_view_sphere(const LightClusterView& view,
+                                    const GPUPointLight& light);
+bool light_cluster_test_sphere(const GPULightClusterBounds& bounds,
+                               const glm::vec4& view_sphere);
+
+// As light_clustering.glsl: fills the counts and the index lists of every
+// cluster, lights are listed in index order.
+void light_clusters_assign(const LightClusterView& view,
+                           const GPUPointLight* lights, u32 light_count,
+                           const GPULightClusterBounds* bounds,
+                           u32* cluster_light_counts,
+                           u32* cluster_light_indices,
+                           Allocator* temp_allocator);
+
+// Assigns fixed lights, one inside a single cluster, one covering the view,
+// one behind the camera and enough to fill the lists, and compares the lists
+// with their expected values. Logs the mismatches, returns false if there
+// are any.
+bool light_clustering_self_test(Allocator* allocator);
+
+}  // namespace Helix
@@ -0,0 +1,243 @@
+#include "Renderer/MatrixBatch.hpp"
+
+#include <emmintrin.h>
+#include <vendor/glm/glm/gtc/matrix_transform.hpp>
+#include <vendor/tracy/tracy/Tracy.hpp>
+
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "Core/Time.hpp"
+#include "vendor/enkiTS/TaskScheduler.h"
+
+namespace Helix {
+
+// Only SSE2 is used, it is the baseline of every x64 target.
+#define HELIX_SHUFFLE(v, x, y, z, w) \
+  _mm_shuffle_ps((v), (v), _MM_SHUFFLE((w), (z), (y), (x)))
+
+struct Matrix4x4 {
+  __m128 columns[4];
+};  // struct Matrix4x4
+
+static inline Matrix4x4 matrix_load(const glm::mat4& m) {
+  const f32* data = &m[0][0];
+  return {{_mm_loadu_ps(data), _mm_loadu_ps(data + 4), _mm_loadu_ps(data + 8),
+           _mm_loadu_ps(data + 12)}};
+}
+
+static inline void matrix_store(const Matrix4x4& m, glm::mat4& out) {
+  f32* data = &out[0][0];
+  _mm_storeu_ps(data, m.columns[0]);
+  _mm_storeu_ps(data + 4, m.columns[1]);
+  _mm_storeu_ps(data + 8, m.columns[2]);
+  _mm_storeu_ps(data + 12, m.columns[3]);
+}
+
+// a * v, where v is a column of the right matrix.
+static inline __m128 matrix_transform(const Matrix4x4& a, __m128 v) {
+  __m128 result = _mm_mul_ps(a.columns[0], HELIX_SHUFFLE(v, 0, 0, 0, 0));
+  result = _mm_add_ps(result,
+                      _mm_mul_ps(a.columns[1], HELIX_SHUFFLE(v, 1, 1, 1, 1)));
+  result = _mm_add_ps(result,
+                      _mm_mul_ps(a.columns[2], HELIX_SHUFFLE(v, 2, 2, 2, 2)));
+  return result;
+}
+
+static inline Matrix4x4 matrix_multiply_affine(const Matrix4x4& a,
+                                               const Matrix4x4& b) {
+  // The last row of b is 0 0 0 1: only the translation adds a's fourth column.
+  Matrix4x4 result;
+  result.columns[0] = matrix_transform(a, b.columns[0]);
+  result.columns[1] = matrix_transform(a, b.columns[1]);
+  result.columns[2] = matrix_transform(a, b.columns[2]);
+  result.columns[3] =
+      _mm_add_ps(matrix_transform(a, b.columns[3]), a.columns[3]);
+  return result;
+}
+
+static inline __m128 vector_cross3(__m128 a, __m128 b) {
+  const __m128 a_yzx = HELIX_SHUFFLE(a, 1, 2, 0, 3);
+  const __m128 b_yzx = HELIX_SHUFFLE(b, 1, 2, 0, 3);
+  const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+  return HELIX_SHUFFLE(c, 1, 2, 0, 3);
+}
+
+// Dot product of xyz, broadcast to every lane.
+static inline __m128 vector_dot3(__m128 a, __m128 b) {
+  const __m128 m = _mm_mul_ps(a, b);
+  return _mm_add_ps(_mm_add_ps(HELIX_SHUFFLE(m, 0, 0, 0, 0),
+                               HELIX_SHUFFLE(m, 1, 1, 1, 1)),
+                    HELIX_SHUFFLE(m, 2, 2, 2, 2));
+}
+
+// Columns of inverse(transpose(m)). The rows of the inverse 3x3 are the
+// cross products of the columns divided by the determinant, and their w is
+// minus the inverse translation.
+static inline Matrix4x4 matrix_normal_affine(const Matrix4x4& m) {
+  const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  const __m128 c0 = _mm_and_ps(m.columns[0], xyz_mask);
+  const __m128 c1 = _mm_and_ps(m.columns[1], xyz_mask);
+  const __m128 c2 = _mm_and_ps(m.columns[2], xyz_mask);
+  const __m128 t = _mm_and_ps(m.columns[3], xyz_mask);
+
+  __m128 r0 = vector_cross3(c1, c2);
+  __m128 r1 = vector_cross3(c2, c0);
+  __m128 r2 = vector_cross3(c0, c1);
+  const __m128 inverse_determinant =
+      _mm_div_ps(_mm_set1_ps(1.0f), vector_dot3(c0, r0));
+  r0 = _mm_mul_ps(r0, inverse_determinant);
+  r1 = _mm_mul_ps(r1, inverse_determinant);
+  r2 = _mm_mul_ps(r2, inverse_determinant);
+
+  const __m128 w_axis = _mm_set_ps(-1.0f, 0.f, 0.f, 0.f);
+  Matrix4x4 result;
+  result.columns[0] = _mm_add_ps(r0, _mm_mul_ps(w_axis, vector_dot3(r0, t)));
+  result.columns[1] = _mm_add_ps(r1, _mm_mul_ps(w_axis, vector_dot3(r1, t)));
+  result.columns[2] = _mm_add_ps(r2, _mm_mul_ps(w_axis, vector_dot3(r2, t)));
+  result.columns[3] = _mm_set_ps(1.0f, 0.f, 0.f, 0.f);
+  return result;
+}
+
+void matrix_batch_multiply_affine(const glm::mat4* a, const glm::mat4* b,
+                                  glm::mat4* out, u32 count) {
+  for (u32 i = 0; i < count; ++i) {
+    matrix_store(matrix_multiply_affine(matrix_load(a[i]), matrix_load(b[i])),
+                 out[i]);
+  }
+}
+
+void matrix_batch_multiply_affine(const glm::mat4* a, const glm::mat4& b,
+                                  glm::mat4* out, u32 count) {
+  const Matrix4x4 right = matrix_load(b);
+  for (u32 i = 0; i < count; ++i) {
+    matrix_store(matrix_multiply_affine(matrix_load(a[i]), right), out[i]);
+  }
+}
+
+void matrix_batch_inverse_affine(const glm::mat4* m, glm::mat4* out,
+                                 u32 count) {
+  for (u32 i = 0; i < count; ++i) {
+    // The inverse is the transpose of the normal matrix.
+    Matrix4x4 result = matrix_normal_affine(matrix_load(m[i]));
+    _MM_TRANSPOSE4_PS(result.columns[0], result.columns[1], result.columns[2],
+                      result.columns[3]);
+    matrix_store(result, out[i]);
+  }
+}
+
+void matrix_batch_normal_matrix(const glm::mat4* m, glm::mat4* out,
+                                u32 count) {
+  for (u32 i = 0; i < count; ++i) {
+    matrix_store(matrix_normal_affine(matrix_load(m[i])), out[i]);
+  }
+}
+
+void matrix_batch_model_normal(const glm::mat4* world, const glm::mat4& right,
+                               glm::mat4* out_model, glm::mat4* out_normal,
+                               u32 count) {
+  const Matrix4x4 right_matrix = matrix_load(right);
+  for (u32 i = 0; i < count; ++i) {
+    const Matrix4x4 model =
+        matrix_multiply_affine(matrix_load(world[i]), right_matrix);
+    matrix_store(model, out_model[i]);
+    matrix_store(matrix_normal_affine(model), out_normal[i]);
+  }
+}
+
+//
+//
+struct MatrixBatchModelNormalTask : public enki::ITaskSet {
+  const glm::mat4* world = nullptr;
+  const glm::mat4* right = nullptr;
+  glm::mat4* out_model = nullptr;
+  glm::mat4* out_normal = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_, u32) override {
+    ZoneScoped;
+    const u32 count = range_.end - range_.start;
+    matrix_batch_model_normal(world + range_.start, *right,
+                              out_model + range_.start,
+                              out_normal + range_.start, count);
+  }
+};  // struct MatrixBatchModelNormalTask
+
+void matrix_batch_model_normal(enki::TaskScheduler* task_scheduler,
+                               const glm::mat4* world, const glm::mat4& right,
+                               glm::mat4* out_model, glm::mat4* out_normal,
+                               u32 count, u32 min_range) {
+  if (task_scheduler == nullptr || count <= min_range) {
+    matrix_batch_model_normal(world, right, out_model, out_normal, count);
+    return;
+  }
+
+  MatrixBatchModelNormalTask task;
+  task.world = world;
+  task.right = &right;
+  task.out_model = out_model;
+  task.out_normal = out_normal;
+  task.m_SetSize = count;
+  task.m_MinRange = min_range;
+  task_scheduler->AddTaskSetToPipe(&task);
+  task_scheduler->WaitforTask(&task);
+}
+
+void matrix_batch_benchmark(enki::TaskScheduler* task_scheduler,
+                            Allocator* allocator, u32 count) {
+  glm::mat4* world = (glm::mat4*)halloca(sizeof(glm::mat4) * count, allocator);
+  glm::mat4* model = (glm::mat4*)halloca(sizeof(glm::mat4) * count, allocator);
+  glm::mat4* normal =
+      (glm::mat4*)halloca(sizeof(glm::mat4) * count, allocator);
+
+  // Rotation, non uniform scale and translation.
+  for (u32 i = 0; i < count; ++i) {
+    const f32 angle = (f32)i * 0.37f;
+    const glm::vec3 axis =
+        glm::normalize(glm::vec3(glm::sin(angle), 1.0f, glm::cos(angle)));
+    glm::mat4 m = glm::translate(glm::mat4(1.0f),
+                                 glm::vec3((f32)(i % 97), (f32)(i % 13), 1.0f));
+    m = glm::rotate(m, angle, axis);
+    world[i] = glm::scale(m, glm::vec3(1.0f + (i % 5), 2.0f, 0.5f));
+  }
+  const glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(0.01f));
+
+  i64 start = Time::now();
+  for (u32 i = 0; i < count; ++i) {
+    model[i] = world[i] * scale;
+    normal[i] = glm::inverse(glm::transpose(model[i]));
+  }
+  const f64 glm_ms = Time::from_milliseconds(start);
+
+  f32 max_error = 0.f;
+  glm::mat4 reference_model = model[count - 1];
+  glm::mat4 reference_normal = normal[count - 1];
+
+  start = Time::now();
+  matrix_batch_model_normal(world, scale, model, normal, count);
+  const f64 serial_ms = Time::from_milliseconds(start);
+
+  for (u32 c = 0; c < 4; ++c) {
+    for (u32 r = 0; r < 4; ++r) {
+      max_error = glm::max(
+          max_error, glm::abs(reference_model[c][r] - model[count - 1][c][r]));
+      max_error =
+          glm::max(max_error, glm::abs(reference_normal[c][r] -
+                                       normal[count - 1][c][r]));
+    }
+  }
+
+  start = Time::now();
+  matrix_batch_model_normal(task_scheduler, world, scale, model, normal,
+                            count);
+  const f64 parallel_ms = Time::from_milliseconds(start);
+
+  HINFO(
+      "Matrix batch {} instances: glm {:.3f} ms, sse {:.3f} ms, sse parallel "
+      "{:.3f} ms, max error {}",
+      count, glm_ms, serial_ms, parallel_ms, max_error);
+
+  hfree(normal, allocator);
+  hfree(model, allocator);
+  hfree(world, allocator);
+}
+
+}  // namespace Helix
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vendor/glm/glm/glm.hpp>
+
+#include "Core/Platform.hpp"
+
+namespace enki {
+class TaskScheduler;
+}
+
+namespace Helix {
+struct Allocator;
+
+// Matrix batches /////////////////////////////////////////////////////////
+// SSE kernels over contiguous arrays of column major affine matrices, the
+// last row is assumed to be 0 0 0 1. Every matrix is loaded before its result
+// is stored, so outputs can alias the inputs.
+
+// out[i] = a[i] * b[i]
+void matrix_batch_multiply_affine(const glm::mat4* a, const glm::mat4* b,
+                                  glm::mat4* out, u32 count);
+// out[i] = a[i] * b
+void matrix_batch_multiply_affine(const glm::mat4* a, const glm::mat4& b,
+                                  glm::mat4* out, u32 count);
+// Inverse of the 3x3 part plus translation.
+void matrix_batch_inverse_affine(const glm::mat4* m, glm::mat4* out,
+                                 u32 count);
+// inverse(transpose(m)), the normal matrix read by the shaders.
+void matrix_batch_normal_matrix(const glm::mat4* m, glm::mat4* out,
+                                u32 count);
+// out_model[i] = world[i] * right and its normal matrix in a single pass.
+void matrix_batch_model_normal(const glm::mat4* world, const glm::mat4& right,
+                               glm::mat4* out_model, glm::mat4* out_normal,
+                               u32 count);
+
+// Same as matrix_batch_model_normal, split in chunks of at least min_range
+// matrices over the task scheduler threads. Small batches run inline.
+void matrix_batch_model_normal(enki::TaskScheduler* task_scheduler,
+                               const glm::mat4* world, const glm::mat4& right,
+                               glm::mat4* out_model, glm::mat4* out_normal,
+                               u32 count, u32 min_range = 2048);
+
+// Logs the timings of the glm path and of the batch kernels, serial and
+// parallel, on count random affine matrices.
+void matrix_batch_benchmark(enki::TaskScheduler* task_scheduler,
+                            Allocator* allocator, u32 count = 100000);
+
+}  // namespace Helix
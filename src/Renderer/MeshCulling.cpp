@@ -0,0 +1,526 @@
+#include "Renderer/MeshCulling.hpp"
+
+#include <emmintrin.h>
+#include <string.h>
+#include <vendor/glm/glm/gtc/matrix_transform.hpp>
+#include <vendor/glm/glm/gtc/type_ptr.hpp>
+
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "Renderer/Scene.hpp"
+
+namespace Helix {
+
+static const u32 k_culled_mesh_index = 0xffffffff;
+// The shaders inflate the bounding spheres by 10%.
+static const f32 k_culling_radius_scale = 1.1f;
+
+bool culling_project_sphere(const glm::vec3& center, f32 radius, f32 z_near,
+                            f32 projection_00, f32 projection_11,
+                            glm::vec4& out_aabb) {
+  // Check if the sphere intersects with the near plane
+  if (-center.z - radius < z_near) return false;
+
+  const glm::vec2 cx = glm::vec2(center.x, -center.z);
+  const glm::vec2 vx = glm::vec2(sqrtf(glm::dot(cx, cx) - radius * radius),
+                                 radius);
+  const glm::vec2 minx = glm::mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+  const glm::vec2 maxx = glm::mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+  const glm::vec2 cy = glm::vec2(-center.y, -center.z);
+  const glm::vec2 vy = glm::vec2(sqrtf(glm::dot(cy, cy) - radius * radius),
+                                 radius);
+  const glm::vec2 miny = glm::mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+  const glm::vec2 maxy = glm::mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+  const glm::vec4 aabb = glm::vec4(
+      minx.x / minx.y * projection_00, miny.x / miny.y * projection_11,
+      maxx.x / maxx.y * projection_00, maxy.x / maxy.y * projection_11);
+  out_aabb = glm::vec4(aabb.x, aabb.w, aabb.z, aabb.y) *
+                 glm::vec4(0.5f, -0.5f, 0.5f, -0.5f) +
+             glm::vec4(0.5f);  // clip space -> uv space
+  return true;
+}
+
+void mesh_culling_view_init(MeshCullingView& view,
+                            const GPUSceneData& scene_data, bool late) {
+  const bool frozen = scene_data.freeze_occlusion_camera != 0;
+  view.world_to_camera =
+      frozen ? scene_data.view_matrix_debug : scene_data.view_matrix;
+  view.occlusion_view_projection = frozen ? scene_data.view_projection_debug
+                                          : scene_data.previous_view_projection;
+  view.eye = scene_data.camera_position;
+  for (u32 i = 0; i < 6; ++i) {
+    view.frustum_planes[i] = scene_data.frustum_planes[i];
+  }
+  view.z_near = scene_data.z_near;
+  view.projection_00 = scene_data.projection_00;
+  view.projection_11 = scene_data.projection_11;
+  view.frustum_cull = scene_data.frustum_cull_meshes != 0;
+  view.pyramid_scale = late ? glm::vec2(scene_data.render_scale)
+                            : glm::vec2(scene_data.render_scale.z,
+                                        scene_data.render_scale.w);
+}
+
+// Linear filtering with a max reduction and clamp to edge: the maximum of the
+// 2x2 texels around uv.
+static f32 sample_depth_max(const f32* texels, u32 width, u32 height,
+                            const glm::vec2& uv) {
+  const f32 x = uv.x * width - 0.5f;
+  const f32 y = uv.y * height - 0.5f;
+  const i32 x0 = glm::clamp((i32)floorf(x), 0, (i32)width - 1);
+  const i32 y0 = glm::clamp((i32)floorf(y), 0, (i32)height - 1);
+  const i32 x1 = glm::min(x0 + 1, (i32)width - 1);
+  const i32 y1 = glm::min(y0 + 1, (i32)height - 1);
+
+  return glm::max(
+      glm::max(texels[y0 * width + x0], texels[y0 * width + x1]),
+      glm::max(texels[y1 * width + x0], texels[y1 * width + x1]));
+}
+
+void culling_depth_pyramid_build(CullingDepthPyramid& pyramid,
+                                 const f32* depth, u32 width, u32 height,
+                                 Allocator* allocator) {
+  culling_depth_pyramid_free(pyramid);
+  if (width < 4 || height < 4) {
+    return;
+  }
+
+  // Same size as DepthPyramidPass: previous power of two, halved.
+  u32 pyramid_width = 1;
+  while (pyramid_width * 2 <= width) pyramid_width *= 2;
+  u32 pyramid_height = 1;
+  while (pyramid_height * 2 <= height) pyramid_height *= 2;
+  pyramid.width = pyramid_width / 2;
+  pyramid.height = pyramid_height / 2;
+  pyramid.allocator = allocator;
+
+  const f32* source = depth;
+  u32 source_width = width;
+  u32 source_height = height;
+  u32 level_width = pyramid.width;
+  u32 level_height = pyramid.height;
+  while (level_width >= 2 && level_height >= 2 &&
+         pyramid.level_count < k_max_culling_depth_levels) {
+    f32* level = (f32*)halloca(sizeof(f32) * level_width * level_height,
+                               allocator);
+    for (u32 y = 0; y < level_height; ++y) {
+      for (u32 x = 0; x < level_width; ++x) {
+        const glm::vec2 uv((x + 0.5f) / level_width, (y + 0.5f) / level_height);
+        level[y * level_width + x] =
+            sample_depth_max(source, source_width, source_height, uv);
+      }
+    }
+    pyramid.levels[pyramid.level_count++] = level;
+
+    source = level;
+    source_width = level_width;
+    source_height = level_height;
+    level_width /= 2;
+    level_height /= 2;
+  }
+}
+
+void culling_depth_pyramid_free(CullingDepthPyramid& pyramid) {
+  for (u32 i = 0; i < pyramid.level_count; ++i) {
+    hfree(pyramid.levels[i], pyramid.allocator);
+  }
+  pyramid.width = 0;
+  pyramid.height = 0;
+  pyramid.level_count = 0;
+}
+
+f32 culling_depth_pyramid_sample(const CullingDepthPyramid& pyramid,
+                                 const glm::vec2& uv, f32 level) {
+  // Nearest mip, clamped to the pyramid levels.
+  const f32 max_level = (f32)(pyramid.level_count - 1);
+  const u32 mip =
+      level > 0.f ? (u32)glm::min(floorf(level + 0.5f), max_level) : 0;
+  const u32 width = glm::max(pyramid.width >> mip, 1u);
+  const u32 height = glm::max(pyramid.height >> mip, 1u);
+  return sample_depth_max(pyramid.levels[mip], width, height, uv);
+}
+
+static void write_draw_command(GPUMeshDrawCommand& command,
+                               u32 instance_index, const GPUMeshData& mesh) {
+  memset(&command, 0, sizeof(GPUMeshDrawCommand));
+  command.mesh_index = instance_index;
+  command.indirect.instanceCount = 1;
+  command.indirect.vertexOffset = mesh.vertex_offset;
+#if NVIDIA
+  command.indirectMS.taskCount = (mesh.meshlet_count + 31) / 32;
+  command.indirectMS.firstTask = mesh.meshlet_offset / 32;
+#else
+  command.firstTask = mesh.meshlet_offset / 32;
+  command.indirectMS.groupCountX = (mesh.meshlet_count + 31) / 32;
+  command.indirectMS.groupCountY = 1;
+  command.indirectMS.groupCountZ = 1;
+#endif  // NVIDIA
+}
+
+static bool occlusion_visible(const MeshCullingView& view,
+                              const glm::vec4& world_center,
+                              const glm::vec4& view_center, f32 radius) {
+  const CullingDepthPyramid& pyramid = *view.depth_pyramid;
+
+  glm::vec4 aabb;
+  if (!culling_project_sphere(glm::vec3(view_center), radius, view.z_near,
+                              view.projection_00, view.projection_11, aabb)) {
+    return true;
+  }
+
+  // Only the rendered part of the pyramid is sampled.
+  const glm::vec2& scale = view.pyramid_scale;
+  const f32 width = (aabb.z - aabb.x) * pyramid.width * scale.x;
+  const f32 height = (aabb.w - aabb.y) * pyramid.height * scale.y;
+  const f32 level = floorf(log2f(glm::max(width, height)));
+
+  glm::vec2 uv = (glm::vec2(aabb.x, aabb.y) + glm::vec2(aabb.z, aabb.w)) * 0.5f;
+  uv.y = 1.0f - uv.y;
+  uv *= scale;
+
+  f32 depth = culling_depth_pyramid_sample(pyramid, uv, level);
+  // Sample also 4 corners
+  const glm::vec2 corners[4] = {glm::vec2(aabb.x, 1.0f - aabb.y),
+                                glm::vec2(aabb.z, 1.0f - aabb.w),
+                                glm::vec2(aabb.x, 1.0f - aabb.w),
+                                glm::vec2(aabb.z, 1.0f - aabb.y)};
+  for (u32 i = 0; i < 4; ++i) {
+    depth = glm::max(depth, culling_depth_pyramid_sample(
+                                pyramid, corners[i] * scale, level));
+  }
+
+  const glm::vec3 dir =
+      glm::normalize(glm::vec3(view.eye) - glm::vec3(world_center));
+  const glm::vec4 screen_space_center =
+      view.occlusion_view_projection *
+      glm::vec4(glm::vec3(world_center) + dir * radius, 1.0f);
+  const f32 depth_sphere = screen_space_center.z / screen_space_center.w;
+  return depth_sphere <= depth;
+}
+
+// Culls up to four instances, returns a bit per visible lane. The spheres
+// are transformed and tested against the frustum planes four at a time.
+static u32 cull_instances(const MeshCullingView& view,
+                          const MeshCullingInput& input,
+                          const u32* instance_indices, u32 lane_count) {
+  alignas(16) f32 world_centers[4][4] = {};
+  alignas(16) f32 view_centers[4][4] = {};
+  alignas(16) f32 radii[4] = {};
+
+  const f32* camera = &view.world_to_camera[0][0];
+  const __m128 camera_columns[4] = {
+      _mm_loadu_ps(camera), _mm_loadu_ps(camera + 4), _mm_loadu_ps(camera + 8),
+      _mm_loadu_ps(camera + 12)};
+
+  for (u32 lane = 0; lane < lane_count; ++lane) {
+    const GPUMeshInstanceData& instance =
+        input.instances[instance_indices[lane]];
+    const glm::vec4& bounds = input.mesh_bounds[instance.mesh_index];
+    const f32* model = &instance.world[0][0];
+    const __m128 c0 = _mm_loadu_ps(model);
+    const __m128 c1 = _mm_loadu_ps(model + 4);
+    const __m128 c2 = _mm_loadu_ps(model + 8);
+    const __m128 c3 = _mm_loadu_ps(model + 12);
+
+    __m128 world_center = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(bounds.x)), c3);
+    world_center =
+        _mm_add_ps(world_center, _mm_mul_ps(c1, _mm_set1_ps(bounds.y)));
+    world_center =
+        _mm_add_ps(world_center, _mm_mul_ps(c2, _mm_set1_ps(bounds.z)));
+    _mm_store_ps(world_centers[lane], world_center);
+
+    __m128 view_center = _mm_setzero_ps();
+    for (u32 c = 0; c < 4; ++c) {
+      view_center = _mm_add_ps(
+          view_center, _mm_mul_ps(camera_columns[c],
+                                  _mm_set1_ps(world_centers[lane][c])));
+    }
+    _mm_store_ps(view_centers[lane], view_center);
+
+    // length(model[0]) in the shaders, w included.
+    const __m128 square = _mm_mul_ps(c0, c0);
+    alignas(16) f32 squares[4];
+    _mm_store_ps(squares, square);
+    radii[lane] = bounds.w *
+                  sqrtf(squares[0] + squares[1] + squares[2] + squares[3]) *
+                  k_culling_radius_scale;
+  }
+
+  // Transpose the centers to test the lanes against a plane at once.
+  __m128 xs = _mm_load_ps(view_centers[0]);
+  __m128 ys = _mm_load_ps(view_centers[1]);
+  __m128 zs = _mm_load_ps(view_centers[2]);
+  __m128 ws = _mm_load_ps(view_centers[3]);
+  _MM_TRANSPOSE4_PS(xs, ys, zs, ws);
+  const __m128 negative_radii =
+      _mm_sub_ps(_mm_setzero_ps(), _mm_load_ps(radii));
+
+  u32 visible_mask = (1u << lane_count) - 1;
+  if (view.frustum_cull) {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (u32 i = 0; i < 6; ++i) {
+      const glm::vec4& plane = view.frustum_planes[i];
+      __m128 distance = _mm_mul_ps(xs, _mm_set1_ps(plane.x));
+      distance = _mm_add_ps(distance, _mm_mul_ps(ys, _mm_set1_ps(plane.y)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(zs, _mm_set1_ps(plane.z)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(ws, _mm_set1_ps(plane.w)));
+      inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negative_radii));
+    }
+    visible_mask &= (u32)_mm_movemask_ps(inside);
+  }
+
+  if (view.depth_pyramid && view.depth_pyramid->level_count) {
+    for (u32 lane = 0; lane < lane_count; ++lane) {
+      if ((visible_mask & (1u << lane)) &&
+          !occlusion_visible(view, glm::make_vec4(world_centers[lane]),
+                             glm::make_vec4(view_centers[lane]),
+                             radii[lane])) {
+        visible_mask &= ~(1u << lane);
+      }
+    }
+  }
+  return visible_mask;
+}
+
+static bool is_opaque(const MeshCullingInput& input, u32 instance_index) {
+  const u32 mesh_index = input.instances[instance_index].mesh_index;
+  return (input.materials[mesh_index].flags &
+          (DrawFlags_AlphaMask | DrawFlags_Transparent)) == 0;
+}
+
+void mesh_culling_early(const MeshCullingView& view,
+                        const MeshCullingInput& input,
+                        GPUMeshDrawCommand* early_commands,
+                        GPUMeshDrawCommand* late_commands,
+                        GPUMeshDrawCounts& counts) {
+  counts.opaque_mesh_visible_count = 0;
+  counts.opaque_mesh_culled_count = 0;
+  counts.transparent_mesh_visible_count = 0;
+  counts.transparent_mesh_culled_count = 0;
+  counts.total_count = input.instance_count;
+  counts.total_opaque_mesh_count = input.total_opaque_mesh_count;
+  counts.late_flag = 0;
+
+  u32 batch[4];
+  u32 batch_count = 0;
+  for (u32 i = 0; i < input.instance_count; ++i) {
+    // Released and occluded instance slots are skipped.
+    const bool occluded = input.occluded_instances &&
+                          (input.occluded_instances[i / 32] & (1u << (i % 32)));
+    if (input.instances[i].mesh_index != k_culled_mesh_index && !occluded) {
+      batch[batch_count++] = i;
+    }
+    if (batch_count < 4 && i + 1 < input.instance_count) {
+      continue;
+    }
+
+    const u32 visible_mask = cull_instances(view, input, batch, batch_count);
+    for (u32 lane = 0; lane < batch_count; ++lane) {
+      const u32 instance_index = batch[lane];
+      const GPUMeshData& mesh =
+          input.meshes[input.instances[instance_index].mesh_index];
+
+      if ((visible_mask & (1u << lane)) == 0) {
+        write_draw_command(late_commands[counts.opaque_mesh_culled_count++],
+                           instance_index, mesh);
+      } else if (is_opaque(input, instance_index)) {
+        write_draw_command(early_commands[counts.opaque_mesh_visible_count++],
+                           instance_index, mesh);
+      } else {
+        // Transparent draws are written after the opaque ones.
+        write_draw_command(
+            early_commands[counts.transparent_mesh_visible_count++ +
+                           input.total_opaque_mesh_count],
+            instance_index, mesh);
+      }
+    }
+    batch_count = 0;
+  }
+}
+
+void mesh_culling_late(const MeshCullingView& view,
+                       const MeshCullingInput& input,
+                       GPUMeshDrawCommand* late_commands,
+                       GPUMeshDrawCounts& counts) {
+  counts.late_flag = 0;
+
+  // Draws are compacted in place, a batch is read before it is written.
+  const u32 culled_count = counts.opaque_mesh_culled_count;
+  u32 batch[4];
+  for (u32 i = 0; i < culled_count; i += 4) {
+    const u32 batch_count = culled_count - i < 4 ? culled_count - i : 4;
+    for (u32 lane = 0; lane < batch_count; ++lane) {
+      batch[lane] = late_commands[i + lane].mesh_index;
+    }
+
+    const u32 visible_mask = cull_instances(view, input, batch, batch_count);
+    for (u32 lane = 0; lane < batch_count; ++lane) {
+      const u32 instance_index = batch[lane];
+      if ((visible_mask & (1u << lane)) && is_opaque(input, instance_index)) {
+        write_draw_command(
+            late_commands[counts.late_flag++], instance_index,
+            input.meshes[input.instances[instance_index].mesh_index]);
+      }
+    }
+  }
+}
+
+// Self test ////////////////////////////////////////////////////////////////
+
+static bool culling_expect(bool condition, cstring what) {
+  if (!condition) {
+    HERROR("Mesh culling self test: {}", what);
+  }
+  return condition;
+}
+
+// Depth buffer of a wall at wall_z in the rendered part of the attachment
+// given by scale, cleared to the far plane elsewhere.
+static void fill_wall_depth(f32* depth, u32 size, const glm::mat4& projection,
+                            f32 wall_z, f32 scale) {
+  const glm::vec4 wall = projection * glm::vec4(0.f, 0.f, wall_z, 1.0f);
+  const u32 rendered = (u32)(size * scale);
+  for (u32 y = 0; y < size; ++y) {
+    for (u32 x = 0; x < size; ++x) {
+      depth[y * size + x] =
+          x < rendered && y < rendered ? wall.z / wall.w : 1.0f;
+    }
+  }
+}
+
+bool mesh_culling_self_test(Allocator* allocator) {
+  // Unit spheres in front of a camera at the origin looking down -z, with a
+  // 90 degrees field of view.
+  static const u32 k_instance_count = 5;
+  const glm::vec3 positions[k_instance_count] = {
+      glm::vec3(0.f, 0.f, -5.f),   // Visible opaque.
+      glm::vec3(10.f, 0.f, -5.f),  // Outside of the right plane.
+      glm::vec3(0.f, 0.f, -5.f),   // Visible transparent.
+      glm::vec3(0.f),              // Released slot.
+      glm::vec3(0.f, 0.f, -50.f),  // Opaque, behind the wall.
+  };
+  const u32 mesh_indices[k_instance_count] = {0, 0, 1, k_culled_mesh_index,
+                                              0};
+
+  GPUMeshInstanceData instances[k_instance_count];
+  memset(instances, 0, sizeof(instances));
+  for (u32 i = 0; i < k_instance_count; ++i) {
+    instances[i].world = glm::translate(glm::mat4(1.0f), positions[i]);
+    instances[i].inverse_world = glm::inverse(instances[i].world);
+    instances[i].mesh_index = mesh_indices[i];
+  }
+  GPUMeshData meshes[2];
+  memset(meshes, 0, sizeof(meshes));
+  GPUMaterialData materials[2];
+  memset(materials, 0, sizeof(materials));
+  materials[1].flags = DrawFlags_Transparent;
+  const glm::vec4 mesh_bounds[2] = {glm::vec4(0.f, 0.f, 0.f, 1.0f),
+                                    glm::vec4(0.f, 0.f, 0.f, 1.0f)};
+
+  MeshCullingInput input;
+  input.instances = instances;
+  input.meshes = meshes;
+  input.materials = materials;
+  input.mesh_bounds = mesh_bounds;
+  input.instance_count = k_instance_count;
+  input.total_opaque_mesh_count = 3;
+
+  const glm::mat4 projection =
+      glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.f);
+  const f32 diagonal = 0.70710678f;
+
+  MeshCullingView view;
+  view.world_to_camera = glm::mat4(1.0f);
+  view.occlusion_view_projection = projection;
+  view.eye = glm::vec4(0.f, 0.f, 0.f, 1.0f);
+  view.frustum_planes[0] = glm::vec4(diagonal, 0.f, -diagonal, 0.f);
+  view.frustum_planes[1] = glm::vec4(-diagonal, 0.f, -diagonal, 0.f);
+  view.frustum_planes[2] = glm::vec4(0.f, diagonal, -diagonal, 0.f);
+  view.frustum_planes[3] = glm::vec4(0.f, -diagonal, -diagonal, 0.f);
+  view.frustum_planes[4] = glm::vec4(0.f, 0.f, -1.0f, -0.1f);
+  view.frustum_planes[5] = glm::vec4(0.f, 0.f, 1.0f, 100.f);
+  view.z_near = 0.1f;
+  view.projection_00 = projection[0][0];
+  view.projection_11 = projection[1][1];
+
+  GPUMeshDrawCommand early_commands[k_instance_count];
+  GPUMeshDrawCommand late_commands[k_instance_count];
+  GPUMeshDrawCounts counts;
+  bool passed = true;
+
+  // Frustum only: the sphere behind the wall is drawn.
+  mesh_culling_early(view, input, early_commands, late_commands, counts);
+  passed &= culling_expect(counts.opaque_mesh_visible_count == 2 &&
+                               counts.opaque_mesh_culled_count == 1 &&
+                               counts.transparent_mesh_visible_count == 1,
+                           "frustum counts");
+  passed &= culling_expect(early_commands[0].mesh_index == 0 &&
+                               early_commands[1].mesh_index == 4 &&
+                               early_commands[3].mesh_index == 2 &&
+                               late_commands[0].mesh_index == 1,
+                           "frustum commands");
+
+  // Occluded on the CPU: in neither list.
+  const u32 occluded_instances = 1u << 4;
+  input.occluded_instances = &occluded_instances;
+  mesh_culling_early(view, input, early_commands, late_commands, counts);
+  passed &= culling_expect(counts.opaque_mesh_visible_count == 1 &&
+                               counts.opaque_mesh_culled_count == 1 &&
+                               early_commands[0].mesh_index == 0,
+                           "occluded instance");
+  input.occluded_instances = nullptr;
+
+  // Wall at z = -10 over the whole pyramid.
+  static const u32 k_depth_size = 64;
+  f32* depth =
+      (f32*)halloca(sizeof(f32) * k_depth_size * k_depth_size, allocator);
+  CullingDepthPyramid pyramid;
+  fill_wall_depth(depth, k_depth_size, projection, -10.f, 1.0f);
+  culling_depth_pyramid_build(pyramid, depth, k_depth_size, k_depth_size,
+                              allocator);
+  view.depth_pyramid = &pyramid;
+  passed &= culling_expect(pyramid.width == 32 && pyramid.height == 32 &&
+                               pyramid.level_count == 5,
+                           "pyramid levels");
+
+  mesh_culling_early(view, input, early_commands, late_commands, counts);
+  passed &= culling_expect(counts.opaque_mesh_visible_count == 1 &&
+                               counts.opaque_mesh_culled_count == 2 &&
+                               counts.transparent_mesh_visible_count == 1,
+                           "occlusion counts");
+  passed &= culling_expect(early_commands[0].mesh_index == 0 &&
+                               early_commands[3].mesh_index == 2 &&
+                               late_commands[0].mesh_index == 1 &&
+                               late_commands[1].mesh_index == 4,
+                           "occlusion commands");
+
+  // Still behind the wall for the late pass.
+  mesh_culling_late(view, input, late_commands, counts);
+  passed &= culling_expect(counts.late_flag == 0, "late occluded count");
+
+  // Wall only in the rendered quarter of the attachment: the sphere is hidden
+  // at a scale of one half and seen when the whole pyramid is read.
+  fill_wall_depth(depth, k_depth_size, projection, -10.f, 0.5f);
+  culling_depth_pyramid_build(pyramid, depth, k_depth_size, k_depth_size,
+                              allocator);
+  view.pyramid_scale = glm::vec2(0.5f);
+  mesh_culling_early(view, input, early_commands, late_commands, counts);
+  passed &= culling_expect(counts.opaque_mesh_culled_count == 2 &&
+                               late_commands[1].mesh_index == 4,
+                           "scaled pyramid occlusion");
+
+  view.pyramid_scale = glm::vec2(1.0f);
+  mesh_culling_late(view, input, late_commands, counts);
+  passed &= culling_expect(
+      counts.late_flag == 1 && late_commands[0].mesh_index == 4,
+      "late visible commands");
+
+  culling_depth_pyramid_free(pyramid);
+  hfree(depth, allocator);
+
+  HINFO("Mesh culling self test {}", passed ? "passed" : "failed");
+  return passed;
+}
+
+}  // namespace Helix
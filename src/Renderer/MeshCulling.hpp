@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vendor/glm/glm/glm.hpp>
+
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+struct GPUMeshDrawCommand;
+struct GPUMeshDrawCounts;
+struct GPUMeshData;
+struct GPUMeshInstanceData;
+struct GPUMaterialData;
+struct GPUSceneData;
+
+static const u32 k_max_culling_depth_levels = 16;
+
+// Mesh culling /////////////////////////////////////////////////////////////
+// CPU version of culling.glsl and culling_late.glsl. It reads the same
+// buffers and writes the same commands and counts. It is used as a reference
+// for the GPU results and for views that are not culled on the GPU. Commands
+// are written in instance order, the GPU order depends on its atomics.
+
+//
+// Depth pyramid with the layout of DepthPyramidPass, level 0 is half the
+// previous power of two of the depth buffer. Texels are max reduced.
+struct CullingDepthPyramid {
+  f32* levels[k_max_culling_depth_levels];
+  u32 width = 0;
+  u32 height = 0;
+  u32 level_count = 0;
+
+  Allocator* allocator = nullptr;
+};  // struct CullingDepthPyramid
+
+//
+// Camera of the culling passes. Occlusion is not tested without a pyramid.
+struct MeshCullingView {
+  glm::mat4 world_to_camera;
+  // Projects the sphere to compare it to the pyramid.
+  glm::mat4 occlusion_view_projection;
+  glm::vec4 eye;
+  glm::vec4 frustum_planes[6];
+  // Rendered part of the pyramid, from the render_scale of the pass.
+  glm::vec2 pyramid_scale = glm::vec2(1.0f);
+
+  f32 z_near = 0.1f;
+  f32 projection_00 = 1.0f;
+  f32 projection_11 = 1.0f;
+  bool frustum_cull = true;
+
+  const CullingDepthPyramid* depth_pyramid = nullptr;
+};  // struct MeshCullingView
+
+//
+// Scene buffers read by the culling, indexed as their GPU counterparts.
+struct MeshCullingInput {
+  const GPUMeshInstanceData* instances = nullptr;
+  const GPUMeshData* meshes = nullptr;
+  const GPUMaterialData* materials = nullptr;
+  const glm::vec4* mesh_bounds = nullptr;
+  // A bit per instance hidden by the CPU occlusion buffer, optional.
+  const u32* occluded_instances = nullptr;
+
+  u32 instance_count = 0;
+  u32 total_opaque_mesh_count = 0;
+};  // struct MeshCullingInput
+
+// Same as project_sphere in mesh.h: uv rectangle of a view space sphere,
+// false when it crosses the near plane.
+bool culling_project_sphere(const glm::vec3& center, f32 radius, f32 z_near,
+                            f32 projection_00, f32 projection_11,
+                            glm::vec4& out_aabb);
+
+// Uses the matrices of the culling shaders, the debug ones when the occlusion
+// camera is frozen. The early pass tests against the pyramid of the previous
+// frame and the late one against the pyramid of this frame.
+void mesh_culling_view_init(MeshCullingView& view,
+                            const GPUSceneData& scene_data, bool late);
+
+// Reduces a depth buffer the way the depth pyramid pass does.
+void culling_depth_pyramid_build(CullingDepthPyramid& pyramid,
+                                 const f32* depth, u32 width, u32 height,
+                                 Allocator* allocator);
+void culling_depth_pyramid_free(CullingDepthPyramid& pyramid);
+// textureLod with the max reduction sampler of the pyramid.
+f32 culling_depth_pyramid_sample(const CullingDepthPyramid& pyramid,
+                                 const glm::vec2& uv, f32 level);
+
+// As culling.glsl: visible opaque draws are written at the start of
+// early_commands and transparent ones after total_opaque_mesh_count, the other
+// instances go to late_commands. Resets the counts it writes.
+void mesh_culling_early(const MeshCullingView& view,
+                        const MeshCullingInput& input,
+                        GPUMeshDrawCommand* early_commands,
+                        GPUMeshDrawCommand* late_commands,
+                        GPUMeshDrawCounts& counts);
+// As culling_late.glsl: tests the opaque_mesh_culled_count commands left by
+// the early pass and compacts the visible opaque ones at the start of
+// late_commands, their count goes in late_flag.
+void mesh_culling_late(const MeshCullingView& view,
+                       const MeshCullingInput& input,
+                       GPUMeshDrawCommand* late_commands,
+                       GPUMeshDrawCounts& counts);
+
+// Culls a few fixed instances against a known frustum and depth pyramids and
+// compares the commands and counts with their expected values. Logs the
+// mismatches, returns false if there are any.
+bool mesh_culling_self_test(Allocator* allocator);
+
+}  // namespace Helix
@@ -24,22 +24,202 @@ cstring node_type_to_cstring(NodeType type) {
   }
 }
 
-static void update_transform(Node* node, NodePool* node_pool) {
-  if (node->parent.index != k_invalid_index) {
-    Node* parent_node = (Node*)node_pool->access_node(node->parent);
-    glm::mat4 combined_matrix =
-        parent_node->world_transform.calculate_matrix() *
-        node->local_transform.calculate_matrix();
-    node->world_transform.set_transform(combined_matrix);
-  } else {
-    node->world_transform.set_transform(
-        node->local_transform.calculate_matrix());
+// Transform hierarchy ////////////////////////////////////
+void TransformHierarchy::init(Allocator* allocator_, u32 initial_capacity) {
+  allocator = allocator_;
+
+  local_matrices.init(allocator, initial_capacity);
+  world_matrices.init(allocator, initial_capacity);
+  parents.init(allocator, initial_capacity);
+  depths.init(allocator, initial_capacity);
+  nodes.init(allocator, initial_capacity);
+  dirty.init(allocator, initial_capacity);
+  updated_nodes.init(allocator, initial_capacity);
+  sort_scratch.init(allocator, initial_capacity);
+
+  first_dirty = u32_max;
+  needs_sort = false;
+}
+
+void TransformHierarchy::shutdown() {
+  local_matrices.shutdown();
+  world_matrices.shutdown();
+  parents.shutdown();
+  depths.shutdown();
+  nodes.shutdown();
+  dirty.shutdown();
+  updated_nodes.shutdown();
+  sort_scratch.shutdown();
+}
+
+u32 TransformHierarchy::add(NodeHandle node) {
+  // New entries are roots, appending them keeps parents before children.
+  const u32 index = nodes.size;
+  local_matrices.push(glm::mat4(1.0f));
+  world_matrices.push(glm::mat4(1.0f));
+  parents.push(k_invalid_index);
+  depths.push(0);
+  nodes.push(node);
+  dirty.push(1);
+
+  first_dirty = index < first_dirty ? index : first_dirty;
+  return index;
+}
+
+void TransformHierarchy::remove(u32 index) {
+  // Compacted by the next sort.
+  nodes[index] = {k_invalid_index, NodeType::Node};
+  needs_sort = true;
+}
+
+void TransformHierarchy::set_parent(u32 index, u32 parent_index) {
+  parents[index] = parent_index;
+  dirty[index] = 1;
+  first_dirty = index < first_dirty ? index : first_dirty;
+  needs_sort = true;
+}
+
+void TransformHierarchy::set_local_matrix(u32 index,
+                                          const glm::mat4& local_matrix) {
+  local_matrices[index] = local_matrix;
+  dirty[index] = 1;
+  first_dirty = index < first_dirty ? index : first_dirty;
+}
+
+void TransformHierarchy::update(NodePool* node_pool) {
+  updated_nodes.clear();
+  if (needs_sort) {
+    sort(node_pool);
   }
 
-  for (u32 i = 0; i < node->children.size; i++) {
-    Node* child_node = (Node*)node_pool->access_node(node->children[i]);
-    child_node->update_transform(node_pool);
+  const u32 count = nodes.size;
+  if (first_dirty >= count) {
+    first_dirty = u32_max;
+    return;
+  }
+
+  // Parents are stored first: their dirty flag and world matrix are final by
+  // the time their children are visited.
+  for (u32 i = first_dirty; i < count; ++i) {
+    const u32 parent = parents[i];
+    if (parent != k_invalid_index) {
+      dirty[i] |= dirty[parent];
+    }
+    if (!dirty[i]) {
+      continue;
+    }
+    world_matrices[i] = parent != k_invalid_index
+                            ? world_matrices[parent] * local_matrices[i]
+                            : local_matrices[i];
+    updated_nodes.push(nodes[i]);
   }
+
+  memset(dirty.data + first_dirty, 0, count - first_dirty);
+  first_dirty = u32_max;
+}
+
+template <typename T>
+static void transform_permute(Array<T>& array, const u32* order, u32 count,
+                              void* scratch) {
+  T* sorted = (T*)scratch;
+  for (u32 i = 0; i < count; ++i) {
+    sorted[i] = array[order[i]];
+  }
+  memcpy(array.data, sorted, sizeof(T) * count);
+  array.set_size(count);
+}
+
+void TransformHierarchy::sort(NodePool* node_pool) {
+  needs_sort = false;
+
+  const u32 count = nodes.size;
+  if (count == 0) {
+    return;
+  }
+
+  // Depths, parents can still be stored after their children here. Walk up
+  // to the first known depth and fill the chain on the way back.
+  sort_scratch.set_size(count * 2);
+  u32* chain = sort_scratch.data;
+  for (u32 i = 0; i < count; ++i) {
+    depths[i] = u32_max;
+  }
+  u32 max_depth = 0;
+  for (u32 i = 0; i < count; ++i) {
+    u32 chain_size = 0;
+    u32 entry = i;
+    while (entry != k_invalid_index && depths[entry] == u32_max) {
+      HASSERT(chain_size < count);  // Cycle in the hierarchy
+      chain[chain_size++] = entry;
+      entry = parents[entry];
+    }
+    u32 depth = entry == k_invalid_index ? 0 : depths[entry] + 1;
+    while (chain_size) {
+      depths[chain[--chain_size]] = depth++;
+    }
+    max_depth = depths[i] > max_depth ? depths[i] : max_depth;
+  }
+
+  // Counting sort by depth, stable so siblings keep their order. Removed
+  // entries are dropped.
+  sort_scratch.set_size(count * 2 + max_depth + 2);
+  u32* order = sort_scratch.data;
+  u32* remap = order + count;
+  u32* offsets = remap + count;
+  memset(offsets, 0, sizeof(u32) * (max_depth + 2));
+  for (u32 i = 0; i < count; ++i) {
+    if (nodes[i].index != k_invalid_index) {
+      ++offsets[depths[i] + 1];
+    }
+  }
+  for (u32 d = 1; d <= max_depth + 1; ++d) {
+    offsets[d] += offsets[d - 1];
+  }
+  const u32 sorted_count = offsets[max_depth + 1];
+  for (u32 i = 0; i < count; ++i) {
+    if (nodes[i].index == k_invalid_index) {
+      remap[i] = k_invalid_index;
+      continue;
+    }
+    const u32 sorted_index = offsets[depths[i]]++;
+    order[sorted_index] = i;
+    remap[i] = sorted_index;
+  }
+
+  void* scratch = hallocam(sizeof(glm::mat4) * count, allocator);
+  transform_permute(local_matrices, order, sorted_count, scratch);
+  transform_permute(world_matrices, order, sorted_count, scratch);
+  transform_permute(parents, order, sorted_count, scratch);
+  transform_permute(depths, order, sorted_count, scratch);
+  transform_permute(nodes, order, sorted_count, scratch);
+  transform_permute(dirty, order, sorted_count, scratch);
+  hfree(scratch, allocator);
+
+  first_dirty = u32_max;
+  for (u32 i = 0; i < sorted_count; ++i) {
+    const u32 parent = parents[i];
+    if (parent != k_invalid_index) {
+      parents[i] = remap[parent];
+      // Entries whose parent was removed become roots.
+      dirty[i] |= parents[i] == k_invalid_index;
+    }
+    if (dirty[i] && first_dirty == u32_max) {
+      first_dirty = i;
+    }
+
+    Node* node = (Node*)node_pool->access_node(nodes[i]);
+    node->transform_index = i;
+  }
+}
+
+void Node::update_transform(NodePool* node_pool) {
+  node_pool->transforms.set_local_matrix(transform_index,
+                                         local_transform.calculate_matrix());
+}
+
+void Node::add_child(Node* node, NodePool* node_pool) {
+  children.push(node->handle);
+  node_pool->set_parent(node->handle, handle);
 }
 
 static void draw_node_property_p_light(NodePool& node_pool,
@@ -57,8 +237,11 @@ static void draw_node_property_p_light(NodePool& node_pool,
 
   glm::vec3 local_rotation =
       glm::degrees(glm::eulerAngles(node->local_transform.rotation));
+  // Decomposed for display only.
+  Transform world_transform{};
+  world_transform.set_transform(node_pool.get_world_matrix(node));
   glm::vec3 world_rotation =
-      glm::degrees(glm::eulerAngles(node->world_transform.rotation));
+      glm::degrees(glm::eulerAngles(world_transform.rotation));
 
   // TODO: Represent rotation as quats
   ImGui::Text("Local Transform");
@@ -70,8 +253,8 @@ static void draw_node_property_p_light(NodePool& node_pool,
 
   ImGui::Text("World Transform");
   ImGui::InputFloat3("position##world",
-                     (float*)&node->world_transform.translation);
-  ImGui::InputFloat3("scale##world", (float*)&node->world_transform.scale);
+                     (float*)&world_transform.translation);
+  ImGui::InputFloat3("scale##world", (float*)&world_transform.scale);
   ImGui::InputFloat3("rotation##world", (float*)&world_rotation);
 
   if (modified) {
@@ -80,13 +263,11 @@ static void draw_node_property_p_light(NodePool& node_pool,
   }
 }
 
-static void update_mesh_transform(Node* node, NodePool* node_pool) {
-  update_transform(node, node_pool);
-}
-
 void NodePool::init(Allocator* allocator_) {
   allocator = allocator_;
 
+  transforms.init(allocator_, 512);
+
   mesh_nodes.init(allocator_, 300, sizeof(MeshNode));
   base_nodes.init(allocator_, 50, sizeof(Node));
   point_light_nodes.init(allocator_, 5, sizeof(PointLightNode));
@@ -98,7 +279,6 @@ void NodePool::init(Allocator* allocator_) {
   root->children.init(allocator, 4);
   root->parent = {k_invalid_index, NodeType::Node};
   root->name = "Root_Node";
-  root->world_transform = Transform{};
   root->local_transform = Transform{};
 }
 
@@ -107,6 +287,8 @@ void NodePool::shutdown() {
   base_nodes.shutdown();
   point_light_nodes.shutdown();
   directional_light_nodes.shutdown();
+
+  transforms.shutdown();
 }
 
 void* NodePool::access_node(NodeHandle handle) {
@@ -131,6 +313,7 @@ void NodePool::destroy_node(NodeHandle handle) {
     destroy_node(node->children[i]);
   }
   node->children.shutdown();
+  transforms.remove(node->transform_index);
   switch (handle.type) {
     case NodeType::Node:
       base_nodes.release_resource(handle.index);
@@ -156,29 +339,42 @@ Node* NodePool::get_root_node() {
   return root;
 }
 
+void NodePool::set_parent(NodeHandle node_handle, NodeHandle parent_handle) {
+  Node* node = (Node*)access_node(node_handle);
+  Node* parent = (Node*)access_node(parent_handle);
+  node->parent = parent_handle;
+  transforms.set_parent(node->transform_index, parent->transform_index);
+}
+
+void NodePool::update_transforms() { transforms.update(this); }
+
+const glm::mat4& NodePool::get_world_matrix(const Node* node) const {
+  return transforms.world_matrices[node->transform_index];
+}
+
 NodeHandle NodePool::obtain_node(NodeType type) {
   NodeHandle handle{};
   switch (type) {
     case NodeType::Node: {
       handle = {base_nodes.obtain_resource(), NodeType::Node};
       Node* base_node = new ((Node*)access_node(handle)) Node();
-      base_node->updateFunc = update_transform;
       base_node->handle = handle;
+      base_node->transform_index = transforms.add(handle);
       break;
     }
     case NodeType::MeshNode: {
       handle = {mesh_nodes.obtain_resource(), NodeType::MeshNode};
       MeshNode* mesh_node = new ((MeshNode*)access_node(handle)) MeshNode();
-      mesh_node->updateFunc = update_mesh_transform;
       mesh_node->handle = handle;
+      mesh_node->transform_index = transforms.add(handle);
       break;
     }
     case NodeType::PointLightNode: {
       handle = {point_light_nodes.obtain_resource(), NodeType::PointLightNode};
       PointLightNode* light_node =
           new ((PointLightNode*)access_node(handle)) PointLightNode();
-      light_node->updateFunc = update_transform;
       light_node->handle = handle;
+      light_node->transform_index = transforms.add(handle);
       break;
     }
     case NodeType::DirectionalLightNode: {
@@ -187,8 +383,8 @@ NodeHandle NodePool::obtain_node(NodeType type) {
       DirectionalLightNode* light_node =
           new ((DirectionalLightNode*)access_node(handle))
               DirectionalLightNode();
-      light_node->updateFunc = update_transform;
       light_node->handle = handle;
+      light_node->transform_index = transforms.add(handle);
       break;
     }
     default:
@@ -61,6 +61,46 @@ struct NodeHandle {
 };
 
 struct Node;
+struct NodePool;
+
+// Transform hierarchy ////////////////////////////////////
+//
+// Local and world matrices of every node stored in parallel arrays sorted by
+// depth, so a parent always comes before its children. Changing a local matrix
+// only marks the entry dirty; update walks the arrays once, starting from the
+// first dirty entry, and recomputes the dirty entries and their descendants.
+// Entries are re-sorted when the hierarchy changes, which moves them: indices
+// must be read from Node::transform_index and not cached.
+struct TransformHierarchy {
+  void init(Allocator* allocator, u32 initial_capacity);
+  void shutdown();
+
+  u32 add(NodeHandle node);
+  void remove(u32 index);
+  void set_parent(u32 index, u32 parent_index);
+  void set_local_matrix(u32 index, const glm::mat4& local_matrix);
+
+  void update(NodePool* node_pool);
+  void sort(NodePool* node_pool);
+
+  Allocator* allocator = nullptr;
+
+  Array<glm::mat4> local_matrices;
+  Array<glm::mat4> world_matrices;
+  Array<u32> parents;
+  Array<u32> depths;
+  Array<NodeHandle> nodes;
+  Array<u8> dirty;
+
+  // Nodes whose world matrix was recomputed by the last update.
+  Array<NodeHandle> updated_nodes;
+
+  // Depth counts, sorted order and old to new index remap used by sort.
+  Array<u32> sort_scratch;
+
+  u32 first_dirty = u32_max;
+  bool needs_sort = false;
+};  // struct TransformHierarchy
 
 struct NodePool {
   void init(Allocator* allocator);
@@ -71,6 +111,11 @@ struct NodePool {
   void destroy_node(NodeHandle handle);
   Node* get_root_node();
 
+  // Only links the transforms, the parent children array is left untouched.
+  void set_parent(NodeHandle node, NodeHandle parent);
+  void update_transforms();
+  const glm::mat4& get_world_matrix(const Node* node) const;
+
   Allocator* allocator;
 
   NodeHandle root_node;
@@ -79,6 +124,8 @@ struct NodePool {
   ResourcePool mesh_nodes;
   ResourcePool point_light_nodes;
   ResourcePool directional_light_nodes;
+
+  TransformHierarchy transforms;
 };
 
 struct Node {
@@ -86,27 +133,21 @@ struct Node {
   NodeHandle parent = {k_invalid_index, NodeType::Node};
   Array<NodeHandle> children;
   Transform local_transform{};
-  Transform world_transform{};
+  u32 transform_index = k_invalid_index;
 
   cstring name = nullptr;
 
-  void (*updateFunc)(Node*, NodePool* node_pool);
-
-  void update_transform(NodePool* node_pool) {
-    if (!updateFunc) {
-      HWARN("Node does not have update function");
-      return;
-    }
-    updateFunc(this, node_pool);
-  }
-  void add_child(Node* node) {
-    node->parent = handle;
-    children.push(node->handle);  // TODO: Fix array issue!!!!!!!!!!!!
-  }
+  // Writes local_transform to the hierarchy, world matrices are recomputed by
+  // NodePool::update_transforms.
+  void update_transform(NodePool* node_pool);
+  void add_child(Node* node, NodePool* node_pool);
 };
 
 struct MeshNode : public Node {
+  // Shared by the nodes instancing the same glTF mesh.
   Mesh* mesh;
+  // Slot of the mesh in the GPU instance buffer.
+  u32 instance_index = k_invalid_index;
 };
 
 struct PointLightNode : public Node {
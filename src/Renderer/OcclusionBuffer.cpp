@@ -0,0 +1,534 @@
+#include "Renderer/OcclusionBuffer.hpp"
+
+#include <emmintrin.h>
+#include <float.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <vendor/glm/glm/gtc/matrix_transform.hpp>
+#include <vendor/tracy/tracy/Tracy.hpp>
+
+#include "Core/File.hpp"
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "Core/Time.hpp"
+#include "vendor/enkiTS/TaskScheduler.h"
+
+namespace Helix {
+
+// Vertices closer to the camera plane are not projected.
+static const f32 k_occlusion_min_w = 1e-4f;
+
+void OcclusionBuffer::init(Allocator* allocator_, u32 width_, u32 height_) {
+  allocator = allocator_;
+
+  tile_count_x = (width_ + k_occlusion_tile_width - 1) / k_occlusion_tile_width;
+  tile_count_y =
+      (height_ + k_occlusion_tile_height - 1) / k_occlusion_tile_height;
+  width = tile_count_x * k_occlusion_tile_width;
+  height = tile_count_y * k_occlusion_tile_height;
+  block_count_x = width / k_occlusion_block_size;
+  block_count_y = height / k_occlusion_block_size;
+
+  depth = (f32*)halloca(sizeof(f32) * width * height, allocator);
+  block_depth =
+      (f32*)halloca(sizeof(f32) * block_count_x * block_count_y, allocator);
+
+  const u32 tile_count = tile_count_x * tile_count_y;
+  tile_triangles =
+      (Array<u32>*)halloca(sizeof(Array<u32>) * tile_count, allocator);
+  for (u32 i = 0; i < tile_count; ++i) {
+    new (&tile_triangles[i]) Array<u32>();
+    tile_triangles[i].init(allocator, 256);
+  }
+  triangles.init(allocator, 4096);
+
+  view_projection = glm::mat4(1.0f);
+  begin(view_projection);
+  for (u32 i = 0; i < width * height; ++i) {
+    depth[i] = FLT_MAX;
+  }
+  for (u32 i = 0; i < block_count_x * block_count_y; ++i) {
+    block_depth[i] = FLT_MAX;
+  }
+}
+
+void OcclusionBuffer::shutdown() {
+  if (depth == nullptr) {
+    return;
+  }
+
+  for (u32 i = 0; i < tile_count_x * tile_count_y; ++i) {
+    tile_triangles[i].shutdown();
+  }
+  hfree(tile_triangles, allocator);
+  triangles.shutdown();
+  hfree(block_depth, allocator);
+  hfree(depth, allocator);
+
+  tile_triangles = nullptr;
+  block_depth = nullptr;
+  depth = nullptr;
+}
+
+void OcclusionBuffer::begin(const glm::mat4& view_projection_) {
+  view_projection = view_projection_;
+
+  triangles.clear();
+  for (u32 i = 0; i < tile_count_x * tile_count_y; ++i) {
+    tile_triangles[i].clear();
+  }
+
+  stats = OcclusionBufferStats{};
+}
+
+void OcclusionBuffer::add_occluder(const glm::mat4& model, const f32* positions,
+                                   u32 position_stride, const u32* indices,
+                                   u32 index_count) {
+  const glm::mat4 model_view_projection = view_projection * model;
+  const f32 half_width = width * 0.5f;
+  const f32 half_height = height * 0.5f;
+
+  for (u32 i = 0; i + 2 < index_count; i += 3) {
+    ++stats.occluder_triangles;
+
+    OcclusionTriangle triangle;
+    bool projected = true;
+    for (u32 v = 0; v < 3; ++v) {
+      const f32* position =
+          (const f32*)((const u8*)positions +
+                       (sizet)indices[i + v] * position_stride);
+      const glm::vec4 clip =
+          model_view_projection *
+          glm::vec4(position[0], position[1], position[2], 1.0f);
+      if (clip.w < k_occlusion_min_w) {
+        projected = false;
+        break;
+      }
+      const f32 inverse_w = 1.0f / clip.w;
+      triangle.vertices[v] =
+          glm::vec3((clip.x * inverse_w + 1.0f) * half_width,
+                    (clip.y * inverse_w + 1.0f) * half_height,
+                    clip.z * inverse_w);
+    }
+    if (!projected) {
+      ++stats.dropped_triangles;
+      continue;
+    }
+
+    const glm::vec3& v0 = triangle.vertices[0];
+    const glm::vec3& v1 = triangle.vertices[1];
+    const glm::vec3& v2 = triangle.vertices[2];
+    const f32 min_x = glm::min(v0.x, glm::min(v1.x, v2.x));
+    const f32 max_x = glm::max(v0.x, glm::max(v1.x, v2.x));
+    const f32 min_y = glm::min(v0.y, glm::min(v1.y, v2.y));
+    const f32 max_y = glm::max(v0.y, glm::max(v1.y, v2.y));
+    const f32 area =
+        (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    // Written so that a NaN area, from non finite vertices, drops too.
+    if (max_x < 0.f || max_y < 0.f || min_x >= width || min_y >= height ||
+        !(glm::abs(area) >= 1e-6f)) {
+      ++stats.dropped_triangles;
+      continue;
+    }
+
+    // Clamped to the screen before the conversion, the bounds can be far out
+    // of the u32 range.
+    const u32 tile_x0 = (u32)glm::clamp(min_x, 0.f, width - 1.f) /
+                        k_occlusion_tile_width;
+    const u32 tile_y0 = (u32)glm::clamp(min_y, 0.f, height - 1.f) /
+                        k_occlusion_tile_height;
+    const u32 tile_x1 = (u32)glm::clamp(max_x, 0.f, width - 1.f) /
+                        k_occlusion_tile_width;
+    const u32 tile_y1 = (u32)glm::clamp(max_y, 0.f, height - 1.f) /
+                        k_occlusion_tile_height;
+
+    const u32 triangle_index = triangles.size;
+    triangles.push(triangle);
+    for (u32 tile_y = tile_y0; tile_y <= tile_y1; ++tile_y) {
+      for (u32 tile_x = tile_x0; tile_x <= tile_x1; ++tile_x) {
+        tile_triangles[tile_y * tile_count_x + tile_x].push(triangle_index);
+      }
+    }
+  }
+}
+
+// Edge function a*x + b*y + c, positive inside a counter clockwise triangle.
+struct OcclusionEdge {
+  f32 a;
+  f32 b;
+  f32 c;
+};  // struct OcclusionEdge
+
+static inline OcclusionEdge occlusion_edge(const glm::vec3& from,
+                                           const glm::vec3& to) {
+  OcclusionEdge edge;
+  edge.a = from.y - to.y;
+  edge.b = to.x - from.x;
+  edge.c = -(edge.a * from.x + edge.b * from.y);
+  return edge;
+}
+
+// Writes the nearest depth of the pixel centers covered by the triangle, four
+// pixels at a time, clipped to the tile rectangle.
+static void rasterize_triangle(const OcclusionTriangle& triangle, f32* depth,
+                               u32 width, u32 x0, u32 y0, u32 x1, u32 y1) {
+  glm::vec3 v0 = triangle.vertices[0];
+  glm::vec3 v1 = triangle.vertices[1];
+  glm::vec3 v2 = triangle.vertices[2];
+  f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+  // Occluders are not back face culled.
+  if (area < 0.f) {
+    const glm::vec3 swap = v1;
+    v1 = v2;
+    v2 = swap;
+    area = -area;
+  }
+
+  const i32 min_x = glm::max((i32)floorf(glm::min(v0.x, glm::min(v1.x, v2.x))),
+                             (i32)x0);
+  const i32 max_x = glm::min((i32)ceilf(glm::max(v0.x, glm::max(v1.x, v2.x))),
+                             (i32)x1);
+  const i32 min_y = glm::max((i32)floorf(glm::min(v0.y, glm::min(v1.y, v2.y))),
+                             (i32)y0);
+  const i32 max_y = glm::min((i32)ceilf(glm::max(v0.y, glm::max(v1.y, v2.y))),
+                             (i32)y1);
+  if (min_x >= max_x || min_y >= max_y) {
+    return;
+  }
+
+  // Each edge weights the vertex in front of it.
+  const OcclusionEdge e0 = occlusion_edge(v1, v2);
+  const OcclusionEdge e1 = occlusion_edge(v2, v0);
+  const OcclusionEdge e2 = occlusion_edge(v0, v1);
+  const f32 inverse_area = 1.0f / area;
+  const f32 depth_a = (e0.a * v0.z + e1.a * v1.z + e2.a * v2.z) * inverse_area;
+  const f32 depth_b = (e0.b * v0.z + e1.b * v1.z + e2.b * v2.z) * inverse_area;
+  const f32 depth_c = (e0.c * v0.z + e1.c * v1.z + e2.c * v2.z) * inverse_area;
+
+  // Tiles are aligned to 4 pixels, so are the groups.
+  const i32 start_x = min_x & ~3;
+  const __m128 pixel_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 step0 = _mm_set1_ps(e0.a);
+  const __m128 step1 = _mm_set1_ps(e1.a);
+  const __m128 step2 = _mm_set1_ps(e2.a);
+  const __m128 depth_step = _mm_set1_ps(depth_a);
+
+  for (i32 y = min_y; y < max_y; ++y) {
+    const f32 pixel_y = y + 0.5f;
+    const __m128 row0 = _mm_set1_ps(e0.b * pixel_y + e0.c);
+    const __m128 row1 = _mm_set1_ps(e1.b * pixel_y + e1.c);
+    const __m128 row2 = _mm_set1_ps(e2.b * pixel_y + e2.c);
+    const __m128 row_depth = _mm_set1_ps(depth_b * pixel_y + depth_c);
+    f32* depth_row = depth + (sizet)y * width;
+
+    for (i32 x = start_x; x < max_x; x += 4) {
+      const __m128 pixel_x = _mm_add_ps(_mm_set1_ps((f32)x), pixel_offsets);
+      const __m128 w0 = _mm_add_ps(_mm_mul_ps(step0, pixel_x), row0);
+      const __m128 w1 = _mm_add_ps(_mm_mul_ps(step1, pixel_x), row1);
+      const __m128 w2 = _mm_add_ps(_mm_mul_ps(step2, pixel_x), row2);
+      const __m128 inside =
+          _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)),
+                     _mm_cmpge_ps(w2, zero));
+      if (_mm_movemask_ps(inside) == 0) {
+        continue;
+      }
+
+      const __m128 pixel_depth =
+          _mm_add_ps(_mm_mul_ps(depth_step, pixel_x), row_depth);
+      const __m128 current = _mm_loadu_ps(depth_row + x);
+      const __m128 nearest = _mm_min_ps(current, pixel_depth);
+      _mm_storeu_ps(depth_row + x,
+                    _mm_or_ps(_mm_and_ps(inside, nearest),
+                              _mm_andnot_ps(inside, current)));
+    }
+  }
+}
+
+void OcclusionBuffer::rasterize_tile(u32 tile_index) {
+  const u32 x0 = (tile_index % tile_count_x) * k_occlusion_tile_width;
+  const u32 y0 = (tile_index / tile_count_x) * k_occlusion_tile_height;
+  const u32 x1 = x0 + k_occlusion_tile_width;
+  const u32 y1 = y0 + k_occlusion_tile_height;
+
+  const __m128 far_depth = _mm_set1_ps(FLT_MAX);
+  for (u32 y = y0; y < y1; ++y) {
+    for (u32 x = x0; x < x1; x += 4) {
+      _mm_storeu_ps(depth + (sizet)y * width + x, far_depth);
+    }
+  }
+
+  const Array<u32>& bin = tile_triangles[tile_index];
+  for (u32 i = 0; i < bin.size; ++i) {
+    rasterize_triangle(triangles[bin[i]], depth, width, x0, y0, x1, y1);
+  }
+
+  // Farthest depth of each block of the tile.
+  for (u32 block_y = y0; block_y < y1; block_y += k_occlusion_block_size) {
+    for (u32 block_x = x0; block_x < x1; block_x += k_occlusion_block_size) {
+      __m128 farthest = _mm_setzero_ps();
+      for (u32 y = block_y; y < block_y + k_occlusion_block_size; ++y) {
+        const f32* row = depth + (sizet)y * width + block_x;
+        farthest = _mm_max_ps(farthest, _mm_loadu_ps(row));
+        farthest = _mm_max_ps(farthest, _mm_loadu_ps(row + 4));
+      }
+      farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest,
+                                                     _MM_SHUFFLE(1, 0, 3, 2)));
+      farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest,
+                                                     _MM_SHUFFLE(2, 3, 0, 1)));
+      _mm_store_ss(block_depth +
+                       (block_y / k_occlusion_block_size) * block_count_x +
+                       block_x / k_occlusion_block_size,
+                   farthest);
+    }
+  }
+}
+
+//
+//
+struct OcclusionRasterizeTask : public enki::ITaskSet {
+  OcclusionBuffer* buffer = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_, u32) override {
+    ZoneScoped;
+    for (u32 tile_index = range_.start; tile_index < range_.end;
+         ++tile_index) {
+      buffer->rasterize_tile(tile_index);
+    }
+  }
+};  // struct OcclusionRasterizeTask
+
+void OcclusionBuffer::rasterize(enki::TaskScheduler* task_scheduler) {
+  ZoneScoped;
+  const i64 start = Time::now();
+
+  const u32 tile_count = tile_count_x * tile_count_y;
+  if (task_scheduler) {
+    OcclusionRasterizeTask task;
+    task.buffer = this;
+    task.m_SetSize = tile_count;
+    task.m_MinRange = 1;
+    task_scheduler->AddTaskSetToPipe(&task);
+    task_scheduler->WaitforTask(&task);
+  } else {
+    for (u32 tile_index = 0; tile_index < tile_count; ++tile_index) {
+      rasterize_tile(tile_index);
+    }
+  }
+
+  stats.rasterize_ms = Time::from_milliseconds(start);
+}
+
+bool OcclusionBuffer::is_aabb_visible(const glm::vec3& min,
+                                      const glm::vec3& max) const {
+  f32 min_x = FLT_MAX;
+  f32 min_y = FLT_MAX;
+  f32 max_x = -FLT_MAX;
+  f32 max_y = -FLT_MAX;
+  f32 nearest = FLT_MAX;
+  u32 behind_count = 0;
+  for (u32 corner = 0; corner < 8; ++corner) {
+    const glm::vec4 position((corner & 1) ? max.x : min.x,
+                             (corner & 2) ? max.y : min.y,
+                             (corner & 4) ? max.z : min.z, 1.0f);
+    const glm::vec4 clip = view_projection * position;
+    if (clip.w < k_occlusion_min_w) {
+      ++behind_count;
+      continue;
+    }
+
+    const f32 inverse_w = 1.0f / clip.w;
+    const f32 x = (clip.x * inverse_w + 1.0f) * width * 0.5f;
+    const f32 y = (clip.y * inverse_w + 1.0f) * height * 0.5f;
+    min_x = glm::min(min_x, x);
+    max_x = glm::max(max_x, x);
+    min_y = glm::min(min_y, y);
+    max_y = glm::max(max_y, y);
+    nearest = glm::min(nearest, clip.z * inverse_w);
+  }
+
+  // Entirely behind the camera.
+  if (behind_count == 8) {
+    return false;
+  }
+  // Crossing the camera plane the bounds can cover the whole screen.
+  if (behind_count > 0) {
+    return true;
+  }
+  // No finite corner: nothing to test, kept.
+  if (!(min_x <= max_x && min_y <= max_y)) {
+    return true;
+  }
+  // Empty once clipped to the screen.
+  if (max_x < 0.f || max_y < 0.f || min_x >= width || min_y >= height) {
+    return false;
+  }
+
+  // Clamped to the screen before the conversion, the bounds can be far out
+  // of the u32 range.
+  const u32 block_x0 =
+      (u32)glm::clamp(min_x, 0.f, width - 1.f) / k_occlusion_block_size;
+  const u32 block_y0 =
+      (u32)glm::clamp(min_y, 0.f, height - 1.f) / k_occlusion_block_size;
+  const u32 block_x1 =
+      (u32)glm::clamp(max_x, 0.f, width - 1.f) / k_occlusion_block_size;
+  const u32 block_y1 =
+      (u32)glm::clamp(max_y, 0.f, height - 1.f) / k_occlusion_block_size;
+
+  for (u32 block_y = block_y0; block_y <= block_y1; ++block_y) {
+    const f32* row = block_depth + block_y * block_count_x;
+    for (u32 block_x = block_x0; block_x <= block_x1; ++block_x) {
+      if (nearest <= row[block_x]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool OcclusionBuffer::is_sphere_visible(const glm::vec3& center,
+                                        f32 radius) const {
+  return is_aabb_visible(center - glm::vec3(radius),
+                         center + glm::vec3(radius));
+}
+
+u8* OcclusionBuffer::write_depth_image_memory(bool reduced,
+                                              Allocator* allocator,
+                                              sizet& out_size) const {
+  const u32 image_width = reduced ? block_count_x : width;
+  const u32 image_height = reduced ? block_count_y : height;
+  const f32* values = reduced ? block_depth : depth;
+
+  char header[64];
+  const int header_size = snprintf(header, sizeof(header), "P5\n%u %u\n255\n",
+                                   image_width, image_height);
+  const sizet size = header_size + (sizet)image_width * image_height;
+  u8* image = hallocam(size, allocator);
+  memcpy(image, header, header_size);
+
+  // Occluders from black (near) to white, empty pixels stay white.
+  u8* pixels = image + header_size;
+  for (u32 i = 0; i < image_width * image_height; ++i) {
+    pixels[i] = (u8)(glm::clamp(values[i], 0.f, 1.f) * 255.f + 0.5f);
+  }
+
+  out_size = size;
+  return image;
+}
+
+void OcclusionBuffer::write_depth_image(cstring filename, bool reduced,
+                                        Allocator* temp_allocator) const {
+  sizet size = 0;
+  u8* image = write_depth_image_memory(reduced, temp_allocator, size);
+  file_write_binary(filename, image, size);
+  hfree(image, temp_allocator);
+}
+
+// Self test ////////////////////////////////////////////////////////////////
+
+static bool occlusion_expect(bool condition, cstring what) {
+  if (!condition) {
+    HERROR("Occlusion buffer self test: {}", what);
+  }
+  return condition;
+}
+
+// Same size and header, pixels within one step of quantization.
+static bool occlusion_images_match(const u8* image, sizet size,
+                                   const u8* golden, sizet golden_size) {
+  if (size != golden_size) {
+    return false;
+  }
+  for (sizet i = 0; i < size; ++i) {
+    const i32 difference = (i32)image[i] - (i32)golden[i];
+    if (difference < -1 || difference > 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool occlusion_buffer_self_test(cstring golden_folder, Allocator* allocator) {
+  // Camera at the origin looking down -z, 90 degrees vertical field of view
+  // on a 2:1 buffer, so x/-z in [-2, 2] and y/-z in [-1, 1] are on screen.
+  // The short depth range keeps the occluders apart in the 8 bits image.
+  OcclusionBuffer buffer;
+  buffer.init(allocator, 128, 64);
+  buffer.begin(glm::perspectiveZO(glm::radians(90.0f), 2.0f, 1.0f, 20.f));
+
+  // A wall at z = -10 over the left half of the screen and a triangle at
+  // z = -5 in front of it, around the center.
+  const f32 positions[] = {-30.f, -15.f, -10.f, 0.f,  -15.f, -10.f,
+                           0.f,   15.f,  -10.f, -30.f, 15.f, -10.f,
+                           -10.f, -4.f,  -5.f,  2.f,  -4.f,  -5.f,
+                           -4.f,  4.f,   -5.f};
+  const u32 indices[] = {0, 1, 2, 0, 2, 3, 4, 5, 6};
+  buffer.add_occluder(glm::mat4(1.0f), positions, sizeof(f32) * 3, indices,
+                      ArraySize(indices));
+  buffer.rasterize(nullptr);
+
+  bool passed = occlusion_expect(buffer.stats.occluder_triangles == 3 &&
+                                     buffer.stats.dropped_triangles == 0,
+                                 "occluder triangles");
+
+  char golden_path[512];
+  snprintf(golden_path, ArraySize(golden_path), "%socclusion_buffer_blocks.pgm",
+           golden_folder);
+  sizet image_size = 0;
+  u8* image = buffer.write_depth_image_memory(true, allocator, image_size);
+  sizet golden_size = 0;
+  u8* golden = (u8*)file_read_binary(golden_path, allocator, &golden_size);
+  if (golden) {
+    passed &= occlusion_expect(
+        occlusion_images_match(image, image_size, golden, golden_size),
+        "reduced depth differs from the golden image");
+    hfree(golden, allocator);
+  } else {
+    buffer.write_depth_image(golden_path, true, allocator);
+    HWARN("Occlusion buffer self test: wrote the golden image {}",
+          golden_path);
+  }
+  hfree(image, allocator);
+
+  struct Bounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    bool visible;
+    cstring what;
+  };
+  const Bounds boxes[] = {
+      {{-12.f, -2.f, -22.f}, {-8.f, 2.f, -18.f}, false, "box behind the wall"},
+      {{-4.25f, -1.25f, -8.25f},
+       {-3.75f, -0.75f, -7.75f},
+       false,
+       "box behind the triangle"},
+      {{-6.f, -1.f, -4.f}, {-4.f, 1.f, -3.f}, true, "box in front"},
+      {{12.f, -2.f, -22.f}, {16.f, 2.f, -18.f}, true, "box beside the wall"},
+      {{40.f, -1.f, -11.f}, {42.f, 1.f, -9.f}, false, "box off screen"},
+      {{-1.f, -1.f, -1.f}, {1.f, 1.f, 1.f}, true, "box around the camera"},
+      {{-1.f, -1.f, 5.f}, {1.f, 1.f, 6.f}, false, "box behind the camera"},
+  };
+  for (u32 i = 0; i < ArraySize(boxes); ++i) {
+    passed &= occlusion_expect(
+        buffer.is_aabb_visible(boxes[i].min, boxes[i].max) == boxes[i].visible,
+        boxes[i].what);
+  }
+
+  passed &= occlusion_expect(
+      !buffer.is_sphere_visible(glm::vec3(-10.f, 0.f, -20.f), 1.0f),
+      "sphere behind the wall");
+  passed &= occlusion_expect(
+      buffer.is_sphere_visible(glm::vec3(14.f, 0.f, -20.f), 1.0f),
+      "sphere beside the wall");
+  passed &= occlusion_expect(
+      buffer.is_sphere_visible(glm::vec3(-5.f, 0.f, -4.f), 0.5f),
+      "sphere in front");
+
+  buffer.shutdown();
+
+  HINFO("Occlusion buffer self test {}", passed ? "passed" : "failed");
+  return passed;
+}
+
+}  // namespace Helix
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vendor/glm/glm/glm.hpp>
+
+#include "Core/Array.hpp"
+#include "Core/Platform.hpp"
+
+namespace enki {
+class TaskScheduler;
+}
+
+namespace Helix {
+struct Allocator;
+
+// Tiles are rasterized by separate tasks.
+static const u32 k_occlusion_tile_width = 64;
+static const u32 k_occlusion_tile_height = 32;
+// Pixels reduced by a texel of the hierarchical depth.
+static const u32 k_occlusion_block_size = 8;
+
+//
+// Screen space triangle, z is the projected depth.
+struct OcclusionTriangle {
+  glm::vec3 vertices[3];
+};  // struct OcclusionTriangle
+
+//
+//
+struct OcclusionBufferStats {
+  u32 occluder_triangles = 0;
+  // Triangles behind the camera, outside the screen or degenerate.
+  u32 dropped_triangles = 0;
+  u32 tested = 0;
+  // Tested bounds outside the frustum, then the ones inside it hidden by the
+  // occluders.
+  u32 frustum_culled = 0;
+  u32 occlusion_culled = 0;
+
+  f64 rasterize_ms = 0.0;
+  f64 test_ms = 0.0;
+};  // struct OcclusionBufferStats
+
+//
+// Low resolution depth buffer rasterized on the CPU from a few large
+// occluders. Bounds are tested against the maximum depth of the blocks they
+// cover, so anything partially visible passes. Depth grows with the distance,
+// as in the depth pyramid.
+struct OcclusionBuffer {
+  // The size is rounded up to whole tiles.
+  void init(Allocator* allocator, u32 width, u32 height);
+  void shutdown();
+
+  // Clears the occluders of the previous frame.
+  void begin(const glm::mat4& view_projection);
+  // Transforms and bins an indexed triangle list. Triangles crossing the near
+  // plane are dropped, which only makes the culling more conservative.
+  void add_occluder(const glm::mat4& model, const f32* positions,
+                    u32 position_stride, const u32* indices, u32 index_count);
+  // Rasterizes the binned triangles and reduces the hierarchical depth, a
+  // task per tile.
+  void rasterize(enki::TaskScheduler* task_scheduler);
+  void rasterize_tile(u32 tile_index);
+
+  // False when the bounds are behind the occluders or outside the screen.
+  // Bounds crossing the camera plane or without a finite corner are visible.
+  // Can be called from any thread once rasterize returned.
+  bool is_aabb_visible(const glm::vec3& min, const glm::vec3& max) const;
+  bool is_sphere_visible(const glm::vec3& center, f32 radius) const;
+
+  // Binary PGM of the depth, or of the reduced block depth, used to compare
+  // against golden images. The memory is allocated from 'allocator'.
+  u8* write_depth_image_memory(bool reduced, Allocator* allocator,
+                               sizet& out_size) const;
+  void write_depth_image(cstring filename, bool reduced,
+                         Allocator* temp_allocator) const;
+
+  glm::mat4 view_projection;
+
+  Array<OcclusionTriangle> triangles;
+  // Triangle indices binned per tile.
+  Array<u32>* tile_triangles = nullptr;
+
+  f32* depth = nullptr;
+  f32* block_depth = nullptr;
+
+  u32 width = 0;
+  u32 height = 0;
+  u32 tile_count_x = 0;
+  u32 tile_count_y = 0;
+  u32 block_count_x = 0;
+  u32 block_count_y = 0;
+
+  OcclusionBufferStats stats;
+  Allocator* allocator = nullptr;
+};  // struct OcclusionBuffer
+
+// Rasterizes a few fixed occluders, compares the reduced depth with
+// occlusion_buffer_blocks.pgm in golden_folder and tests boxes and spheres
+// with known visibility. A missing golden image is written, delete it to
+// regenerate it. Logs the mismatches, returns false if there are any.
+bool occlusion_buffer_self_test(cstring golden_folder, Allocator* allocator);
+
+}  // namespace Helix
@@ -0,0 +1,166 @@
+#include "Renderer/PassTimings.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "Core/File.hpp"
+#include "Core/Memory.hpp"
+#include "Core/Numerics.hpp"
+#include "Core/String.hpp"
+#include "Renderer/GPUDevice.hpp"
+
+namespace Helix {
+
+void PassTimingSamples::add(f32 milliseconds) {
+  samples[next] = milliseconds;
+  next = (next + 1) % k_pass_timing_window;
+  count = Helix::min(count + 1, k_pass_timing_window);
+}
+
+void PassTimingSamples::statistics(PassTimingStats& stats) const {
+  stats = {};
+  if (count == 0) {
+    return;
+  }
+
+  f32 sorted[k_pass_timing_window];
+  memcpy(sorted, samples, sizeof(f32) * count);
+  std::sort(sorted, sorted + count);
+
+  f64 sum = 0.0;
+  for (u32 i = 0; i < count; ++i) {
+    sum += sorted[i];
+  }
+
+  // Nearest rank percentiles.
+  auto percentile = [&](f32 p) {
+    const u32 rank = (u32)ceilf(p * count);
+    return sorted[Helix::clamp(rank, 1u, count) - 1];
+  };
+
+  stats.last =
+      samples[(next + k_pass_timing_window - 1) % k_pass_timing_window];
+  stats.min = sorted[0];
+  stats.average = (f32)(sum / count);
+  stats.p95 = percentile(0.95f);
+  stats.p99 = percentile(0.99f);
+  stats.sample_count = count;
+}
+
+void PassTimings::init(Allocator* allocator) {
+  passes.init(allocator, 16);
+  name_to_pass.init(allocator, 16);
+  name_to_pass.set_default_value(u32_max);
+}
+
+void PassTimings::shutdown() {
+  passes.shutdown();
+  name_to_pass.shutdown();
+}
+
+void PassTimings::reset() {
+  for (u32 i = 0; i < passes.size; ++i) {
+    passes[i].cpu = {};
+    passes[i].gpu = {};
+  }
+}
+
+PassTiming* PassTimings::access_pass(cstring name) {
+  const u64 key = hash_calculate(name);
+  u32 index = name_to_pass.get(key);
+  if (index == u32_max) {
+    index = passes.size;
+    passes.push({});
+    passes[index].name = name;
+    name_to_pass.insert(key, index);
+  }
+  return &passes[index];
+}
+
+void PassTimings::add_cpu_sample(cstring name, f32 milliseconds) {
+  access_pass(name)->cpu.add(milliseconds);
+}
+
+void PassTimings::add_gpu_sample(cstring name, f32 milliseconds) {
+  access_pass(name)->gpu.add(milliseconds);
+}
+
+void PassTimings::add_gpu_samples(const GPUTimestamp* timestamps, u32 count) {
+  for (u32 i = 0; i < count; ++i) {
+    const u32 index = name_to_pass.get(hash_calculate(timestamps[i].name));
+    if (index != u32_max) {
+      passes[index].gpu.add((f32)timestamps[i].elapsed_ms);
+    }
+  }
+}
+
+bool PassTimings::get_statistics(cstring name, PassTimingStats& cpu,
+                                 PassTimingStats& gpu) {
+  const u32 index = name_to_pass.get(hash_calculate(name));
+  if (index == u32_max) {
+    cpu = {};
+    gpu = {};
+    return false;
+  }
+
+  passes[index].cpu.statistics(cpu);
+  passes[index].gpu.statistics(gpu);
+  return cpu.sample_count > 0 || gpu.sample_count > 0;
+}
+
+static void pass_timings_append_json(StringBuffer& buffer, cstring name,
+                                     const PassTimingStats& stats) {
+  buffer.append_f(
+      "\"%s\": { \"last\": %.4f, \"min\": %.4f, \"average\": %.4f, "
+      "\"p95\": %.4f, \"p99\": %.4f, \"samples\": %u }",
+      name, stats.last, stats.min, stats.average, stats.p95, stats.p99,
+      stats.sample_count);
+}
+
+void PassTimings::write_json(cstring path, Allocator* temp_allocator) const {
+  StringBuffer buffer;
+  buffer.init(512 * (passes.size + 1), temp_allocator);
+
+  buffer.append("{\n  \"passes\": [\n");
+  for (u32 i = 0; i < passes.size; ++i) {
+    PassTimingStats cpu, gpu;
+    passes[i].cpu.statistics(cpu);
+    passes[i].gpu.statistics(gpu);
+
+    buffer.append_f("    { \"name\": \"%s\", ", passes[i].name);
+    pass_timings_append_json(buffer, "cpu", cpu);
+    buffer.append(", ");
+    pass_timings_append_json(buffer, "gpu", gpu);
+    buffer.append(i + 1 < passes.size ? " },\n" : " }\n");
+  }
+  buffer.append("  ]\n}\n");
+
+  file_write_binary(path, buffer.data, buffer.current_size);
+  buffer.shutdown();
+}
+
+void PassTimings::write_csv(cstring path, Allocator* temp_allocator) const {
+  StringBuffer buffer;
+  buffer.init(256 * (passes.size + 1), temp_allocator);
+
+  buffer.append("pass,timer,last,min,average,p95,p99,samples\n");
+  for (u32 i = 0; i < passes.size; ++i) {
+    PassTimingStats stats[2];
+    passes[i].cpu.statistics(stats[0]);
+    passes[i].gpu.statistics(stats[1]);
+
+    static cstring timers[2] = {"cpu", "gpu"};
+    for (u32 t = 0; t < 2; ++t) {
+      buffer.append_f("%s,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%u\n", passes[i].name,
+                      timers[t], stats[t].last, stats[t].min,
+                      stats[t].average, stats[t].p95, stats[t].p99,
+                      stats[t].sample_count);
+    }
+  }
+
+  file_write_binary(path, buffer.data, buffer.current_size);
+  buffer.shutdown();
+}
+
+}  // namespace Helix
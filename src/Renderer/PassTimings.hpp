@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Core/Array.hpp"
+#include "Core/HashMap.hpp"
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+struct GPUTimestamp;
+
+// Pass timings /////////////////////////////////////////////////////////////
+// CPU recording time and GPU time of every frame graph pass over the last
+// frames. The GPU times come from the timestamps of the nodes, a frame or two
+// after the CPU ones. Statistics are computed on request from the window of
+// samples, they can be read by name or dumped to JSON or CSV.
+
+static const u32 k_pass_timing_window = 240;
+
+//
+// Milliseconds, all 0 without samples.
+struct PassTimingStats {
+  f32 last = 0.f;
+  f32 min = 0.f;
+  f32 average = 0.f;
+  f32 p95 = 0.f;
+  f32 p99 = 0.f;
+  u32 sample_count = 0;
+};  // struct PassTimingStats
+
+//
+// Ring buffer of the last k_pass_timing_window samples.
+struct PassTimingSamples {
+  void add(f32 milliseconds);
+  void statistics(PassTimingStats& stats) const;
+
+  f32 samples[k_pass_timing_window];
+  u32 count = 0;
+  u32 next = 0;
+};  // struct PassTimingSamples
+
+//
+//
+struct PassTiming {
+  cstring name;
+  PassTimingSamples cpu;
+  PassTimingSamples gpu;
+};  // struct PassTiming
+
+//
+//
+struct PassTimings {
+  void init(Allocator* allocator);
+  void shutdown();
+  // Drops the samples, the passes stay listed.
+  void reset();
+
+  // The name must outlive the timings, as the frame graph node names do.
+  void add_cpu_sample(cstring name, f32 milliseconds);
+  void add_gpu_sample(cstring name, f32 milliseconds);
+  // Samples the timestamps of the listed passes only.
+  void add_gpu_samples(const GPUTimestamp* timestamps, u32 count);
+
+  // Returns false when the pass has no samples.
+  bool get_statistics(cstring name, PassTimingStats& cpu,
+                      PassTimingStats& gpu);
+
+  // One entry per pass with the CPU and GPU statistics.
+  void write_json(cstring path, Allocator* temp_allocator) const;
+  void write_csv(cstring path, Allocator* temp_allocator) const;
+
+  PassTiming* access_pass(cstring name);
+
+  Array<PassTiming> passes;
+  FlatHashMap<u64, u32> name_to_pass;
+};  // struct PassTimings
+
+}  // namespace Helix
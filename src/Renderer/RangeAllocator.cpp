@@ -0,0 +1,165 @@
+#include "Renderer/RangeAllocator.hpp"
+
+#include <string.h>
+
+#include "Core/Assert.hpp"
+#include "Core/Memory.hpp"
+
+namespace Helix {
+
+static u32 range_align(u32 offset, u32 alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+void RangeAllocator::init(Allocator* allocator, u32 capacity_,
+                          u32 used_count) {
+  HASSERT(used_count <= capacity_);
+  free_ranges.init(allocator, 16);
+  pending_ranges.init(allocator, 16);
+
+  capacity = capacity_;
+  allocated_count = used_count;
+  if (used_count < capacity) {
+    free_ranges.push({used_count, capacity - used_count});
+  }
+}
+
+void RangeAllocator::shutdown() {
+  free_ranges.shutdown();
+  pending_ranges.shutdown();
+  capacity = 0;
+  allocated_count = 0;
+}
+
+u32 RangeAllocator::allocate(u32 count, u32 alignment) {
+  if (count == 0) {
+    return 0;
+  }
+
+  for (u32 i = 0; i < free_ranges.size; ++i) {
+    Range& range = free_ranges[i];
+    const u32 offset = range_align(range.offset, alignment);
+    const u32 range_end = range.offset + range.count;
+    if (offset + count > range_end) {
+      continue;
+    }
+
+    const u32 padding = offset - range.offset;
+    const u32 tail = range_end - (offset + count);
+    if (padding > 0 && tail > 0) {
+      // Both sides stay free: split the range in two.
+      range.count = padding;
+      free_ranges.push({});
+      memmove(free_ranges.data + i + 2, free_ranges.data + i + 1,
+              sizeof(Range) * (free_ranges.size - i - 2));
+      free_ranges[i + 1] = {offset + count, tail};
+    } else if (padding > 0) {
+      range.count = padding;
+    } else if (tail > 0) {
+      range = {offset + count, tail};
+    } else {
+      memmove(free_ranges.data + i, free_ranges.data + i + 1,
+              sizeof(Range) * (free_ranges.size - i - 1));
+      free_ranges.pop();
+    }
+
+    allocated_count += count;
+    return offset;
+  }
+  return u32_max;
+}
+
+void RangeAllocator::free(u32 offset, u32 count) {
+  if (count == 0) {
+    return;
+  }
+  HASSERT(offset + count <= capacity && count <= allocated_count);
+  allocated_count -= count;
+
+  // First free range after the freed one.
+  u32 next = 0;
+  while (next < free_ranges.size && free_ranges[next].offset < offset) {
+    ++next;
+  }
+  HASSERT(next == free_ranges.size ||
+          offset + count <= free_ranges[next].offset);
+
+  const bool merge_previous =
+      next > 0 &&
+      free_ranges[next - 1].offset + free_ranges[next - 1].count == offset;
+  const bool merge_next = next < free_ranges.size &&
+                          offset + count == free_ranges[next].offset;
+
+  if (merge_previous && merge_next) {
+    free_ranges[next - 1].count += count + free_ranges[next].count;
+    memmove(free_ranges.data + next, free_ranges.data + next + 1,
+            sizeof(Range) * (free_ranges.size - next - 1));
+    free_ranges.pop();
+  } else if (merge_previous) {
+    free_ranges[next - 1].count += count;
+  } else if (merge_next) {
+    free_ranges[next].offset = offset;
+    free_ranges[next].count += count;
+  } else {
+    free_ranges.push({});
+    memmove(free_ranges.data + next + 1, free_ranges.data + next,
+            sizeof(Range) * (free_ranges.size - next - 1));
+    free_ranges[next] = {offset, count};
+  }
+}
+
+void RangeAllocator::free_deferred(u32 offset, u32 count,
+                                   u64 release_frame) {
+  if (count > 0) {
+    pending_ranges.push({{offset, count}, release_frame});
+  }
+}
+
+void RangeAllocator::update(u64 frame) {
+  for (u32 i = 0; i < pending_ranges.size;) {
+    const PendingRange& pending = pending_ranges[i];
+    if (pending.release_frame <= frame) {
+      free(pending.range.offset, pending.range.count);
+      pending_ranges.delete_swap(i);
+    } else {
+      ++i;
+    }
+  }
+}
+
+bool RangeAllocator::can_allocate(u32 count, u32 alignment) const {
+  if (count == 0) {
+    return true;
+  }
+  for (u32 i = 0; i < free_ranges.size; ++i) {
+    const Range& range = free_ranges[i];
+    if (range_align(range.offset, alignment) + count <=
+        range.offset + range.count) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RangeAllocator::grow(u32 new_capacity) {
+  if (new_capacity <= capacity) {
+    return;
+  }
+
+  const u32 old_capacity = capacity;
+  // free merges the new range with a free tail.
+  capacity = new_capacity;
+  allocated_count += new_capacity - old_capacity;
+  free(old_capacity, new_capacity - old_capacity);
+}
+
+void RangeAllocator::append_allocated(u32 new_capacity) {
+  if (new_capacity <= capacity) {
+    return;
+  }
+
+  allocated_count += new_capacity - capacity;
+  capacity = new_capacity;
+}
+
+}  // namespace Helix
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Core/Array.hpp"
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+
+//
+// Elements [offset, offset + count) of a pool.
+struct Range {
+  u32 offset;
+  u32 count;
+};  // struct Range
+
+//
+// A freed range waiting for the frames that may still read it.
+struct PendingRange {
+  Range range;
+  u64 release_frame;
+};  // struct PendingRange
+
+//
+// First fit suballocator of a growable GPU pool, in elements. Free ranges are
+// sorted by offset and merged with their neighbours. Freed ranges can be
+// deferred until the frames in flight stop reading them.
+struct RangeAllocator {
+  // [0, used_count) is allocated, the rest of the capacity is free.
+  void init(Allocator* allocator, u32 capacity, u32 used_count = 0);
+  void shutdown();
+
+  // Returns u32_max when no free range fits. Offsets are multiples of
+  // alignment.
+  u32 allocate(u32 count, u32 alignment = 1);
+  void free(u32 offset, u32 count);
+  // The range is freed by the first update at or after release_frame.
+  void free_deferred(u32 offset, u32 count, u64 release_frame);
+  void update(u64 frame);
+
+  bool can_allocate(u32 count, u32 alignment = 1) const;
+  // Appends [capacity, new_capacity) to the free ranges.
+  void grow(u32 new_capacity);
+  // Appends [capacity, new_capacity) as allocated, for elements written past
+  // the end of the pool.
+  void append_allocated(u32 new_capacity);
+
+  Array<Range> free_ranges;
+  Array<PendingRange> pending_ranges;
+
+  u32 capacity = 0;
+  // Elements allocated or waiting for their release frame.
+  u32 allocated_count = 0;
+};  // struct RangeAllocator
+
+}  // namespace Helix
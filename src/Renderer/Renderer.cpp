@@ -133,6 +133,7 @@ void Renderer::init(const RendererCreation& creation) {
   resource_cache.init(creation.allocator);
 
   textures_to_update.init(creation.allocator, 400, 400);
+  textures_to_copy.init(creation.allocator, 16);
   // Init resource hashes
   TextureResource::k_type_hash = hash_calculate(TextureResource::k_type);
   BufferResource::k_type_hash = hash_calculate(BufferResource::k_type);
@@ -154,6 +155,7 @@ void Renderer::shutdown() {
   resource_name_buffer.shutdown();
   gpu_heap_budgets.shutdown();
   textures_to_update.shutdown();
+  textures_to_copy.shutdown();
 
   textures.shutdown();
   buffers.shutdown();
@@ -179,9 +181,29 @@ void Renderer::end_frame() {
   gpu->present(nullptr);
 }
 
+sizet Renderer::update_gpu_heap_budgets() {
+  vmaGetHeapBudgets(gpu->vma_allocator, gpu_heap_budgets.data);
+
+  const VkPhysicalDeviceMemoryProperties* memory_properties = nullptr;
+  vmaGetMemoryProperties(gpu->vma_allocator, &memory_properties);
+
+  sizet available = 0;
+  for (u32 i = 0; i < gpu_heap_budgets.size; ++i) {
+    if ((memory_properties->memoryHeaps[i].flags &
+         VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0) {
+      continue;
+    }
+    const VmaBudget& budget = gpu_heap_budgets[i];
+    if (budget.budget > budget.usage) {
+      available += budget.budget - budget.usage;
+    }
+  }
+  return available;
+}
+
 void Renderer::imgui_draw() {
   // Print memory stats
-  vmaGetHeapBudgets(gpu->vma_allocator, gpu_heap_budgets.data);
+  update_gpu_heap_budgets();
 
   sizet total_memory_used = 0;
   for (u32 i = 0; i < gpu->get_memory_heap_count(); ++i) {
@@ -619,19 +641,82 @@ static void generate_mipmaps(Helix::Texture* texture, Helix::CommandBuffer* cb,
   }
 }
 
+static void copy_texture_mips(Helix::Texture* source,
+                              Helix::Texture* destination, u32 source_mip,
+                              Helix::CommandBuffer* cb) {
+  using namespace Helix;
+
+  const u32 mip_count = destination->mip_level_count;
+  HASSERT(source_mip + mip_count <= source->mip_level_count);
+
+  util_add_image_barrier(cb->device, cb->vk_handle, source->vk_image,
+                         RESOURCE_STATE_SHADER_RESOURCE,
+                         RESOURCE_STATE_COPY_SOURCE, source_mip, mip_count,
+                         false);
+  util_add_image_barrier(cb->device, cb->vk_handle, destination->vk_image,
+                         RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_COPY_DEST, 0,
+                         mip_count, false);
+
+  VkImageCopy regions[16]{};
+  HASSERT(mip_count <= ArraySize(regions));
+  for (u32 mip = 0; mip < mip_count; ++mip) {
+    VkImageCopy& region = regions[mip];
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, source_mip + mip, 0, 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1};
+    const u32 width = destination->width >> mip;
+    const u32 height = destination->height >> mip;
+    region.extent = {width ? width : 1, height ? height : 1, 1};
+  }
+  vkCmdCopyImage(cb->vk_handle, source->vk_image,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination->vk_image,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_count, regions);
+
+  util_add_image_barrier(cb->device, cb->vk_handle, source->vk_image,
+                         RESOURCE_STATE_COPY_SOURCE,
+                         RESOURCE_STATE_SHADER_RESOURCE, source_mip, mip_count,
+                         false);
+  util_add_image_barrier(cb->device, cb->vk_handle, destination->vk_image,
+                         RESOURCE_STATE_COPY_DEST,
+                         RESOURCE_STATE_SHADER_RESOURCE, 0, mip_count, false);
+  destination->state = RESOURCE_STATE_SHADER_RESOURCE;
+}
+
+void Renderer::add_texture_copy(TextureHandle source,
+                                TextureHandle destination, u32 source_mip) {
+  std::lock_guard<std::mutex> guard(texture_update_mutex);
+
+  textures_to_copy.push({source, destination, source_mip});
+}
+
 void Renderer::add_texture_update_commands(u32 thread_id) {
   std::lock_guard<std::mutex> guard(texture_update_mutex);
 
-  if (num_textures_to_update == 0) {
+  if (num_textures_to_update == 0 && textures_to_copy.size == 0) {
     return;
   }
 
-  CommandBuffer* cb = gpu->get_command_buffer(thread_id, false);
-  cb->begin();
+  CommandBuffer* cb = gpu->get_command_buffer(thread_id, true);
 
   for (u32 i = 0; i < num_textures_to_update; ++i) {
     Texture* texture = gpu->access_texture(textures_to_update[i]);
 
+    // Block compressed textures are uploaded with all their mips and cannot
+    // be blitted, so acquire the whole chain and make it readable.
+    if (TextureFormat::is_block_compressed(texture->vk_format)) {
+      util_add_image_barrier(
+          cb->device, cb->vk_handle, texture->vk_image,
+          RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_COPY_SOURCE, 0,
+          texture->mip_level_count, false, gpu->vulkan_transfer_queue_family,
+          gpu->vulkan_main_queue_family, QueueType::CopyTransfer,
+          QueueType::Graphics);
+      util_add_image_barrier(cb->device, cb->vk_handle, texture->vk_image,
+                             RESOURCE_STATE_COPY_SOURCE,
+                             RESOURCE_STATE_SHADER_RESOURCE, 0,
+                             texture->mip_level_count, false);
+      texture->state = RESOURCE_STATE_SHADER_RESOURCE;
+      continue;
+    }
+
     // TODO set the vk_image_layout of the texture
     util_add_image_barrier(cb->device, cb->vk_handle, texture->vk_image,
                            RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_COPY_SOURCE,
@@ -642,6 +727,14 @@ void Renderer::add_texture_update_commands(u32 thread_id) {
     generate_mipmaps(texture, cb, true);
   }
 
+  for (u32 i = 0; i < textures_to_copy.size; ++i) {
+    const TextureCopy& copy = textures_to_copy[i];
+    copy_texture_mips(gpu->access_texture(copy.source),
+                      gpu->access_texture(copy.destination), copy.source_mip,
+                      cb);
+  }
+  textures_to_copy.clear();
+
   // TODO: this is done before submitting to the queue in the device.
   // cb->end();
   gpu->queue_command_buffer(cb);
@@ -198,6 +198,14 @@ struct Renderer : public Service {
   // Multithread friendly update to textures
   void add_texture_to_update(Helix::TextureHandle texture);
   void add_texture_update_commands(u32 thread_id);
+  // Copies mips [source_mip, source_mip + destination mip count) of a shader
+  // readable texture into a new one, recorded with the texture updates.
+  void add_texture_copy(TextureHandle source, TextureHandle destination,
+                        u32 source_mip);
+
+  // Refreshes gpu_heap_budgets and returns the device local memory that can
+  // still be allocated within the budget VMA reports.
+  sizet update_gpu_heap_budgets();
 
   f64 fps = 0;
 
@@ -214,6 +222,13 @@ struct Renderer : public Service {
   Array<TextureHandle> textures_to_update;
   u32 num_textures_to_update = 0;
 
+  struct TextureCopy {
+    TextureHandle source;
+    TextureHandle destination;
+    u32 source_mip;
+  };
+  Array<TextureCopy> textures_to_copy;
+
   StringBuffer resource_name_buffer;
 
   Helix::GpuDevice* gpu;
@@ -14,13 +14,16 @@
 #include "Core/Time.hpp"
 #include "Renderer/GPUEnum.hpp"
 #include "Renderer/GPUResources.hpp"
+#include "Renderer/GeometryCache.hpp"
+#include "Renderer/MatrixBatch.hpp"
 #include "glm/glm/ext/matrix_clip_space.hpp"
 #include "glm/glm/ext/matrix_transform.hpp"
 #include "glm/glm/trigonometric.hpp"
 #include "vulkan/vulkan_core.h"
 // #include "glm/glm/ext/quaternion_geometric.hpp"
 
-const u32 MAX_LIGHTS = 256;
+// Point lights the light buffers start with, they grow past it.
+static const u32 k_min_light_buffer_capacity = 256;
 
 namespace Helix {
 float square(float r) { return r * r; }
@@ -30,39 +33,6 @@ glm::vec4 normalize_plane(glm::vec4 plane) {
   return (plane / glm::length(normal));
 }
 
-glm::vec4 project_sphere(glm::vec3 C, float r, float znear, float P00,
-                         float P11, glm::mat4 P) {
-  if (C.z + r > -znear) return glm::vec4(0, 0, 0, 0);
-
-  glm::vec4 aabb;
-
-  glm::vec4 min_p = glm::vec4(C.x - r, C.y - r, C.z, 1.0f);
-  glm::vec4 max_p = glm::vec4(C.x + r, C.y + r, C.z, 1.0f);
-
-  // aabb = glm::vec4(min_clip.x / min_clip.w, min_clip.y / min_clip.w,
-  // max_clip.x / max_clip.w, max_clip.y / max_clip.w);
-
-  // aabb = glm::vec4(aabb.x + 1.0f, 1.0f - aabb.y, aabb.z + 1.0f, 1.0f -
-  // aabb.w) * 0.5f;
-
-  glm::vec2 cx = glm::vec2(C.x, -C.z);
-  glm::vec2 vx = glm::vec2(sqrt(dot(cx, cx) - r * r), r);
-  glm::vec2 minx = glm::mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
-  glm::vec2 maxx = glm::mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
-
-  glm::vec2 cy = glm::vec2(-C.y, -C.z);
-  glm::vec2 vy = glm::vec2(sqrt(dot(cy, cy) - r * r), r);
-  glm::vec2 miny = glm::mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
-  glm::vec2 maxy = glm::mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
-
-  aabb = glm::vec4(minx.x / minx.y * P00, miny.x / miny.y * P11,
-                   maxx.x / maxx.y * P00, maxy.x / maxy.y * P11);
-  aabb = aabb * glm::vec4(0.5f, -0.5f, 0.5f, -0.5f) +
-         glm::vec4(0.5f);  // clip space -> uv space
-
-  return aabb;
-}
-
 // Helper functions //////////////////////////////////////////////////
 
 // Light
@@ -152,17 +122,24 @@ static FrameGraphResource* get_output_texture(FrameGraph* frame_graph,
 }
 //
 //
-static void copy_gpu_mesh_matrix(MeshData& gpu_mesh_data, const Mesh& mesh,
-                                 const f32 global_scale,
-                                 const ResourcePool* mesh_nodes) {
-  // Apply global scale matrix
-  glm::mat4 scale_mat = glm::scale(
-      glm::mat4(1.0f), glm::vec3(global_scale, global_scale, global_scale));
-  MeshNode* mesh_node = (MeshNode*)mesh_nodes->access_resource(mesh.node_index);
-  gpu_mesh_data.model =
-      mesh_node->world_transform.calculate_matrix() * scale_mat;
-  gpu_mesh_data.inverse_model =
-      glm::inverse(glm::transpose(gpu_mesh_data.model));
+static const glm::mat4& instance_world_matrix(const MeshInstance& instance,
+                                              const NodePool& node_pool) {
+  const MeshNode* mesh_node =
+      (const MeshNode*)node_pool.mesh_nodes.access_resource(
+          instance.node_index);
+  return node_pool.get_world_matrix(mesh_node);
+}
+
+// World space bounding sphere, same as the culling shaders without the
+// inflation.
+static void mesh_world_sphere(const Mesh& mesh, const glm::mat4& model,
+                              glm::vec3& out_center, f32& out_radius) {
+  out_center =
+      glm::vec3(model * glm::vec4(glm::vec3(mesh.bounding_sphere), 1.0f));
+  const f32 scale = glm::max(glm::length(glm::vec3(model[0])),
+                             glm::max(glm::length(glm::vec3(model[1])),
+                                      glm::length(glm::vec3(model[2]))));
+  out_radius = mesh.bounding_sphere.w * scale;
 }
 //
 // MeshEarlyCullingPass
@@ -181,9 +158,8 @@ void MeshEarlyCullingPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
   mesh_draw_counts.transparent_mesh_visible_count = 0;
   mesh_draw_counts.transparent_mesh_culled_count = 0;
 
-  mesh_draw_counts.total_count =
-      scene->opaque_meshes.size + scene->transparent_meshes.size;
-  mesh_draw_counts.total_opaque_mesh_count = scene->opaque_meshes.size;
+  mesh_draw_counts.total_count = scene->gpu_instance_count;
+  mesh_draw_counts.total_opaque_mesh_count = scene->gpu_opaque_instance_count;
   mesh_draw_counts.depth_pyramid_texture_index = depth_pyramid_texture_index;
   mesh_draw_counts.late_flag = 0;
 
@@ -211,20 +187,18 @@ void MeshEarlyCullingPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
     renderer->gpu->unmap_buffer(cb_map);
   }
 
-  gpu_commands->bind_pipeline(frustum_cull_pipeline);
+  // Instances hidden behind the CPU occluders are not culled again.
+  cb_map.buffer = scene->mesh_occluded_instance_buffers[buffer_frame_index];
+  u8* occluded_instances = (u8*)renderer->gpu->map_buffer(cb_map);
+  if (occluded_instances) {
+    memcpy(occluded_instances, scene->occluded_instances.bits,
+           scene->occluded_instances.size);
 
-  const Buffer* indirect_draw_commands_sb = renderer->gpu->access_buffer(
-      scene->mesh_indirect_draw_early_command_buffers[buffer_frame_index]);
-  util_add_buffer_barrier(
-      renderer->gpu, gpu_commands->vk_handle,
-      indirect_draw_commands_sb->vk_handle, RESOURCE_STATE_INDIRECT_ARGUMENT,
-      RESOURCE_STATE_UNORDERED_ACCESS, indirect_draw_commands_sb->size);
+    renderer->gpu->unmap_buffer(cb_map);
+  }
 
-  const Buffer* count_sb = renderer->gpu->access_buffer(
-      scene->mesh_draw_count_buffers[buffer_frame_index]);
-  util_add_buffer_barrier(renderer->gpu, gpu_commands->vk_handle,
-                          count_sb->vk_handle, RESOURCE_STATE_INDIRECT_ARGUMENT,
-                          RESOURCE_STATE_UNORDERED_ACCESS, count_sb->size);
+  // The frame graph transitions the draw command and count buffers.
+  gpu_commands->bind_pipeline(frustum_cull_pipeline);
 
   gpu_commands->bind_descriptor_set(
       &frustum_cull_descriptor_set[buffer_frame_index], 1, nullptr, 0);
@@ -235,15 +209,6 @@ void MeshEarlyCullingPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
   u32 group_x = Helix::ceilu32(scene->mesh_draw_counts.total_count /
                                (f32)pipeline->local_size[0]);
   gpu_commands->dispatch(group_x, 1, 1);
-
-  util_add_buffer_barrier(
-      renderer->gpu, gpu_commands->vk_handle,
-      indirect_draw_commands_sb->vk_handle, RESOURCE_STATE_UNORDERED_ACCESS,
-      RESOURCE_STATE_INDIRECT_ARGUMENT, indirect_draw_commands_sb->size);
-
-  util_add_buffer_barrier(renderer->gpu, gpu_commands->vk_handle,
-                          count_sb->vk_handle, RESOURCE_STATE_UNORDERED_ACCESS,
-                          RESOURCE_STATE_INDIRECT_ARGUMENT, count_sb->size);
 }
 
 void MeshEarlyCullingPass::prepare_draws(Scene& scene, FrameGraph* frame_graph,
@@ -254,7 +219,7 @@ void MeshEarlyCullingPass::prepare_draws(Scene& scene, FrameGraph* frame_graph,
 
     return;
   }
-  enabled = node->enabled;
+  enabled = node->active();
 
   renderer = scene.renderer;
   GpuDevice& gpu = *renderer->gpu;
@@ -278,6 +243,7 @@ void MeshEarlyCullingPass::prepare_draws(Scene& scene, FrameGraph* frame_graph,
           .buffer(scene.mesh_instances_buffer, 10)
           .buffer(scene.mesh_draw_count_buffers[i], 11)
           .buffer(scene.mesh_bounds_buffer, 12)
+          .buffer(scene.mesh_occluded_instance_buffers[i], 13)
           .buffer(scene.debug_line_buffer, 20)
           .buffer(scene.debug_line_count_buffer, 21)
           .buffer(scene.debug_line_indirect_command_buffer, 22)
@@ -311,21 +277,9 @@ void MeshLateCullingPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
   // const Buffer* mesh_draw_count_buffer =
   // renderer->gpu->access_buffer(scene->mesh_draw_count_buffers[buffer_frame_index]);
 
+  // The frame graph transitions the draw command and count buffers.
   gpu_commands->bind_pipeline(frustum_cull_pipeline);
 
-  const Buffer* indirect_draw_commands_sb = renderer->gpu->access_buffer(
-      scene->mesh_indirect_draw_early_command_buffers[buffer_frame_index]);
-  util_add_buffer_barrier(
-      renderer->gpu, gpu_commands->vk_handle,
-      indirect_draw_commands_sb->vk_handle, RESOURCE_STATE_INDIRECT_ARGUMENT,
-      RESOURCE_STATE_UNORDERED_ACCESS, indirect_draw_commands_sb->size);
-
-  const Buffer* count_sb = renderer->gpu->access_buffer(
-      scene->mesh_draw_count_buffers[buffer_frame_index]);
-  util_add_buffer_barrier(renderer->gpu, gpu_commands->vk_handle,
-                          count_sb->vk_handle, RESOURCE_STATE_INDIRECT_ARGUMENT,
-                          RESOURCE_STATE_UNORDERED_ACCESS, count_sb->size);
-
   // TODO: Right now setting this to 0 and updating the buffer does nothing
   // since it uses late_flag as the count buffer in the gbuffer_late pass.
   // scene->mesh_draw_counts.opaque_mesh_visible_count = 0;
@@ -340,17 +294,9 @@ void MeshLateCullingPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
   gpu_commands->bind_descriptor_set(
       &frustum_cull_descriptor_set[buffer_frame_index], 1, nullptr, 0);
 
-  u32 group_x = Helix::ceilu32(scene->mesh_draw_counts.total_count / 64.0f);
+  // mesh_draw_counts is written by the early pass, possibly on another thread.
+  u32 group_x = Helix::ceilu32(scene->gpu_instance_count / 64.0f);
   gpu_commands->dispatch(group_x, 1, 1);
-
-  util_add_buffer_barrier(
-      renderer->gpu, gpu_commands->vk_handle,
-      indirect_draw_commands_sb->vk_handle, RESOURCE_STATE_UNORDERED_ACCESS,
-      RESOURCE_STATE_INDIRECT_ARGUMENT, indirect_draw_commands_sb->size);
-
-  util_add_buffer_barrier(renderer->gpu, gpu_commands->vk_handle,
-                          count_sb->vk_handle, RESOURCE_STATE_UNORDERED_ACCESS,
-                          RESOURCE_STATE_INDIRECT_ARGUMENT, count_sb->size);
 }
 
 void MeshLateCullingPass::prepare_draws(Scene& scene, FrameGraph* frame_graph,
@@ -363,7 +309,7 @@ void MeshLateCullingPass::prepare_draws(Scene& scene, FrameGraph* frame_graph,
   }
   // node->enabled = false;
 
-  enabled = node->enabled;
+  enabled = node->active();
 
   renderer = scene.renderer;
   GpuDevice& gpu = *renderer->gpu;
@@ -433,7 +379,7 @@ void DirectionalShadowMapPass::render(CommandBuffer* gpu_commands,
       scene->mesh_indirect_draw_early_command_buffers[buffer_frame_index],
       offsetof(GPUMeshDrawCommand, indirectMS),
       scene->mesh_draw_count_buffers[buffer_frame_index], 0,
-      scene->opaque_meshes.size, sizeof(GPUMeshDrawCommand));
+      scene->gpu_opaque_instance_count, sizeof(GPUMeshDrawCommand));
 }
 
 void DirectionalShadowMapPass::prepare_draws(Scene& scene,
@@ -559,7 +505,7 @@ void GBufferEarlyPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
       scene->mesh_indirect_draw_early_command_buffers[buffer_frame_index],
       offsetof(GPUMeshDrawCommand, indirectMS),
       scene->mesh_draw_count_buffers[buffer_frame_index], 0,
-      scene->opaque_meshes.size, sizeof(GPUMeshDrawCommand));
+      scene->gpu_opaque_instance_count, sizeof(GPUMeshDrawCommand));
 }
 
 void GBufferEarlyPass::init() {
@@ -629,8 +575,8 @@ void GBufferLatePass::render(CommandBuffer* gpu_commands, Scene* scene_) {
       scene->mesh_indirect_draw_late_command_buffers[buffer_frame_index],
       offsetof(GPUMeshDrawCommand, indirectMS),
       scene->mesh_draw_count_buffers[buffer_frame_index],
-      offsetof(GPUMeshDrawCounts, late_flag), scene->opaque_meshes.size,
-      sizeof(GPUMeshDrawCommand));
+      offsetof(GPUMeshDrawCounts, late_flag),
+      scene->gpu_opaque_instance_count, sizeof(GPUMeshDrawCommand));
 }
 
 void GBufferLatePass::init() {
@@ -705,20 +651,17 @@ void DepthPyramidPass::post_render(u32 current_frame_index,
     u32 width = depth_pyramid_texture->width;
     u32 height = depth_pyramid_texture->height;
 
-    FrameGraphResource* depth_resource =
-        (FrameGraphResource*)frame_graph->get_resource("depth");
-    TextureHandle depth_handle = depth_resource->resource_info.texture.handle;
-    Texture* depth_texture = gpu->access_texture(depth_handle);
-
-    util_add_image_barrier(gpu, gpu_commands->vk_handle, depth_texture,
-                           RESOURCE_STATE_SHADER_RESOURCE, 0, 1, true);
-
+    // The depth input is transitioned by the frame graph. The pass can run on
+    // the async compute queue, the stages of the barriers are the ones of
+    // the queue of the command buffer.
+    const QueueType::Enum queue = gpu_commands->queue_type;
     for (u32 mip_index = 0; mip_index < depth_pyramid_texture->mip_level_count;
          ++mip_index) {
       util_add_image_barrier(
           gpu, gpu_commands->vk_handle, depth_pyramid_texture->vk_image,
           RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_UNORDERED_ACCESS, mip_index,
-          1, false);
+          1, false, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, queue,
+          queue);
 
       gpu_commands->bind_descriptor_set(
           &depth_hierarchy_descriptor_set[mip_index], 1, nullptr, 0);
@@ -747,7 +690,8 @@ void DepthPyramidPass::post_render(u32 current_frame_index,
       util_add_image_barrier(
           gpu, gpu_commands->vk_handle, depth_pyramid_texture->vk_image,
           RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE,
-          mip_index, 1, false);
+          mip_index, 1, false, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+          queue, queue);
 
       width /= 2;
       height /= 2;
@@ -773,6 +717,13 @@ void DepthPyramidPass::on_resize(GpuDevice& gpu, FrameGraph* frame_graph,
   // create_depth_pyramid_resource(depth_texture);
 }
 
+void DepthPyramidPass::on_compile(GpuDevice& gpu, FrameGraph* frame_graph) {
+  if (!enabled) return;
+
+  // The first level reads the depth attachment, recreated by the compile.
+  gpu.update_descriptor_set(depth_hierarchy_descriptor_set[0]);
+}
+
 void DepthPyramidPass::prepare_draws(Scene& scene_, FrameGraph* frame_graph,
                                      Allocator* resident_allocator) {
   glTFScene& scene = (glTFScene&)scene_;
@@ -785,7 +736,7 @@ void DepthPyramidPass::prepare_draws(Scene& scene_, FrameGraph* frame_graph,
 
     return;
   }
-  enabled = node->enabled;
+  enabled = node->active();
   if (!enabled) return;
 
   GpuDevice& gpu = *renderer->gpu;
@@ -896,6 +847,55 @@ void DepthPyramidPass::create_depth_pyramid_resource(Texture* depth_texture) {
   }
 }
 
+//
+// LightClusteringPass ////////////////////////////////////////////////
+void LightClusteringPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
+  if (!renderer) return;
+
+  // One invocation per cluster, the frame graph transitions the lists for
+  // the passes reading them.
+  gpu_commands->bind_pipeline(light_clustering_pipeline);
+  gpu_commands->bind_descriptor_set(&light_clustering_d_set, 1, nullptr, 0);
+
+  const Pipeline* pipeline =
+      renderer->gpu->access_pipeline(light_clustering_pipeline);
+  gpu_commands->dispatch(
+      Helix::ceilu32(k_light_cluster_count / (f32)pipeline->local_size[0]), 1,
+      1);
+}
+
+void LightClusteringPass::prepare_draws(glTFScene& scene,
+                                        FrameGraph* frame_graph,
+                                        Allocator* resident_allocator) {
+  // Prepared even when the node is culled, compile can activate it later.
+  FrameGraphNode* node = frame_graph->get_node("light_clustering_pass");
+  if (node == nullptr || renderer) return;
+  renderer = scene.renderer;
+
+  Program* lighting_program =
+      renderer->resource_cache.programs.get(hash_calculate("pbr_lighting"));
+  light_clustering_pipeline =
+      lighting_program
+          ->passes[lighting_program->get_pass_index("light_clustering")]
+          .pipeline;
+
+  DescriptorSetCreation ds_creation{};
+  DescriptorSetLayoutHandle layout = renderer->gpu->get_descriptor_set_layout(
+      light_clustering_pipeline, k_material_descriptor_set_index);
+  ds_creation.buffer(scene.scene_constant_buffer, 0)
+      .buffer(scene.light_data_buffer, 1)
+      .buffer(scene.light_cluster_bounds_buffer, 2)
+      .buffer(scene.light_cluster_data_buffer, 3)
+      .set_layout(layout);
+  light_clustering_d_set = renderer->gpu->create_descriptor_set(ds_creation);
+}
+
+void LightClusteringPass::free_gpu_resources() {
+  if (!renderer) return;
+
+  renderer->gpu->destroy_descriptor_set(light_clustering_d_set);
+}
+
 //
 // LightPass //////////////////////////////////////////////////////////
 void LightPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
@@ -933,20 +933,23 @@ void LightPass::prepare_draws(glTFScene& scene, FrameGraph* frame_graph,
 
   FrameGraphNode* node = frame_graph->get_node("lighting_pass");
   HASSERT(node);
-  enabled = node->enabled;
+  enabled = node->active();
   if (!enabled) return;
 
   const u64 hashed_name = hash_calculate("pbr_lighting");
   Program* lighting_program =
       renderer->resource_cache.programs.get(hashed_name);
-  pipeline_handle = lighting_program->passes[0].pipeline;
+  pipeline_handle =
+      lighting_program->passes[lighting_program->get_pass_index("pbr")]
+          .pipeline;
 
   DescriptorSetCreation ds_creation{};
   DescriptorSetLayoutHandle layout = renderer->gpu->get_descriptor_set_layout(
-      lighting_program->passes[0].pipeline, k_material_descriptor_set_index);
+      pipeline_handle, k_material_descriptor_set_index);
   ds_creation.buffer(scene.scene_constant_buffer, 0)
       .buffer(scene.light_data_buffer, 1)
       .buffer(scene.directional_light_buffer, 2)
+      .buffer(scene.light_cluster_data_buffer, 3)
       .set_layout(layout);
   d_set = renderer->gpu->create_descriptor_set(ds_creation);
 
@@ -1007,10 +1010,10 @@ void TransparentPass::render(CommandBuffer* gpu_commands, Scene* scene_) {
   gpu_commands->draw_mesh_task_indirect_count(
       scene->mesh_indirect_draw_early_command_buffers[buffer_frame_index],
       offsetof(GPUMeshDrawCommand, indirectMS) +
-          (sizeof(GPUMeshDrawCommand) * scene->opaque_meshes.size),
+          (sizeof(GPUMeshDrawCommand) * scene->gpu_opaque_instance_count),
       scene->mesh_draw_count_buffers[buffer_frame_index],
       offsetof(GPUMeshDrawCounts, transparent_mesh_visible_count),
-      scene->transparent_meshes.size, sizeof(GPUMeshDrawCommand));
+      scene->gpu_transparent_instance_count, sizeof(GPUMeshDrawCommand));
 }
 
 void TransparentPass::init() {
@@ -1089,15 +1092,48 @@ void DebugPass::free_gpu_resources() {
 
 void glTFDrawTask::init(GpuDevice* gpu_, FrameGraph* frame_graph_,
                         Renderer* renderer_, ImGuiService* imgui_,
-                        GPUProfiler* gpu_profiler_, glTFScene* scene_) {
+                        GPUProfiler* gpu_profiler_, glTFScene* scene_,
+                        enki::TaskScheduler* task_scheduler_) {
   gpu = gpu_;
   frame_graph = frame_graph_;
   renderer = renderer_;
   imgui = imgui_;
   gpu_profiler = gpu_profiler_;
   scene = scene_;
+  task_scheduler = task_scheduler_;
 }
 
+//
+// Records chunks of consecutive frame graph nodes, each in a command buffer
+// of the recording thread for the queue of its submission.
+struct FrameGraphChunkTask : public enki::ITaskSet {
+  GpuDevice* gpu = nullptr;
+  FrameGraph* frame_graph = nullptr;
+  glTFScene* scene = nullptr;
+  // Chunk c records the nodes [first_nodes[c], first_nodes[c + 1]) of the
+  // frame graph submission submissions[c].
+  u32 first_nodes[k_max_frame_graph_chunks + 1];
+  u32 submissions[k_max_frame_graph_chunks];
+  CommandBuffer* command_buffers[k_max_frame_graph_chunks];
+
+  void ExecuteRange(enki::TaskSetPartition range_,
+                    u32 threadnum_) override {
+    ZoneScoped;
+    // The first chunk is recorded by the draw task.
+    for (u32 c = range_.start + 1; c < range_.end + 1; ++c) {
+      const bool compute =
+          frame_graph->submissions[submissions[c]].queue ==
+          QueueType::Compute;
+      CommandBuffer* gpu_commands =
+          compute ? gpu->get_compute_command_buffer(threadnum_, true)
+                  : gpu->get_command_buffer(threadnum_, true);
+      frame_graph->render_nodes(gpu->current_frame, gpu_commands, scene,
+                                first_nodes[c], first_nodes[c + 1]);
+      command_buffers[c] = gpu_commands;
+    }
+  }
+};  // struct FrameGraphChunkTask
+
 void glTFDrawTask::ExecuteRange(enki::TaskSetPartition range_,
                                 uint32_t threadnum_) {
   ZoneScoped;
@@ -1108,7 +1144,112 @@ void glTFDrawTask::ExecuteRange(enki::TaskSetPartition range_,
   //  TODO: improve getting a command buffer/pool
   CommandBuffer* gpu_commands = gpu->get_command_buffer(threadnum_, true);
 
-  frame_graph->render(gpu->current_frame, gpu_commands, scene);
+  // Per frame buffers written by the culling passes.
+  const u32 buffer_frame_index = gpu->current_frame;
+  frame_graph->bind_buffer(
+      "mesh_indirect_draw_early_list",
+      scene->mesh_indirect_draw_early_command_buffers[buffer_frame_index]);
+  frame_graph->bind_buffer(
+      "mesh_indirect_draw_late_list",
+      scene->mesh_indirect_draw_late_command_buffers[buffer_frame_index]);
+  frame_graph->bind_buffer("mesh_draw_counts",
+                           scene->mesh_draw_count_buffers[buffer_frame_index]);
+  frame_graph->bind_buffer("light_clusters",
+                           scene->light_cluster_data_buffer);
+
+  frame_graph->render_begin(gpu_commands);
+
+  // Active nodes are split in chunks of about the same count, one per task
+  // thread, and every submission of the frame graph gets its own chunks.
+  // This thread records the first one after the frame start, the others are
+  // recorded in parallel and submitted after it in node order.
+  Array<FrameGraphSubmission>& submissions = frame_graph->submissions;
+  u32 active_count = 0;
+  for (u32 n = 0; n < frame_graph->nodes.size; ++n) {
+    active_count += frame_graph->access_node(frame_graph->nodes[n])->active();
+  }
+  const u32 thread_chunks =
+      Helix::min(task_scheduler->GetNumTaskThreads(), k_max_frame_graph_chunks);
+  const u32 extra_chunks =
+      thread_chunks > submissions.size ? thread_chunks - submissions.size : 0;
+
+  FrameGraphChunkTask chunk_task;
+  chunk_task.gpu = gpu;
+  chunk_task.frame_graph = frame_graph;
+  chunk_task.scene = scene;
+  u32 chunk_count = 0;
+  for (u32 s = 0; s < submissions.size; ++s) {
+    const FrameGraphSubmission& submission = submissions[s];
+    u32 submission_active = 0;
+    for (u32 n = submission.first_node; n < submission.last_node; ++n) {
+      submission_active +=
+          frame_graph->access_node(frame_graph->nodes[n])->active();
+    }
+    u32 submission_chunks =
+        1 + (active_count ? extra_chunks * submission_active / active_count
+                          : 0);
+    submission_chunks =
+        Helix::max(Helix::min(submission_chunks, submission_active), 1u);
+
+    const u32 first_chunk = chunk_count;
+    u32 active_index = 0;
+    for (u32 n = submission.first_node; n < submission.last_node; ++n) {
+      if (!frame_graph->access_node(frame_graph->nodes[n])->active()) {
+        continue;
+      }
+      const u32 chunk = chunk_count - first_chunk;
+      if (chunk < submission_chunks &&
+          active_index == chunk * submission_active / submission_chunks) {
+        chunk_task.first_nodes[chunk_count] =
+            chunk == 0 ? submission.first_node : n;
+        chunk_task.submissions[chunk_count] = s;
+        ++chunk_count;
+      }
+      ++active_index;
+    }
+    if (chunk_count == first_chunk) {
+      chunk_task.first_nodes[chunk_count] = submission.first_node;
+      chunk_task.submissions[chunk_count] = s;
+      ++chunk_count;
+    }
+  }
+  chunk_task.first_nodes[chunk_count] = frame_graph->nodes.size;
+
+  chunk_task.command_buffers[0] = gpu_commands;
+  if (chunk_count > 1) {
+    chunk_task.m_SetSize = chunk_count - 1;
+    chunk_task.m_MinRange = 1;
+    task_scheduler->AddTaskSetToPipe(&chunk_task);
+  }
+  frame_graph->render_nodes(gpu->current_frame, gpu_commands, scene,
+                            chunk_task.first_nodes[0],
+                            chunk_task.first_nodes[1]);
+
+  if (chunk_count > 1) {
+    task_scheduler->WaitforTask(&chunk_task);
+    // Submissions wait for the one of the other queue they depend on and
+    // signal the ones the other queue waits for.
+    for (u32 c = 0; c < chunk_count; ++c) {
+      const u32 s = chunk_task.submissions[c];
+      FrameGraphSubmission& submission = submissions[s];
+      const bool first = c == 0 || chunk_task.submissions[c - 1] != s;
+      const bool last =
+          c + 1 == chunk_count || chunk_task.submissions[c + 1] != s;
+      if (first && submission.wait_submission != u32_max) {
+        gpu->queue_wait(submission.queue,
+                        submissions[submission.wait_submission].signal_value);
+      }
+      if (submission.queue == QueueType::Compute) {
+        gpu->queue_compute_command_buffer(chunk_task.command_buffers[c]);
+      } else {
+        gpu->queue_command_buffer(chunk_task.command_buffers[c]);
+      }
+      if (last && submission.signal) {
+        submission.signal_value = gpu->queue_sync_point(submission.queue);
+      }
+    }
+    gpu_commands = gpu->get_command_buffer(threadnum_, true);
+  }
 
   gpu_commands->push_marker("Fullscreen");
   gpu_commands->clear(0.3f, 0.3f, 0.3f, 1.f, 0);
@@ -1137,10 +1278,15 @@ void glTFDrawTask::ExecuteRange(enki::TaskSetPartition range_,
   imgui->render(*gpu_commands, false);
   gpu_commands->end_current_render_pass();
 
-  gpu_commands->pop_marker();
+  frame_graph->render_end(gpu_commands);
 
   gpu_profiler->update(*gpu);
 
+  u32 timestamp_count = 0;
+  const GPUTimestamp* timestamps =
+      gpu_profiler->last_frame_timestamps(timestamp_count);
+  frame_graph->update_timings(timestamps, timestamp_count);
+
   // Send commands to GPU
   gpu->queue_command_buffer(gpu_commands);
 }
@@ -1160,10 +1306,31 @@ void glTFScene::init(Renderer* _renderer, Allocator* resident_allocator,
   transparent_meshes.init(resident_allocator, k_num_meshes);
   opaque_meshes.init(resident_allocator, k_num_meshes);
 
+  mesh_instances.init(resident_allocator, k_num_meshes, sizeof(MeshInstance));
+  occlusion_buffer.init(resident_allocator, 256, 128);
+  occluder_indices.init(resident_allocator, 4096);
+  occluded_instances.init(resident_allocator, k_num_meshes);
+  mesh_bvh.init(resident_allocator, k_num_meshes);
+  bvh_query_results.init(resident_allocator, k_num_meshes);
+  instance_dirty.init(resident_allocator, k_num_meshes);
+  material_dirty.init(resident_allocator, k_num_meshes);
+
   node_pool.init(resident_allocator);
 
   images.init(resident_allocator, k_num_meshes);
   samplers.init(resident_allocator, 1);
+
+  texture_streaming.init(resident_allocator, k_num_meshes);
+  streamed_textures.init(resident_allocator, k_num_meshes);
+  streamed_texture_map.init(resident_allocator, k_num_meshes);
+  streamed_texture_map.set_default_value(u32_max);
+  image_load_jobs.init(resident_allocator, k_num_meshes);
+  image_load_priorities.init(resident_allocator, k_num_meshes);
+  image_texture_map.init(resident_allocator, k_num_meshes);
+  image_texture_map.set_default_value(u32_max);
+  load_group = async_loader->load_jobs.create_group();
+  texture_streaming_loads.init(resident_allocator, 16);
+  texture_streaming_evictions.init(resident_allocator, 16);
   buffers.init(resident_allocator, k_num_meshes);
 
   meshlets.init(resident_allocator, 16);
@@ -1171,7 +1338,15 @@ void glTFScene::init(Renderer* _renderer, Allocator* resident_allocator,
   meshlets_vertex_positions.init(resident_allocator, 16);
   meshlets_vertex_data.init(resident_allocator, 16);
 
-  lights.init(resident_allocator, MAX_LIGHTS);
+  sections.init(resident_allocator, 8);
+  meshlet_ranges.init(resident_allocator, 0);
+  meshlet_vertex_ranges.init(resident_allocator, 0);
+  meshlet_data_ranges.init(resident_allocator, 0);
+  free_opaque_meshes.init(resident_allocator, 16);
+  free_transparent_meshes.init(resident_allocator, 16);
+
+  lights.init(resident_allocator, k_min_light_buffer_capacity);
+  light_buffer_capacity = k_min_light_buffer_capacity;
 
   names.init(hmega(1), main_allocator);
 
@@ -1224,15 +1399,788 @@ void glTFScene::init(Renderer* _renderer, Allocator* resident_allocator,
 
   buffer_creation.reset()
       .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
-           sizeof(GPUPointLight) * MAX_LIGHTS)
+           sizeof(GPUPointLight) * light_buffer_capacity)
       .set_name("lights_data_buffer");
   light_data_buffer = renderer->create_buffer(buffer_creation)->handle;
 
+  // The directional light comes first.
   buffer_creation.reset()
       .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
-           sizeof(glm::vec4) * MAX_LIGHTS + 1)
+           sizeof(glm::vec4) * (light_buffer_capacity + 1))
       .set_name("light_debug_buffer");
   light_debug_buffer = renderer->create_buffer(buffer_creation)->handle;
+
+  buffer_creation.reset()
+      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
+           sizeof(GPULightClusterBounds) * k_light_cluster_count)
+      .set_name("light_cluster_bounds_buffer");
+  light_cluster_bounds_buffer =
+      renderer->create_buffer(buffer_creation)->handle;
+
+  buffer_creation.reset()
+      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
+           k_light_cluster_data_size)
+      .set_name("light_cluster_data_buffer");
+  light_cluster_data_buffer = renderer->create_buffer(buffer_creation)->handle;
+  // The bounds are uploaded by the first fill_gpu_data_buffers.
+  light_cluster_view.projection_00 = 0.f;
+}
+
+// Geometry cache ////////////////////////////////////////////////////////
+
+//
+// Meshlet streams stored in the geometry cache of a glTF file. Meshlet data
+// offsets and vertex indices are relative to the first element of the file.
+namespace MeshletCacheStream {
+enum Enum {
+  Primitives,
+  Meshlets,
+  VertexIndices,
+  Triangles,
+  Positions,
+  Normals,
+  Attributes,
+  Count
+};
+}  // namespace MeshletCacheStream
+
+//
+//
+struct MeshletCachePrimitive {
+  u32 meshlet_offset;
+  u32 meshlet_count;
+};  // struct MeshletCachePrimitive
+
+//
+// Vertex data without the normal, which is stored octahedral encoded.
+struct MeshletCacheAttributes {
+  u8 tangent[4];
+  u16 uv_coords[2];
+};  // struct MeshletCacheAttributes
+
+static const u32 k_meshlet_cache_strides[MeshletCacheStream::Count] = {
+    sizeof(MeshletCachePrimitive),
+    sizeof(GPUMeshlet),
+    sizeof(u32),
+    sizeof(u16),
+    sizeof(GPUMeshletVertexPosition),
+    4,
+    sizeof(MeshletCacheAttributes)};
+
+static const GeometryCodec::Enum
+    k_meshlet_cache_codecs[MeshletCacheStream::Count] = {
+        GeometryCodec::Vertex,     GeometryCodec::Vertex,
+        GeometryCodec::Vertex,     GeometryCodec::Index,
+        GeometryCodec::Vertex,     GeometryCodec::Octahedral,
+        GeometryCodec::Vertex};
+
+// Bumped when the cached tables change meaning. 2: a primitive entry per glTF
+// mesh primitive instead of one per node.
+static const u32 k_meshlet_cache_version = 2;
+
+static u32 meshlet_index_group_count(u32 triangle_count) {
+#if NVIDIA
+  return (triangle_count * 3 + 3) / 4;
+#else
+  return triangle_count;
+#endif  // NVIDIA
+}
+
+static u64 meshlet_cache_file_hash(cstring filename, u64 hash) {
+  sizet size = 0;
+  u64 write_time = 0;
+  if (!file_size_and_write_time(filename, &size, &write_time)) {
+    // Not a file, embedded buffer data is keyed by its uri.
+    return filename ? hash_bytes((void*)filename, strlen(filename), hash)
+                    : hash;
+  }
+  hash = hash_calculate(size, hash);
+  return hash_calculate(write_time, hash);
+}
+
+static u64 meshlet_cache_source_hash(cstring filename,
+                                     const glTF::glTF& gltf_scene) {
+  // Changing the meshlet generation or the GPU layouts invalidates the cache.
+  u64 hash = hash_calculate(sizeof(GPUMeshlet) * 1000 +
+                            sizeof(GPUMeshletVertexData));
+  hash = hash_calculate(k_meshlet_cache_strides, hash);
+  hash = hash_calculate(k_meshlet_cache_version, hash);
+
+  // The sources are keyed by their size and last write time, the cache is
+  // checked before the buffers are read.
+  hash = meshlet_cache_file_hash(filename, hash);
+  for (u32 i = 0; i < gltf_scene.buffers_count; ++i) {
+    hash = hash_calculate(gltf_scene.buffers[i].byte_length, hash);
+    hash = meshlet_cache_file_hash(gltf_scene.buffers[i].uri.data, hash);
+  }
+  return hash;
+}
+
+// Data at offset in a glTF buffer, nullptr when the buffer was not read.
+static u8* gltf_buffer_data(const Array<void*>& buffers_data, i32 buffer,
+                            i32 offset) {
+  return buffers_data[buffer] ? (u8*)buffers_data[buffer] + offset : nullptr;
+}
+
+static void write_meshlet_cache(glTFScene& scene, cstring path, u64 source_hash,
+                                u32 base_meshlet, u32 base_vertex,
+                                u32 base_data,
+                                const Array<MeshletCachePrimitive>& primitives,
+                                Allocator* allocator) {
+  ZoneScoped;
+
+  const u32 meshlet_count = scene.meshlets.size - base_meshlet;
+  const u32 vertex_count = scene.meshlets_vertex_positions.size - base_vertex;
+
+  u32 vertex_index_count = 0;
+  u32 triangle_index_count = 0;
+  for (u32 m = 0; m < meshlet_count; ++m) {
+    const GPUMeshlet& meshlet = scene.meshlets[base_meshlet + m];
+    vertex_index_count += meshlet.vertex_count;
+    triangle_index_count += meshlet.triangle_count * 3;
+  }
+
+  GPUMeshlet* meshlets = (GPUMeshlet*)halloca(
+      sizeof(GPUMeshlet) * (meshlet_count ? meshlet_count : 1), allocator);
+  u32* vertex_indices = (u32*)halloca(
+      sizeof(u32) * (vertex_index_count ? vertex_index_count : 1), allocator);
+  u16* triangles = (u16*)halloca(
+      sizeof(u16) * (triangle_index_count ? triangle_index_count : 1),
+      allocator);
+  f32* normals = (f32*)halloca(
+      sizeof(f32) * 4 * (vertex_count ? vertex_count : 1), allocator);
+  MeshletCacheAttributes* attributes = (MeshletCacheAttributes*)halloca(
+      sizeof(MeshletCacheAttributes) * (vertex_count ? vertex_count : 1),
+      allocator);
+
+  u32 vertex_index = 0;
+  u32 triangle_index = 0;
+  for (u32 m = 0; m < meshlet_count; ++m) {
+    GPUMeshlet meshlet = scene.meshlets[base_meshlet + m];
+    if (meshlet.vertex_count == 0 && meshlet.triangle_count == 0) {
+      // Padding.
+      meshlets[m] = meshlet;
+      continue;
+    }
+
+    const u32* data =
+        scene.meshlet_vertex_and_index_indices.data + meshlet.data_offset;
+    for (u32 i = 0; i < meshlet.vertex_count; ++i) {
+      vertex_indices[vertex_index++] = data[i] - base_vertex;
+    }
+
+    const u32* index_groups = data + meshlet.vertex_count;
+#if NVIDIA
+    const u8* packed_indices = (const u8*)index_groups;
+    for (u32 i = 0; i < meshlet.triangle_count * 3u; ++i) {
+      triangles[triangle_index++] = packed_indices[i];
+    }
+#else
+    for (u32 i = 0; i < meshlet.triangle_count; ++i) {
+      const u32 index_group = index_groups[i];
+      triangles[triangle_index++] = (index_group >> 16) & 0xff;
+      triangles[triangle_index++] = (index_group >> 8) & 0xff;
+      triangles[triangle_index++] = index_group & 0xff;
+    }
+#endif  // NVIDIA
+
+    meshlet.data_offset -= base_data;
+    meshlets[m] = meshlet;
+  }
+
+  for (u32 v = 0; v < vertex_count; ++v) {
+    const GPUMeshletVertexData& vertex_data =
+        scene.meshlets_vertex_data[base_vertex + v];
+    for (u32 i = 0; i < 3; ++i) {
+      normals[v * 4 + i] = vertex_data.normal[i] / 127.0f - 1.0f;
+    }
+    normals[v * 4 + 3] = 0.0f;
+
+    MeshletCacheAttributes& attribute = attributes[v];
+    memcpy(attribute.tangent, vertex_data.tangent, sizeof(attribute.tangent));
+    memcpy(attribute.uv_coords, vertex_data.uv_coords,
+           sizeof(attribute.uv_coords));
+  }
+
+  const void* stream_data[MeshletCacheStream::Count] = {
+      primitives.data,
+      meshlets,
+      vertex_indices,
+      triangles,
+      scene.meshlets_vertex_positions.data + base_vertex,
+      normals,
+      attributes};
+  const u32 stream_counts[MeshletCacheStream::Count] = {
+      primitives.size,    meshlet_count,        vertex_index_count,
+      triangle_index_count, vertex_count,       vertex_count,
+      vertex_count};
+
+  GeometryStreamData streams[MeshletCacheStream::Count];
+  for (u32 s = 0; s < MeshletCacheStream::Count; ++s) {
+    streams[s].data = stream_data[s];
+    streams[s].count = stream_counts[s];
+    streams[s].stride = k_meshlet_cache_strides[s];
+    streams[s].codec = k_meshlet_cache_codecs[s];
+  }
+
+  sizet encoded_size = 0;
+  if (geometry_cache_write_file(path, source_hash, streams,
+                                MeshletCacheStream::Count, allocator,
+                                &encoded_size)) {
+    const sizet raw_size =
+        sizeof(GPUMeshlet) * meshlet_count +
+        sizeof(u32) * (scene.meshlet_vertex_and_index_indices.size -
+                       base_data) +
+        (sizeof(GPUMeshletVertexPosition) + sizeof(GPUMeshletVertexData)) *
+            vertex_count;
+    HINFO("Geometry cache {} written, {} KB of meshlet data encoded to {} KB",
+          path, raw_size / 1024, encoded_size / 1024);
+  } else {
+    HWARN("Could not write geometry cache {}", path);
+  }
+
+  hfree(attributes, allocator);
+  hfree(normals, allocator);
+  hfree(triangles, allocator);
+  hfree(vertex_indices, allocator);
+  hfree(meshlets, allocator);
+}
+
+//
+// Decodes the blocks of a geometry cache, each stream into its destination.
+struct GeometryCacheDecodeTask : public enki::ITaskSet {
+  const GeometryCache* cache = nullptr;
+  void* destinations[MeshletCacheStream::Count];
+  u8* block_failed = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_,
+                    u32 threadnum_) override {
+    ZoneScoped;
+    for (u32 b = range_.start; b < range_.end; ++b) {
+      const u32 stream = cache->blocks[b].stream;
+      block_failed[b] =
+          geometry_cache_decode_block(*cache, b, destinations[stream]) ? 0
+                                                                        : 1;
+    }
+  }
+};  // struct GeometryCacheDecodeTask
+
+//
+// Interleaves decoded meshlet indices back into the GPU layout.
+struct MeshletCacheAssembleTask : public enki::ITaskSet {
+  glTFScene* scene = nullptr;
+  GPUMeshlet* meshlets = nullptr;
+  const u32* vertex_indices = nullptr;
+  const u32* vertex_index_offsets = nullptr;
+  const u16* triangles = nullptr;
+  const u32* triangle_offsets = nullptr;
+  u32 base_vertex = 0;
+  u32 base_data = 0;
+
+  void ExecuteRange(enki::TaskSetPartition range_,
+                    u32 threadnum_) override {
+    ZoneScoped;
+    for (u32 m = range_.start; m < range_.end; ++m) {
+      GPUMeshlet& meshlet = meshlets[m];
+      if (meshlet.vertex_count == 0 && meshlet.triangle_count == 0) {
+        continue;
+      }
+
+      meshlet.data_offset += base_data;
+      u32* data =
+          scene->meshlet_vertex_and_index_indices.data + meshlet.data_offset;
+
+      const u32* meshlet_vertices = vertex_indices + vertex_index_offsets[m];
+      for (u32 i = 0; i < meshlet.vertex_count; ++i) {
+        data[i] = meshlet_vertices[i] + base_vertex;
+      }
+
+      const u16* meshlet_triangles = triangles + triangle_offsets[m];
+      u32* index_groups = data + meshlet.vertex_count;
+#if NVIDIA
+      const u32 index_count = meshlet.triangle_count * 3u;
+      const u32 index_group_count = meshlet_index_group_count(
+          meshlet.triangle_count);
+      u8* packed_indices = (u8*)index_groups;
+      for (u32 i = 0; i < index_group_count * 4; ++i) {
+        packed_indices[i] = i < index_count ? (u8)meshlet_triangles[i] : 0;
+      }
+#else
+      for (u32 i = 0; i < meshlet.triangle_count; ++i) {
+        index_groups[i] = (u32(meshlet_triangles[i * 3 + 0]) << 16) |
+                          (u32(meshlet_triangles[i * 3 + 1]) << 8) |
+                          (u32(meshlet_triangles[i * 3 + 2]));
+      }
+#endif  // NVIDIA
+    }
+  }
+};  // struct MeshletCacheAssembleTask
+
+//
+// Rebuilds GPUMeshletVertexData from the normal and attribute streams.
+struct MeshletVertexAssembleTask : public enki::ITaskSet {
+  GPUMeshletVertexData* vertex_data = nullptr;
+  const i8* normals = nullptr;
+  const MeshletCacheAttributes* attributes = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_,
+                    u32 threadnum_) override {
+    ZoneScoped;
+    for (u32 v = range_.start; v < range_.end; ++v) {
+      GPUMeshletVertexData& data = vertex_data[v];
+      // Signed normalized back to the biased unsigned encoding.
+      for (u32 i = 0; i < 3; ++i) {
+        data.normal[i] = (u8)(normals[v * 4 + i] + 127);
+      }
+      data.normal[3] = 0;
+
+      memcpy(data.tangent, attributes[v].tangent, sizeof(data.tangent));
+      memcpy(data.uv_coords, attributes[v].uv_coords, sizeof(data.uv_coords));
+      data.padding = 0.f;
+    }
+  }
+};  // struct MeshletVertexAssembleTask
+
+// Appends the cached meshlets to the scene streams. Returns false, leaving the
+// scene untouched, when the cache is missing or out of date.
+static bool load_meshlet_cache(glTFScene& scene, cstring path,
+                               u64 source_hash, Allocator* allocator,
+                               enki::TaskScheduler* task_scheduler,
+                               Array<MeshletCachePrimitive>& out_primitives) {
+  ZoneScoped;
+
+  GeometryCache cache;
+  if (!geometry_cache_read_file(path, source_hash, allocator, cache)) {
+    return false;
+  }
+
+  bool valid = cache.stream_count == MeshletCacheStream::Count;
+  for (u32 s = 0; s < cache.stream_count && valid; ++s) {
+    valid = cache.streams[s].stride == k_meshlet_cache_strides[s] &&
+            cache.streams[s].codec == (u32)k_meshlet_cache_codecs[s];
+  }
+  if (!valid) {
+    HWARN("Geometry cache {} has an unknown layout", path);
+    geometry_cache_free(cache);
+    return false;
+  }
+
+  const u32 primitive_count =
+      cache.streams[MeshletCacheStream::Primitives].count;
+  const u32 meshlet_count = cache.streams[MeshletCacheStream::Meshlets].count;
+  const u32 vertex_count = cache.streams[MeshletCacheStream::Positions].count;
+  if (cache.streams[MeshletCacheStream::Normals].count != vertex_count ||
+      cache.streams[MeshletCacheStream::Attributes].count != vertex_count) {
+    geometry_cache_free(cache);
+    return false;
+  }
+
+  const u32 base_meshlet = scene.meshlets.size;
+  const u32 base_vertex = scene.meshlets_vertex_positions.size;
+  const u32 base_data = scene.meshlet_vertex_and_index_indices.size;
+
+  out_primitives.set_size(primitive_count);
+  scene.meshlets.set_size(base_meshlet + meshlet_count);
+  scene.meshlets_vertex_positions.set_size(base_vertex + vertex_count);
+
+  u8* vertex_indices = (u8*)halloca(
+      geometry_cache_stream_size(cache, MeshletCacheStream::VertexIndices) + 4,
+      allocator);
+  u8* triangles = (u8*)halloca(
+      geometry_cache_stream_size(cache, MeshletCacheStream::Triangles) + 4,
+      allocator);
+  u8* normals = (u8*)halloca(
+      geometry_cache_stream_size(cache, MeshletCacheStream::Normals) + 4,
+      allocator);
+  u8* attributes = (u8*)halloca(
+      geometry_cache_stream_size(cache, MeshletCacheStream::Attributes) + 4,
+      allocator);
+  u8* block_failed = (u8*)halloca(cache.block_count + 1, allocator);
+  u32* meshlet_offsets =
+      (u32*)halloca(sizeof(u32) * 2 * (meshlet_count + 1), allocator);
+
+  i64 start_decoding = Time::now();
+
+  GeometryCacheDecodeTask decode_task;
+  decode_task.cache = &cache;
+  decode_task.block_failed = block_failed;
+  decode_task.destinations[MeshletCacheStream::Primitives] =
+      out_primitives.data;
+  decode_task.destinations[MeshletCacheStream::Meshlets] =
+      scene.meshlets.data + base_meshlet;
+  decode_task.destinations[MeshletCacheStream::VertexIndices] = vertex_indices;
+  decode_task.destinations[MeshletCacheStream::Triangles] = triangles;
+  decode_task.destinations[MeshletCacheStream::Positions] =
+      scene.meshlets_vertex_positions.data + base_vertex;
+  decode_task.destinations[MeshletCacheStream::Normals] = normals;
+  decode_task.destinations[MeshletCacheStream::Attributes] = attributes;
+  decode_task.m_SetSize = cache.block_count;
+  decode_task.m_MinRange = 1;
+  task_scheduler->AddTaskSetToPipe(&decode_task);
+  task_scheduler->WaitforTask(&decode_task);
+
+  const f64 decoding_seconds = Time::from_seconds(start_decoding);
+
+  for (u32 b = 0; b < cache.block_count && valid; ++b) {
+    valid = block_failed[b] == 0;
+  }
+
+  // Where each meshlet reads its indices, and the size of the GPU data.
+  u32* vertex_index_offsets = meshlet_offsets;
+  u32* triangle_offsets = meshlet_offsets + meshlet_count + 1;
+  u32 vertex_index_count = 0;
+  u32 triangle_index_count = 0;
+  u32 data_size = 0;
+  for (u32 m = 0; m < meshlet_count && valid; ++m) {
+    const GPUMeshlet& meshlet = scene.meshlets[base_meshlet + m];
+    vertex_index_offsets[m] = vertex_index_count;
+    triangle_offsets[m] = triangle_index_count;
+    vertex_index_count += meshlet.vertex_count;
+    triangle_index_count += meshlet.triangle_count * 3;
+
+    if (meshlet.vertex_count || meshlet.triangle_count) {
+      const u32 data_end = meshlet.data_offset + meshlet.vertex_count +
+                           meshlet_index_group_count(meshlet.triangle_count);
+      data_size = data_end > data_size ? data_end : data_size;
+    }
+  }
+  for (u32 p = 0; p < primitive_count && valid; ++p) {
+    const MeshletCachePrimitive& primitive = out_primitives[p];
+    valid = primitive.meshlet_offset + primitive.meshlet_count <= meshlet_count;
+  }
+  valid = valid &&
+          vertex_index_count ==
+              cache.streams[MeshletCacheStream::VertexIndices].count &&
+          triangle_index_count ==
+              cache.streams[MeshletCacheStream::Triangles].count;
+
+  if (valid) {
+    scene.meshlet_vertex_and_index_indices.set_size(base_data + data_size);
+
+    MeshletCacheAssembleTask meshlet_task;
+    meshlet_task.scene = &scene;
+    meshlet_task.meshlets = scene.meshlets.data + base_meshlet;
+    meshlet_task.vertex_indices = (const u32*)vertex_indices;
+    meshlet_task.vertex_index_offsets = vertex_index_offsets;
+    meshlet_task.triangles = (const u16*)triangles;
+    meshlet_task.triangle_offsets = triangle_offsets;
+    meshlet_task.base_vertex = base_vertex;
+    meshlet_task.base_data = base_data;
+    meshlet_task.m_SetSize = meshlet_count;
+    meshlet_task.m_MinRange = 1024;
+
+    scene.meshlets_vertex_data.set_size(base_vertex + vertex_count);
+    MeshletVertexAssembleTask vertex_task;
+    vertex_task.vertex_data = scene.meshlets_vertex_data.data + base_vertex;
+    vertex_task.normals = (const i8*)normals;
+    vertex_task.attributes = (const MeshletCacheAttributes*)attributes;
+    vertex_task.m_SetSize = vertex_count;
+    vertex_task.m_MinRange = 4096;
+
+    task_scheduler->AddTaskSetToPipe(&meshlet_task);
+    task_scheduler->AddTaskSetToPipe(&vertex_task);
+    task_scheduler->WaitforTask(&meshlet_task);
+    task_scheduler->WaitforTask(&vertex_task);
+
+    sizet decoded_size = 0;
+    for (u32 s = 0; s < cache.stream_count; ++s) {
+      decoded_size += geometry_cache_stream_size(cache, s);
+    }
+    HINFO(
+        "Geometry cache {} decoded: {} KB to {} KB in {} ms ({} GB/s), ready "
+        "in {} ms",
+        path, cache.size / 1024, decoded_size / 1024, decoding_seconds * 1000.0,
+        decoding_seconds > 0.0 ? decoded_size / decoding_seconds / 1e9 : 0.0,
+        Time::from_milliseconds(start_decoding));
+  } else {
+    HWARN("Geometry cache {} is corrupted, building meshlets again", path);
+    out_primitives.clear();
+    scene.meshlets.set_size(base_meshlet);
+    scene.meshlets_vertex_positions.set_size(base_vertex);
+  }
+
+  hfree(meshlet_offsets, allocator);
+  hfree(block_failed, allocator);
+  hfree(attributes, allocator);
+  hfree(normals, allocator);
+  hfree(triangles, allocator);
+  hfree(vertex_indices, allocator);
+  geometry_cache_free(cache);
+
+  return valid;
+}
+
+//
+// Meshlet streams a primitive is appended to: the scene ones or the ones of a
+// section being loaded.
+struct MeshletGeometry {
+  Array<GPUMeshlet>* meshlets;
+  Array<GPUMeshletVertexPosition>* vertex_positions;
+  Array<GPUMeshletVertexData>* vertex_data;
+  Array<u32>* vertex_and_index_indices;
+};  // struct MeshletGeometry
+
+// Builds the meshlets of a primitive and appends them with their vertices to
+// the geometry streams. Returns the meshlet count, padding excluded.
+static u32 build_primitive_meshlets(MeshletGeometry& geometry,
+                                    const f32* vertices, const f32* normals,
+                                    const f32* tangents, const f32* tex_coords,
+                                    u32 vertex_count, const u16* indices,
+                                    u32 index_count,
+                                    Allocator* temp_allocator) {
+  const sizet max_vertices = 64;
+  const sizet max_triangles = 124;
+  const f32 cone_weight = 0.0f;
+
+  const sizet max_meshlets =
+      meshopt_buildMeshletsBound(index_count, max_vertices, max_triangles);
+
+  Array<meshopt_Meshlet> local_meshlets;
+  local_meshlets.init(temp_allocator, (u32)max_meshlets, (u32)max_meshlets);
+
+  Array<u32> meshlet_vertex_indices;
+  meshlet_vertex_indices.init(temp_allocator,
+                              (u32)max_meshlets * (u32)max_vertices,
+                              (u32)max_meshlets * (u32)max_vertices);
+
+  Array<u8> meshlet_triangles;
+  meshlet_triangles.init(temp_allocator,
+                         (u32)max_meshlets * (u32)max_triangles * 3,
+                         (u32)max_meshlets * (u32)max_triangles * 3);
+
+  sizet meshlet_count = meshopt_buildMeshlets(
+      local_meshlets.data, meshlet_vertex_indices.data, meshlet_triangles.data,
+      indices, index_count, vertices, vertex_count, sizeof(glm::vec3),
+      max_vertices, max_triangles, cone_weight);
+
+  u32 meshlet_vertex_offset = geometry.vertex_positions->size;
+  for (u32 v = 0; v < (u32)vertex_count; ++v) {
+    GPUMeshletVertexPosition meshlet_vertex_pos{};
+
+    meshlet_vertex_pos.position[0] = vertices[v * 3 + 0];
+    meshlet_vertex_pos.position[1] = vertices[v * 3 + 1];
+    meshlet_vertex_pos.position[2] = vertices[v * 3 + 2];
+
+    geometry.vertex_positions->push(meshlet_vertex_pos);
+
+    GPUMeshletVertexData meshlet_vertex_data{};
+
+    if (normals != nullptr) {
+      meshlet_vertex_data.normal[0] =
+          (u8)((normals[v * 3 + 0] + 1.0f) * 127.0f);
+      meshlet_vertex_data.normal[1] =
+          (u8)((normals[v * 3 + 1] + 1.0f) * 127.0f);
+      meshlet_vertex_data.normal[2] =
+          (u8)((normals[v * 3 + 2] + 1.0f) * 127.0f);
+    }
+
+    if (tangents != nullptr) {
+      meshlet_vertex_data.tangent[0] =
+          (u8)((tangents[v * 3 + 0] + 1.0f) * 127.0f);
+      meshlet_vertex_data.tangent[1] =
+          (u8)((tangents[v * 3 + 1] + 1.0f) * 127.0f);
+      meshlet_vertex_data.tangent[2] =
+          (u8)((tangents[v * 3 + 2] + 1.0f) * 127.0f);
+      meshlet_vertex_data.tangent[3] =
+          (u8)((tangents[v * 3 + 3] + 1.0f) * 127.0f);
+    }
+
+    if (tex_coords != nullptr) {
+      meshlet_vertex_data.uv_coords[0] =
+          meshopt_quantizeHalf(tex_coords[v * 2 + 0]);
+      meshlet_vertex_data.uv_coords[1] =
+          meshopt_quantizeHalf(tex_coords[v * 2 + 1]);
+    }
+
+    geometry.vertex_data->push(meshlet_vertex_data);
+  }
+
+  for (u32 m = 0; m < meshlet_count; ++m) {
+    meshopt_Meshlet& local_meshlet = local_meshlets[m];
+
+    meshopt_Bounds meshlet_bounds = meshopt_computeMeshletBounds(
+        meshlet_vertex_indices.data + local_meshlet.vertex_offset,
+        meshlet_triangles.data + local_meshlet.triangle_offset,
+        local_meshlet.triangle_count, vertices, vertex_count,
+        sizeof(glm::vec3));
+
+    GPUMeshlet meshlet{};
+    meshlet.data_offset = geometry.vertex_and_index_indices->size;
+    meshlet.vertex_count = local_meshlet.vertex_count;
+    meshlet.triangle_count = local_meshlet.triangle_count;
+
+    meshlet.center =
+        glm::vec3(meshlet_bounds.center[0], meshlet_bounds.center[1],
+                  meshlet_bounds.center[2]);
+    meshlet.radius = meshlet_bounds.radius;
+
+    meshlet.cone_axis[0] = meshlet_bounds.cone_axis_s8[0];
+    meshlet.cone_axis[1] = meshlet_bounds.cone_axis_s8[1];
+    meshlet.cone_axis[2] = meshlet_bounds.cone_axis_s8[2];
+
+    meshlet.cone_cutoff = meshlet_bounds.cone_cutoff_s8;
+    // meshlet.mesh_index = mesh.is_transparent() ? opaque_meshes.size +
+    // transparent_meshes.size - 1 : opaque_meshes.size - 1; // TODO: What
+    // about transparent meshes?
+#if NVIDIA
+
+    // Resize data array
+    const u32 index_group_count =
+        (local_meshlet.triangle_count * 3 + 3) / 4;
+    geometry.vertex_and_index_indices->set_capacity(
+        geometry.vertex_and_index_indices->size +
+        local_meshlet.vertex_count + index_group_count);
+
+    for (u32 i = 0; i < meshlet.vertex_count; ++i) {
+      u32 vertex_index =
+          meshlet_vertex_offset +
+          meshlet_vertex_indices[local_meshlet.vertex_offset + i];
+      geometry.vertex_and_index_indices->push(vertex_index);
+    }
+    // Store indices as uint32
+    // NOTE(marco): we write 4 indices at at time, it will come in handy
+    // in the mesh shader
+    const u32* index_groups = reinterpret_cast<const u32*>(
+        meshlet_triangles.data + local_meshlet.triangle_offset);
+    for (u32 i = 0; i < index_group_count; ++i) {
+      const u32 index_group = index_groups[i];
+      geometry.vertex_and_index_indices->push(index_group);
+    }
+#else
+    // Resize data array
+    // Pack 3 u8 incicies into a u32
+    const u32 index_group_count = (local_meshlet.triangle_count * 3) / 3;
+    geometry.vertex_and_index_indices->set_capacity(
+        geometry.vertex_and_index_indices->size +
+        local_meshlet.vertex_count + index_group_count);
+
+    for (u32 i = 0; i < meshlet.vertex_count; ++i) {
+      u32 vertex_index =
+          meshlet_vertex_offset +
+          meshlet_vertex_indices[local_meshlet.vertex_offset + i];
+      geometry.vertex_and_index_indices->push(vertex_index);
+    }
+    // Store indices as uint32
+    // NOTE(marco): we write to the gl_PrimitiveTriangleIndicesEXT uvec3
+    // array
+    const u8* p_indicies = reinterpret_cast<const u8*>(
+        meshlet_triangles.data + local_meshlet.triangle_offset);
+    for (u32 i = 0; i < index_group_count; ++i) {
+      const u32 index_group = (u32(p_indicies[i * 3 + 0]) << 16) |
+                              (u32(p_indicies[i * 3 + 1]) << 8) |
+                              (u32(p_indicies[i * 3 + 2]));
+      geometry.vertex_and_index_indices->push(index_group);
+    }
+#endif  // NVIDIA
+    geometry.meshlets->push(meshlet);
+  }
+  //
+  while (geometry.meshlets->size % 32) geometry.meshlets->push(GPUMeshlet());
+
+  meshlet_triangles.shutdown();
+  meshlet_vertex_indices.shutdown();
+  local_meshlets.shutdown();
+
+  return (u32)meshlet_count;
+}
+
+// Filters and address modes of a glTF sampler.
+static void gltf_sampler_creation(const glTF::Sampler& sampler,
+                                  SamplerCreation& creation) {
+  switch (sampler.min_filter) {
+    case glTF::Sampler::NEAREST:
+      creation.min_filter = VK_FILTER_NEAREST;
+      break;
+    case glTF::Sampler::LINEAR:
+      creation.min_filter = VK_FILTER_LINEAR;
+      break;
+    case glTF::Sampler::LINEAR_MIPMAP_NEAREST:
+      creation.min_filter = VK_FILTER_LINEAR;
+      creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+      break;
+    case glTF::Sampler::LINEAR_MIPMAP_LINEAR:
+      creation.min_filter = VK_FILTER_LINEAR;
+      creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+      break;
+    case glTF::Sampler::NEAREST_MIPMAP_NEAREST:
+      creation.min_filter = VK_FILTER_NEAREST;
+      creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+      break;
+    case glTF::Sampler::NEAREST_MIPMAP_LINEAR:
+      creation.min_filter = VK_FILTER_NEAREST;
+      creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+      break;
+  }
+
+  creation.mag_filter = sampler.mag_filter == glTF::Sampler::Filter::LINEAR
+                            ? VK_FILTER_LINEAR
+                            : VK_FILTER_NEAREST;
+
+  switch (sampler.wrap_s) {
+    case glTF::Sampler::CLAMP_TO_EDGE:
+      creation.address_mode_u = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      break;
+    case glTF::Sampler::MIRRORED_REPEAT:
+      creation.address_mode_u = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+      break;
+    case glTF::Sampler::REPEAT:
+      creation.address_mode_u = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+      break;
+  }
+
+  switch (sampler.wrap_t) {
+    case glTF::Sampler::CLAMP_TO_EDGE:
+      creation.address_mode_v = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      break;
+    case glTF::Sampler::MIRRORED_REPEAT:
+      creation.address_mode_v = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+      break;
+    case glTF::Sampler::REPEAT:
+      creation.address_mode_v = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+      break;
+  }
+}
+
+// Local transform of a glTF node. The glTF matrix is returned as is, without
+// the TRS round trip.
+static void gltf_node_local_transform(const glTF::Node& node,
+                                      Transform& local_transform,
+                                      glm::mat4& local_matrix) {
+  local_transform.translation = glm::vec3(0.0f);
+  local_transform.scale = glm::vec3(1.0f);
+  local_transform.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+  if (node.matrix_count) {
+    memcpy(&local_matrix, node.matrix, sizeof(glm::mat4));
+    local_transform.set_transform(local_matrix);
+  } else {
+    glm::vec3 node_scale(1.0f, 1.0f, 1.0f);
+    if (node.scale_count != 0) {
+      HASSERT(node.scale_count == 3);
+      node_scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+    }
+
+    glm::vec3 node_translation(0.f, 0.f, 0.f);
+    if (node.translation_count) {
+      HASSERT(node.translation_count == 3);
+      node_translation = glm::vec3(node.translation[0], node.translation[1],
+                                   node.translation[2]);
+    }
+
+    // Rotation is written as a plain quaternion
+    glm::quat node_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    if (node.rotation_count) {
+      HASSERT(node.rotation_count == 4);
+      node_rotation = glm::quat(node.rotation[3], node.rotation[0],
+                                node.rotation[1], node.rotation[2]);
+    }
+
+    local_transform.translation = node_translation;
+    local_transform.scale = node_scale;
+    local_transform.rotation = node_rotation;
+
+    local_matrix = local_transform.calculate_matrix();
+  }
 }
 
 void glTFScene::load(cstring filename, cstring path,
@@ -1252,15 +2200,25 @@ void glTFScene::load(cstring filename, cstring path,
   name_buffer.init(hkilo(100), temp_allocator);
 
   // Load all textures
-  Array<FileLoadRequest> texture_requests;
-  texture_requests.init(
-      resident_allocator, gltf_scene.images_count,
-      gltf_scene.images_count);  // TODO: Maybe use stack allocator;
+  const bool use_block_compression =
+      compress_textures && (renderer->gpu->gpu_device_features &
+                            GpuDeviceFeature_TEXTURE_COMPRESSION_BC);
 
   for (u32 image_index = 0; image_index < gltf_scene.images_count;
        ++image_index) {
     glTF::Image& image = gltf_scene.images[image_index];
 
+    TextureCompressionFormat::Enum compression =
+        TextureCompressionFormat::Count;
+    TextureContent::Enum content = TextureContent::Color;
+    if (use_block_compression) {
+      select_image_compression(image_index, compression, content);
+    }
+    const VkFormat format =
+        compression != TextureCompressionFormat::Count
+            ? (VkFormat)texture_compression_to_vk_format(compression)
+            : VK_FORMAT_R8G8B8A8_UNORM;
+
     int comp, width, height;
 
     stbi_info(image.uri.data, &width, &height, &comp);
@@ -1277,34 +2235,66 @@ void glTFScene::load(cstring filename, cstring path,
         ++mip_levels;
       }
     }
+
+    // Streamed images are created with their tail mips only.
+    const bool stream_image =
+        stream_textures && compression != TextureCompressionFormat::Count;
+    const u32 first_mip =
+        stream_image ? texture_streaming_tail_mip(width, height, mip_levels)
+                     : 0;
+
     // Creates an empty texture resource.
     TextureCreation tc;
     tc.set_data(nullptr)
-        .set_format_type(VK_FORMAT_R8G8B8A8_UNORM, TextureType::Texture2D)
-        .set_flags(mip_levels, 0)
-        .set_size((u16)width, (u16)height, 1)
+        .set_format_type(format, TextureType::Texture2D)
+        .set_flags(mip_levels - first_mip, 0)
+        .set_size((u16)(width >> first_mip), (u16)(height >> first_mip), 1)
         .set_name(image.uri.data);
     TextureResource* tr = renderer->create_texture(tc);
     HASSERT(tr != nullptr);
 
+    image_texture_map.insert(tr->handle.index, images.size);
     images.push(*tr);
 
     // Reconstruct file path
     char* full_filename =
         name_buffer.append_use_f("%s%s", path, image.uri.data);
 
-    FileLoadRequest& request = texture_requests[image_index];
-    request.texture = tr->handle;
-    strcpy(request.path, full_filename);
+    // Priorities are given once the meshes are visible.
+    LoadJobHandle load_job;
+    if (compression != TextureCompressionFormat::Count) {
+      load_job = async_loader->request_compressed_texture_data(
+          full_filename, tr->handle, compression, content, first_mip, 0.f,
+          load_group);
+    } else {
+      load_job =
+          async_loader->request_texture_data(full_filename, tr->handle, 0.f,
+                                             load_group);
+    }
+    image_load_jobs.push(load_job);
+    image_load_priorities.push(0.f);
+    ++pending_image_loads;
+
+    if (stream_image) {
+      const u32 streamed_index = texture_streaming.add_texture(
+          width, height, mip_levels, compression);
+      HASSERT(streamed_index == streamed_textures.size);
+
+      StreamedTexture& streamed_texture = streamed_textures.push_use();
+      streamed_texture.texture = tr->handle;
+      streamed_texture.pending_texture = k_invalid_texture;
+      streamed_texture.load_job = k_invalid_load_job;
+      streamed_texture.path = names.append_use_f("%s", full_filename);
+      streamed_texture.format = compression;
+      streamed_texture.content = content;
+
+      streamed_texture_map.insert(tr->handle.index, streamed_index);
+    }
 
     // Reset name buffer
     name_buffer.clear();
   }
 
-  async_loader->file_load_requests.push_array(texture_requests);
-
-  texture_requests.shutdown();
-
   i64 end_creating_textures = Time::now();
 
   // Load all samplers
@@ -1316,75 +2306,49 @@ void glTFScene::load(cstring filename, cstring path,
         "sampler_%u", sampler_index + current_samplers_count);
 
     SamplerCreation creation;
-    switch (sampler.min_filter) {
-      case glTF::Sampler::NEAREST:
-        creation.min_filter = VK_FILTER_NEAREST;
-        break;
-      case glTF::Sampler::LINEAR:
-        creation.min_filter = VK_FILTER_LINEAR;
-        break;
-      case glTF::Sampler::LINEAR_MIPMAP_NEAREST:
-        creation.min_filter = VK_FILTER_LINEAR;
-        creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-        break;
-      case glTF::Sampler::LINEAR_MIPMAP_LINEAR:
-        creation.min_filter = VK_FILTER_LINEAR;
-        creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        break;
-      case glTF::Sampler::NEAREST_MIPMAP_NEAREST:
-        creation.min_filter = VK_FILTER_NEAREST;
-        creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-        break;
-      case glTF::Sampler::NEAREST_MIPMAP_LINEAR:
-        creation.min_filter = VK_FILTER_NEAREST;
-        creation.mip_filter = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        break;
-    }
+    gltf_sampler_creation(sampler, creation);
+    creation.name = sampler_name;
 
-    creation.mag_filter = sampler.mag_filter == glTF::Sampler::Filter::LINEAR
-                              ? VK_FILTER_LINEAR
-                              : VK_FILTER_NEAREST;
-
-    switch (sampler.wrap_s) {
-      case glTF::Sampler::CLAMP_TO_EDGE:
-        creation.address_mode_u = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        break;
-      case glTF::Sampler::MIRRORED_REPEAT:
-        creation.address_mode_u = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
-        break;
-      case glTF::Sampler::REPEAT:
-        creation.address_mode_u = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        break;
-    }
-
-    switch (sampler.wrap_t) {
-      case glTF::Sampler::CLAMP_TO_EDGE:
-        creation.address_mode_v = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        break;
-      case glTF::Sampler::MIRRORED_REPEAT:
-        creation.address_mode_v = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
-        break;
-      case glTF::Sampler::REPEAT:
-        creation.address_mode_v = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        break;
-    }
-
-    creation.name = sampler_name;
-
-    SamplerResource* sr = renderer->create_sampler(creation);
-    HASSERT(sr != nullptr);
+    SamplerResource* sr = renderer->create_sampler(creation);
+    HASSERT(sr != nullptr);
 
     samplers.push(*sr);
   }
 
   i64 end_creating_samplers = Time::now();
 
-  // Temporary array of buffer data
+  // Meshlets are appended after the ones of the scenes loaded before.
+  const u32 base_meshlet = meshlets.size;
+  const u32 base_vertex = meshlets_vertex_positions.size;
+  const u32 base_data = meshlet_vertex_and_index_indices.size;
+
+  Array<MeshletCachePrimitive> cache_primitives;
+  cache_primitives.init(resident_allocator, 64);
+  u32 cache_primitive_index = 0;
+
+  char geometry_cache_path[512];
+  snprintf(geometry_cache_path, ArraySize(geometry_cache_path), "%s.meshlets",
+           filename);
+  u64 geometry_source_hash = 0;
+  bool geometry_cache_loaded = false;
+  if (cache_geometry) {
+    geometry_source_hash = meshlet_cache_source_hash(filename, gltf_scene);
+    geometry_cache_loaded = load_meshlet_cache(
+        *this, geometry_cache_path, geometry_source_hash, resident_allocator,
+        async_loader->task_scheduler, cache_primitives);
+  }
+
+  // Temporary array of buffer data. The buffers are only read to build the
+  // meshlets, they are neither read nor uploaded when the cache is valid.
   Array<void*> buffers_data;
   buffers_data.init(resident_allocator, gltf_scene.buffers_count);
 
   for (u32 buffer_index = 0; buffer_index < gltf_scene.buffers_count;
        ++buffer_index) {
+    if (geometry_cache_loaded) {
+      buffers_data.push(nullptr);
+      continue;
+    }
     glTF::Buffer& buffer = gltf_scene.buffers[buffer_index];
 
     FileReadResult buffer_data =
@@ -1406,6 +2370,12 @@ void glTFScene::load(cstring filename, cstring path,
   // Load all buffers and initialize them with buffer data
   for (u32 buffer_index = 0; buffer_index < gltf_scene.buffer_views_count;
        ++buffer_index) {
+    if (geometry_cache_loaded) {
+      // Keeps the buffer view indices of the meshes, nothing draws from them.
+      buffers.push(BufferResource{});
+      buffers.back().handle = k_invalid_buffer;
+      continue;
+    }
     glTF::BufferView& buffer = gltf_scene.buffer_views[buffer_index];
 
     i32 offset = buffer.byte_offset;
@@ -1437,15 +2407,17 @@ void glTFScene::load(cstring filename, cstring path,
 
    // async_loader->request_buffer_upload(buffer_data, br->handle);
     UploadRequest& request = upload_requests[buffer_index];
+	request = UploadRequest{};
 	request.data = buffer_data;
 	request.gpu_buffer = br->handle;
-	request.cpu_buffer = k_invalid_buffer;
-	request.texture = k_invalid_texture;
 
     buffers.push(*br);
   }
 
-   async_loader->upload_requests.push_array(upload_requests);
+  if (!geometry_cache_loaded) {
+    std::lock_guard<std::mutex> guard(async_loader->upload_mutex);
+    async_loader->upload_requests.push_array(upload_requests);
+  }
   upload_requests.shutdown();
 
   i64 end_creating_buffers = Time::now();
@@ -1503,16 +2475,35 @@ void glTFScene::load(cstring filename, cstring path,
     node_parents[root_node_index] = -1;
     node_stack.push(root_node_index);
     Node* node = (Node*)node_pool.access_node(node_handles[root_node_index]);
-    node_pool.get_root_node()->add_child(node);
+    node_pool.get_root_node()->add_child(node, &node_pool);
   }
 
   u32 num_double_sided_meshes_t = 0;  // Transparent meshes
   u32 num_double_sided_meshes = 0;
 
-  // Meshlets
-  const sizet max_vertices = 64;
-  const sizet max_triangles = 124;
-  const f32 cone_weight = 0.0f;
+  MeshletGeometry scene_geometry{&meshlets, &meshlets_vertex_positions,
+                                 &meshlets_vertex_data,
+                                 &meshlet_vertex_and_index_indices};
+
+  // Shared mesh of each glTF mesh primitive, created by the first node that
+  // references it.
+  Array<u32> gltf_primitive_offsets;
+  gltf_primitive_offsets.init(temp_allocator, gltf_scene.meshes_count,
+                              gltf_scene.meshes_count);
+  u32 gltf_primitive_count = 0;
+  for (u32 mesh_index = 0; mesh_index < gltf_scene.meshes_count;
+       ++mesh_index) {
+    gltf_primitive_offsets[mesh_index] = gltf_primitive_count;
+    gltf_primitive_count += gltf_scene.meshes[mesh_index].primitives_count;
+  }
+  Array<MeshInstance> gltf_primitive_meshes;
+  gltf_primitive_meshes.init(temp_allocator, gltf_primitive_count,
+                             gltf_primitive_count);
+  for (u32 i = 0; i < gltf_primitive_count; ++i) {
+    gltf_primitive_meshes[i] = MeshInstance{};
+  }
+  const u32 base_mesh_count = opaque_meshes.size + transparent_meshes.size;
+  u32 primitive_instance_count = 0;
 
   while (node_stack.size) {
     u32 node_index = node_stack.back();
@@ -1521,41 +2512,7 @@ void glTFScene::load(cstring filename, cstring path,
 
     glm::mat4 local_matrix{};
     Transform local_transform{};
-    local_transform.translation = glm::vec3(0.0f);
-    local_transform.scale = glm::vec3(1.0f);
-    local_transform.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-
-    if (node.matrix_count) {
-      memcpy(&local_matrix, node.matrix, sizeof(glm::mat4));
-      local_transform.set_transform(local_matrix);
-    } else {
-      glm::vec3 node_scale(1.0f, 1.0f, 1.0f);
-      if (node.scale_count != 0) {
-        HASSERT(node.scale_count == 3);
-        node_scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
-      }
-
-      glm::vec3 node_translation(0.f, 0.f, 0.f);
-      if (node.translation_count) {
-        HASSERT(node.translation_count == 3);
-        node_translation = glm::vec3(node.translation[0], node.translation[1],
-                                     node.translation[2]);
-      }
-
-      // Rotation is written as a plain quaternion
-      glm::quat node_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-      if (node.rotation_count) {
-        HASSERT(node.rotation_count == 4);
-        node_rotation = glm::quat(node.rotation[3], node.rotation[0],
-                                  node.rotation[1], node.rotation[2]);
-      }
-
-      local_transform.translation = node_translation;
-      local_transform.scale = node_scale;
-      local_transform.rotation = node_rotation;
-
-      local_matrix = local_transform.calculate_matrix();
-    }
+    gltf_node_local_transform(node, local_transform, local_matrix);
 
     node_matrix[node_index] = local_matrix;
 
@@ -1566,11 +2523,17 @@ void glTFScene::load(cstring filename, cstring path,
 
     base_node->name = node.name.data ? node.name.data : node_name;
     base_node->local_transform = local_transform;
+    // The glTF matrix is used as is, without the TRS round trip.
+    node_pool.transforms.set_local_matrix(base_node->transform_index,
+                                          local_matrix);
 
     i32 node_parent = node_parents[node_index];
     // Nodes that don't have parents would already have their parent set to
     // the root node
-    if (node_parent != -1) base_node->parent = node_handles[node_parent];
+    if (node_parent != -1) {
+      node_pool.set_parent(node_handles[node_index],
+                           node_handles[node_parent]);
+    }
 
     // Assuming nodes that contain meshes don't contain other glTF nodes
     if (node.mesh == glTF::INVALID_INT_VALUE) {
@@ -1602,231 +2565,193 @@ void glTFScene::load(cstring filename, cstring path,
     // Gltf primitives are conceptually submeshes.
     for (u32 primitive_index = 0; primitive_index < gltf_mesh.primitives_count;
          ++primitive_index) {
-      Mesh mesh{};
-
-      // mesh.gpu_mesh_index = opaque_meshes.size;
-
-      glTF::MeshPrimitive& mesh_primitive =
-          gltf_mesh.primitives[primitive_index];
-
-      const i32 position_accessor_index = gltf_get_attribute_accessor_index(
-          mesh_primitive.attributes, mesh_primitive.attribute_count,
-          "POSITION");
-      const i32 tangent_accessor_index = gltf_get_attribute_accessor_index(
-          mesh_primitive.attributes, mesh_primitive.attribute_count, "TANGENT");
-      const i32 normal_accessor_index = gltf_get_attribute_accessor_index(
-          mesh_primitive.attributes, mesh_primitive.attribute_count, "NORMAL");
-      const i32 texcoord_accessor_index = gltf_get_attribute_accessor_index(
-          mesh_primitive.attributes, mesh_primitive.attribute_count,
-          "TEXCOORD_0");
-
-      get_mesh_vertex_buffer(*this, position_accessor_index,
-                             mesh.position_buffer, mesh.position_offset);
-      get_mesh_vertex_buffer(*this, tangent_accessor_index, mesh.tangent_buffer,
-                             mesh.tangent_offset);
-      get_mesh_vertex_buffer(*this, normal_accessor_index, mesh.normal_buffer,
-                             mesh.normal_offset);
-      get_mesh_vertex_buffer(*this, texcoord_accessor_index,
-                             mesh.texcoord_buffer, mesh.texcoord_offset);
-
-      // Vertex positions
-      glTF::Accessor& position_accessor =
-          gltf_scene.accessors[position_accessor_index];
-      glTF::BufferView& position_buffer_view =
-          gltf_scene.buffer_views[position_accessor.buffer_view];
-      i32 position_data_offset = glTF::get_data_offset(
-          position_accessor.byte_offset, position_buffer_view.byte_offset);
-      f32* vertices = (f32*)((u8*)buffers_data[position_buffer_view.buffer] +
-                             position_data_offset);
-
-      // Calculate bounding sphere center
-      glm::vec3 position_min{position_accessor.min[0], position_accessor.min[1],
-                             position_accessor.min[2]};
-      glm::vec3 position_max{position_accessor.max[0], position_accessor.max[1],
-                             position_accessor.max[2]};
-      glm::vec3 bounding_center = position_min + position_max;
-      bounding_center = bounding_center / 2.0f;
-
-      // Calculate bounding sphere radius
-      f32 radius = Helix::max(glm::distance(position_max, bounding_center),
-                              glm::distance(position_min, bounding_center));
-      mesh.bounding_sphere = {bounding_center.x, bounding_center.y,
-                              bounding_center.z, radius};
-
-      // Vertex normals
-      f32* normals = nullptr;
-      if (normal_accessor_index != -1) {
-        glTF::Accessor& normal_buffer_accessor =
-            gltf_scene.accessors[normal_accessor_index];
-        glTF::BufferView& normal_buffer_view =
-            gltf_scene.buffer_views[normal_buffer_accessor.buffer_view];
-        i32 normal_data_offset = glTF::get_data_offset(
-            normal_buffer_accessor.byte_offset, normal_buffer_view.byte_offset);
-        normals = (f32*)((u8*)buffers_data[normal_buffer_view.buffer] +
-                         normal_data_offset);
-        mesh.pbr_material.flags |= DrawFlags_HasNormals;
-      }
-
-      // Vertex texture coords
-      f32* tex_coords = nullptr;
-      if (texcoord_accessor_index != -1) {
-        glTF::Accessor& tex_coord_buffer_accessor =
-            gltf_scene.accessors[texcoord_accessor_index];
-        glTF::BufferView& tex_coord_buffer_view =
-            gltf_scene.buffer_views[tex_coord_buffer_accessor.buffer_view];
-        i32 tex_coord_data_offset =
-            glTF::get_data_offset(tex_coord_buffer_accessor.byte_offset,
-                                  tex_coord_buffer_view.byte_offset);
-        tex_coords = (f32*)((u8*)buffers_data[tex_coord_buffer_view.buffer] +
-                            tex_coord_data_offset);
-        mesh.pbr_material.flags |= DrawFlags_HasTexCoords;
-      }
-
-      // Vertex tangents
-      f32* tangents = nullptr;
-      if (tangent_accessor_index != -1) {
-        glTF::Accessor& tangent_buffer_accessor =
-            gltf_scene.accessors[tangent_accessor_index];
-        glTF::BufferView& tangent_buffer_view =
-            gltf_scene.buffer_views[tangent_buffer_accessor.buffer_view];
-        i32 tangent_data_offset =
-            glTF::get_data_offset(tangent_buffer_accessor.byte_offset,
-                                  tangent_buffer_view.byte_offset);
-        tangents = (f32*)((u8*)buffers_data[tangent_buffer_view.buffer] +
-                          tangent_data_offset);
-        mesh.pbr_material.flags |= DrawFlags_HasTangents;
-      }
+      // Nodes referencing the same glTF mesh only add instances.
+      MeshInstance& primitive_mesh =
+          gltf_primitive_meshes[gltf_primitive_offsets[node.mesh] +
+                                primitive_index];
+      if (primitive_mesh.mesh_index == k_invalid_index) {
+        Mesh mesh{};
+
+        // mesh.gpu_mesh_index = opaque_meshes.size;
+
+        glTF::MeshPrimitive& mesh_primitive =
+            gltf_mesh.primitives[primitive_index];
+
+        const i32 position_accessor_index = gltf_get_attribute_accessor_index(
+            mesh_primitive.attributes, mesh_primitive.attribute_count,
+            "POSITION");
+        const i32 tangent_accessor_index = gltf_get_attribute_accessor_index(
+            mesh_primitive.attributes, mesh_primitive.attribute_count,
+            "TANGENT");
+        const i32 normal_accessor_index = gltf_get_attribute_accessor_index(
+            mesh_primitive.attributes, mesh_primitive.attribute_count,
+            "NORMAL");
+        const i32 texcoord_accessor_index = gltf_get_attribute_accessor_index(
+            mesh_primitive.attributes, mesh_primitive.attribute_count,
+            "TEXCOORD_0");
+
+        get_mesh_vertex_buffer(*this, position_accessor_index,
+                               mesh.position_buffer, mesh.position_offset);
+        get_mesh_vertex_buffer(*this, tangent_accessor_index,
+                               mesh.tangent_buffer, mesh.tangent_offset);
+        get_mesh_vertex_buffer(*this, normal_accessor_index, mesh.normal_buffer,
+                               mesh.normal_offset);
+        get_mesh_vertex_buffer(*this, texcoord_accessor_index,
+                               mesh.texcoord_buffer, mesh.texcoord_offset);
+
+        // Vertex positions
+        glTF::Accessor& position_accessor =
+            gltf_scene.accessors[position_accessor_index];
+        glTF::BufferView& position_buffer_view =
+            gltf_scene.buffer_views[position_accessor.buffer_view];
+        i32 position_data_offset = glTF::get_data_offset(
+            position_accessor.byte_offset, position_buffer_view.byte_offset);
+        f32* vertices = (f32*)gltf_buffer_data(
+            buffers_data, position_buffer_view.buffer, position_data_offset);
+
+        // Calculate bounding sphere center
+        glm::vec3 position_min{position_accessor.min[0],
+                               position_accessor.min[1],
+                               position_accessor.min[2]};
+        glm::vec3 position_max{position_accessor.max[0],
+                               position_accessor.max[1],
+                               position_accessor.max[2]};
+        glm::vec3 bounding_center = position_min + position_max;
+        bounding_center = bounding_center / 2.0f;
+
+        // Calculate bounding sphere radius
+        f32 radius = Helix::max(glm::distance(position_max, bounding_center),
+                                glm::distance(position_min, bounding_center));
+        mesh.bounding_sphere = {bounding_center.x, bounding_center.y,
+                                bounding_center.z, radius};
+
+        // Vertex normals
+        f32* normals = nullptr;
+        if (normal_accessor_index != -1) {
+          glTF::Accessor& normal_buffer_accessor =
+              gltf_scene.accessors[normal_accessor_index];
+          glTF::BufferView& normal_buffer_view =
+              gltf_scene.buffer_views[normal_buffer_accessor.buffer_view];
+          i32 normal_data_offset =
+              glTF::get_data_offset(normal_buffer_accessor.byte_offset,
+                                    normal_buffer_view.byte_offset);
+          normals = (f32*)gltf_buffer_data(
+              buffers_data, normal_buffer_view.buffer, normal_data_offset);
+          mesh.pbr_material.flags |= DrawFlags_HasNormals;
+        }
 
-      // Create index buffer
-      glTF::Accessor& indices_accessor =
-          gltf_scene.accessors[mesh_primitive.indices];
-      HASSERT(indices_accessor.component_type ==
-                  glTF::Accessor::ComponentType::UNSIGNED_SHORT ||
-              indices_accessor.component_type ==
-                  glTF::Accessor::ComponentType::UNSIGNED_INT);
-      mesh.index_type = (indices_accessor.component_type ==
-                         glTF::Accessor::ComponentType::UNSIGNED_SHORT)
-                            ? VK_INDEX_TYPE_UINT16
-                            : VK_INDEX_TYPE_UINT32;
-
-      glTF::BufferView& indices_buffer_view =
-          gltf_scene.buffer_views[indices_accessor.buffer_view];
-      BufferResource& indices_buffer_gpu =
-          buffers[indices_accessor.buffer_view + current_buffers_count];
-      mesh.index_buffer = indices_buffer_gpu.handle;
-      mesh.index_offset =
-          indices_accessor.byte_offset == glTF::INVALID_INT_VALUE
-              ? 0
-              : indices_accessor.byte_offset;
-      mesh.primitive_count = indices_accessor.count;
-
-      i32 indicies_data_offset = glTF::get_data_offset(
-          indices_accessor.byte_offset, indices_buffer_view.byte_offset);
-      u16* indices = (u16*)((u8*)buffers_data[indices_buffer_view.buffer] +
-                            indicies_data_offset);
-
-      // meshopt_optimizeVertexCache(indices, indices, indices_accessor.count,
-      // position_accessor.count); meshopt_optimizeVertexFetch(vertices,
-      // indices, indices_accessor.count, vertices, position_accessor.count,
-      // sizeof(glm::vec3)); if(normals)
-      //     meshopt_optimizeVertexFetch(normals, indices,
-      //     indices_accessor.count, normals, position_accessor.count,
-      //     sizeof(glm::vec3));
-      // if(tangents)
-      //     meshopt_optimizeVertexFetch(tangents, indices,
-      //     indices_accessor.count, tangents, position_accessor.count,
-      //     sizeof(glm::vec4));
-      // if(tex_coords)
-      //     meshopt_optimizeVertexFetch(tex_coords, indices,
-      //     indices_accessor.count, tex_coords, position_accessor.count,
-      //     sizeof(glm::vec2));
-
-      // Create material
-      if (mesh_primitive.material != glTF::INVALID_INT_VALUE) {
-        glTF::Material& material =
-            gltf_scene.materials[mesh_primitive.material];
-        fill_pbr_material(*renderer, material, mesh.pbr_material);
-      }
-      // Create material buffer
-      BufferCreation buffer_creation;
-      cstring mesh_data_name = renderer->resource_name_buffer.append_use_f(
-          "mesh_data_%u", opaque_meshes.size + transparent_meshes.size);
-      buffer_creation.reset()
-          .set(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ResourceUsageType::Dynamic,
-               sizeof(MeshData))
-          .set_name(mesh_data_name);
-      mesh.pbr_material.material_buffer =
-          renderer->create_buffer(buffer_creation)->handle;
-
-      // Meshlets
-      const sizet max_meshlets = meshopt_buildMeshletsBound(
-          indices_accessor.count, max_vertices, max_triangles);
-
-      Array<meshopt_Meshlet> local_meshlets;
-      local_meshlets.init(temp_allocator, (u32)max_meshlets, (u32)max_meshlets);
-
-      Array<u32> meshlet_vertex_indices;
-      meshlet_vertex_indices.init(temp_allocator,
-                                  (u32)max_meshlets * (u32)max_vertices,
-                                  (u32)max_meshlets * (u32)max_vertices);
-
-      Array<u8> meshlet_triangles;
-      meshlet_triangles.init(temp_allocator,
-                             (u32)max_meshlets * (u32)max_triangles * 3,
-                             (u32)max_meshlets * (u32)max_triangles * 3);
-
-      sizet meshlet_count = meshopt_buildMeshlets(
-          local_meshlets.data, meshlet_vertex_indices.data,
-          meshlet_triangles.data, indices, indices_accessor.count, vertices,
-          position_accessor.count, sizeof(glm::vec3), max_vertices,
-          max_triangles, cone_weight);
-
-      u32 meshlet_vertex_offset = meshlets_vertex_positions.size;
-      for (u32 v = 0; v < (u32)position_accessor.count; ++v) {
-        GPUMeshletVertexPosition meshlet_vertex_pos{};
-
-        meshlet_vertex_pos.position[0] = vertices[v * 3 + 0];
-        meshlet_vertex_pos.position[1] = vertices[v * 3 + 1];
-        meshlet_vertex_pos.position[2] = vertices[v * 3 + 2];
-
-        meshlets_vertex_positions.push(meshlet_vertex_pos);
-
-        GPUMeshletVertexData meshlet_vertex_data{};
-
-        if (normals != nullptr) {
-          meshlet_vertex_data.normal[0] =
-              (u8)((normals[v * 3 + 0] + 1.0f) * 127.0f);
-          meshlet_vertex_data.normal[1] =
-              (u8)((normals[v * 3 + 1] + 1.0f) * 127.0f);
-          meshlet_vertex_data.normal[2] =
-              (u8)((normals[v * 3 + 2] + 1.0f) * 127.0f);
+        // Vertex texture coords
+        f32* tex_coords = nullptr;
+        if (texcoord_accessor_index != -1) {
+          glTF::Accessor& tex_coord_buffer_accessor =
+              gltf_scene.accessors[texcoord_accessor_index];
+          glTF::BufferView& tex_coord_buffer_view =
+              gltf_scene.buffer_views[tex_coord_buffer_accessor.buffer_view];
+          i32 tex_coord_data_offset =
+              glTF::get_data_offset(tex_coord_buffer_accessor.byte_offset,
+                                    tex_coord_buffer_view.byte_offset);
+          tex_coords = (f32*)gltf_buffer_data(buffers_data,
+                                              tex_coord_buffer_view.buffer,
+                                              tex_coord_data_offset);
+          mesh.pbr_material.flags |= DrawFlags_HasTexCoords;
         }
 
-        if (tangents != nullptr) {
-          meshlet_vertex_data.tangent[0] =
-              (u8)((tangents[v * 3 + 0] + 1.0f) * 127.0f);
-          meshlet_vertex_data.tangent[1] =
-              (u8)((tangents[v * 3 + 1] + 1.0f) * 127.0f);
-          meshlet_vertex_data.tangent[2] =
-              (u8)((tangents[v * 3 + 2] + 1.0f) * 127.0f);
-          meshlet_vertex_data.tangent[3] =
-              (u8)((tangents[v * 3 + 3] + 1.0f) * 127.0f);
+        // Vertex tangents
+        f32* tangents = nullptr;
+        if (tangent_accessor_index != -1) {
+          glTF::Accessor& tangent_buffer_accessor =
+              gltf_scene.accessors[tangent_accessor_index];
+          glTF::BufferView& tangent_buffer_view =
+              gltf_scene.buffer_views[tangent_buffer_accessor.buffer_view];
+          i32 tangent_data_offset =
+              glTF::get_data_offset(tangent_buffer_accessor.byte_offset,
+                                    tangent_buffer_view.byte_offset);
+          tangents = (f32*)gltf_buffer_data(
+              buffers_data, tangent_buffer_view.buffer, tangent_data_offset);
+          mesh.pbr_material.flags |= DrawFlags_HasTangents;
         }
 
-        if (tex_coords != nullptr) {
-          meshlet_vertex_data.uv_coords[0] =
-              meshopt_quantizeHalf(tex_coords[v * 2 + 0]);
-          meshlet_vertex_data.uv_coords[1] =
-              meshopt_quantizeHalf(tex_coords[v * 2 + 1]);
+        // Create index buffer
+        glTF::Accessor& indices_accessor =
+            gltf_scene.accessors[mesh_primitive.indices];
+        HASSERT(indices_accessor.component_type ==
+                    glTF::Accessor::ComponentType::UNSIGNED_SHORT ||
+                indices_accessor.component_type ==
+                    glTF::Accessor::ComponentType::UNSIGNED_INT);
+        mesh.index_type = (indices_accessor.component_type ==
+                           glTF::Accessor::ComponentType::UNSIGNED_SHORT)
+                              ? VK_INDEX_TYPE_UINT16
+                              : VK_INDEX_TYPE_UINT32;
+
+        glTF::BufferView& indices_buffer_view =
+            gltf_scene.buffer_views[indices_accessor.buffer_view];
+        BufferResource& indices_buffer_gpu =
+            buffers[indices_accessor.buffer_view + current_buffers_count];
+        mesh.index_buffer = indices_buffer_gpu.handle;
+        mesh.index_offset =
+            indices_accessor.byte_offset == glTF::INVALID_INT_VALUE
+                ? 0
+                : indices_accessor.byte_offset;
+        mesh.primitive_count = indices_accessor.count;
+
+        i32 indicies_data_offset = glTF::get_data_offset(
+            indices_accessor.byte_offset, indices_buffer_view.byte_offset);
+        u16* indices = (u16*)gltf_buffer_data(
+            buffers_data, indices_buffer_view.buffer, indicies_data_offset);
+
+        // meshopt_optimizeVertexCache(indices, indices, indices_accessor.count,
+        // position_accessor.count); meshopt_optimizeVertexFetch(vertices,
+        // indices, indices_accessor.count, vertices, position_accessor.count,
+        // sizeof(glm::vec3)); if(normals)
+        //     meshopt_optimizeVertexFetch(normals, indices,
+        //     indices_accessor.count, normals, position_accessor.count,
+        //     sizeof(glm::vec3));
+        // if(tangents)
+        //     meshopt_optimizeVertexFetch(tangents, indices,
+        //     indices_accessor.count, tangents, position_accessor.count,
+        //     sizeof(glm::vec4));
+        // if(tex_coords)
+        //     meshopt_optimizeVertexFetch(tex_coords, indices,
+        //     indices_accessor.count, tex_coords, position_accessor.count,
+        //     sizeof(glm::vec2));
+
+        // Create material
+        if (mesh_primitive.material != glTF::INVALID_INT_VALUE) {
+          glTF::Material& material =
+              gltf_scene.materials[mesh_primitive.material];
+          fill_pbr_material(*renderer, material, mesh.pbr_material);
         }
 
-        meshlets_vertex_data.push(meshlet_vertex_data);
+        // Meshlets, already decoded when the geometry cache is valid.
+        if (geometry_cache_loaded) {
+          HASSERT(cache_primitive_index < cache_primitives.size);
+          const MeshletCachePrimitive& cached_primitive =
+              cache_primitives[cache_primitive_index];
+          mesh.meshlet_offset = base_meshlet + cached_primitive.meshlet_offset;
+          mesh.meshlet_count = cached_primitive.meshlet_count;
+        } else {
+          mesh.meshlet_offset = meshlets.size;
+          mesh.meshlet_count = build_primitive_meshlets(
+              scene_geometry, vertices, normals, tangents, tex_coords,
+              (u32)position_accessor.count, indices,
+              (u32)indices_accessor.count, temp_allocator);
+          cache_primitives.push(
+              {mesh.meshlet_offset - base_meshlet, mesh.meshlet_count});
+        }
+        ++cache_primitive_index;
+
+        if (mesh.is_transparent()) {
+          primitive_mesh.mesh_index = transparent_meshes.size;
+          primitive_mesh.transparent = true;
+          transparent_meshes.push(mesh);
+          if (mesh.is_double_sided()) num_double_sided_meshes_t++;
+        } else {
+          primitive_mesh.mesh_index = opaque_meshes.size;
+          opaque_meshes.push(mesh);
+          if (mesh.is_double_sided()) num_double_sided_meshes++;
+        }
       }
 
-      // Cache meshlet offset
-      mesh.meshlet_offset = meshlets.size;
-      mesh.meshlet_count = (u32)meshlet_count;
-
       // Nodes
       // TODO Make this a primitive struct. Not a MeshNode
       NodeHandle mesh_handle = node_pool.obtain_node(NodeType::MeshNode);
@@ -1834,111 +2759,33 @@ void glTFScene::load(cstring filename, cstring path,
           (MeshNode*)node_pool.access_node(mesh_handle);
       mesh_node_primitive->children.size = 0;
       mesh_node_primitive->name = "Mesh_Primitive";
-      mesh_node_primitive->parent = node_handles[node_index];
+      mesh_node_primitive->instance_index = obtain_mesh_instance(
+          primitive_mesh.mesh_index, primitive_mesh.transparent,
+          mesh_handle.index);
+      mesh_node_primitive->mesh =
+          primitive_mesh.transparent
+              ? &transparent_meshes[primitive_mesh.mesh_index]
+              : &opaque_meshes[primitive_mesh.mesh_index];
+      node_pool.set_parent(mesh_handle, node_handles[node_index]);
+      ++primitive_instance_count;
 
       mesh_node_primitive->children.size = 0;
 
       // TODO: Extract the position from the position buffer.
       base_node->children.push(mesh_handle);
-
-      mesh.node_index = mesh_handle.index;
-
-      if (mesh.is_transparent()) {
-        transparent_meshes.push(mesh);
-        mesh_node_primitive->mesh =
-            &transparent_meshes[transparent_meshes.size - 1];
-        if (mesh.is_double_sided()) num_double_sided_meshes_t++;
-      } else {
-        opaque_meshes.push(mesh);
-        mesh_node_primitive->mesh = &opaque_meshes[opaque_meshes.size - 1];
-        if (mesh.is_double_sided()) num_double_sided_meshes++;
-      }
-
-      for (u32 m = 0; m < meshlet_count; ++m) {
-        meshopt_Meshlet& local_meshlet = local_meshlets[m];
-
-        meshopt_Bounds meshlet_bounds = meshopt_computeMeshletBounds(
-            meshlet_vertex_indices.data + local_meshlet.vertex_offset,
-            meshlet_triangles.data + local_meshlet.triangle_offset,
-            local_meshlet.triangle_count, vertices, position_accessor.count,
-            sizeof(glm::vec3));
-
-        GPUMeshlet meshlet{};
-        meshlet.data_offset = meshlet_vertex_and_index_indices.size;
-        meshlet.vertex_count = local_meshlet.vertex_count;
-        meshlet.triangle_count = local_meshlet.triangle_count;
-
-        meshlet.center =
-            glm::vec3(meshlet_bounds.center[0], meshlet_bounds.center[1],
-                      meshlet_bounds.center[2]);
-        meshlet.radius = meshlet_bounds.radius;
-
-        meshlet.cone_axis[0] = meshlet_bounds.cone_axis_s8[0];
-        meshlet.cone_axis[1] = meshlet_bounds.cone_axis_s8[1];
-        meshlet.cone_axis[2] = meshlet_bounds.cone_axis_s8[2];
-
-        meshlet.cone_cutoff = meshlet_bounds.cone_cutoff_s8;
-        // meshlet.mesh_index = mesh.is_transparent() ? opaque_meshes.size +
-        // transparent_meshes.size - 1 : opaque_meshes.size - 1; // TODO: What
-        // about transparent meshes?
-#if NVIDIA
-
-        // Resize data array
-        const u32 index_group_count =
-            (local_meshlet.triangle_count * 3 + 3) / 4;
-        meshlet_vertex_and_index_indices.set_capacity(
-            meshlet_vertex_and_index_indices.size + local_meshlet.vertex_count +
-            index_group_count);
-
-        for (u32 i = 0; i < meshlet.vertex_count; ++i) {
-          u32 vertex_index =
-              meshlet_vertex_offset +
-              meshlet_vertex_indices[local_meshlet.vertex_offset + i];
-          meshlet_vertex_and_index_indices.push(vertex_index);
-        }
-        // Store indices as uint32
-        // NOTE(marco): we write 4 indices at at time, it will come in handy
-        // in the mesh shader
-        const u32* index_groups = reinterpret_cast<const u32*>(
-            meshlet_triangles.data + local_meshlet.triangle_offset);
-        for (u32 i = 0; i < index_group_count; ++i) {
-          const u32 index_group = index_groups[i];
-          meshlet_vertex_and_index_indices.push(index_group);
-        }
-#else
-        // Resize data array
-        // Pack 3 u8 incicies into a u32
-        const u32 index_group_count = (local_meshlet.triangle_count * 3) / 3;
-        meshlet_vertex_and_index_indices.set_capacity(
-            meshlet_vertex_and_index_indices.size + local_meshlet.vertex_count +
-            index_group_count);
-
-        for (u32 i = 0; i < meshlet.vertex_count; ++i) {
-          u32 vertex_index =
-              meshlet_vertex_offset +
-              meshlet_vertex_indices[local_meshlet.vertex_offset + i];
-          meshlet_vertex_and_index_indices.push(vertex_index);
-        }
-        // Store indices as uint32
-        // NOTE(marco): we write to the gl_PrimitiveTriangleIndicesEXT uvec3
-        // array
-        const u8* p_indicies = reinterpret_cast<const u8*>(
-            meshlet_triangles.data + local_meshlet.triangle_offset);
-        for (u32 i = 0; i < index_group_count; ++i) {
-          const u32 index_group = (u32(p_indicies[i * 3 + 0]) << 16) |
-                                  (u32(p_indicies[i * 3 + 1]) << 8) |
-                                  (u32(p_indicies[i * 3 + 2]));
-          meshlet_vertex_and_index_indices.push(index_group);
-        }
-#endif  // NVIDIA
-        meshlets.push(meshlet);
-      }
-      //
-      while (meshlets.size % 32) meshlets.push(GPUMeshlet());
     }
   }
 
   HWARN("Scene meshlet count: {}", meshlets.size);
+  HINFO("{} mesh instances share {} meshes", primitive_instance_count,
+        opaque_meshes.size + transparent_meshes.size - base_mesh_count);
+
+  if (cache_geometry && !geometry_cache_loaded) {
+    write_meshlet_cache(*this, geometry_cache_path, geometry_source_hash,
+                        base_meshlet, base_vertex, base_data, cache_primitives,
+                        resident_allocator);
+  }
+  cache_primitives.shutdown();
 
   current_images_count += gltf_scene.images_count;
   current_buffers_count += gltf_scene.buffer_views_count;
@@ -1947,7 +2794,7 @@ void glTFScene::load(cstring filename, cstring path,
   // qsort(transparent_meshes.data, transparent_meshes.size, sizeof(Mesh),
   // gltf_mesh_doublesided_compare); qsort(opaque_meshes.data,
   // opaque_meshes.size, sizeof(Mesh), gltf_mesh_doublesided_compare);
-  node_pool.get_root_node()->update_transform(&node_pool);
+  node_pool.update_transforms();
 
   transparent_pass.double_sided_mesh_count += num_double_sided_meshes_t;
   gbuffer_pass.double_sided_mesh_count += num_double_sided_meshes;
@@ -1957,7 +2804,9 @@ void glTFScene::load(cstring filename, cstring path,
   for (u32 buffer_index = 0; buffer_index < gltf_scene.buffers_count;
        ++buffer_index) {
     void* buffer = buffers_data[buffer_index];
-    resident_allocator->deallocate(buffer);  // TODO: NEEDED?
+    if (buffer) {
+      resident_allocator->deallocate(buffer);  // TODO: NEEDED?
+    }
   }
 
   buffers_data.shutdown();
@@ -1974,6 +2823,7 @@ void glTFScene::free_gpu_resources(Renderer* renderer) {
   directional_shadow_map_pass.free_gpu_resources();
   gbuffer_pass.free_gpu_resources();
   gbuffer_late_pass.free_gpu_resources();
+  light_clustering_pass.free_gpu_resources();
   light_pass.free_gpu_resources();
   transparent_pass.free_gpu_resources();
   depth_pyramid_pass.free_gpu_resources();
@@ -1984,6 +2834,21 @@ void glTFScene::free_gpu_resources(Renderer* renderer) {
   }
   gpu.destroy_descriptor_set(fullscreen_ds);
 
+  // Queued loads would fill destroyed textures.
+  loader->load_jobs.cancel_group(load_group);
+
+  for (u32 i = 0; i < sections.size; ++i) {
+    free_section(*sections[i]);
+    delete sections[i];
+  }
+  sections.clear();
+
+  for (u32 i = 0; i < streamed_textures.size; ++i) {
+    if (streamed_textures[i].pending_texture.index != k_invalid_index) {
+      gpu.destroy_texture(streamed_textures[i].pending_texture);
+    }
+  }
+
   transparent_meshes.shutdown();
   opaque_meshes.shutdown();
 }
@@ -1992,17 +2857,46 @@ void glTFScene::unload(Renderer* renderer) {
   destroy_node(node_pool.root_node);
 
   node_pool.shutdown();
+
+  mesh_instances.free_all_resources();
+  mesh_instances.shutdown();
+  mesh_instance_count = 0;
+  opaque_instance_count = 0;
+  transparent_instance_count = 0;
+  instance_dirty.shutdown();
+  material_dirty.shutdown();
+  occlusion_buffer.shutdown();
+  occluder_indices.shutdown();
+  occluded_instances.shutdown();
+  mesh_bvh.shutdown();
+  bvh_query_results.shutdown();
   // Free scene buffers
   samplers.shutdown();
   images.shutdown();
   buffers.shutdown();
 
+  texture_streaming.shutdown();
+  streamed_textures.shutdown();
+  streamed_texture_map.shutdown();
+  image_load_jobs.shutdown();
+  image_load_priorities.shutdown();
+  image_texture_map.shutdown();
+  texture_streaming_loads.shutdown();
+  texture_streaming_evictions.shutdown();
+
   meshlets.shutdown();
   meshlets_vertex_positions.shutdown();
   meshlets_vertex_data.shutdown();
   meshlet_vertex_and_index_indices.shutdown();
   lights.shutdown();
 
+  sections.shutdown();
+  meshlet_ranges.shutdown();
+  meshlet_vertex_ranges.shutdown();
+  meshlet_data_ranges.shutdown();
+  free_opaque_meshes.shutdown();
+  free_transparent_meshes.shutdown();
+
   // NOTE(marco): we can't destroy this sooner as textures and buffers
   // hold a pointer to the names stored here
   gltf_free(gltf_scene);
@@ -2025,6 +2919,8 @@ void glTFScene::register_render_passes(FrameGraph* frame_graph_) {
   frame_graph->builder->register_render_pass("gbuffer_pass", &gbuffer_pass);
   frame_graph->builder->register_render_pass("gbuffer_late_pass",
                                              &gbuffer_late_pass);
+  frame_graph->builder->register_render_pass("light_clustering_pass",
+                                             &light_clustering_pass);
   frame_graph->builder->register_render_pass("lighting_pass", &light_pass);
   frame_graph->builder->register_render_pass("transparent_pass",
                                              &transparent_pass);
@@ -2035,6 +2931,28 @@ void glTFScene::register_render_passes(FrameGraph* frame_graph_) {
   debug_pass.prepare_draws(*this, frame_graph, renderer->gpu->allocator);
 }
 
+// Smallest pools created by prepare_draws, sections grow them when needed.
+static const u32 k_min_gpu_meshlets = 8192;
+static const u32 k_min_gpu_meshlet_vertices = 65536;
+static const u32 k_min_gpu_meshlet_data = 131072;
+static const u32 k_min_gpu_meshes = 256;
+static const u32 k_min_gpu_instances = 1024;
+
+// Sizes array to capacity, zeroing the new elements.
+template <typename T>
+static void resize_zeroed(Array<T>& array, u32 capacity) {
+  const u32 old_size = array.size;
+  array.set_size(capacity);
+  if (capacity > old_size) {
+    memset(array.data + old_size, 0, sizeof(T) * (capacity - old_size));
+  }
+}
+
+// The culling shader reads the occluded instance bits as u32.
+static u32 occluded_instance_bits(u32 instance_capacity) {
+  return (instance_capacity + 31) / 32 * 32;
+}
+
 void glTFScene::prepare_draws(Renderer* renderer,
                               StackAllocator* stack_allocator) {
   for (u32 i = 0; i < opaque_meshes.size; ++i) {
@@ -2052,20 +2970,46 @@ void glTFScene::prepare_draws(Renderer* renderer,
   }
 
   u32 total_meshes = opaque_meshes.size + transparent_meshes.size;
+  // A draw command per instance, meshes are shared between instances.
+  const u32 total_draws = opaque_instance_count + transparent_instance_count;
+
+  // Pools have room for the sections streamed later. The CPU streams mirror
+  // the meshlet pools, the unused tail is allocated by the range allocators.
+  gpu_mesh_capacity = Helix::max(total_meshes, k_min_gpu_meshes);
+  gpu_instance_capacity =
+      Helix::max(mesh_instances.pool_size, k_min_gpu_instances);
+  gpu_draw_capacity = Helix::max(total_draws, k_min_gpu_instances);
+
+  // Scenes loaded since the last prepare_draws are appended after the pools.
+  meshlet_ranges.append_allocated(meshlets.size);
+  meshlet_ranges.grow(Helix::max(meshlets.size, k_min_gpu_meshlets));
+  meshlet_vertex_ranges.append_allocated(meshlets_vertex_positions.size);
+  meshlet_vertex_ranges.grow(
+      Helix::max(meshlets_vertex_positions.size, k_min_gpu_meshlet_vertices));
+  meshlet_data_ranges.append_allocated(meshlet_vertex_and_index_indices.size);
+  meshlet_data_ranges.grow(Helix::max(meshlet_vertex_and_index_indices.size,
+                                      k_min_gpu_meshlet_data));
+  resize_zeroed(meshlets, meshlet_ranges.capacity);
+  resize_zeroed(meshlets_vertex_positions, meshlet_vertex_ranges.capacity);
+  resize_zeroed(meshlets_vertex_data, meshlet_vertex_ranges.capacity);
+  resize_zeroed(meshlet_vertex_and_index_indices,
+                meshlet_data_ranges.capacity);
 
   BufferCreation buffer_creation;
-  // Meshlets buffers
+  // Meshlets buffers, mapped so that sections can be written in place.
   buffer_creation.reset()
-      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable,
+      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
            sizeof(GPUMeshlet) * meshlets.size)
       .set_name("meshlets_buffer")
-      .set_data(meshlets.data);
+      .set_data(meshlets.data)
+      .set_persistent(true);
   meshlets_buffer = renderer->create_buffer(buffer_creation)->handle;
 
   buffer_creation.reset()
       .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
-           sizeof(GPUMaterialData) * total_meshes)
-      .set_name("material_data_buffer");
+           sizeof(GPUMaterialData) * gpu_mesh_capacity)
+      .set_name("material_data_buffer")
+      .set_persistent(true);
   material_data_buffer = renderer->create_buffer(buffer_creation)->handle;
 
   buffer_creation.reset()
@@ -2076,43 +3020,87 @@ void glTFScene::prepare_draws(Renderer* renderer,
 
   buffer_creation.reset()
       .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
-           sizeof(GPUMeshData) * total_meshes)
-      .set_name("mesh_data_buffer");
+           sizeof(GPUMeshData) * gpu_mesh_capacity)
+      .set_name("mesh_data_buffer")
+      .set_persistent(true);
   mesh_data_buffer = renderer->create_buffer(buffer_creation)->handle;
 
   buffer_creation.reset()
       .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
-           sizeof(GPUMeshInstanceData) * total_meshes)
-      .set_name("mesh_instances_buffer");
+           sizeof(GPUMeshInstanceData) * gpu_instance_capacity)
+      .set_name("mesh_instances_buffer")
+      .set_persistent(true);
   mesh_instances_buffer = renderer->create_buffer(buffer_creation)->handle;
 
   // Create mesh bound ssbo
   buffer_creation.reset()
       .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
-           sizeof(glm::vec4) * total_meshes)
-      .set_name("mesh_bounds_buffer");
+           sizeof(glm::vec4) * gpu_mesh_capacity)
+      .set_name("mesh_bounds_buffer")
+      .set_persistent(true);
   mesh_bounds_buffer = renderer->create_buffer(buffer_creation)->handle;
 
+  // Mesh data and bounds never change, instances and materials are uploaded
+  // by the next fill_gpu_data_buffers.
+  GPUMeshData* gpu_mesh_data =
+      (GPUMeshData*)renderer->gpu->access_buffer(mesh_data_buffer)->mapped_data;
+  glm::vec4* gpu_bounds_data =
+      (glm::vec4*)renderer->gpu->access_buffer(mesh_bounds_buffer)->mapped_data;
+  if (gpu_mesh_data && gpu_bounds_data) {
+    for (u32 mesh_index = 0; mesh_index < total_meshes; ++mesh_index) {
+      const Mesh& mesh = get_gpu_mesh(mesh_index);
+      copy_gpu_mesh_data(gpu_mesh_data[mesh_index], mesh);
+      gpu_bounds_data[mesh_index] = mesh.bounding_sphere;
+    }
+  }
+
+  gpu_mesh_count = total_meshes;
+  gpu_instance_count = mesh_instance_count;
+  gpu_opaque_instance_count = opaque_instance_count;
+  gpu_transparent_instance_count = transparent_instance_count;
+  if ((gpu_mesh_capacity + 7) / 8 > material_dirty.size) {
+    material_dirty.resize(gpu_mesh_capacity);
+  }
+  if ((gpu_instance_capacity + 7) / 8 > instance_dirty.size) {
+    instance_dirty.resize(gpu_instance_capacity);
+  }
+  occluded_instances.resize(occluded_instance_bits(gpu_instance_capacity));
+  memset(instance_dirty.bits, 0, instance_dirty.size);
+  memset(material_dirty.bits, 0, material_dirty.size);
+  memset(occluded_instances.bits, 0, occluded_instances.size);
+  instance_dirty_count = 0;
+  material_dirty_count = 0;
+  for (u32 instance_index = 0; instance_index < gpu_instance_count;
+       ++instance_index) {
+    mark_instance_dirty(instance_index);
+  }
+  for (u32 mesh_index = 0; mesh_index < total_meshes; ++mesh_index) {
+    mark_material_dirty(mesh_index);
+  }
+
   buffer_creation.reset()
-      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable,
+      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
            sizeof(u32) * meshlet_vertex_and_index_indices.size)
       .set_name("meshlet_vertex_and_index_indices_buffer")
-      .set_data(meshlet_vertex_and_index_indices.data);
+      .set_data(meshlet_vertex_and_index_indices.data)
+      .set_persistent(true);
   meshlet_vertex_and_index_indices_buffer =
       renderer->create_buffer(buffer_creation)->handle;
 
   buffer_creation.reset()
-      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable,
+      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
            sizeof(GPUMeshletVertexPosition) * meshlets_vertex_positions.size)
       .set_name("meshlets_vertex_pos_buffer")
-      .set_data(meshlets_vertex_positions.data);
+      .set_data(meshlets_vertex_positions.data)
+      .set_persistent(true);
   meshlets_vertex_pos_buffer = renderer->create_buffer(buffer_creation)->handle;
 
   buffer_creation.reset()
-      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable,
+      .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
            sizeof(GPUMeshletVertexData) * meshlets_vertex_data.size)
       .set_name("meshlets_vertex_data_buffer")
-      .set_data(meshlets_vertex_data.data);
+      .set_data(meshlets_vertex_data.data)
+      .set_persistent(true);
   meshlets_vertex_data_buffer =
       renderer->create_buffer(buffer_creation)->handle;
 
@@ -2124,7 +3112,7 @@ void glTFScene::prepare_draws(Renderer* renderer,
         .set(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
              ResourceUsageType::Dynamic,
-             total_meshes * sizeof(GPUMeshDrawCommand))
+             gpu_draw_capacity * sizeof(GPUMeshDrawCommand))
         .set_name(name)
         .set_device_only(true);
     mesh_indirect_draw_early_command_buffers[i] =
@@ -2136,7 +3124,7 @@ void glTFScene::prepare_draws(Renderer* renderer,
         .set(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
              ResourceUsageType::Dynamic,
-             total_meshes * sizeof(GPUMeshDrawCommand))
+             gpu_draw_capacity * sizeof(GPUMeshDrawCommand))
         .set_name(name)
         .set_device_only(true);
     mesh_indirect_draw_late_command_buffers[i] =
@@ -2152,6 +3140,16 @@ void glTFScene::prepare_draws(Renderer* renderer,
     mesh_draw_count_buffers[i] =
         renderer->create_buffer(buffer_creation)->handle;
 
+    name = renderer->resource_name_buffer.append_use_f(
+        "mesh_occluded_instance_buffer_%d", i);
+    buffer_creation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic,
+             occluded_instances.size)
+        .set_name(name)
+        .set_data(occluded_instances.bits);
+    mesh_occluded_instance_buffers[i] =
+        renderer->create_buffer(buffer_creation)->handle;
+
     // TODO(marco): create buffer to track meshlet visibility
   }
 
@@ -2209,6 +3207,7 @@ void glTFScene::prepare_draws(Renderer* renderer,
           .buffer(mesh_instances_buffer, 10)
           .buffer(directional_light_buffer, 11)
           .buffer(mesh_bounds_buffer, 12)
+          .buffer(light_cluster_data_buffer, 13)
           .buffer(debug_line_buffer, 20)
           .buffer(debug_line_count_buffer, 21)
           .buffer(debug_line_indirect_command_buffer, 22)
@@ -2229,6 +3228,8 @@ void glTFScene::prepare_draws(Renderer* renderer,
                                     renderer->gpu->allocator);
   gbuffer_pass.prepare_draws(*this, frame_graph, renderer->gpu->allocator);
   gbuffer_late_pass.prepare_draws(*this, frame_graph, renderer->gpu->allocator);
+  light_clustering_pass.prepare_draws(*this, frame_graph,
+                                      renderer->gpu->allocator);
   light_pass.prepare_draws(*this, frame_graph, renderer->gpu->allocator);
   transparent_pass.prepare_draws(*this, frame_graph, renderer->gpu->allocator);
   directional_shadow_map_pass.prepare_draws(*this, frame_graph,
@@ -2244,9 +3245,38 @@ void glTFScene::prepare_draws(Renderer* renderer,
   // depth_pyramid_pass.depth_pyramid.index;
 }
 
-void glTFScene::fill_pbr_material(Renderer& renderer, glTF::Material& material,
-                                  PBRMaterial& pbr_material) {
-  GpuDevice& gpu = *renderer.gpu;
+// Texture index of a glTF texture, linked with its sampler. images and
+// samplers are the resources created for the glTF file.
+static u16 gltf_material_texture(GpuDevice& gpu, const glTF::glTF& gltf,
+                                 const TextureResource* images,
+                                 const SamplerResource* samplers,
+                                 i32 gltf_texture_index) {
+  if (gltf_texture_index < 0) {
+    return (u16)k_invalid_index;
+  }
+
+  glTF::Texture& gltf_texture = gltf.textures[gltf_texture_index];
+  const TextureResource& texture_gpu = images[gltf_texture.source];
+  SamplerHandle sampler_gpu{};
+  sampler_gpu = gpu.default_sampler;
+  if (gltf_texture.sampler != 2147483647) {
+    sampler_gpu = samplers[gltf_texture.sampler].handle;
+  }
+
+  gpu.link_texture_sampler(texture_gpu.handle, sampler_gpu);
+
+  return (u16)texture_gpu.handle.index;
+}
+
+static void gltf_fill_pbr_material(GpuDevice& gpu, const glTF::glTF& gltf,
+                                   const TextureResource* images,
+                                   const SamplerResource* samplers,
+                                   glTF::Material& material,
+                                   PBRMaterial& pbr_material) {
+  auto material_texture = [&](i32 gltf_texture_index) {
+    return gltf_material_texture(gpu, gltf, images, samplers,
+                                 gltf_texture_index);
+  };
 
   // Handle flags
   if (material.alpha_mode.data != nullptr &&
@@ -2285,19 +3315,23 @@ void glTFScene::fill_pbr_material(Renderer& renderer, glTF::Material& material,
             ? material.pbr_metallic_roughness->metallic_factor
             : 1.f;
 
-    pbr_material.diffuse_texture_index = get_material_texture(
-        gpu, material.pbr_metallic_roughness->base_color_texture);
-    pbr_material.roughness_texture_index = get_material_texture(
-        gpu, material.pbr_metallic_roughness->metallic_roughness_texture);
+    glTF::MaterialPBRMetallicRoughness* pbr = material.pbr_metallic_roughness;
+    pbr_material.diffuse_texture_index = material_texture(
+        pbr->base_color_texture != nullptr ? pbr->base_color_texture->index
+                                           : -1);
+    pbr_material.roughness_texture_index = material_texture(
+        pbr->metallic_roughness_texture != nullptr
+            ? pbr->metallic_roughness_texture->index
+            : -1);
   }
 
   pbr_material.occlusion_texture_index =
-      get_material_texture(gpu, (material.occlusion_texture != nullptr)
-                                    ? material.occlusion_texture->index
-                                    : -1);
-  pbr_material.normal_texture_index = get_material_texture(
-      gpu, (material.normal_texture != nullptr) ? material.normal_texture->index
-                                                : -1);
+      material_texture((material.occlusion_texture != nullptr)
+                           ? material.occlusion_texture->index
+                           : -1);
+  pbr_material.normal_texture_index = material_texture(
+      (material.normal_texture != nullptr) ? material.normal_texture->index
+                                           : -1);
 
   if (material.occlusion_texture != nullptr) {
     if (material.occlusion_texture->strength != glTF::INVALID_FLOAT_VALUE) {
@@ -2309,141 +3343,142 @@ void glTFScene::fill_pbr_material(Renderer& renderer, glTF::Material& material,
   }
 }
 
-u16 glTFScene::get_material_texture(GpuDevice& gpu,
-                                    glTF::TextureInfo* texture_info) {
-  if (texture_info != nullptr) {
-    glTF::Texture& gltf_texture = gltf_scene.textures[texture_info->index];
-    TextureResource& texture_gpu =
-        images[gltf_texture.source + current_images_count];
-    SamplerHandle sampler_gpu{};
-    sampler_gpu = gpu.default_sampler;
-    if (gltf_texture.sampler != 2147483647) {
-      sampler_gpu =
-          samplers[gltf_texture.sampler + current_samplers_count].handle;
+// BC format of a glTF image, chosen by the material slots sampling it.
+static void gltf_select_image_compression(
+    const glTF::glTF& gltf, u32 image_index,
+    TextureCompressionFormat::Enum& format, TextureContent::Enum& content) {
+  enum ImageSlot {
+    ImageSlot_BaseColor = 1 << 0,
+    ImageSlot_MetallicRoughness = 1 << 1,
+    ImageSlot_Normal = 1 << 2,
+    ImageSlot_Occlusion = 1 << 3,
+    ImageSlot_Emissive = 1 << 4,
+  };
+
+  auto uses_image = [&](i32 texture_index) {
+    return texture_index >= 0 &&
+           (u32)texture_index < gltf.textures_count &&
+           (u32)gltf.textures[texture_index].source == image_index;
+  };
+
+  u32 slots = 0;
+  for (u32 m = 0; m < gltf.materials_count; ++m) {
+    glTF::Material& material = gltf.materials[m];
+
+    if (material.pbr_metallic_roughness != nullptr) {
+      glTF::MaterialPBRMetallicRoughness* pbr =
+          material.pbr_metallic_roughness;
+      if (pbr->base_color_texture &&
+          uses_image(pbr->base_color_texture->index)) {
+        slots |= ImageSlot_BaseColor;
+      }
+      if (pbr->metallic_roughness_texture &&
+          uses_image(pbr->metallic_roughness_texture->index)) {
+        slots |= ImageSlot_MetallicRoughness;
+      }
     }
+    if (material.normal_texture &&
+        uses_image(material.normal_texture->index)) {
+      slots |= ImageSlot_Normal;
+    }
+    if (material.occlusion_texture &&
+        uses_image(material.occlusion_texture->index)) {
+      slots |= ImageSlot_Occlusion;
+    }
+    if (material.emissive_texture &&
+        uses_image(material.emissive_texture->index)) {
+      slots |= ImageSlot_Emissive;
+    }
+  }
 
-    gpu.link_texture_sampler(texture_gpu.handle, sampler_gpu);
-
-    return (u16)texture_gpu.handle.index;
+  // Albedo and emissive keep their alpha and precision with BC7, normals only
+  // need two channels, ORM data is fine with BC1 and lone occlusion with BC4.
+  if (slots & (ImageSlot_BaseColor | ImageSlot_Emissive)) {
+    format = TextureCompressionFormat::BC7;
+    content = TextureContent::Color;
+  } else if (slots & ImageSlot_Normal) {
+    format = TextureCompressionFormat::BC5;
+    content = TextureContent::Normal;
+  } else if (slots & ImageSlot_MetallicRoughness) {
+    format = TextureCompressionFormat::BC1;
+    content = TextureContent::Linear;
+  } else if (slots & ImageSlot_Occlusion) {
+    format = TextureCompressionFormat::BC4;
+    content = TextureContent::Linear;
   } else {
-    return (u16)k_invalid_index;
+    format = TextureCompressionFormat::BC7;
+    content = TextureContent::Color;
   }
 }
 
-u16 glTFScene::get_material_texture(GpuDevice& gpu, i32 gltf_texture_index) {
-  if (gltf_texture_index >= 0) {
-    glTF::Texture& gltf_texture = gltf_scene.textures[gltf_texture_index];
-    TextureResource& texture_gpu =
-        images[gltf_texture.source + current_images_count];
-    SamplerHandle sampler_gpu{};
-    sampler_gpu = gpu.default_sampler;
-    if (gltf_texture.sampler != 2147483647) {
-      sampler_gpu =
-          samplers[gltf_texture.sampler + current_samplers_count].handle;
-    }
-
-    gpu.link_texture_sampler(texture_gpu.handle, sampler_gpu);
+void glTFScene::fill_pbr_material(Renderer& renderer, glTF::Material& material,
+                                  PBRMaterial& pbr_material) {
+  gltf_fill_pbr_material(*renderer.gpu, gltf_scene,
+                         images.data + current_images_count,
+                         samplers.data + current_samplers_count, material,
+                         pbr_material);
+}
 
-    return (u16)texture_gpu.handle.index;
-  } else {
-    return (u16)k_invalid_index;
-  }
+void glTFScene::select_image_compression(
+    u32 image_index, TextureCompressionFormat::Enum& format,
+    TextureContent::Enum& content) {
+  gltf_select_image_compression(gltf_scene, image_index, format, content);
 }
 
-void glTFScene::fill_gpu_data_buffers(float model_scale) {
-  // Update per mesh material buffer
+u16 glTFScene::get_material_texture(GpuDevice& gpu,
+                                    glTF::TextureInfo* texture_info) {
+  return get_material_texture(
+      gpu, texture_info != nullptr ? texture_info->index : -1);
+}
 
-  MapBufferParameters material_buffer_map = {material_data_buffer, 0, 0};
-  GPUMaterialData* gpu_material_data =
-      (GPUMaterialData*)renderer->gpu->map_buffer(material_buffer_map);
+u16 glTFScene::get_material_texture(GpuDevice& gpu, i32 gltf_texture_index) {
+  return gltf_material_texture(gpu, gltf_scene,
+                               images.data + current_images_count,
+                               samplers.data + current_samplers_count,
+                               gltf_texture_index);
+}
 
-  MapBufferParameters mesh_buffer_map = {mesh_data_buffer, 0, 0};
-  GPUMeshData* gpu_mesh_data =
-      (GPUMeshData*)renderer->gpu->map_buffer(mesh_buffer_map);
-
-  MapBufferParameters mesh_instance_map = {mesh_instances_buffer, 0, 0};
-  GPUMeshInstanceData* gpu_mesh_instance_data =
-      (GPUMeshInstanceData*)renderer->gpu->map_buffer(mesh_instance_map);
-
-  if (gpu_material_data && gpu_mesh_data) {
-    for (u32 mesh_index = 0; mesh_index < opaque_meshes.size; ++mesh_index) {
-      copy_gpu_material_data(gpu_material_data[mesh_index],
-                             opaque_meshes[mesh_index]);
-      copy_gpu_mesh_data(gpu_mesh_data[mesh_index], opaque_meshes[mesh_index]);
-      Mesh& mesh = opaque_meshes[mesh_index];
-
-      MapBufferParameters material_buffer_map = {
-          mesh.pbr_material.material_buffer, 0, 0};
-      MeshData* mesh_data =
-          (MeshData*)renderer->gpu->map_buffer(material_buffer_map);
-      if (gpu_mesh_instance_data && mesh_data) {
-        copy_gpu_mesh_matrix(*mesh_data, mesh, model_scale,
-                             &node_pool.mesh_nodes);
-        gpu_mesh_instance_data[mesh_index].world = mesh_data->model;
-        gpu_mesh_instance_data[mesh_index].inverse_world =
-            mesh_data->inverse_model;
-        gpu_mesh_instance_data[mesh_index].mesh_index = mesh_index;
-        renderer->gpu->unmap_buffer(material_buffer_map);
-      }
-    }
-    for (u32 mesh_index = 0; mesh_index < transparent_meshes.size;
-         ++mesh_index) {
-      copy_gpu_material_data(gpu_material_data[mesh_index + opaque_meshes.size],
-                             transparent_meshes[mesh_index]);
-      copy_gpu_mesh_data(gpu_mesh_data[mesh_index + opaque_meshes.size],
-                         transparent_meshes[mesh_index]);
-      Mesh& mesh = transparent_meshes[mesh_index];
-
-      MapBufferParameters material_buffer_map = {
-          mesh.pbr_material.material_buffer, 0, 0};
-      MeshData* mesh_data =
-          (MeshData*)renderer->gpu->map_buffer(material_buffer_map);
-      if (mesh_data) {
-        copy_gpu_mesh_matrix(*mesh_data, mesh, model_scale,
-                             &node_pool.mesh_nodes);
-        gpu_mesh_instance_data[mesh_index + opaque_meshes.size].world =
-            mesh_data->model;
-        gpu_mesh_instance_data[mesh_index + opaque_meshes.size].inverse_world =
-            mesh_data->inverse_model;
-        gpu_mesh_instance_data[mesh_index + opaque_meshes.size].mesh_index =
-            mesh_index + opaque_meshes.size;
-        renderer->gpu->unmap_buffer(material_buffer_map);
-      }
+void glTFScene::fill_gpu_data_buffers(float model_scale) {
+  // Only the subtrees touched since the last frame are recomputed.
+  node_pool.update_transforms();
+
+  // A new global scale changes every instance.
+  if (model_scale != uploaded_model_scale) {
+    uploaded_model_scale = model_scale;
+    for (u32 instance_index = 0; instance_index < gpu_instance_count;
+         ++instance_index) {
+      mark_instance_dirty(instance_index);
     }
-    renderer->gpu->unmap_buffer(material_buffer_map);
-    renderer->gpu->unmap_buffer(mesh_buffer_map);
-    renderer->gpu->unmap_buffer(mesh_instance_map);
   }
 
-  // Copy mesh bounding spheres
-  mesh_buffer_map.buffer = mesh_bounds_buffer;
-  glm::vec4* gpu_bounds_data =
-      (glm::vec4*)renderer->gpu->map_buffer(mesh_buffer_map);
-  if (gpu_bounds_data) {
-    for (u32 mesh_index = 0; mesh_index < opaque_meshes.size; ++mesh_index) {
-      gpu_bounds_data[mesh_index] = opaque_meshes[mesh_index].bounding_sphere;
+  const Array<NodeHandle>& updated_nodes = node_pool.transforms.updated_nodes;
+  for (u32 i = 0; i < updated_nodes.size; ++i) {
+    if (updated_nodes[i].type != NodeType::MeshNode) {
+      continue;
     }
-    for (u32 mesh_index = 0; mesh_index < transparent_meshes.size;
-         ++mesh_index) {
-      gpu_bounds_data[mesh_index + opaque_meshes.size] =
-          transparent_meshes[mesh_index].bounding_sphere;
+    const MeshNode* mesh_node =
+        (const MeshNode*)node_pool.access_node(updated_nodes[i]);
+    if (mesh_node->instance_index < gpu_instance_count) {
+      mark_instance_dirty(mesh_node->instance_index);
     }
-    renderer->gpu->unmap_buffer(mesh_buffer_map);
   }
 
-  mesh_buffer_map.buffer = light_data_buffer;
+  upload_dirty_instances(model_scale);
+  upload_dirty_materials();
+
+  MapBufferParameters light_data_map = {light_data_buffer, 0, 0};
   MapBufferParameters light_debug_map = {light_debug_buffer, 0, 0};
 
   glm::vec4* light_debug_data =
       (glm::vec4*)renderer->gpu->map_buffer(light_debug_map);
   GPUPointLight* point_lights_data =
-      (GPUPointLight*)renderer->gpu->map_buffer(mesh_buffer_map);
+      (GPUPointLight*)renderer->gpu->map_buffer(light_data_map);
 
   if (point_lights_data && light_debug_data) {
     for (u32 i = 0; i < node_pool.point_light_nodes.used_indices; ++i) {
-      glm::vec3 light_pos = ((PointLightNode*)node_pool.access_node(
-                                 {i, NodeType::PointLightNode}))
-                                ->world_transform.translation;
+      glm::vec3 light_pos = glm::vec3(
+          node_pool.get_world_matrix((PointLightNode*)node_pool.access_node(
+              {i, NodeType::PointLightNode}))[3]);
       lights[i].position =
           glm::vec4(light_pos, point_light_texture.handle.index);
       point_lights_data[i] = lights[i];
@@ -2451,15 +3486,33 @@ void glTFScene::fill_gpu_data_buffers(float model_scale) {
       light_debug_data[i + 1] =
           glm::vec4(light_pos, point_light_texture.handle.index);
     }
-    glm::vec3 light_pos = ((DirectionalLightNode*)node_pool.access_node(
-                               {0, NodeType::DirectionalLightNode}))
-                              ->world_transform.translation;
+    glm::vec3 light_pos = glm::vec3(node_pool.get_world_matrix(
+        (DirectionalLightNode*)node_pool.access_node(
+            {0, NodeType::DirectionalLightNode}))[3]);
     light_debug_data[0] =
         glm::vec4(light_pos, directional_light_texture.handle.index);
-    renderer->gpu->unmap_buffer(mesh_buffer_map);
+    renderer->gpu->unmap_buffer(light_data_map);
     renderer->gpu->unmap_buffer(light_debug_map);
   }
 
+  // Cluster bounds only depend on the projection.
+  LightClusterView cluster_view;
+  light_cluster_view_init(cluster_view, scene_data);
+  if (cluster_view.z_near != light_cluster_view.z_near ||
+      cluster_view.z_far != light_cluster_view.z_far ||
+      cluster_view.projection_00 != light_cluster_view.projection_00 ||
+      cluster_view.projection_11 != light_cluster_view.projection_11) {
+    MapBufferParameters cluster_bounds_map = {light_cluster_bounds_buffer, 0,
+                                              0};
+    GPULightClusterBounds* cluster_bounds =
+        (GPULightClusterBounds*)renderer->gpu->map_buffer(cluster_bounds_map);
+    if (cluster_bounds) {
+      light_clusters_build_bounds(cluster_view, cluster_bounds);
+      renderer->gpu->unmap_buffer(cluster_bounds_map);
+      light_cluster_view = cluster_view;
+    }
+  }
+
   light_debug_map.buffer = directional_light_buffer;
   GPUDirectionalLight* directional_light =
       (GPUDirectionalLight*)renderer->gpu->map_buffer(light_debug_map);
@@ -2468,7 +3521,7 @@ void glTFScene::fill_gpu_data_buffers(float model_scale) {
     DirectionalLightNode* light_node =
         (DirectionalLightNode*)node_pool.access_node(
             {0, NodeType::DirectionalLightNode});
-    glm::vec3 light_pos = light_node->world_transform.translation;
+    glm::vec3 light_pos = glm::vec3(node_pool.get_world_matrix(light_node)[3]);
 
     directional_light->position_enabled =
         glm::vec4(light_pos, (f32)enable_shadows);
@@ -2499,16 +3552,519 @@ void glTFScene::fill_gpu_data_buffers(float model_scale) {
   renderer->gpu->unmap_buffer(light_debug_map);
 }
 
+Mesh& glTFScene::get_gpu_mesh(u32 mesh_index) {
+  return mesh_index < opaque_meshes.size
+             ? opaque_meshes[mesh_index]
+             : transparent_meshes[mesh_index - opaque_meshes.size];
+}
+
+void glTFScene::mark_instance_dirty(u32 instance_index) {
+  if (!instance_dirty.get_bit(instance_index)) {
+    instance_dirty.set_bit(instance_index);
+    ++instance_dirty_count;
+  }
+}
+
+void glTFScene::mark_material_dirty(u32 mesh_index) {
+  if (!material_dirty.get_bit(mesh_index)) {
+    material_dirty.set_bit(mesh_index);
+    ++material_dirty_count;
+  }
+}
+
+u32 glTFScene::obtain_mesh_instance(u32 mesh_index, bool transparent,
+                                    u32 node_index) {
+  const u32 instance_index = mesh_instances.obtain_resource();
+  MeshInstance& instance =
+      *(MeshInstance*)mesh_instances.access_resource(instance_index);
+  instance.mesh_index = mesh_index;
+  instance.node_index = node_index;
+  instance.transparent = transparent;
+  if (transparent) {
+    ++transparent_instance_count;
+  } else {
+    ++opaque_instance_count;
+  }
+  mesh_instance_count = instance_index + 1 > mesh_instance_count
+                            ? instance_index + 1
+                            : mesh_instance_count;
+  return instance_index;
+}
+
+void glTFScene::release_mesh_instance(u32 instance_index) {
+  MeshInstance& instance =
+      *(MeshInstance*)mesh_instances.access_resource(instance_index);
+  if (instance.transparent) {
+    --transparent_instance_count;
+  } else {
+    --opaque_instance_count;
+  }
+  instance = MeshInstance{};
+  mesh_instances.release_resource(instance_index);
+  if (instance_index < gpu_instance_count) {
+    mark_instance_dirty(instance_index);
+  }
+}
+
+u32 glTFScene::get_instance_mesh_index(u32 instance_index) {
+  const MeshInstance& instance =
+      *(const MeshInstance*)mesh_instances.access_resource(instance_index);
+  if (instance.mesh_index == k_invalid_index) {
+    return k_invalid_index;
+  }
+  return instance.transparent ? opaque_meshes.size + instance.mesh_index
+                              : instance.mesh_index;
+}
+
+void glTFScene::upload_dirty_instances(f32 model_scale) {
+  if (instance_dirty_count == 0) {
+    return;
+  }
+
+  GPUMeshInstanceData* gpu_instances =
+      (GPUMeshInstanceData*)renderer->gpu->access_buffer(mesh_instances_buffer)
+          ->mapped_data;
+  if (gpu_instances == nullptr) {
+    return;
+  }
+
+  // Gather the dirty instances, skipping clean bytes of the bitset.
+  const u32 dirty_count = instance_dirty_count;
+  const sizet scratch_marker = scratch_allocator->get_marker();
+  u32* instance_indices =
+      (u32*)halloca(sizeof(u32) * dirty_count, scratch_allocator);
+  glm::mat4* world_matrices = (glm::mat4*)halloca(
+      sizeof(glm::mat4) * dirty_count * 3, scratch_allocator);
+  glm::mat4* model_matrices = world_matrices + dirty_count;
+  glm::mat4* normal_matrices = model_matrices + dirty_count;
+
+  u32 count = 0;
+  u32 released_count = 0;
+  for (u32 byte = 0; byte < instance_dirty.size; ++byte) {
+    if (instance_dirty.bits[byte] == 0) {
+      continue;
+    }
+    for (u32 bit = 0; bit < 8; ++bit) {
+      const u32 instance_index = byte * 8 + bit;
+      if (instance_index >= gpu_instance_count ||
+          !instance_dirty.get_bit(instance_index)) {
+        continue;
+      }
+
+      const u32 mesh_index = get_instance_mesh_index(instance_index);
+      if (mesh_index == k_invalid_index) {
+        GPUMeshInstanceData& instance = gpu_instances[instance_index];
+        instance.world = glm::mat4(1.0f);
+        instance.inverse_world = glm::mat4(1.0f);
+        instance.mesh_index = k_invalid_index;
+        mesh_bvh.remove(instance_index);
+        ++released_count;
+        continue;
+      }
+
+      instance_indices[count] = instance_index;
+      world_matrices[count] = instance_world_matrix(
+          *(const MeshInstance*)mesh_instances.access_resource(instance_index),
+          node_pool);
+      ++count;
+    }
+    instance_dirty.bits[byte] = 0;
+  }
+  HASSERT(count + released_count == dirty_count);
+  instance_dirty_count = 0;
+
+  const glm::mat4 scale_matrix =
+      glm::scale(glm::mat4(1.0f), glm::vec3(model_scale));
+  matrix_batch_model_normal(loader->task_scheduler, world_matrices,
+                            scale_matrix, model_matrices, normal_matrices,
+                            count);
+
+  for (u32 i = 0; i < count; ++i) {
+    const u32 instance_index = instance_indices[i];
+    GPUMeshInstanceData& instance = gpu_instances[instance_index];
+    instance.world = model_matrices[i];
+    instance.inverse_world = normal_matrices[i];
+    instance.mesh_index = get_instance_mesh_index(instance_index);
+
+    glm::vec3 center;
+    f32 radius;
+    mesh_world_sphere(get_gpu_mesh(instance.mesh_index), model_matrices[i],
+                      center, radius);
+    mesh_bvh.insert(instance_index, center - glm::vec3(radius),
+                    center + glm::vec3(radius));
+  }
+
+  if (mesh_bvh.needs_rebuild()) {
+    mesh_bvh.build(loader->task_scheduler);
+  } else {
+    mesh_bvh.refit(loader->task_scheduler);
+  }
+
+  scratch_allocator->free_marker(scratch_marker);
+}
+
+void glTFScene::get_mesh_culling_input(MeshCullingInput& out_input) {
+  GpuDevice& gpu = *renderer->gpu;
+  out_input.instances = (const GPUMeshInstanceData*)gpu
+                            .access_buffer(mesh_instances_buffer)
+                            ->mapped_data;
+  out_input.meshes =
+      (const GPUMeshData*)gpu.access_buffer(mesh_data_buffer)->mapped_data;
+  out_input.materials = (const GPUMaterialData*)gpu
+                            .access_buffer(material_data_buffer)
+                            ->mapped_data;
+  out_input.mesh_bounds =
+      (const glm::vec4*)gpu.access_buffer(mesh_bounds_buffer)->mapped_data;
+  out_input.occluded_instances = (const u32*)occluded_instances.bits;
+  out_input.instance_count = gpu_instance_count;
+  out_input.total_opaque_mesh_count = gpu_opaque_instance_count;
+}
+
+void glTFScene::upload_dirty_materials() {
+  if (material_dirty_count == 0) {
+    return;
+  }
+
+  GPUMaterialData* gpu_materials =
+      (GPUMaterialData*)renderer->gpu->access_buffer(material_data_buffer)
+          ->mapped_data;
+  if (gpu_materials == nullptr) {
+    return;
+  }
+
+  for (u32 byte = 0; byte < material_dirty.size; ++byte) {
+    if (material_dirty.bits[byte] == 0) {
+      continue;
+    }
+    for (u32 bit = 0; bit < 8; ++bit) {
+      const u32 mesh_index = byte * 8 + bit;
+      if (mesh_index < gpu_mesh_count && material_dirty.get_bit(mesh_index)) {
+        copy_gpu_material_data(gpu_materials[mesh_index],
+                               get_gpu_mesh(mesh_index));
+      }
+    }
+    material_dirty.bits[byte] = 0;
+  }
+  material_dirty_count = 0;
+}
+
+void glTFScene::update_occlusion_buffer(enki::TaskScheduler* task_scheduler,
+                                        f32 model_scale) {
+  // Nothing is hidden when the CPU occlusion is off.
+  memset(occluded_instances.bits, 0, occluded_instances.size);
+  if (!cpu_occlusion_culling) {
+    return;
+  }
+  ZoneScoped;
+
+  occlusion_buffer.begin(scene_data.view_projection);
+  const glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(model_scale));
+  const glm::vec3 eye = glm::vec3(scene_data.camera_position);
+
+  for (u32 instance_index = 0; instance_index < gpu_instance_count;
+       ++instance_index) {
+    const MeshInstance& instance =
+        *(const MeshInstance*)mesh_instances.access_resource(instance_index);
+    if (instance.mesh_index == k_invalid_index || instance.transparent) {
+      continue;
+    }
+    const Mesh& mesh = opaque_meshes[instance.mesh_index];
+    const glm::mat4 model = instance_world_matrix(instance, node_pool) * scale;
+    glm::vec3 center;
+    f32 radius;
+    mesh_world_sphere(mesh, model, center, radius);
+    const f32 distance = glm::length(center - eye);
+    if (distance > radius && radius < occluder_min_screen_size * distance) {
+      continue;
+    }
+
+    occluder_indices.clear();
+    for (u32 m = 0; m < mesh.meshlet_count; ++m) {
+      const GPUMeshlet& meshlet = meshlets[mesh.meshlet_offset + m];
+      const u32* vertex_indices =
+          meshlet_vertex_and_index_indices.data + meshlet.data_offset;
+      const u32* triangle_data = vertex_indices + meshlet.vertex_count;
+      for (u32 t = 0; t < meshlet.triangle_count; ++t) {
+#if NVIDIA
+        // Four u8 indices per u32.
+        const u8* triangle = (const u8*)triangle_data + t * 3;
+        occluder_indices.push(vertex_indices[triangle[0]]);
+        occluder_indices.push(vertex_indices[triangle[1]]);
+        occluder_indices.push(vertex_indices[triangle[2]]);
+#else
+        // A triangle per u32.
+        const u32 triangle = triangle_data[t];
+        occluder_indices.push(vertex_indices[(triangle >> 16) & 0xff]);
+        occluder_indices.push(vertex_indices[(triangle >> 8) & 0xff]);
+        occluder_indices.push(vertex_indices[triangle & 0xff]);
+#endif  // NVIDIA
+      }
+    }
+
+    occlusion_buffer.add_occluder(
+        model, meshlets_vertex_positions[0].position,
+        sizeof(GPUMeshletVertexPosition), occluder_indices.data,
+        occluder_indices.size);
+  }
+
+  occlusion_buffer.rasterize(task_scheduler);
+
+  // Only the instances in the frustum are tested against the occluders.
+  const i64 start = Time::now();
+  glm::vec4 frustum_planes[6];
+  bvh_frustum_planes(scene_data.view_projection, frustum_planes);
+  bvh_query_results.clear();
+  mesh_bvh.frustum_query(frustum_planes, 6, bvh_query_results);
+
+  OcclusionBufferStats& stats = occlusion_buffer.stats;
+  stats.tested = mesh_bvh.leaf_count;
+  stats.frustum_culled = mesh_bvh.leaf_count - bvh_query_results.size;
+  stats.occlusion_culled = 0;
+  for (u32 i = 0; i < bvh_query_results.size; ++i) {
+    // Items of the hierarchy are instance slots.
+    const u32 instance_index = bvh_query_results[i];
+    const InstanceBvhNode& leaf =
+        mesh_bvh.nodes[mesh_bvh.item_leaves[instance_index]];
+    if (!occlusion_buffer.is_aabb_visible(leaf.aabb_min, leaf.aabb_max)) {
+      occluded_instances.set_bit(instance_index);
+      ++stats.occlusion_culled;
+    }
+  }
+  stats.test_ms = Time::from_milliseconds(start);
+}
+
+static void add_texture_load_feedback(glTFScene& scene,
+                                      const MeshInstance& instance,
+                                      f32 model_scale, f32 pixels_per_unit) {
+  const Mesh& mesh = instance.transparent
+                         ? scene.transparent_meshes[instance.mesh_index]
+                         : scene.opaque_meshes[instance.mesh_index];
+  const u16 texture_indices[] = {mesh.pbr_material.diffuse_texture_index,
+                                 mesh.pbr_material.roughness_texture_index,
+                                 mesh.pbr_material.normal_texture_index,
+                                 mesh.pbr_material.occlusion_texture_index};
+
+  const glm::mat4 model = instance_world_matrix(instance, scene.node_pool) *
+                          glm::scale(glm::mat4(1.0f), glm::vec3(model_scale));
+  glm::vec3 center;
+  f32 radius;
+  mesh_world_sphere(mesh, model, center, radius);
+
+  const glm::vec4 view_center =
+      scene.scene_data.view_matrix * glm::vec4(center, 1.0f);
+  bool visible = true;
+  for (u32 i = 0; i < 6; ++i) {
+    visible = visible && glm::dot(scene.scene_data.frustum_planes[i],
+                                  view_center) > -radius;
+  }
+
+  const f32 distance = glm::length(
+      center - glm::vec3(scene.scene_data.camera_position));
+  // Projected size in pixels, meshes behind the camera are kept warm with a
+  // much lower priority.
+  f32 priority = distance > radius
+                     ? 2.f * radius / distance * pixels_per_unit
+                     : (f32)scene.scene_data.resolution_y;
+  if (!visible) {
+    priority *= 0.01f;
+  }
+
+  for (u32 i = 0; i < ArraySize(texture_indices); ++i) {
+    if (texture_indices[i] == INVALID_TEXTURE_INDEX) {
+      continue;
+    }
+
+    const u32 image_index = scene.image_texture_map.get(texture_indices[i]);
+    if (image_index != u32_max &&
+        priority > scene.image_load_priorities[image_index]) {
+      scene.image_load_priorities[image_index] = priority;
+    }
+
+    const u32 streamed_index =
+        scene.streamed_texture_map.get(texture_indices[i]);
+    if (streamed_index == u32_max) {
+      continue;
+    }
+
+    const TextureStreamingEntry& entry =
+        scene.texture_streaming.entries[streamed_index];
+    const u32 desired_mip = texture_streaming_desired_mip(
+        entry.width, entry.height, distance, radius, pixels_per_unit);
+    scene.texture_streaming.add_feedback(streamed_index, desired_mip, priority,
+                                         scene.texture_streaming_frame);
+  }
+}
+
+void glTFScene::update_texture_streaming(f32 model_scale) {
+  if (streamed_textures.size == 0 && pending_image_loads == 0) {
+    return;
+  }
+  ZoneScoped;
+
+  GpuDevice& gpu = *renderer->gpu;
+  ++texture_streaming_frame;
+
+  // Textures filled during the previous frame have their barriers recorded
+  // in already submitted command buffers, so they can be swapped in.
+  for (u32 i = 0; i < streamed_textures.size; ++i) {
+    StreamedTexture& streamed_texture = streamed_textures[i];
+    const TextureStreamingEntry& entry = texture_streaming.entries[i];
+    if (!entry.is_pending()) {
+      continue;
+    }
+
+    // Initial load of the tail mips, done in place.
+    if (entry.resident_mip == entry.mip_count) {
+      Texture* texture = gpu.access_texture(streamed_texture.texture);
+      if (texture->state == RESOURCE_STATE_SHADER_RESOURCE) {
+        texture_streaming.on_residency_changed(i, entry.pending_mip);
+      }
+      continue;
+    }
+
+    // A load that failed or was cancelled leaves the resident mips in place.
+    if (streamed_texture.load_job.index != k_invalid_index) {
+      const LoadJobState::Enum state =
+          loader->load_jobs.get_state(streamed_texture.load_job);
+      if (state == LoadJobState::Cancelled || state == LoadJobState::Failed) {
+        gpu.destroy_texture(streamed_texture.pending_texture);
+        streamed_texture.pending_texture = k_invalid_texture;
+        streamed_texture.load_job = k_invalid_load_job;
+
+        texture_streaming.on_residency_changed(i, entry.resident_mip);
+        continue;
+      }
+    }
+
+    Texture* pending_texture =
+        gpu.access_texture(streamed_texture.pending_texture);
+    if (pending_texture->state != RESOURCE_STATE_SHADER_RESOURCE) {
+      continue;
+    }
+
+    gpu.swap_texture(streamed_texture.texture,
+                     streamed_texture.pending_texture);
+    gpu.destroy_texture(streamed_texture.pending_texture);
+    streamed_texture.pending_texture = k_invalid_texture;
+    streamed_texture.load_job = k_invalid_load_job;
+
+    texture_streaming.on_residency_changed(i, entry.pending_mip);
+  }
+
+  // Feedback
+  const f32 pixels_per_unit =
+      scene_data.projection_11 * scene_data.resolution_y * 0.5f;
+  texture_streaming.begin_feedback();
+  for (u32 i = 0; i < image_load_priorities.size; ++i) {
+    image_load_priorities[i] = 0.f;
+  }
+  for (u32 instance_index = 0; instance_index < mesh_instance_count;
+       ++instance_index) {
+    const MeshInstance& instance =
+        *(const MeshInstance*)mesh_instances.access_resource(instance_index);
+    if (instance.mesh_index != k_invalid_index) {
+      add_texture_load_feedback(*this, instance, model_scale,
+                                pixels_per_unit);
+    }
+  }
+
+  // Images still waiting for the loader are read in the new order, finished
+  // jobs are forgotten.
+  if (pending_image_loads) {
+    for (u32 i = 0; i < image_load_jobs.size; ++i) {
+      LoadJobHandle& load_job = image_load_jobs[i];
+      if (load_job.index == k_invalid_index) {
+        continue;
+      }
+      if (loader->load_jobs.get_state(load_job) >= LoadJobState::Ready) {
+        load_job = k_invalid_load_job;
+        --pending_image_loads;
+        continue;
+      }
+      loader->load_jobs.set_priority(load_job, image_load_priorities[i]);
+    }
+  }
+
+  for (u32 i = 0; i < streamed_textures.size; ++i) {
+    StreamedTexture& streamed_texture = streamed_textures[i];
+    // Jobs are forgotten with their pending texture, when it is swapped in
+    // or dropped.
+    if (streamed_texture.load_job.index == k_invalid_index) {
+      continue;
+    }
+    loader->load_jobs.set_priority(streamed_texture.load_job,
+                                   texture_streaming.entries[i].priority);
+  }
+
+  // Stay within the configured budget and within what the device can still
+  // allocate.
+  sizet budget = texture_streaming_budget;
+  const sizet device_limit = texture_streaming.committed_size +
+                             renderer->update_gpu_heap_budgets() / 4 * 3;
+  if (device_limit < budget) {
+    budget = device_limit;
+  }
+
+  texture_streaming.update(budget, texture_streaming_max_loads,
+                           texture_streaming_frame, texture_streaming_loads,
+                           texture_streaming_evictions);
+
+  // Higher mips come from the KTX2 file, the lower ones are loaded again with
+  // them.
+  for (u32 i = 0; i < texture_streaming_loads.size; ++i) {
+    const TextureStreamingDecision& load = texture_streaming_loads[i];
+    StreamedTexture& streamed_texture = streamed_textures[load.texture_index];
+
+    streamed_texture.pending_texture =
+        create_streamed_texture(load.texture_index, load.target_mip);
+    streamed_texture.load_job = loader->request_compressed_texture_data(
+        streamed_texture.path, streamed_texture.pending_texture,
+        streamed_texture.format, streamed_texture.content, load.target_mip,
+        texture_streaming.entries[load.texture_index].priority, load_group);
+  }
+
+  // Evictions copy the mips that stay resident into a smaller texture.
+  for (u32 i = 0; i < texture_streaming_evictions.size; ++i) {
+    const TextureStreamingDecision& eviction = texture_streaming_evictions[i];
+    StreamedTexture& streamed_texture =
+        streamed_textures[eviction.texture_index];
+    const TextureStreamingEntry& entry =
+        texture_streaming.entries[eviction.texture_index];
+
+    streamed_texture.pending_texture =
+        create_streamed_texture(eviction.texture_index, eviction.target_mip);
+    renderer->add_texture_copy(streamed_texture.texture,
+                               streamed_texture.pending_texture,
+                               eviction.target_mip - entry.resident_mip);
+  }
+}
+
+TextureHandle glTFScene::create_streamed_texture(u32 streamed_index,
+                                                 u32 first_mip) {
+  const TextureStreamingEntry& entry =
+      texture_streaming.entries[streamed_index];
+  Texture* texture =
+      renderer->gpu->access_texture(streamed_textures[streamed_index].texture);
+
+  TextureCreation tc;
+  tc.set_data(nullptr)
+      .set_format_type(texture->vk_format, TextureType::Texture2D)
+      .set_flags(entry.mip_count - first_mip, 0)
+      .set_size((u16)(entry.width >> first_mip),
+                (u16)(entry.height >> first_mip), 1)
+      .set_name(texture->name);
+  return renderer->gpu->create_texture(tc);
+}
+
 void glTFScene::submit_draw_task(ImGuiService* imgui, GPUProfiler* gpu_profiler,
                                  enki::TaskScheduler* task_scheduler) {
   glTFDrawTask draw_task;
   draw_task.init(renderer->gpu, frame_graph, renderer, imgui, gpu_profiler,
-                 this);
+                 this, task_scheduler);
   task_scheduler->AddTaskSetToPipe(&draw_task);
   task_scheduler->WaitforTask(&draw_task);
-  // Avoid using the same command buffer
-  renderer->add_texture_update_commands((draw_task.thread_id + 1) %
-                                        task_scheduler->GetNumTaskThreads());
+  // Command buffers of the frame are not reused within it.
+  renderer->add_texture_update_commands(draw_task.thread_id);
 }
 
 void glTFScene::draw_mesh(CommandBuffer* gpu_commands, Mesh& mesh) {
@@ -2549,8 +4105,11 @@ void glTFScene::imgui_draw_node_property(NodeHandle node_handle) {
 
       glm::vec3 local_rotation =
           glm::degrees(glm::eulerAngles(node->local_transform.rotation));
+      // Decomposed for display only.
+      Transform world_transform{};
+      world_transform.set_transform(node_pool.get_world_matrix(node));
       glm::vec3 world_rotation =
-          glm::degrees(glm::eulerAngles(node->world_transform.rotation));
+          glm::degrees(glm::eulerAngles(world_transform.rotation));
 
       // TODO: Represent rotation as quats
       ImGui::Text("Local Transform");
@@ -2563,8 +4122,8 @@ void glTFScene::imgui_draw_node_property(NodeHandle node_handle) {
 
       ImGui::Text("World Transform");
       ImGui::InputFloat3("position##world",
-                         (float*)&node->world_transform.translation);
-      ImGui::InputFloat3("scale##world", (float*)&node->world_transform.scale);
+                         (float*)&world_transform.translation);
+      ImGui::InputFloat3("scale##world", (float*)&world_transform.scale);
       ImGui::InputFloat3("rotation##world", (float*)&world_rotation);
 
       if (node_handle.type == NodeType::PointLightNode) {
@@ -2591,7 +4150,42 @@ void glTFScene::imgui_draw_node_property(NodeHandle node_handle) {
   ImGui::End();
 }
 
-void glTFScene::add_point_light() {
+void glTFScene::reserve_light_buffers(u32 light_count) {
+  if (light_count <= light_buffer_capacity) {
+    return;
+  }
+
+  GpuDevice& gpu = *renderer->gpu;
+  light_buffer_capacity =
+      Helix::max(light_buffer_capacity * 2, light_count);
+  gpu.resize_buffer(light_data_buffer,
+                    sizeof(GPUPointLight) * light_buffer_capacity);
+  gpu.resize_buffer(light_debug_buffer,
+                    sizeof(glm::vec4) * (light_buffer_capacity + 1));
+
+  // The passes are prepared with the mesh shader descriptor sets.
+  if (!light_pass.renderer) {
+    return;
+  }
+  if (light_pass.enabled) {
+    gpu.update_descriptor_set(light_pass.d_set);
+  }
+  if (light_clustering_pass.renderer) {
+    gpu.update_descriptor_set(light_clustering_pass.light_clustering_d_set);
+  }
+  if (debug_pass.renderer) {
+    gpu.update_descriptor_set(debug_pass.debug_light_dset);
+  }
+  if (gpu.gpu_device_features & GpuDeviceFeature_MESH_SHADER) {
+    for (u32 i = 0; i < k_max_frames; ++i) {
+      gpu.update_descriptor_set(mesh_shader_descriptor_set[i]);
+    }
+  }
+}
+
+void glTFScene::add_point_light(const glm::vec3& position) {
+  reserve_light_buffers(lights.size + 1);
+
   NodeHandle light_node_handle =
       node_pool.obtain_node(NodeType::PointLightNode);
 
@@ -2600,10 +4194,10 @@ void glTFScene::add_point_light() {
   light_node->name = names.append_use_f(
       "Point Light_%d", node_pool.point_light_nodes.used_indices - 1);
   light_node->local_transform.scale = {1.0f, 1.0f, 1.0f};
-  light_node->local_transform.translation.y = 4.0f;
+  light_node->local_transform.translation = position;
   light_node->light_index = lights.size;
 
-  node_pool.get_root_node()->add_child(light_node);
+  node_pool.get_root_node()->add_child(light_node, &node_pool);
 
   GPUPointLight light;
   light.range = 10.f;
@@ -2625,7 +4219,7 @@ void glTFScene::add_directional_light() {
   light_node->local_transform.translation.y = 30.0f;
   light_node->direction_intensity = glm::vec4(0.001f, -1.f, 0.f, 1.f);
 
-  node_pool.get_root_node()->add_child(light_node);
+  node_pool.get_root_node()->add_child(light_node, &node_pool);
 
   light_node->update_transform(&node_pool);
 }
@@ -2682,12 +4276,824 @@ void glTFScene::imgui_draw_hierarchy() {
     if (ImGui::Button("Add Light", {viewportPanelSize.x, 30})) {
       add_point_light();
     }
+    if (ImGui::Button("Add 1024 Lights", {viewportPanelSize.x, 30})) {
+      // A grid over the scene to stress the light clustering.
+      reserve_light_buffers(lights.size + 1024);
+      for (u32 i = 0; i < 1024; ++i) {
+        add_point_light({(f32)(i % 32) - 16.f, 1.f + (f32)(i / 256) * 2.f,
+                         (f32)(i / 32 % 8) * 4.f - 16.f});
+      }
+    }
 
     imgui_draw_node(node_pool.root_node);
     ImGui::End();
   }
 }
 
+// Scene sections //////////////////////////////////////////////////////////
+
+// Data of an accessor inside the buffers of its glTF file, nullptr for -1.
+static const u8* gltf_accessor_data(const glTF::glTF& gltf,
+                                    const Array<void*>& buffers_data,
+                                    i32 accessor_index) {
+  if (accessor_index < 0) {
+    return nullptr;
+  }
+  const glTF::Accessor& accessor = gltf.accessors[accessor_index];
+  const glTF::BufferView& buffer_view = gltf.buffer_views[accessor.buffer_view];
+  const i32 data_offset =
+      glTF::get_data_offset(accessor.byte_offset, buffer_view.byte_offset);
+  return (const u8*)buffers_data[buffer_view.buffer] + data_offset;
+}
+
+// Builds the meshlets of a primitive into the section streams. Fails for
+// primitives that can't be drawn by the meshlet pipeline.
+static bool build_section_primitive(SceneSection& section,
+                                    const Array<void*>& buffers_data,
+                                    const glTF::MeshPrimitive& mesh_primitive,
+                                    SceneSectionPrimitive& out_primitive) {
+  const glTF::glTF& gltf = section.gltf;
+  Allocator* allocator = &section.allocator;
+
+  const i32 position_accessor_index = gltf_get_attribute_accessor_index(
+      mesh_primitive.attributes, mesh_primitive.attribute_count, "POSITION");
+  const i32 tangent_accessor_index = gltf_get_attribute_accessor_index(
+      mesh_primitive.attributes, mesh_primitive.attribute_count, "TANGENT");
+  const i32 normal_accessor_index = gltf_get_attribute_accessor_index(
+      mesh_primitive.attributes, mesh_primitive.attribute_count, "NORMAL");
+  const i32 texcoord_accessor_index = gltf_get_attribute_accessor_index(
+      mesh_primitive.attributes, mesh_primitive.attribute_count, "TEXCOORD_0");
+  if (position_accessor_index == -1 ||
+      mesh_primitive.indices == glTF::INVALID_INT_VALUE) {
+    HWARN("Section {}: skipping a primitive without positions or indices",
+          section.filename);
+    return false;
+  }
+
+  const glTF::Accessor& position_accessor =
+      gltf.accessors[position_accessor_index];
+  const glTF::Accessor& indices_accessor =
+      gltf.accessors[mesh_primitive.indices];
+  const u32 vertex_count = (u32)position_accessor.count;
+  const u32 index_count = (u32)indices_accessor.count;
+
+  // Same bounding sphere as the scene meshes, from the accessor bounds.
+  const glm::vec3 position_min{position_accessor.min[0],
+                               position_accessor.min[1],
+                               position_accessor.min[2]};
+  const glm::vec3 position_max{position_accessor.max[0],
+                               position_accessor.max[1],
+                               position_accessor.max[2]};
+  const glm::vec3 bounding_center = (position_min + position_max) / 2.0f;
+  const f32 radius =
+      Helix::max(glm::distance(position_max, bounding_center),
+                 glm::distance(position_min, bounding_center));
+  out_primitive.bounding_sphere = {bounding_center.x, bounding_center.y,
+                                   bounding_center.z, radius};
+
+  out_primitive.flags = 0;
+  out_primitive.flags |= normal_accessor_index != -1 ? DrawFlags_HasNormals : 0;
+  out_primitive.flags |=
+      texcoord_accessor_index != -1 ? DrawFlags_HasTexCoords : 0;
+  out_primitive.flags |=
+      tangent_accessor_index != -1 ? DrawFlags_HasTangents : 0;
+  out_primitive.material = mesh_primitive.material != glTF::INVALID_INT_VALUE
+                               ? mesh_primitive.material
+                               : -1;
+
+  // The meshlet builder reads 16 bit indices.
+  const u8* index_data =
+      gltf_accessor_data(gltf, buffers_data, mesh_primitive.indices);
+  Array<u16> converted_indices;
+  converted_indices.init(allocator, 0);
+  const u16* indices = (const u16*)index_data;
+  if (indices_accessor.component_type ==
+      glTF::Accessor::ComponentType::UNSIGNED_INT) {
+    if (vertex_count > 65536) {
+      HWARN("Section {}: skipping a primitive with {} vertices",
+            section.filename, vertex_count);
+      return false;
+    }
+    converted_indices.set_size(index_count);
+    const u32* indices_32 = (const u32*)index_data;
+    for (u32 i = 0; i < index_count; ++i) {
+      converted_indices[i] = (u16)indices_32[i];
+    }
+    indices = converted_indices.data;
+  }
+
+  MeshletGeometry geometry{&section.meshlets,
+                           &section.meshlets_vertex_positions,
+                           &section.meshlets_vertex_data,
+                           &section.meshlet_vertex_and_index_indices};
+  out_primitive.meshlet_offset = section.meshlets.size;
+  out_primitive.meshlet_count = build_primitive_meshlets(
+      geometry,
+      (const f32*)gltf_accessor_data(gltf, buffers_data,
+                                     position_accessor_index),
+      (const f32*)gltf_accessor_data(gltf, buffers_data,
+                                     normal_accessor_index),
+      (const f32*)gltf_accessor_data(gltf, buffers_data,
+                                     tangent_accessor_index),
+      (const f32*)gltf_accessor_data(gltf, buffers_data,
+                                     texcoord_accessor_index),
+      vertex_count, indices, index_count, allocator);
+
+  converted_indices.shutdown();
+  return true;
+}
+
+// Everything a section needs from the disk: the glTF, its buffers, the image
+// sizes and the meshlets of the meshes referenced by a node.
+static bool load_section(SceneSection& section) {
+  Allocator* allocator = &section.allocator;
+
+  char* full_filename =
+      section.names.append_use_f("%s%s", section.path, section.filename);
+  section.gltf = gltf_load_file(full_filename, allocator);
+  glTF::glTF& gltf = section.gltf;
+  if (gltf.scenes_count == 0) {
+    HERROR("Section {} has no scene", full_filename);
+    return false;
+  }
+
+  // Images are created by the main thread, their size is read here.
+  section.image_infos.set_size(gltf.images_count);
+  for (u32 image_index = 0; image_index < gltf.images_count; ++image_index) {
+    SceneSectionImage& image_info = section.image_infos[image_index];
+    image_info.path = section.names.append_use_f(
+        "%s%s", section.path, gltf.images[image_index].uri.data);
+
+    int comp, width, height;
+    if (!stbi_info(image_info.path, &width, &height, &comp)) {
+      HWARN("Section {}: can't read image {}", section.filename,
+            image_info.path);
+      width = height = 1;
+    }
+    image_info.width = (u32)width;
+    image_info.height = (u32)height;
+  }
+
+  Array<void*> buffers_data;
+  buffers_data.init(allocator, gltf.buffers_count);
+  bool buffers_read = true;
+  for (u32 buffer_index = 0; buffer_index < gltf.buffers_count;
+       ++buffer_index) {
+    cstring buffer_path = section.names.append_use_f(
+        "%s%s", section.path, gltf.buffers[buffer_index].uri.data);
+    FileReadResult buffer_data = file_read_binary(buffer_path, allocator);
+    if (buffer_data.data == nullptr) {
+      HERROR("Section {}: can't read buffer {}", section.filename,
+             buffer_path);
+      buffers_read = false;
+      break;
+    }
+    buffers_data.push(buffer_data.data);
+  }
+
+  if (buffers_read) {
+    // Primitives are indexed as the glTF ones, only the meshes referenced by
+    // a node are built.
+    section.primitive_offsets.set_size(gltf.meshes_count);
+    u32 primitive_count = 0;
+    for (u32 mesh_index = 0; mesh_index < gltf.meshes_count; ++mesh_index) {
+      section.primitive_offsets[mesh_index] = primitive_count;
+      primitive_count += gltf.meshes[mesh_index].primitives_count;
+    }
+    section.primitives.set_size(primitive_count);
+    memset(section.primitives.data, 0,
+           sizeof(SceneSectionPrimitive) * primitive_count);
+
+    Array<u8> mesh_referenced;
+    mesh_referenced.init(allocator, gltf.meshes_count, gltf.meshes_count);
+    memset(mesh_referenced.data, 0, gltf.meshes_count);
+    for (u32 node_index = 0; node_index < gltf.nodes_count; ++node_index) {
+      const glTF::Node& node = gltf.nodes[node_index];
+      if (node.mesh != glTF::INVALID_INT_VALUE) {
+        mesh_referenced[node.mesh] = 1;
+        section.instance_count += gltf.meshes[node.mesh].primitives_count;
+      }
+    }
+
+    for (u32 mesh_index = 0; mesh_index < gltf.meshes_count; ++mesh_index) {
+      if (!mesh_referenced[mesh_index]) {
+        continue;
+      }
+      const glTF::Mesh& gltf_mesh = gltf.meshes[mesh_index];
+      for (u32 p = 0; p < gltf_mesh.primitives_count; ++p) {
+        SceneSectionPrimitive& primitive =
+            section.primitives[section.primitive_offsets[mesh_index] + p];
+        if (!build_section_primitive(section, buffers_data,
+                                     gltf_mesh.primitives[p], primitive)) {
+          primitive = SceneSectionPrimitive{};
+          primitive.material = -1;
+        }
+      }
+    }
+    mesh_referenced.shutdown();
+  }
+
+  for (u32 i = 0; i < buffers_data.size; ++i) {
+    allocator->deallocate(buffers_data[i]);
+  }
+  buffers_data.shutdown();
+
+  return buffers_read;
+}
+
+void SceneSectionLoadTask::ExecuteRange(enki::TaskSetPartition range_,
+                                        u32 threadnum_) {
+  ZoneScoped;
+  const i64 start = Time::now();
+  section->load_succeeded = load_section(*section);
+  HINFO("Loaded section {} in {} seconds, {} meshlets", section->filename,
+        Time::from_seconds(start), section->meshlets.size);
+}
+
+// Copies count elements to a pool: its CPU mirror and its mapped buffer.
+template <typename T>
+static void write_pool_range(GpuDevice& gpu, BufferHandle buffer,
+                             Array<T>& mirror, u32 offset, const T* source,
+                             u32 count) {
+  if (count == 0) {
+    return;
+  }
+  memcpy(mirror.data + offset, source, sizeof(T) * count);
+  u8* mapped_data = gpu.access_buffer(buffer)->mapped_data;
+  if (mapped_data) {
+    memcpy(mapped_data + sizeof(T) * offset, source, sizeof(T) * count);
+  }
+}
+
+// Mesh of a section primitive, in a slot freed by another section when
+// possible.
+static MeshInstance create_section_mesh(glTFScene& scene,
+                                        SceneSection& section,
+                                        u32 primitive_index) {
+  const SceneSectionPrimitive& primitive = section.primitives[primitive_index];
+
+  Mesh mesh{};
+  mesh.pbr_material.flags = primitive.flags;
+  if (primitive.material >= 0) {
+    gltf_fill_pbr_material(*scene.renderer->gpu, section.gltf,
+                           section.images.data, section.samplers.data,
+                           section.gltf.materials[primitive.material],
+                           mesh.pbr_material);
+  }
+  mesh.meshlet_offset = section.meshlet_range.offset + primitive.meshlet_offset;
+  mesh.meshlet_count = primitive.meshlet_count;
+  mesh.bounding_sphere = primitive.bounding_sphere;
+
+  MeshInstance result{};
+  result.transparent = mesh.is_transparent();
+  Array<Mesh>& meshes =
+      result.transparent ? scene.transparent_meshes : scene.opaque_meshes;
+  Array<u32>& free_meshes = result.transparent ? scene.free_transparent_meshes
+                                               : scene.free_opaque_meshes;
+  if (free_meshes.size) {
+    result.mesh_index = free_meshes.back();
+    free_meshes.pop();
+    meshes[result.mesh_index] = mesh;
+  } else {
+    result.mesh_index = meshes.size;
+    meshes.push(mesh);
+  }
+  return result;
+}
+
+// Creates the nodes of a glTF node subtree and the instances of its meshes.
+static void add_section_node(glTFScene& scene, SceneSection& section,
+                             u32 gltf_node_index, NodeHandle parent_handle) {
+  NodePool& node_pool = scene.node_pool;
+  const glTF::glTF& gltf = section.gltf;
+  const glTF::Node& gltf_node = gltf.nodes[gltf_node_index];
+
+  const NodeHandle handle = node_pool.obtain_node(NodeType::Node);
+  Node* node = (Node*)node_pool.access_node(handle);
+  glm::mat4 local_matrix{};
+  gltf_node_local_transform(gltf_node, node->local_transform, local_matrix);
+  node_pool.transforms.set_local_matrix(node->transform_index, local_matrix);
+  node->name = gltf_node.name.data
+                   ? gltf_node.name.data
+                   : section.names.append_use_f("Node_%u", handle.index);
+
+  const bool has_mesh = gltf_node.mesh != glTF::INVALID_INT_VALUE;
+  const u32 child_count = has_mesh
+                              ? gltf.meshes[gltf_node.mesh].primitives_count
+                              : gltf_node.children_count;
+  node->children.init(node_pool.allocator, child_count);
+  ((Node*)node_pool.access_node(parent_handle))->add_child(node, &node_pool);
+
+  if (!has_mesh) {
+    for (u32 c = 0; c < gltf_node.children_count; ++c) {
+      add_section_node(scene, section, gltf_node.children[c], handle);
+    }
+    return;
+  }
+
+  const glTF::Mesh& gltf_mesh = gltf.meshes[gltf_node.mesh];
+  for (u32 p = 0; p < gltf_mesh.primitives_count; ++p) {
+    const u32 primitive_index = section.primitive_offsets[gltf_node.mesh] + p;
+    if (section.primitives[primitive_index].meshlet_count == 0) {
+      continue;
+    }
+    // Nodes referencing the same glTF mesh only add instances.
+    if (section.primitive_meshes[primitive_index].mesh_index ==
+        k_invalid_index) {
+      section.primitive_meshes[primitive_index] =
+          create_section_mesh(scene, section, primitive_index);
+    }
+    const MeshInstance primitive_mesh =
+        section.primitive_meshes[primitive_index];
+
+    const NodeHandle mesh_handle = node_pool.obtain_node(NodeType::MeshNode);
+    MeshNode* mesh_node = (MeshNode*)node_pool.access_node(mesh_handle);
+    mesh_node->children.init(node_pool.allocator, 0);
+    mesh_node->name = "Mesh_Primitive";
+    mesh_node->instance_index = scene.obtain_mesh_instance(
+        primitive_mesh.mesh_index, primitive_mesh.transparent,
+        mesh_handle.index);
+    mesh_node->mesh = primitive_mesh.transparent
+                          ? &scene.transparent_meshes[primitive_mesh.mesh_index]
+                          : &scene.opaque_meshes[primitive_mesh.mesh_index];
+    section.instances.push(mesh_node->instance_index);
+
+    ((Node*)node_pool.access_node(handle))->add_child(mesh_node, &node_pool);
+  }
+}
+
+void glTFScene::request_section(cstring filename, cstring path) {
+  SceneSection* section = new SceneSection();
+  snprintf(section->filename, ArraySize(section->filename), "%s", filename);
+  snprintf(section->path, ArraySize(section->path), "%s", path);
+
+  // Arrays written by the task use the thread safe section allocator.
+  Allocator* allocator = &section->allocator;
+  section->names.init(hkilo(256), allocator);
+  section->image_infos.init(allocator, 16);
+  section->primitives.init(allocator, 64);
+  section->primitive_offsets.init(allocator, 16);
+  section->meshlets.init(allocator, 1024);
+  section->meshlets_vertex_positions.init(allocator, 4096);
+  section->meshlets_vertex_data.init(allocator, 4096);
+  section->meshlet_vertex_and_index_indices.init(allocator, 8192);
+  section->images.init(allocator, 16);
+  section->samplers.init(allocator, 4);
+  section->primitive_meshes.init(allocator, 64);
+  section->instances.init(allocator, 64);
+  section->load_group = loader->load_jobs.create_group();
+
+  section->load_task.section = section;
+  sections.push(section);
+  loader->task_scheduler->AddTaskSetToPipe(&section->load_task);
+}
+
+void glTFScene::unload_section(u32 section_index) {
+  sections[section_index]->unload_requested = true;
+}
+
+void glTFScene::update_sections() {
+  ZoneScoped;
+
+  // Ranges freed by unloaded sections are reused once no frame in flight
+  // draws them.
+  const u64 frame = renderer->gpu->absolute_frame;
+  meshlet_ranges.update(frame);
+  meshlet_vertex_ranges.update(frame);
+  meshlet_data_ranges.update(frame);
+
+  bool section_committed = false;
+  for (u32 i = 0; i < sections.size;) {
+    SceneSection& section = *sections[i];
+    const bool task_complete = section.load_task.GetIsComplete();
+    if (section.state == SceneSectionState::Loading && task_complete) {
+      section.state = section.load_succeeded ? SceneSectionState::Loaded
+                                             : SceneSectionState::Failed;
+    }
+
+    if (section.unload_requested && task_complete) {
+      free_section(section);
+      delete sections[i];
+      sections.delete_swap(i);
+      continue;
+    }
+
+    // A commit per frame bounds the time spent creating resources.
+    if (!section_committed && section.state == SceneSectionState::Loaded) {
+      section_committed = true;
+      if (meshlet_ranges.capacity == 0) {
+        prepare_draws(renderer, scratch_allocator);
+      }
+      if (reserve_section_pools(section)) {
+        commit_section(section);
+        section.state = SceneSectionState::Resident;
+      }
+    }
+    ++i;
+  }
+}
+
+bool glTFScene::reserve_section_pools(const SceneSection& section) {
+  GpuDevice& gpu = *renderer->gpu;
+  bool grown = false;
+
+  // Meshlet pools grow geometrically, with room for the section.
+  const u32 meshlet_count = section.meshlets.size;
+  if (!meshlet_ranges.can_allocate(meshlet_count, 32)) {
+    const u32 capacity =
+        Helix::max(meshlet_ranges.capacity * 2,
+                   meshlet_ranges.capacity + meshlet_count + 32);
+    meshlet_ranges.grow(capacity);
+    resize_zeroed(meshlets, capacity);
+    gpu.resize_buffer(meshlets_buffer, sizeof(GPUMeshlet) * capacity);
+    grown = true;
+  }
+
+  const u32 vertex_count = section.meshlets_vertex_positions.size;
+  if (!meshlet_vertex_ranges.can_allocate(vertex_count)) {
+    const u32 capacity =
+        Helix::max(meshlet_vertex_ranges.capacity * 2,
+                   meshlet_vertex_ranges.capacity + vertex_count);
+    meshlet_vertex_ranges.grow(capacity);
+    resize_zeroed(meshlets_vertex_positions, capacity);
+    resize_zeroed(meshlets_vertex_data, capacity);
+    gpu.resize_buffer(meshlets_vertex_pos_buffer,
+                      sizeof(GPUMeshletVertexPosition) * capacity);
+    gpu.resize_buffer(meshlets_vertex_data_buffer,
+                      sizeof(GPUMeshletVertexData) * capacity);
+    grown = true;
+  }
+
+  const u32 data_count = section.meshlet_vertex_and_index_indices.size;
+  if (!meshlet_data_ranges.can_allocate(data_count)) {
+    const u32 capacity = Helix::max(meshlet_data_ranges.capacity * 2,
+                                    meshlet_data_ranges.capacity + data_count);
+    meshlet_data_ranges.grow(capacity);
+    resize_zeroed(meshlet_vertex_and_index_indices, capacity);
+    gpu.resize_buffer(meshlet_vertex_and_index_indices_buffer,
+                      sizeof(u32) * capacity);
+    grown = true;
+  }
+
+  // Freed mesh slots are not counted, every primitive could need a new one.
+  const u32 mesh_count = opaque_meshes.size + transparent_meshes.size +
+                         section.primitives.size;
+  if (mesh_count > gpu_mesh_capacity) {
+    gpu_mesh_capacity = Helix::max(gpu_mesh_capacity * 2, mesh_count);
+    gpu.resize_buffer(mesh_data_buffer,
+                      sizeof(GPUMeshData) * gpu_mesh_capacity);
+    gpu.resize_buffer(mesh_bounds_buffer,
+                      sizeof(glm::vec4) * gpu_mesh_capacity);
+    gpu.resize_buffer(material_data_buffer,
+                      sizeof(GPUMaterialData) * gpu_mesh_capacity);
+    material_dirty.resize(gpu_mesh_capacity);
+    grown = true;
+  }
+
+  const u32 instance_count = mesh_instance_count + section.instance_count;
+  if (instance_count > gpu_instance_capacity) {
+    gpu_instance_capacity =
+        Helix::max(gpu_instance_capacity * 2, instance_count);
+    gpu.resize_buffer(mesh_instances_buffer,
+                      sizeof(GPUMeshInstanceData) * gpu_instance_capacity);
+    instance_dirty.resize(gpu_instance_capacity);
+    occluded_instances.resize(occluded_instance_bits(gpu_instance_capacity));
+    for (u32 i = 0; i < k_max_frames; ++i) {
+      gpu.resize_buffer(mesh_occluded_instance_buffers[i],
+                        occluded_instances.size);
+    }
+    grown = true;
+  }
+
+  const u32 draw_count = opaque_instance_count + transparent_instance_count +
+                         section.instance_count;
+  if (draw_count > gpu_draw_capacity) {
+    gpu_draw_capacity = Helix::max(gpu_draw_capacity * 2, draw_count);
+    for (u32 i = 0; i < k_max_frames; ++i) {
+      gpu.resize_buffer(mesh_indirect_draw_early_command_buffers[i],
+                        sizeof(GPUMeshDrawCommand) * gpu_draw_capacity);
+      gpu.resize_buffer(mesh_indirect_draw_late_command_buffers[i],
+                        sizeof(GPUMeshDrawCommand) * gpu_draw_capacity);
+    }
+    grown = true;
+  }
+
+  if (!grown) {
+    return true;
+  }
+
+  // Descriptor updates are applied by the next new_frame, the section is
+  // committed once they point to the new buffers.
+  for (u32 i = 0; i < k_max_frames; ++i) {
+    if (gpu.gpu_device_features & GpuDeviceFeature_MESH_SHADER) {
+      gpu.update_descriptor_set(mesh_shader_descriptor_set[i]);
+    }
+    if (mesh_cull_pass.renderer) {
+      gpu.update_descriptor_set(mesh_cull_pass.frustum_cull_descriptor_set[i]);
+    }
+    if (mesh_cull_late_pass.renderer) {
+      gpu.update_descriptor_set(
+          mesh_cull_late_pass.frustum_cull_descriptor_set[i]);
+    }
+  }
+  return false;
+}
+
+void glTFScene::commit_section(SceneSection& section) {
+  ZoneScoped;
+  GpuDevice& gpu = *renderer->gpu;
+  glTF::glTF& gltf = section.gltf;
+
+  // Geometry, relocated to the ranges of the pools.
+  section.meshlet_range = {meshlet_ranges.allocate(section.meshlets.size, 32),
+                           section.meshlets.size};
+  section.vertex_range = {
+      meshlet_vertex_ranges.allocate(section.meshlets_vertex_positions.size),
+      section.meshlets_vertex_positions.size};
+  section.data_range = {meshlet_data_ranges.allocate(
+                            section.meshlet_vertex_and_index_indices.size),
+                        section.meshlet_vertex_and_index_indices.size};
+  HASSERT(section.meshlet_range.offset != u32_max &&
+          section.vertex_range.offset != u32_max &&
+          section.data_range.offset != u32_max);
+
+  for (u32 m = 0; m < section.meshlets.size; ++m) {
+    GPUMeshlet& meshlet = section.meshlets[m];
+    u32* vertex_indices =
+        section.meshlet_vertex_and_index_indices.data + meshlet.data_offset;
+    for (u32 v = 0; v < meshlet.vertex_count; ++v) {
+      vertex_indices[v] += section.vertex_range.offset;
+    }
+    meshlet.data_offset += section.data_range.offset;
+  }
+
+  write_pool_range(gpu, meshlets_buffer, meshlets, section.meshlet_range.offset,
+                   section.meshlets.data, section.meshlets.size);
+  write_pool_range(gpu, meshlets_vertex_pos_buffer, meshlets_vertex_positions,
+                   section.vertex_range.offset,
+                   section.meshlets_vertex_positions.data,
+                   section.meshlets_vertex_positions.size);
+  write_pool_range(gpu, meshlets_vertex_data_buffer, meshlets_vertex_data,
+                   section.vertex_range.offset,
+                   section.meshlets_vertex_data.data,
+                   section.meshlets_vertex_data.size);
+  write_pool_range(gpu, meshlet_vertex_and_index_indices_buffer,
+                   meshlet_vertex_and_index_indices, section.data_range.offset,
+                   section.meshlet_vertex_and_index_indices.data,
+                   section.meshlet_vertex_and_index_indices.size);
+
+  // Images are loaded whole by the asynchronous loader.
+  const bool use_block_compression =
+      compress_textures &&
+      (gpu.gpu_device_features & GpuDeviceFeature_TEXTURE_COMPRESSION_BC);
+  for (u32 image_index = 0; image_index < gltf.images_count; ++image_index) {
+    const SceneSectionImage& image = section.image_infos[image_index];
+
+    TextureCompressionFormat::Enum compression =
+        TextureCompressionFormat::Count;
+    TextureContent::Enum content = TextureContent::Color;
+    if (use_block_compression) {
+      gltf_select_image_compression(gltf, image_index, compression, content);
+    }
+    const VkFormat format =
+        compression != TextureCompressionFormat::Count
+            ? (VkFormat)texture_compression_to_vk_format(compression)
+            : VK_FORMAT_R8G8B8A8_UNORM;
+
+    u32 mip_levels = 1;
+    for (u32 w = image.width, h = image.height; w > 1 && h > 1;
+         w /= 2, h /= 2) {
+      ++mip_levels;
+    }
+
+    TextureCreation tc;
+    tc.set_data(nullptr)
+        .set_format_type(format, TextureType::Texture2D)
+        .set_flags(mip_levels, 0)
+        .set_size((u16)image.width, (u16)image.height, 1)
+        .set_name(image.path);
+    TextureResource* tr = renderer->create_texture(tc);
+    HASSERT(tr != nullptr);
+    section.images.push(*tr);
+
+    if (compression != TextureCompressionFormat::Count) {
+      loader->request_compressed_texture_data(image.path, tr->handle,
+                                              compression, content, 0, 0.f,
+                                              section.load_group);
+    } else {
+      loader->request_texture_data(image.path, tr->handle, 0.f,
+                                   section.load_group);
+    }
+  }
+
+  for (u32 sampler_index = 0; sampler_index < gltf.samplers_count;
+       ++sampler_index) {
+    SamplerCreation creation;
+    gltf_sampler_creation(gltf.samplers[sampler_index], creation);
+    creation.name = section.names.append_use_f("%s_sampler_%u",
+                                               section.filename, sampler_index);
+
+    SamplerResource* sr = renderer->create_sampler(creation);
+    HASSERT(sr != nullptr);
+    section.samplers.push(*sr);
+  }
+
+  // Nodes under a section root, meshes are created by the first node
+  // referencing them.
+  const u32 previous_opaque_mesh_count = opaque_meshes.size;
+  section.primitive_meshes.set_size(section.primitives.size);
+  for (u32 i = 0; i < section.primitive_meshes.size; ++i) {
+    section.primitive_meshes[i] = MeshInstance{};
+  }
+
+  section.root_node = node_pool.obtain_node(NodeType::Node);
+  Node* root_node = (Node*)node_pool.access_node(section.root_node);
+  root_node->name = section.filename;
+  const glTF::Scene& root_gltf_scene =
+      gltf.scenes[gltf.scene != glTF::INVALID_INT_VALUE ? gltf.scene : 0];
+  root_node->children.init(node_pool.allocator, root_gltf_scene.nodes_count);
+  node_pool.get_root_node()->add_child(root_node, &node_pool);
+  for (u32 i = 0; i < root_gltf_scene.nodes_count; ++i) {
+    add_section_node(*this, section, root_gltf_scene.nodes[i],
+                     section.root_node);
+  }
+
+  gpu_mesh_count = opaque_meshes.size + transparent_meshes.size;
+  gpu_instance_count = mesh_instance_count;
+  gpu_opaque_instance_count = opaque_instance_count;
+  gpu_transparent_instance_count = transparent_instance_count;
+  HASSERT(gpu_mesh_count <= gpu_mesh_capacity &&
+          gpu_instance_count <= gpu_instance_capacity &&
+          gpu_opaque_instance_count + gpu_transparent_instance_count <=
+              gpu_draw_capacity);
+
+  // Transparent meshes are indexed after the opaque ones, new opaque meshes
+  // move all of them.
+  if (opaque_meshes.size != previous_opaque_mesh_count) {
+    for (u32 i = 0; i < transparent_meshes.size; ++i) {
+      upload_gpu_mesh(opaque_meshes.size + i);
+    }
+    for (u32 i = 0; i < mesh_instance_count; ++i) {
+      const MeshInstance& instance =
+          *(const MeshInstance*)mesh_instances.access_resource(i);
+      if (instance.transparent) {
+        mark_instance_dirty(i);
+      }
+    }
+  }
+  for (u32 i = 0; i < section.primitive_meshes.size; ++i) {
+    const MeshInstance& primitive_mesh = section.primitive_meshes[i];
+    if (primitive_mesh.mesh_index != k_invalid_index) {
+      upload_gpu_mesh(primitive_mesh.transparent
+                          ? opaque_meshes.size + primitive_mesh.mesh_index
+                          : primitive_mesh.mesh_index);
+    }
+  }
+  for (u32 i = 0; i < section.instances.size; ++i) {
+    mark_instance_dirty(section.instances[i]);
+  }
+
+  HINFO("Section {} resident: {} meshlets, {} instances", section.filename,
+        section.meshlets.size, section.instances.size);
+
+  // The pools hold the geometry now.
+  section.meshlets.shutdown();
+  section.meshlets_vertex_positions.shutdown();
+  section.meshlets_vertex_data.shutdown();
+  section.meshlet_vertex_and_index_indices.shutdown();
+}
+
+void glTFScene::free_section(SceneSection& section) {
+  // Queued loads would fill destroyed textures.
+  loader->load_jobs.cancel_group(section.load_group);
+
+  if (section.state == SceneSectionState::Resident) {
+    for (u32 i = 0; i < section.instances.size; ++i) {
+      release_mesh_instance(section.instances[i]);
+    }
+
+    Node* root_node = node_pool.get_root_node();
+    for (u32 i = 0; i < root_node->children.size; ++i) {
+      if (root_node->children[i] == section.root_node) {
+        root_node->children.delete_swap(i);
+        break;
+      }
+    }
+    node_pool.destroy_node(section.root_node);
+
+    // Empty meshes draw nothing until their slot is reused.
+    for (u32 i = 0; i < section.primitive_meshes.size; ++i) {
+      const MeshInstance& primitive_mesh = section.primitive_meshes[i];
+      if (primitive_mesh.mesh_index == k_invalid_index) {
+        continue;
+      }
+      if (primitive_mesh.transparent) {
+        transparent_meshes[primitive_mesh.mesh_index] = Mesh{};
+        upload_gpu_mesh(opaque_meshes.size + primitive_mesh.mesh_index);
+        free_transparent_meshes.push(primitive_mesh.mesh_index);
+      } else {
+        opaque_meshes[primitive_mesh.mesh_index] = Mesh{};
+        upload_gpu_mesh(primitive_mesh.mesh_index);
+        free_opaque_meshes.push(primitive_mesh.mesh_index);
+      }
+    }
+
+    const u64 release_frame = renderer->gpu->absolute_frame + k_max_frames;
+    meshlet_ranges.free_deferred(section.meshlet_range.offset,
+                                 section.meshlet_range.count, release_frame);
+    meshlet_vertex_ranges.free_deferred(section.vertex_range.offset,
+                                        section.vertex_range.count,
+                                        release_frame);
+    meshlet_data_ranges.free_deferred(section.data_range.offset,
+                                      section.data_range.count, release_frame);
+
+    for (u32 i = 0; i < section.images.size; ++i) {
+      renderer->destroy_texture(
+          renderer->textures.get(section.images[i].pool_index));
+    }
+    for (u32 i = 0; i < section.samplers.size; ++i) {
+      renderer->destroy_sampler(
+          renderer->samplers.get(section.samplers[i].pool_index));
+    }
+
+    gpu_opaque_instance_count = opaque_instance_count;
+    gpu_transparent_instance_count = transparent_instance_count;
+  }
+
+  // Names and the glTF strings are referenced by the destroyed resources.
+  gltf_free(section.gltf);
+  section.image_infos.shutdown();
+  section.primitives.shutdown();
+  section.primitive_offsets.shutdown();
+  section.meshlets.shutdown();
+  section.meshlets_vertex_positions.shutdown();
+  section.meshlets_vertex_data.shutdown();
+  section.meshlet_vertex_and_index_indices.shutdown();
+  section.images.shutdown();
+  section.samplers.shutdown();
+  section.primitive_meshes.shutdown();
+  section.instances.shutdown();
+  section.names.shutdown();
+}
+
+void glTFScene::upload_gpu_mesh(u32 mesh_index) {
+  GpuDevice& gpu = *renderer->gpu;
+  const Mesh& mesh = get_gpu_mesh(mesh_index);
+
+  GPUMeshData* gpu_mesh_data =
+      (GPUMeshData*)gpu.access_buffer(mesh_data_buffer)->mapped_data;
+  glm::vec4* gpu_bounds_data =
+      (glm::vec4*)gpu.access_buffer(mesh_bounds_buffer)->mapped_data;
+  GPUMeshlet* gpu_meshlets =
+      (GPUMeshlet*)gpu.access_buffer(meshlets_buffer)->mapped_data;
+  if (gpu_mesh_data && gpu_bounds_data) {
+    copy_gpu_mesh_data(gpu_mesh_data[mesh_index], mesh);
+    gpu_bounds_data[mesh_index] = mesh.bounding_sphere;
+  }
+  for (u32 m = 0; m < mesh.meshlet_count; ++m) {
+    meshlets[mesh.meshlet_offset + m].mesh_index = mesh_index;
+    if (gpu_meshlets) {
+      gpu_meshlets[mesh.meshlet_offset + m].mesh_index = mesh_index;
+    }
+  }
+
+  mark_material_dirty(mesh_index);
+}
+
+void glTFScene::imgui_draw_sections() {
+  if (ImGui::Begin("Scene Sections")) {
+    ImVec2 viewport_panel_size = ImGui::GetContentRegionAvail();
+    if (ImGui::Button("Stream GLTF section", {viewport_panel_size.x, 30})) {
+      char* file_path = nullptr;
+      char* filename = nullptr;
+      if (file_open_dialog(file_path, filename)) {
+        request_section(filename, file_path);
+
+        delete[] filename;
+        delete[] file_path;
+      }
+    }
+
+    for (u32 i = 0; i < sections.size; ++i) {
+      const SceneSection& section = *sections[i];
+      ImGui::PushID((i32)i);
+      ImGui::Text("%s: %s%s", section.filename,
+                  SceneSectionState::ToString(section.state),
+                  section.unload_requested ? ", unloading" : "");
+      ImGui::SameLine();
+      if (!section.unload_requested && ImGui::Button("Unload")) {
+        unload_section(i);
+      }
+      ImGui::PopID();
+    }
+    ImGui::Text("Meshlets %u/%u, vertices %u/%u",
+                meshlet_ranges.allocated_count, meshlet_ranges.capacity,
+                meshlet_vertex_ranges.allocated_count,
+                meshlet_vertex_ranges.capacity);
+  }
+  ImGui::End();
+}
+
 // Nodes //////////////////////////////////////////
 
 }  // namespace Helix
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Core/Bit.hpp"
 #include "Core/Gltf.hpp"
 #include "Renderer/AsynchronousLoader.hpp"
 #include "Renderer/CommandBuffer.hpp"
@@ -7,8 +8,14 @@
 #include "Renderer/GPUProfiler.hpp"
 #include "Renderer/GPUResources.hpp"
 #include "Renderer/HelixImgui.hpp"
+#include "Renderer/InstanceBvh.hpp"
+#include "Renderer/LightClustering.hpp"
+#include "Renderer/MeshCulling.hpp"
 #include "Renderer/Node.hpp"
+#include "Renderer/OcclusionBuffer.hpp"
+#include "Renderer/RangeAllocator.hpp"
 #include "Renderer/Renderer.hpp"
+#include "Renderer/TextureStreaming.hpp"
 #include "vendor/enkiTS/TaskScheduler.h"
 
 namespace Helix {
@@ -44,7 +51,6 @@ enum DrawFlags {
 struct PBRMaterial {
   Material* material;
 
-  BufferHandle material_buffer;
   DescriptorSetHandle descriptor_set;
 
   u16 diffuse_texture_index;
@@ -59,6 +65,8 @@ struct PBRMaterial {
   u32 flags;
 };
 
+// Geometry and material of a glTF mesh primitive, shared by the instances of
+// every node referencing the glTF mesh.
 struct Mesh {
   PBRMaterial pbr_material;
 
@@ -77,7 +85,6 @@ struct Mesh {
   u32 texcoord_offset;
 
   u32 primitive_count;
-  u32 node_index;
 
   u32 meshlet_offset;
   u32 meshlet_count;
@@ -96,26 +103,30 @@ struct Mesh {
   }
 };  // struct Mesh
 
+// A slot of the mesh instance buffer: the shared mesh it draws and the
+// MeshNode holding its transform.
 struct MeshInstance {
-  Mesh* mesh;
-  u32 material_pass_index;
+  // Index in opaque_meshes or transparent_meshes, k_invalid_index once the
+  // slot is released.
+  u32 mesh_index = k_invalid_index;
+  u32 node_index = k_invalid_index;
+  bool transparent = false;
 };  // struct MeshInstance
 
-struct MeshData {
-  glm::mat4 model;
-
-  glm::mat4 inverse_model;
+// A compressed scene image whose detailed mips are streamed. The texture
+// referenced by materials always holds the resident mips, a resized texture
+// is swapped in once it has been loaded or copied.
+struct StreamedTexture {
+  TextureHandle texture;
+  TextureHandle pending_texture;
 
-  u32 textures[4];  // diffuse, roughness, normal, occlusion
+  // Load of pending_texture, reprioritized every frame.
+  LoadJobHandle load_job;
 
-  glm::vec4 base_color_factor;
-
-  glm::vec4 roughness_metallic_occlusion_factor;
-
-  f32 alpha_cutoff;
-  u32 flags;
-  f32 padding_[2];
-};  // struct MeshData
+  cstring path;
+  TextureCompressionFormat::Enum format;
+  TextureContent::Enum content;
+};  // struct StreamedTexture
 
 // Gpu Data Structs
 // /////////////////////////////////////////////////////////////////////////
@@ -264,11 +275,105 @@ struct GPUSceneData {
 
   glm::vec4 frustum_planes[6];
 
+  // Rendered part of the attachments sized by the swapchain, this frame in xy
+  // and the previous frame in zw.
+  glm::vec4 render_scale;
 };  // struct GPUSceneData
 
 // Gpu Data Structs
 // /////////////////////////////////////////////////////////////////////////
 
+// Scene sections
+// /////////////////////////////////////////////////////////////////////////
+
+//
+// Lifetime of a streamed section: a task parses the glTF and builds its
+// meshlets, then the main thread commits it to the scene pools.
+namespace SceneSectionState {
+enum Enum { Loading, Loaded, Resident, Failed, Count };
+
+static cstring s_value_names[] = {"Loading", "Loaded", "Resident", "Failed",
+                                  "Count"};
+
+static cstring ToString(Enum e) {
+  return ((u32)e < Enum::Count ? s_value_names[(int)e] : "unsupported");
+}
+}  // namespace SceneSectionState
+
+//
+// A glTF mesh primitive of a section, meshlet offsets are relative to the
+// section streams. Primitives of meshes no node references have no meshlets.
+struct SceneSectionPrimitive {
+  glm::vec4 bounding_sphere;
+  i32 material;
+  // DrawFlags_Has* of the attributes found.
+  u32 flags;
+  u32 meshlet_offset;
+  u32 meshlet_count;
+};  // struct SceneSectionPrimitive
+
+//
+//
+struct SceneSectionImage {
+  cstring path;
+  u32 width;
+  u32 height;
+};  // struct SceneSectionImage
+
+struct SceneSection;
+
+//
+// Reads the glTF of a section and builds its meshlets off the main thread.
+struct SceneSectionLoadTask : public enki::ITaskSet {
+  SceneSection* section = nullptr;
+
+  void ExecuteRange(enki::TaskSetPartition range_, u32 threadnum_) override;
+};  // struct SceneSectionLoadTask
+
+//
+// A glTF file streamed in and out of a glTFScene. Everything it adds to the
+// scene is recorded so that it can be unloaded on its own.
+struct SceneSection {
+  SceneSectionLoadTask load_task;
+  SceneSectionState::Enum state = SceneSectionState::Loading;
+  // The section is freed once its task is done.
+  bool unload_requested = false;
+  // Written by the load task, read once it is complete.
+  bool load_succeeded = false;
+
+  char filename[512];
+  char path[512];
+
+  // Written by the load task until it is complete.
+  MallocAllocator allocator;
+  glTF::glTF gltf;
+  StringBuffer names;
+  Array<SceneSectionImage> image_infos;
+  Array<SceneSectionPrimitive> primitives;
+  // First primitive of each glTF mesh.
+  Array<u32> primitive_offsets;
+  // Mesh nodes primitives, an upper bound of the instances.
+  u32 instance_count = 0;
+
+  // Meshlet streams, released once committed.
+  Array<GPUMeshlet> meshlets;
+  Array<GPUMeshletVertexPosition> meshlets_vertex_positions;
+  Array<GPUMeshletVertexData> meshlets_vertex_data;
+  Array<u32> meshlet_vertex_and_index_indices;
+
+  // Resources of a resident section.
+  Range meshlet_range{};
+  Range vertex_range{};
+  Range data_range{};
+  Array<TextureResource> images;
+  Array<SamplerResource> samplers;
+  // Mesh slot of each primitive.
+  Array<MeshInstance> primitive_meshes;
+  Array<u32> instances;
+  NodeHandle root_node{};
+  u32 load_group = 0;
+};  // struct SceneSection
+
 ///////////////////////////////////////////////
 struct Scene {
   virtual void init(Renderer* renderer, Allocator* resident_allocator,
@@ -310,11 +415,17 @@ struct Scene {
   BufferHandle light_data_buffer = k_invalid_buffer;
   BufferHandle light_debug_buffer = k_invalid_buffer;
   BufferHandle directional_light_buffer = k_invalid_buffer;
+  // GPULightClusterBounds of every cluster, then the light lists written by
+  // the clustering dispatch.
+  BufferHandle light_cluster_bounds_buffer = k_invalid_buffer;
+  BufferHandle light_cluster_data_buffer = k_invalid_buffer;
 
   // Indirect data
   BufferHandle mesh_draw_count_buffers[k_max_frames];
   BufferHandle mesh_indirect_draw_early_command_buffers[k_max_frames];
   BufferHandle mesh_indirect_draw_late_command_buffers[k_max_frames];
+  // Copies of occluded_instances read by the early culling.
+  BufferHandle mesh_occluded_instance_buffers[k_max_frames];
 
   // Gpu debug draw
   BufferHandle debug_line_buffer = k_invalid_buffer;
@@ -439,6 +550,7 @@ struct DepthPyramidPass : public FrameGraphRenderPass {
   void render(CommandBuffer* gpu_commands, Scene* scene) override;
   void on_resize(GpuDevice& gpu, FrameGraph* frame_graph, u32 new_width,
                  u32 new_height) override;
+  void on_compile(GpuDevice& gpu, FrameGraph* frame_graph) override;
   void post_render(u32 current_frame_index, CommandBuffer* gpu_commands,
                    FrameGraph* frame_graph) override;
 
@@ -462,6 +574,23 @@ struct DepthPyramidPass : public FrameGraphRenderPass {
   bool update_depth_pyramid;
 };  // struct DepthPrePass
 
+//
+// Lists the point lights of every cluster in light_cluster_data_buffer. The
+// lists are the light_clusters buffer of the graph, read by the lighting and
+// the transparent passes.
+struct LightClusteringPass : public FrameGraphRenderPass {
+  void render(CommandBuffer* gpu_commands, Scene* scene) override;
+
+  void prepare_draws(glTFScene& scene, FrameGraph* frame_graph,
+                     Allocator* resident_allocator);
+  void free_gpu_resources();
+
+  Renderer* renderer = nullptr;
+
+  PipelineHandle light_clustering_pipeline;
+  DescriptorSetHandle light_clustering_d_set;
+};  // struct LightClusteringPass
+
 //
 //
 struct LightPass : public FrameGraphRenderPass {
@@ -538,13 +667,63 @@ struct glTFScene : public Scene {
                          PBRMaterial& pbr_material);
   u16 get_material_texture(GpuDevice& gpu, glTF::TextureInfo* texture_info);
   u16 get_material_texture(GpuDevice& gpu, i32 gltf_texture_index);
+  void select_image_compression(u32 image_index,
+                                TextureCompressionFormat::Enum& format,
+                                TextureContent::Enum& content);
 
   void fill_gpu_data_buffers(f32 model_scale) override;
+  // Meshes are indexed as in the GPU buffers: opaque meshes first. Dirty
+  // entries are written by the next fill_gpu_data_buffers.
+  Mesh& get_gpu_mesh(u32 mesh_index);
+  void mark_instance_dirty(u32 instance_index);
+  void mark_material_dirty(u32 mesh_index);
+  // Instance slots are kept by a mesh node until released, released slots are
+  // written empty and skipped by the culling. New slots are drawn after the
+  // next prepare_draws.
+  u32 obtain_mesh_instance(u32 mesh_index, bool transparent, u32 node_index);
+  void release_mesh_instance(u32 instance_index);
+  // GPU mesh index drawn by the slot, k_invalid_index when released.
+  u32 get_instance_mesh_index(u32 instance_index);
+  void upload_dirty_instances(f32 model_scale);
+  void upload_dirty_materials();
+  // Points the CPU culling to the mapped scene buffers, up to date after
+  // fill_gpu_data_buffers.
+  void get_mesh_culling_input(MeshCullingInput& out_input);
+  // Rasterizes the meshlets of the largest meshes on screen and tests the
+  // instances in the frustum against them. The hidden ones are marked in
+  // occluded_instances and skipped by the GPU culling.
+  void update_occlusion_buffer(enki::TaskScheduler* task_scheduler,
+                               f32 model_scale);
+  // Gathers mip feedback from the meshes, reprioritizes pending image loads
+  // and executes the streaming policy. Must be called before
+  // submit_draw_task.
+  void update_texture_streaming(f32 model_scale);
+  TextureHandle create_streamed_texture(u32 streamed_index, u32 first_mip);
   void submit_draw_task(ImGuiService* imgui, GPUProfiler* gpu_profiler,
                         enki::TaskScheduler* task_scheduler) override;
 
   void draw_mesh(CommandBuffer* gpu_commands, Mesh& mesh);
 
+  // Sections are glTF files loaded by background tasks and committed to the
+  // scene pools by update_sections, at most one per frame. When a pool is too
+  // small it grows and the section is committed the next frame, once the
+  // descriptor sets point to the new buffers. The pools are created by
+  // prepare_draws, called for the first section when no scene was loaded.
+  void request_section(cstring filename, cstring path);
+  // Frees the section once its task is done. Its ranges are reused once the
+  // frames in flight stop drawing it.
+  void unload_section(u32 section_index);
+  void update_sections();
+  // Grows the GPU pools that can't fit the section, returns true when
+  // nothing had to grow.
+  bool reserve_section_pools(const SceneSection& section);
+  void commit_section(SceneSection& section);
+  void free_section(SceneSection& section);
+  // Writes the mesh data, bounds and meshlet mesh indices of a GPU mesh and
+  // marks its material dirty.
+  void upload_gpu_mesh(u32 mesh_index);
+  void imgui_draw_sections();
+
   void destroy_node(NodeHandle handle);
 
   void imgui_draw_node(NodeHandle node_handle);
@@ -552,8 +731,10 @@ struct glTFScene : public Scene {
 
   void imgui_draw_node_property(NodeHandle node_handle);
 
-  void add_point_light();
+  void add_point_light(const glm::vec3& position = {0.f, 4.f, 0.f});
   void add_directional_light();
+  // Grows the point light buffers to hold light_count lights.
+  void reserve_light_buffers(u32 light_count);
 
   Array<Mesh> opaque_meshes;
   Array<Mesh> transparent_meshes;
@@ -581,6 +762,7 @@ struct glTFScene : public Scene {
   GBufferEarlyPass gbuffer_pass;
   GBufferLatePass gbuffer_late_pass;
   DepthPyramidPass depth_pyramid_pass;
+  LightClusteringPass light_clustering_pass;
   LightPass light_pass;
   TransparentPass transparent_pass;
   DebugPass debug_pass;
@@ -590,9 +772,93 @@ struct glTFScene : public Scene {
   DescriptorSetHandle fullscreen_ds;
   u32 fullscreen_texture_index = u32_max;
   bool enable_shadows = true;
+  // Convert images to BC formats chosen by material slot, cached as KTX2.
+  bool compress_textures = true;
+  // Encode the meshlet streams with the meshopt codecs and cache them next to
+  // the glTF file as '<file>.meshlets'.
+  bool cache_geometry = true;
+  // Compressed images start with their small mips only, details are loaded
+  // and evicted within texture_streaming_budget.
+  bool stream_textures = true;
+  sizet texture_streaming_budget = hmega(512);
+  u32 texture_streaming_max_loads = 4;
+  u64 texture_streaming_frame = 0;
+
+  bool cpu_occlusion_culling = false;
+  // Meshes whose bounding sphere covers this fraction of the view distance
+  // are occluders.
+  f32 occluder_min_screen_size = 0.1f;
+  OcclusionBuffer occlusion_buffer;
+  Array<u32> occluder_indices;
+  // A bit per instance slot, rounded up to whole u32 for the shader.
+  BitSet occluded_instances;
+
+  // Point lights the light buffers can hold.
+  u32 light_buffer_capacity = 0;
+  // Projection of the uploaded cluster bounds, rebuilt when it changes.
+  LightClusterView light_cluster_view;
+
+  // Streamed sections, in request order until one is freed.
+  Array<SceneSection*> sections;
+  // Ranges of the meshlet pools, in meshlets, meshlet vertices and entries of
+  // meshlet_vertex_and_index_indices. The CPU streams mirror the pools.
+  RangeAllocator meshlet_ranges;
+  RangeAllocator meshlet_vertex_ranges;
+  RangeAllocator meshlet_data_ranges;
+  // Mesh slots of unloaded sections, reused by the next ones.
+  Array<u32> free_opaque_meshes;
+  Array<u32> free_transparent_meshes;
+
+  // Bounds of the mesh instance slots, kept up to date with the uploads.
+  InstanceBvh mesh_bvh;
+  Array<u32> bvh_query_results;
+
+  TextureStreamingPolicy texture_streaming;
+  Array<StreamedTexture> streamed_textures;
+  // Texture index to streamed texture index.
+  FlatHashMap<u64, u32> streamed_texture_map;
+  Array<TextureStreamingDecision> texture_streaming_loads;
+  Array<TextureStreamingDecision> texture_streaming_evictions;
+
+  // Loads of the scene images, parallel to images. Visible textures close to
+  // the camera get the highest priority.
+  Array<LoadJobHandle> image_load_jobs;
+  Array<f32> image_load_priorities;
+  // Texture index to image index.
+  FlatHashMap<u64, u32> image_texture_map;
+  u32 pending_image_loads = 0;
+  // All the loads of this scene, cancelled when it is freed.
+  u32 load_group = 0;
 
   NodeHandle current_node{};
 
+  // MeshInstance of each slot of mesh_instances_buffer.
+  ResourcePool mesh_instances;
+  // Highest obtained slot + 1.
+  u32 mesh_instance_count = 0;
+  // Live slots drawing opaque and transparent meshes.
+  u32 opaque_instance_count = 0;
+  u32 transparent_instance_count = 0;
+
+  // Instance slots and materials to upload. Transform changes set instance
+  // bits; mesh data and bounds are static and written once by prepare_draws.
+  BitSet instance_dirty;
+  BitSet material_dirty;
+  u32 instance_dirty_count = 0;
+  u32 material_dirty_count = 0;
+  // Sizes of the GPU buffers created by the last prepare_draws.
+  u32 gpu_mesh_count = 0;
+  u32 gpu_instance_count = 0;
+  // Draw commands reserved for opaque and transparent instances, the
+  // transparent ones start after the opaque ones.
+  u32 gpu_opaque_instance_count = 0;
+  u32 gpu_transparent_instance_count = 0;
+  // Sizes of the mesh, instance and draw command buffers, grown by sections.
+  u32 gpu_mesh_capacity = 0;
+  u32 gpu_instance_capacity = 0;
+  u32 gpu_draw_capacity = 0;
+  f32 uploaded_model_scale = 0.f;
+
   FrameGraph* frame_graph;
   StackAllocator* scratch_allocator;
   Allocator* main_allocator;
@@ -606,6 +872,16 @@ struct glTFScene : public Scene {
 
 };  // struct GltfScene
 
+// Most command buffers the frame graph nodes are recorded in, a thread can
+// record all of them: see CommandBufferManager::num_command_buffers_per_thread.
+static const u32 k_max_frame_graph_chunks = 8;
+// Every frame graph submission is recorded in chunks of its own.
+static_assert(k_max_frame_graph_submissions <= k_max_frame_graph_chunks,
+              "A chunk is needed per frame graph submission");
+
+//
+// Records a frame: the frame graph nodes in chunks recorded by the task
+// threads, then the fullscreen and ImGui passes.
 struct glTFDrawTask : public enki::ITaskSet {
   GpuDevice* gpu = nullptr;
   FrameGraph* frame_graph = nullptr;
@@ -613,11 +889,12 @@ struct glTFDrawTask : public enki::ITaskSet {
   ImGuiService* imgui = nullptr;
   GPUProfiler* gpu_profiler = nullptr;
   glTFScene* scene = nullptr;
+  enki::TaskScheduler* task_scheduler = nullptr;
   u32 thread_id = 0;
 
   void init(GpuDevice* gpu_, FrameGraph* frame_graph_, Renderer* renderer_,
             ImGuiService* imgui_, GPUProfiler* gpu_profiler_,
-            glTFScene* scene_);
+            glTFScene* scene_, enki::TaskScheduler* task_scheduler_);
 
   void ExecuteRange(enki::TaskSetPartition range_, u32 threadnum_) override;
 
@@ -0,0 +1,1370 @@
+#include "Renderer/TextureCompression.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "Core/Assert.hpp"
+#include "Core/File.hpp"
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+
+namespace Helix {
+
+// Format helpers ////////////////////////////////////////////////////////
+
+// VkFormat enumerants for the formats below.
+static const u32 k_vk_format_bc1_rgb_unorm = 131;
+static const u32 k_vk_format_bc1_rgba_srgb = 134;
+static const u32 k_vk_format_bc3_unorm = 137;
+static const u32 k_vk_format_bc3_srgb = 138;
+static const u32 k_vk_format_bc4_unorm = 139;
+static const u32 k_vk_format_bc5_unorm = 141;
+static const u32 k_vk_format_bc7_unorm = 145;
+static const u32 k_vk_format_bc7_srgb = 146;
+
+u32 texture_compression_block_bytes(TextureCompressionFormat::Enum format) {
+  switch (format) {
+    case TextureCompressionFormat::BC1:
+    case TextureCompressionFormat::BC4:
+      return 8;
+    default:
+      return 16;
+  }
+}
+
+sizet texture_compression_level_size(TextureCompressionFormat::Enum format,
+                                     u32 width, u32 height) {
+  const sizet blocks_x = (width + 3) / 4;
+  const sizet blocks_y = (height + 3) / 4;
+  return blocks_x * blocks_y * texture_compression_block_bytes(format);
+}
+
+u32 texture_compression_to_vk_format(TextureCompressionFormat::Enum format) {
+  switch (format) {
+    case TextureCompressionFormat::BC1:
+      return k_vk_format_bc1_rgb_unorm;
+    case TextureCompressionFormat::BC3:
+      return k_vk_format_bc3_unorm;
+    case TextureCompressionFormat::BC4:
+      return k_vk_format_bc4_unorm;
+    case TextureCompressionFormat::BC5:
+      return k_vk_format_bc5_unorm;
+    case TextureCompressionFormat::BC7:
+      return k_vk_format_bc7_unorm;
+    default:
+      return 0;
+  }
+}
+
+bool texture_compression_from_vk_format(
+    u32 vk_format, TextureCompressionFormat::Enum& out_format) {
+  if (vk_format >= k_vk_format_bc1_rgb_unorm &&
+      vk_format <= k_vk_format_bc1_rgba_srgb) {
+    out_format = TextureCompressionFormat::BC1;
+  } else if (vk_format == k_vk_format_bc3_unorm ||
+             vk_format == k_vk_format_bc3_srgb) {
+    out_format = TextureCompressionFormat::BC3;
+  } else if (vk_format == k_vk_format_bc4_unorm) {
+    out_format = TextureCompressionFormat::BC4;
+  } else if (vk_format == k_vk_format_bc5_unorm) {
+    out_format = TextureCompressionFormat::BC5;
+  } else if (vk_format == k_vk_format_bc7_unorm ||
+             vk_format == k_vk_format_bc7_srgb) {
+    out_format = TextureCompressionFormat::BC7;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+u32 texture_compression_mip_count(u32 width, u32 height) {
+  // Same chain length used when creating the scene textures.
+  u32 mip_levels = 1;
+  while (width > 1 && height > 1) {
+    width /= 2;
+    height /= 2;
+
+    ++mip_levels;
+  }
+  return mip_levels < k_max_compressed_mips ? mip_levels
+                                            : k_max_compressed_mips;
+}
+
+// Bit helpers ///////////////////////////////////////////////////////////
+static u16 read_u16(const u8* memory) {
+  return (u16)(memory[0] | (memory[1] << 8));
+}
+
+static void write_u16(u8* memory, u16 value) {
+  memory[0] = (u8)(value & 0xff);
+  memory[1] = (u8)(value >> 8);
+}
+
+static void write_bits(u8* block, u32& bit_offset, u32 value, u32 bit_count) {
+  for (u32 i = 0; i < bit_count; ++i, ++bit_offset) {
+    if ((value >> i) & 1) {
+      block[bit_offset >> 3] |= (u8)(1 << (bit_offset & 7));
+    }
+  }
+}
+
+static u32 read_bits(const u8* block, u32& bit_offset, u32 bit_count) {
+  u32 value = 0;
+  for (u32 i = 0; i < bit_count; ++i, ++bit_offset) {
+    value |= ((block[bit_offset >> 3] >> (bit_offset & 7)) & 1) << i;
+  }
+  return value;
+}
+
+static i32 clamp_i32(i32 value, i32 min_value, i32 max_value) {
+  return value < min_value ? min_value
+                           : (value > max_value ? max_value : value);
+}
+
+static u32 color_distance_sq(const u8* a, const u8* b, u32 channels) {
+  u32 distance = 0;
+  for (u32 c = 0; c < channels; ++c) {
+    const i32 d = (i32)a[c] - (i32)b[c];
+    distance += (u32)(d * d);
+  }
+  return distance;
+}
+
+// Finds the dominant direction of the block with a few power iterations.
+// Returns false if the block is a single color.
+static bool block_principal_axis(const u8* rgba, u32 channels, f32* mean,
+                                 f32* axis) {
+  for (u32 c = 0; c < channels; ++c) {
+    mean[c] = 0.f;
+  }
+  for (u32 i = 0; i < 16; ++i) {
+    for (u32 c = 0; c < channels; ++c) {
+      mean[c] += rgba[i * 4 + c];
+    }
+  }
+  for (u32 c = 0; c < channels; ++c) {
+    mean[c] /= 16.f;
+  }
+
+  f32 covariance[4][4] = {};
+  for (u32 i = 0; i < 16; ++i) {
+    f32 d[4];
+    for (u32 c = 0; c < channels; ++c) {
+      d[c] = rgba[i * 4 + c] - mean[c];
+    }
+    for (u32 r = 0; r < channels; ++r) {
+      for (u32 c = 0; c < channels; ++c) {
+        covariance[r][c] += d[r] * d[c];
+      }
+    }
+  }
+
+  f32 trace = 0.f;
+  for (u32 c = 0; c < channels; ++c) {
+    axis[c] = 1.f;
+    trace += covariance[c][c];
+  }
+  if (trace < 1.f) {
+    return false;
+  }
+
+  for (u32 iteration = 0; iteration < 8; ++iteration) {
+    f32 next[4] = {};
+    f32 length_sq = 0.f;
+    for (u32 r = 0; r < channels; ++r) {
+      for (u32 c = 0; c < channels; ++c) {
+        next[r] += covariance[r][c] * axis[c];
+      }
+      length_sq += next[r] * next[r];
+    }
+    if (length_sq < 1e-12f) {
+      return false;
+    }
+    const f32 inverse_length = 1.f / sqrtf(length_sq);
+    for (u32 c = 0; c < channels; ++c) {
+      axis[c] = next[c] * inverse_length;
+    }
+  }
+  return true;
+}
+
+// Projects the block on the axis and returns the inset extremes.
+static void block_endpoints_along_axis(const u8* rgba, u32 channels,
+                                       const f32* mean, const f32* axis,
+                                       f32* out_min, f32* out_max) {
+  f32 min_t = 1e30f, max_t = -1e30f;
+  for (u32 i = 0; i < 16; ++i) {
+    f32 t = 0.f;
+    for (u32 c = 0; c < channels; ++c) {
+      t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+    }
+    min_t = t < min_t ? t : min_t;
+    max_t = t > max_t ? t : max_t;
+  }
+
+  const f32 inset = (max_t - min_t) / 32.f;
+  min_t += inset;
+  max_t -= inset;
+
+  for (u32 c = 0; c < channels; ++c) {
+    out_min[c] = mean[c] + axis[c] * min_t;
+    out_max[c] = mean[c] + axis[c] * max_t;
+  }
+}
+
+// BC1 ///////////////////////////////////////////////////////////////////
+static u16 pack_565(const f32* color) {
+  const i32 r = clamp_i32((i32)(color[0] * 31.f / 255.f + 0.5f), 0, 31);
+  const i32 g = clamp_i32((i32)(color[1] * 63.f / 255.f + 0.5f), 0, 63);
+  const i32 b = clamp_i32((i32)(color[2] * 31.f / 255.f + 0.5f), 0, 31);
+  return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(u16 packed, u8* out_color) {
+  const u32 r = (packed >> 11) & 31;
+  const u32 g = (packed >> 5) & 63;
+  const u32 b = packed & 31;
+  out_color[0] = (u8)((r << 3) | (r >> 2));
+  out_color[1] = (u8)((g << 2) | (g >> 4));
+  out_color[2] = (u8)((b << 3) | (b >> 2));
+  out_color[3] = 255;
+}
+
+static void bc1_palette(u16 color0, u16 color1, bool force_four_colors,
+                        u8 palette[4][4]) {
+  unpack_565(color0, palette[0]);
+  unpack_565(color1, palette[1]);
+
+  if (color0 > color1 || force_four_colors) {
+    for (u32 c = 0; c < 3; ++c) {
+      palette[2][c] = (u8)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+      palette[3][c] = (u8)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+    }
+    palette[2][3] = 255;
+    palette[3][3] = 255;
+  } else {
+    for (u32 c = 0; c < 3; ++c) {
+      palette[2][c] = (u8)((palette[0][c] + palette[1][c]) / 2);
+      palette[3][c] = 0;
+    }
+    palette[2][3] = 255;
+    palette[3][3] = 0;
+  }
+}
+
+static u32 bc1_assign_indices(const u8* rgba, u16 color0, u16 color1,
+                              u32& out_indices) {
+  u8 palette[4][4];
+  bc1_palette(color0, color1, true, palette);
+
+  u32 total_error = 0;
+  out_indices = 0;
+  for (u32 i = 0; i < 16; ++i) {
+    u32 best_index = 0;
+    u32 best_error = u32_max;
+    for (u32 p = 0; p < 4; ++p) {
+      const u32 error = color_distance_sq(rgba + i * 4, palette[p], 3);
+      if (error < best_error) {
+        best_error = error;
+        best_index = p;
+      }
+    }
+    total_error += best_error;
+    out_indices |= best_index << (i * 2);
+  }
+  return total_error;
+}
+
+// Solves the endpoints that minimize the error for the given indices.
+static bool bc1_refine_endpoints(const u8* rgba, u32 indices, f32* out_color0,
+                                 f32* out_color1) {
+  static const f32 k_weights[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+
+  f32 aa = 0.f, ab = 0.f, bb = 0.f;
+  f32 ax[3] = {}, bx[3] = {};
+  for (u32 i = 0; i < 16; ++i) {
+    const f32 t = k_weights[(indices >> (i * 2)) & 3];
+    const f32 s = 1.f - t;
+    aa += s * s;
+    ab += s * t;
+    bb += t * t;
+    for (u32 c = 0; c < 3; ++c) {
+      ax[c] += s * rgba[i * 4 + c];
+      bx[c] += t * rgba[i * 4 + c];
+    }
+  }
+
+  const f32 determinant = aa * bb - ab * ab;
+  if (fabsf(determinant) < 1e-6f) {
+    return false;
+  }
+  const f32 inverse_determinant = 1.f / determinant;
+  for (u32 c = 0; c < 3; ++c) {
+    out_color0[c] = (ax[c] * bb - bx[c] * ab) * inverse_determinant;
+    out_color1[c] = (bx[c] * aa - ax[c] * ab) * inverse_determinant;
+  }
+  return true;
+}
+
+static void bc1_write_block(u16 color0, u16 color1, u32 indices,
+                            u8* out_block) {
+  if (color0 < color1) {
+    // Swap to keep the four color mode: 0 <-> 1 and 2 <-> 3.
+    const u16 temp = color0;
+    color0 = color1;
+    color1 = temp;
+    indices ^= 0x55555555;
+  } else if (color0 == color1) {
+    indices = 0;
+  }
+
+  write_u16(out_block, color0);
+  write_u16(out_block + 2, color1);
+  memcpy(out_block + 4, &indices, sizeof(u32));
+}
+
+static void bc1_encode_color_block(const u8* rgba, u8* out_block) {
+  f32 mean[4], axis[4];
+  if (!block_principal_axis(rgba, 3, mean, axis)) {
+    const u16 color = pack_565(mean);
+    bc1_write_block(color, color, 0, out_block);
+    return;
+  }
+
+  f32 endpoint_min[4], endpoint_max[4];
+  block_endpoints_along_axis(rgba, 3, mean, axis, endpoint_min, endpoint_max);
+
+  u16 color0 = pack_565(endpoint_max);
+  u16 color1 = pack_565(endpoint_min);
+  u32 indices;
+  u32 error = bc1_assign_indices(rgba, color0, color1, indices);
+
+  f32 refined0[3], refined1[3];
+  if (bc1_refine_endpoints(rgba, indices, refined0, refined1)) {
+    const u16 refined_color0 = pack_565(refined0);
+    const u16 refined_color1 = pack_565(refined1);
+    u32 refined_indices;
+    const u32 refined_error = bc1_assign_indices(rgba, refined_color0,
+                                                 refined_color1,
+                                                 refined_indices);
+    if (refined_error < error) {
+      color0 = refined_color0;
+      color1 = refined_color1;
+      indices = refined_indices;
+    }
+  }
+
+  bc1_write_block(color0, color1, indices, out_block);
+}
+
+static void bc1_decode_color_block(const u8* block, bool force_four_colors,
+                                   u8* out_rgba) {
+  u8 palette[4][4];
+  bc1_palette(read_u16(block), read_u16(block + 2), force_four_colors,
+              palette);
+
+  u32 indices;
+  memcpy(&indices, block + 4, sizeof(u32));
+  for (u32 i = 0; i < 16; ++i) {
+    memcpy(out_rgba + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+  }
+}
+
+void bc1_encode_block(const u8* rgba, u8* out_block) {
+  bc1_encode_color_block(rgba, out_block);
+}
+
+void bc1_decode_block(const u8* block, u8* out_rgba) {
+  bc1_decode_color_block(block, false, out_rgba);
+}
+
+// BC4 ///////////////////////////////////////////////////////////////////
+static void bc4_palette(u8 value0, u8 value1, u8 palette[8]) {
+  palette[0] = value0;
+  palette[1] = value1;
+  if (value0 > value1) {
+    for (u32 i = 1; i < 7; ++i) {
+      palette[i + 1] = (u8)(((7 - i) * value0 + i * value1 + 3) / 7);
+    }
+  } else {
+    for (u32 i = 1; i < 5; ++i) {
+      palette[i + 1] = (u8)(((5 - i) * value0 + i * value1 + 2) / 5);
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void bc4_encode_block(const u8* rgba, u32 channel, u8* out_block) {
+  u8 min_value = 255, max_value = 0;
+  for (u32 i = 0; i < 16; ++i) {
+    const u8 value = rgba[i * 4 + channel];
+    min_value = value < min_value ? value : min_value;
+    max_value = value > max_value ? value : max_value;
+  }
+
+  memset(out_block, 0, 8);
+  out_block[0] = max_value;
+  out_block[1] = min_value;
+  if (min_value == max_value) {
+    return;
+  }
+
+  u8 palette[8];
+  bc4_palette(max_value, min_value, palette);
+
+  u32 bit_offset = 16;
+  for (u32 i = 0; i < 16; ++i) {
+    const i32 value = rgba[i * 4 + channel];
+    u32 best_index = 0;
+    i32 best_error = 256;
+    for (u32 p = 0; p < 8; ++p) {
+      const i32 error = abs(value - (i32)palette[p]);
+      if (error < best_error) {
+        best_error = error;
+        best_index = p;
+      }
+    }
+    write_bits(out_block, bit_offset, best_index, 3);
+  }
+}
+
+void bc4_decode_block(const u8* block, u32 channel, u8* out_rgba) {
+  u8 palette[8];
+  bc4_palette(block[0], block[1], palette);
+
+  u32 bit_offset = 16;
+  for (u32 i = 0; i < 16; ++i) {
+    out_rgba[i * 4 + channel] = palette[read_bits(block, bit_offset, 3)];
+  }
+}
+
+// BC3 ///////////////////////////////////////////////////////////////////
+void bc3_encode_block(const u8* rgba, u8* out_block) {
+  bc4_encode_block(rgba, 3, out_block);
+  bc1_encode_color_block(rgba, out_block + 8);
+}
+
+void bc3_decode_block(const u8* block, u8* out_rgba) {
+  bc1_decode_color_block(block + 8, true, out_rgba);
+  bc4_decode_block(block, 3, out_rgba);
+}
+
+// BC5 ///////////////////////////////////////////////////////////////////
+void bc5_encode_block(const u8* rgba, u8* out_block) {
+  bc4_encode_block(rgba, 0, out_block);
+  bc4_encode_block(rgba, 1, out_block + 8);
+}
+
+void bc5_decode_block(const u8* block, u8* out_rgba) {
+  for (u32 i = 0; i < 16; ++i) {
+    out_rgba[i * 4 + 2] = 0;
+    out_rgba[i * 4 + 3] = 255;
+  }
+  bc4_decode_block(block, 0, out_rgba);
+  bc4_decode_block(block + 8, 1, out_rgba);
+}
+
+// BC7 ///////////////////////////////////////////////////////////////////
+// Mode 6: one subset, RGBA 7.7.7.7 endpoints with a unique p-bit each and
+// 4 bits indices.
+static const u32 k_bc7_weights4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                       34, 38, 43, 47, 51, 55, 60, 64};
+
+static u8 bc7_interpolate(u32 e0, u32 e1, u32 index) {
+  const u32 w = k_bc7_weights4[index];
+  return (u8)(((64 - w) * e0 + w * e1 + 32) >> 6);
+}
+
+struct Bc7Mode6Block {
+  u8 endpoints[2][4];  // 7 bits per channel.
+  u8 pbits[2];
+  u8 indices[16];
+};  // struct Bc7Mode6Block
+
+static void bc7_quantize_endpoint(const f32* color, u32 pbit,
+                                  u8* out_endpoint) {
+  for (u32 c = 0; c < 4; ++c) {
+    out_endpoint[c] =
+        (u8)clamp_i32((i32)((color[c] - (f32)pbit) * 0.5f + 0.5f), 0, 127);
+  }
+}
+
+static u32 bc7_assign_indices(const u8* rgba, Bc7Mode6Block& block) {
+  u8 palette[16][4];
+  for (u32 c = 0; c < 4; ++c) {
+    const u32 e0 = (block.endpoints[0][c] << 1) | block.pbits[0];
+    const u32 e1 = (block.endpoints[1][c] << 1) | block.pbits[1];
+    for (u32 p = 0; p < 16; ++p) {
+      palette[p][c] = bc7_interpolate(e0, e1, p);
+    }
+  }
+
+  u32 total_error = 0;
+  for (u32 i = 0; i < 16; ++i) {
+    u32 best_index = 0;
+    u32 best_error = u32_max;
+    for (u32 p = 0; p < 16; ++p) {
+      const u32 error = color_distance_sq(rgba + i * 4, palette[p], 4);
+      if (error < best_error) {
+        best_error = error;
+        best_index = p;
+      }
+    }
+    block.indices[i] = (u8)best_index;
+    total_error += best_error;
+  }
+  return total_error;
+}
+
+// Tries the four p-bit combinations and keeps the best one.
+static u32 bc7_fit_endpoints(const u8* rgba, const f32* color0,
+                             const f32* color1, Bc7Mode6Block& out_block) {
+  u32 best_error = u32_max;
+  for (u32 p = 0; p < 4; ++p) {
+    Bc7Mode6Block candidate;
+    candidate.pbits[0] = (u8)(p & 1);
+    candidate.pbits[1] = (u8)(p >> 1);
+    bc7_quantize_endpoint(color0, candidate.pbits[0], candidate.endpoints[0]);
+    bc7_quantize_endpoint(color1, candidate.pbits[1], candidate.endpoints[1]);
+
+    const u32 error = bc7_assign_indices(rgba, candidate);
+    if (error < best_error) {
+      best_error = error;
+      out_block = candidate;
+    }
+  }
+  return best_error;
+}
+
+void bc7_encode_block(const u8* rgba, u8* out_block) {
+  f32 mean[4], axis[4];
+  f32 color0[4], color1[4];
+
+  if (block_principal_axis(rgba, 4, mean, axis)) {
+    block_endpoints_along_axis(rgba, 4, mean, axis, color0, color1);
+  } else {
+    for (u32 c = 0; c < 4; ++c) {
+      color0[c] = color1[c] = mean[c];
+    }
+  }
+
+  Bc7Mode6Block block;
+  u32 error = bc7_fit_endpoints(rgba, color0, color1, block);
+
+  // One least squares refinement pass using the chosen indices.
+  f32 aa = 0.f, ab = 0.f, bb = 0.f;
+  f32 ax[4] = {}, bx[4] = {};
+  for (u32 i = 0; i < 16; ++i) {
+    const f32 t = k_bc7_weights4[block.indices[i]] / 64.f;
+    const f32 s = 1.f - t;
+    aa += s * s;
+    ab += s * t;
+    bb += t * t;
+    for (u32 c = 0; c < 4; ++c) {
+      ax[c] += s * rgba[i * 4 + c];
+      bx[c] += t * rgba[i * 4 + c];
+    }
+  }
+  const f32 determinant = aa * bb - ab * ab;
+  if (fabsf(determinant) > 1e-6f) {
+    const f32 inverse_determinant = 1.f / determinant;
+    for (u32 c = 0; c < 4; ++c) {
+      color0[c] = (ax[c] * bb - bx[c] * ab) * inverse_determinant;
+      color1[c] = (bx[c] * aa - ax[c] * ab) * inverse_determinant;
+    }
+
+    Bc7Mode6Block refined;
+    const u32 refined_error =
+        bc7_fit_endpoints(rgba, color0, color1, refined);
+    if (refined_error < error) {
+      block = refined;
+      error = refined_error;
+    }
+  }
+
+  // The anchor index is stored with an implicit zero MSB.
+  if (block.indices[0] & 8) {
+    for (u32 c = 0; c < 4; ++c) {
+      const u8 temp = block.endpoints[0][c];
+      block.endpoints[0][c] = block.endpoints[1][c];
+      block.endpoints[1][c] = temp;
+    }
+    const u8 temp = block.pbits[0];
+    block.pbits[0] = block.pbits[1];
+    block.pbits[1] = temp;
+
+    for (u32 i = 0; i < 16; ++i) {
+      block.indices[i] = (u8)(15 - block.indices[i]);
+    }
+  }
+
+  memset(out_block, 0, 16);
+  u32 bit_offset = 0;
+  write_bits(out_block, bit_offset, 1 << 6, 7);
+  for (u32 c = 0; c < 4; ++c) {
+    write_bits(out_block, bit_offset, block.endpoints[0][c], 7);
+    write_bits(out_block, bit_offset, block.endpoints[1][c], 7);
+  }
+  write_bits(out_block, bit_offset, block.pbits[0], 1);
+  write_bits(out_block, bit_offset, block.pbits[1], 1);
+  write_bits(out_block, bit_offset, block.indices[0], 3);
+  for (u32 i = 1; i < 16; ++i) {
+    write_bits(out_block, bit_offset, block.indices[i], 4);
+  }
+  HASSERT(bit_offset == 128);
+}
+
+bool bc7_decode_block(const u8* block, u8* out_rgba) {
+  if ((block[0] & 0x7f) != 0x40) {
+    memset(out_rgba, 0, 64);
+    return false;
+  }
+
+  u32 bit_offset = 7;
+  u32 endpoints[2][4];
+  for (u32 c = 0; c < 4; ++c) {
+    endpoints[0][c] = read_bits(block, bit_offset, 7);
+    endpoints[1][c] = read_bits(block, bit_offset, 7);
+  }
+  const u32 pbit0 = read_bits(block, bit_offset, 1);
+  const u32 pbit1 = read_bits(block, bit_offset, 1);
+  for (u32 c = 0; c < 4; ++c) {
+    endpoints[0][c] = (endpoints[0][c] << 1) | pbit0;
+    endpoints[1][c] = (endpoints[1][c] << 1) | pbit1;
+  }
+
+  for (u32 i = 0; i < 16; ++i) {
+    const u32 index = read_bits(block, bit_offset, i == 0 ? 3 : 4);
+    for (u32 c = 0; c < 4; ++c) {
+      out_rgba[i * 4 + c] =
+          bc7_interpolate(endpoints[0][c], endpoints[1][c], index);
+    }
+  }
+  return true;
+}
+
+// Texture level methods /////////////////////////////////////////////////
+struct SrgbToLinearTable {
+  SrgbToLinearTable() {
+    for (u32 i = 0; i < 256; ++i) {
+      const f32 c = i / 255.f;
+      values[i] =
+          c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+  }
+
+  f32 values[256];
+};  // struct SrgbToLinearTable
+
+// Built on first use, textures are compressed from several loader threads.
+static const SrgbToLinearTable& srgb_to_linear_table() {
+  static const SrgbToLinearTable table;
+  return table;
+}
+
+static u8 linear_to_srgb(f32 value) {
+  const f32 c = value <= 0.0031308f
+                    ? value * 12.92f
+                    : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+  return (u8)clamp_i32((i32)(c * 255.f + 0.5f), 0, 255);
+}
+
+void texture_downsample_rgba8(const u8* source, u32 source_width,
+                              u32 source_height, u8* destination,
+                              TextureContent::Enum content) {
+  const f32* srgb_to_linear = srgb_to_linear_table().values;
+
+  const u32 width = source_width > 1 ? source_width / 2 : 1;
+  const u32 height = source_height > 1 ? source_height / 2 : 1;
+
+  for (u32 y = 0; y < height; ++y) {
+    const u32 y0 = y * 2;
+    const u32 y1 = y0 + 1 < source_height ? y0 + 1 : y0;
+    for (u32 x = 0; x < width; ++x) {
+      const u32 x0 = x * 2;
+      const u32 x1 = x0 + 1 < source_width ? x0 + 1 : x0;
+
+      const u8* texels[4] = {source + (y0 * source_width + x0) * 4,
+                             source + (y0 * source_width + x1) * 4,
+                             source + (y1 * source_width + x0) * 4,
+                             source + (y1 * source_width + x1) * 4};
+      u8* output = destination + (y * width + x) * 4;
+
+      f32 sum[4] = {};
+      for (u32 t = 0; t < 4; ++t) {
+        for (u32 c = 0; c < 4; ++c) {
+          const u8 value = texels[t][c];
+          if (content == TextureContent::Color && c < 3) {
+            sum[c] += srgb_to_linear[value];
+          } else if (content == TextureContent::Normal && c < 3) {
+            sum[c] += value / 127.5f - 1.f;
+          } else {
+            sum[c] += value;
+          }
+        }
+      }
+
+      switch (content) {
+        case TextureContent::Color: {
+          for (u32 c = 0; c < 3; ++c) {
+            output[c] = linear_to_srgb(sum[c] * 0.25f);
+          }
+          break;
+        }
+        case TextureContent::Normal: {
+          f32 length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] +
+                             sum[2] * sum[2]);
+          length = length > 1e-6f ? length : 1.f;
+          for (u32 c = 0; c < 3; ++c) {
+            output[c] = (u8)clamp_i32(
+                (i32)((sum[c] / length + 1.f) * 127.5f + 0.5f), 0, 255);
+          }
+          break;
+        }
+        default: {
+          for (u32 c = 0; c < 3; ++c) {
+            output[c] = (u8)((sum[c] + 2.f) * 0.25f);
+          }
+          break;
+        }
+      }
+      output[3] = (u8)((sum[3] + 2.f) * 0.25f);
+    }
+  }
+}
+
+static void compress_level(const u8* rgba, u32 width, u32 height,
+                           TextureCompressionFormat::Enum format,
+                           u8* destination) {
+  const u32 block_bytes = texture_compression_block_bytes(format);
+  const u32 blocks_x = (width + 3) / 4;
+  const u32 blocks_y = (height + 3) / 4;
+
+  u8 block_rgba[64];
+  for (u32 by = 0; by < blocks_y; ++by) {
+    for (u32 bx = 0; bx < blocks_x; ++bx) {
+      // Replicate the edge texels for partial blocks.
+      for (u32 y = 0; y < 4; ++y) {
+        const u32 sy = by * 4 + y < height ? by * 4 + y : height - 1;
+        for (u32 x = 0; x < 4; ++x) {
+          const u32 sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+          memcpy(block_rgba + (y * 4 + x) * 4, rgba + (sy * width + sx) * 4,
+                 4);
+        }
+      }
+
+      u8* block = destination + (by * blocks_x + bx) * block_bytes;
+      switch (format) {
+        case TextureCompressionFormat::BC1:
+          bc1_encode_block(block_rgba, block);
+          break;
+        case TextureCompressionFormat::BC3:
+          bc3_encode_block(block_rgba, block);
+          break;
+        case TextureCompressionFormat::BC4:
+          bc4_encode_block(block_rgba, 0, block);
+          break;
+        case TextureCompressionFormat::BC5:
+          bc5_encode_block(block_rgba, block);
+          break;
+        case TextureCompressionFormat::BC7:
+          bc7_encode_block(block_rgba, block);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+bool texture_compress(const u8* rgba, u32 width, u32 height, u32 mip_count,
+                      TextureCompressionFormat::Enum format,
+                      TextureContent::Enum content, Allocator* allocator,
+                      CompressedTexture& out_texture) {
+  if (rgba == nullptr || width == 0 || height == 0 ||
+      format >= TextureCompressionFormat::Count) {
+    return false;
+  }
+
+  const u32 max_mips = texture_compression_mip_count(width, height);
+  mip_count = (mip_count == 0 || mip_count > max_mips) ? max_mips : mip_count;
+
+  out_texture.width = width;
+  out_texture.height = height;
+  out_texture.mip_count = mip_count;
+  out_texture.format = format;
+  out_texture.allocator = allocator;
+
+  sizet total_size = 0;
+  for (u32 mip = 0; mip < mip_count; ++mip) {
+    const u32 mip_width = width >> mip ? width >> mip : 1;
+    const u32 mip_height = height >> mip ? height >> mip : 1;
+    out_texture.mip_offsets[mip] = total_size;
+    out_texture.mip_sizes[mip] =
+        texture_compression_level_size(format, mip_width, mip_height);
+    total_size += out_texture.mip_sizes[mip];
+  }
+
+  out_texture.data_size = total_size;
+  out_texture.data = (u8*)hallocaa(total_size, allocator, 16);
+
+  // Ping-pong between two scratch levels while walking the chain.
+  u8* scratch[2] = {nullptr, nullptr};
+  if (mip_count > 1) {
+    const sizet scratch_size =
+        (sizet)(width > 1 ? width / 2 : 1) * (height > 1 ? height / 2 : 1) * 4;
+    scratch[0] = (u8*)halloca(scratch_size, allocator);
+    scratch[1] = (u8*)halloca(scratch_size, allocator);
+  }
+
+  const u8* level = rgba;
+  u32 level_width = width, level_height = height;
+  for (u32 mip = 0; mip < mip_count; ++mip) {
+    if (mip > 0) {
+      u8* next_level = scratch[mip & 1];
+      texture_downsample_rgba8(level, level_width, level_height, next_level,
+                               content);
+      level = next_level;
+      level_width = level_width > 1 ? level_width / 2 : 1;
+      level_height = level_height > 1 ? level_height / 2 : 1;
+    }
+
+    compress_level(level, level_width, level_height, format,
+                   out_texture.data + out_texture.mip_offsets[mip]);
+  }
+
+  if (scratch[0]) {
+    hfree(scratch[1], allocator);
+    hfree(scratch[0], allocator);
+  }
+
+  return true;
+}
+
+bool texture_decompress_level(const CompressedTexture& texture, u32 mip,
+                              u8* out_rgba) {
+  if (mip >= texture.mip_count) {
+    return false;
+  }
+
+  const u32 width = texture.width >> mip ? texture.width >> mip : 1;
+  const u32 height = texture.height >> mip ? texture.height >> mip : 1;
+  const u32 block_bytes = texture_compression_block_bytes(texture.format);
+  const u32 blocks_x = (width + 3) / 4;
+  const u32 blocks_y = (height + 3) / 4;
+  const u8* level = texture.data + texture.mip_offsets[mip];
+
+  bool result = true;
+  u8 block_rgba[64];
+  for (u32 by = 0; by < blocks_y; ++by) {
+    for (u32 bx = 0; bx < blocks_x; ++bx) {
+      const u8* block = level + (by * blocks_x + bx) * block_bytes;
+      switch (texture.format) {
+        case TextureCompressionFormat::BC1:
+          bc1_decode_block(block, block_rgba);
+          break;
+        case TextureCompressionFormat::BC3:
+          bc3_decode_block(block, block_rgba);
+          break;
+        case TextureCompressionFormat::BC4:
+          memset(block_rgba, 0, sizeof(block_rgba));
+          bc4_decode_block(block, 0, block_rgba);
+          for (u32 i = 0; i < 16; ++i) {
+            block_rgba[i * 4 + 3] = 255;
+          }
+          break;
+        case TextureCompressionFormat::BC5:
+          bc5_decode_block(block, block_rgba);
+          break;
+        case TextureCompressionFormat::BC7:
+          result &= bc7_decode_block(block, block_rgba);
+          break;
+        default:
+          return false;
+      }
+
+      for (u32 y = 0; y < 4 && by * 4 + y < height; ++y) {
+        for (u32 x = 0; x < 4 && bx * 4 + x < width; ++x) {
+          memcpy(out_rgba + ((by * 4 + y) * width + bx * 4 + x) * 4,
+                 block_rgba + (y * 4 + x) * 4, 4);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+void texture_compressed_free(CompressedTexture& texture) {
+  if (texture.data && texture.allocator) {
+    hfree(texture.data, texture.allocator);
+  }
+  texture.data = nullptr;
+  texture.data_size = 0;
+  texture.mip_count = 0;
+}
+
+void texture_compressed_skip_mips(CompressedTexture& texture, u32 first_mip) {
+  if (first_mip == 0) {
+    return;
+  }
+  HASSERT(first_mip < texture.mip_count);
+
+  for (u32 mip = first_mip; mip < texture.mip_count; ++mip) {
+    texture.mip_offsets[mip - first_mip] = texture.mip_offsets[mip];
+    texture.mip_sizes[mip - first_mip] = texture.mip_sizes[mip];
+  }
+  texture.mip_count -= first_mip;
+  texture.width = texture.width >> first_mip ? texture.width >> first_mip : 1;
+  texture.height =
+      texture.height >> first_mip ? texture.height >> first_mip : 1;
+}
+
+f64 texture_compute_psnr(const u8* a, const u8* b, u32 width, u32 height,
+                         u32 channels) {
+  f64 squared_error = 0.0;
+  const sizet pixel_count = (sizet)width * height;
+  for (sizet i = 0; i < pixel_count; ++i) {
+    squared_error += color_distance_sq(a + i * 4, b + i * 4, channels);
+  }
+
+  const f64 mse = squared_error / ((f64)pixel_count * channels);
+  if (mse <= 0.0) {
+    return 99.0;
+  }
+  return 10.0 * log10((255.0 * 255.0) / mse);
+}
+
+// KTX2 container ////////////////////////////////////////////////////////
+static const u8 k_ktx2_identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+                                         0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct Ktx2Header {
+  u8 identifier[12];
+  u32 vk_format;
+  u32 type_size;
+  u32 pixel_width;
+  u32 pixel_height;
+  u32 pixel_depth;
+  u32 layer_count;
+  u32 face_count;
+  u32 level_count;
+  u32 supercompression_scheme;
+
+  u32 dfd_byte_offset;
+  u32 dfd_byte_length;
+  u32 kvd_byte_offset;
+  u32 kvd_byte_length;
+  u64 sgd_byte_offset;
+  u64 sgd_byte_length;
+};  // struct Ktx2Header
+
+struct Ktx2LevelIndex {
+  u64 byte_offset;
+  u64 byte_length;
+  u64 uncompressed_byte_length;
+};  // struct Ktx2LevelIndex
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be 80 bytes");
+static_assert(sizeof(Ktx2LevelIndex) == 24, "KTX2 level index is 24 bytes");
+
+// Khronos data format descriptor values used by the basic block.
+static const u32 k_dfd_model_bc1a = 128;
+static const u32 k_dfd_model_bc3 = 130;
+static const u32 k_dfd_model_bc4 = 131;
+static const u32 k_dfd_model_bc5 = 132;
+static const u32 k_dfd_model_bc7 = 134;
+static const u32 k_dfd_channel_bc3_alpha = 15;
+
+struct DfdSample {
+  u32 bit_offset;
+  u32 bit_length;
+  u32 channel;
+};  // struct DfdSample
+
+static u32 ktx2_dfd_samples(TextureCompressionFormat::Enum format,
+                            u32& out_model, DfdSample* out_samples) {
+  switch (format) {
+    case TextureCompressionFormat::BC1:
+      out_model = k_dfd_model_bc1a;
+      out_samples[0] = {0, 64, 0};
+      return 1;
+    case TextureCompressionFormat::BC3:
+      out_model = k_dfd_model_bc3;
+      out_samples[0] = {0, 64, k_dfd_channel_bc3_alpha};
+      out_samples[1] = {64, 64, 0};
+      return 2;
+    case TextureCompressionFormat::BC4:
+      out_model = k_dfd_model_bc4;
+      out_samples[0] = {0, 64, 0};
+      return 1;
+    case TextureCompressionFormat::BC5:
+      out_model = k_dfd_model_bc5;
+      out_samples[0] = {0, 64, 0};
+      out_samples[1] = {64, 64, 1};
+      return 2;
+    case TextureCompressionFormat::BC7:
+    default:
+      out_model = k_dfd_model_bc7;
+      out_samples[0] = {0, 128, 0};
+      return 1;
+  }
+}
+
+static sizet align_size(sizet size, sizet alignment) {
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+u8* ktx2_write_memory(const CompressedTexture& texture, Allocator* allocator,
+                      sizet& out_size) {
+  DfdSample samples[2];
+  u32 color_model = 0;
+  const u32 sample_count =
+      ktx2_dfd_samples(texture.format, color_model, samples);
+
+  const u32 block_bytes = texture_compression_block_bytes(texture.format);
+  const u32 level_index_size = sizeof(Ktx2LevelIndex) * texture.mip_count;
+  const u32 dfd_block_size = 24 + 16 * sample_count;
+  const u32 dfd_offset = sizeof(Ktx2Header) + level_index_size;
+  const u32 dfd_size = 4 + dfd_block_size;
+
+  // Levels are stored from the smallest to the biggest.
+  sizet level_offsets[k_max_compressed_mips];
+  sizet total_size = dfd_offset + dfd_size;
+  for (i32 mip = (i32)texture.mip_count - 1; mip >= 0; --mip) {
+    total_size = align_size(total_size, block_bytes);
+    level_offsets[mip] = total_size;
+    total_size += texture.mip_sizes[mip];
+  }
+
+  u8* memory = (u8*)halloca(total_size, allocator);
+  memset(memory, 0, total_size);
+
+  Ktx2Header header{};
+  memcpy(header.identifier, k_ktx2_identifier, sizeof(k_ktx2_identifier));
+  header.vk_format = texture_compression_to_vk_format(texture.format);
+  header.type_size = 1;
+  header.pixel_width = texture.width;
+  header.pixel_height = texture.height;
+  header.pixel_depth = 0;
+  header.layer_count = 0;
+  header.face_count = 1;
+  header.level_count = texture.mip_count;
+  header.supercompression_scheme = 0;
+  header.dfd_byte_offset = dfd_offset;
+  header.dfd_byte_length = dfd_size;
+  memcpy(memory, &header, sizeof(Ktx2Header));
+
+  Ktx2LevelIndex* levels = (Ktx2LevelIndex*)(memory + sizeof(Ktx2Header));
+  for (u32 mip = 0; mip < texture.mip_count; ++mip) {
+    levels[mip].byte_offset = level_offsets[mip];
+    levels[mip].byte_length = texture.mip_sizes[mip];
+    levels[mip].uncompressed_byte_length = texture.mip_sizes[mip];
+
+    memcpy(memory + level_offsets[mip],
+           texture.data + texture.mip_offsets[mip], texture.mip_sizes[mip]);
+  }
+
+  // Basic data format descriptor block.
+  u32* dfd = (u32*)(memory + dfd_offset);
+  dfd[0] = dfd_size;
+  dfd[1] = 0;                             // Vendor Khronos, type basic.
+  dfd[2] = 2 | (dfd_block_size << 16);    // Version 1.3.
+  dfd[3] = color_model | (1 << 8) | (1 << 16);  // BT709 primaries, linear.
+  dfd[4] = 3 | (3 << 8);                  // 4x4 texel blocks.
+  dfd[5] = block_bytes;
+  dfd[6] = 0;
+  for (u32 s = 0; s < sample_count; ++s) {
+    u32* sample = dfd + 7 + s * 4;
+    sample[0] = samples[s].bit_offset | ((samples[s].bit_length - 1) << 16) |
+                (samples[s].channel << 24);
+    sample[1] = 0;
+    sample[2] = 0;
+    sample[3] = u32_max;
+  }
+
+  out_size = total_size;
+  return memory;
+}
+
+bool ktx2_write_file(cstring filename, const CompressedTexture& texture,
+                     Allocator* temp_allocator) {
+  sizet size = 0;
+  u8* memory = ktx2_write_memory(texture, temp_allocator, size);
+  if (memory == nullptr) {
+    return false;
+  }
+
+  file_write_binary(filename, memory, size);
+  hfree(memory, temp_allocator);
+  return true;
+}
+
+bool ktx2_read_memory(u8* memory, sizet size, CompressedTexture& out_texture) {
+  if (memory == nullptr || size < sizeof(Ktx2Header)) {
+    return false;
+  }
+
+  Ktx2Header header;
+  memcpy(&header, memory, sizeof(Ktx2Header));
+  if (memcmp(header.identifier, k_ktx2_identifier,
+             sizeof(k_ktx2_identifier)) != 0) {
+    return false;
+  }
+
+  // Only plain 2D textures are handled.
+  if (header.supercompression_scheme != 0 || header.face_count != 1 ||
+      header.layer_count > 1 || header.pixel_depth > 1) {
+    return false;
+  }
+
+  if (!texture_compression_from_vk_format(header.vk_format,
+                                          out_texture.format)) {
+    return false;
+  }
+
+  if (header.pixel_width == 0 || header.pixel_height == 0) {
+    return false;
+  }
+
+  const u32 level_count = header.level_count ? header.level_count : 1;
+  if (level_count > k_max_compressed_mips ||
+      level_count >
+          texture_compression_mip_count(header.pixel_width,
+                                        header.pixel_height) ||
+      sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * level_count > size) {
+    return false;
+  }
+
+  const Ktx2LevelIndex* levels =
+      (const Ktx2LevelIndex*)(memory + sizeof(Ktx2Header));
+  for (u32 mip = 0; mip < level_count; ++mip) {
+    const u32 mip_width =
+        header.pixel_width >> mip ? header.pixel_width >> mip : 1;
+    const u32 mip_height =
+        header.pixel_height >> mip ? header.pixel_height >> mip : 1;
+    const sizet expected_size = texture_compression_level_size(
+        out_texture.format, mip_width, mip_height);
+
+    if (levels[mip].byte_length != expected_size ||
+        levels[mip].byte_offset + levels[mip].byte_length > size) {
+      return false;
+    }
+
+    out_texture.mip_offsets[mip] = (sizet)levels[mip].byte_offset;
+    out_texture.mip_sizes[mip] = (sizet)levels[mip].byte_length;
+  }
+
+  out_texture.data = memory;
+  out_texture.data_size = size;
+  out_texture.width = header.pixel_width;
+  out_texture.height = header.pixel_height;
+  out_texture.mip_count = level_count;
+  out_texture.allocator = nullptr;
+  return true;
+}
+
+bool ktx2_read_file(cstring filename, Allocator* allocator,
+                    CompressedTexture& out_texture) {
+  sizet size = 0;
+  u8* memory = (u8*)file_read_binary(filename, allocator, &size);
+  if (memory == nullptr) {
+    return false;
+  }
+
+  if (!ktx2_read_memory(memory, size, out_texture)) {
+    hfree(memory, allocator);
+    return false;
+  }
+
+  out_texture.allocator = allocator;
+  return true;
+}
+
+// Self test ////////////////////////////////////////////////////////////////
+
+static bool compression_expect(bool condition, cstring what) {
+  if (!condition) {
+    HERROR("Texture compression self test: {}", what);
+  }
+  return condition;
+}
+
+// Smooth gradients with a soft edge, the kind of content the block encoders
+// are expected to keep close to the source.
+static void fill_test_image(u8* rgba, u32 size) {
+  for (u32 y = 0; y < size; ++y) {
+    for (u32 x = 0; x < size; ++x) {
+      u8* texel = rgba + (y * size + x) * 4;
+      texel[0] = (u8)(x * 255 / (size - 1));
+      texel[1] = (u8)(y * 255 / (size - 1));
+      texel[2] = (u8)((x + y) * 255 / (2 * (size - 1)));
+      texel[3] = (u8)(x < size / 2 ? 255 : 255 - (x - size / 2) * 4);
+    }
+  }
+}
+
+// Compresses the image, stores it in a KTX2 container, reads it back and
+// compares every mip with the uncompressed chain. The gradients get twice as
+// steep at each level, which costs about 6 dB, so the bound drops with it.
+static bool compression_round_trip(const u8* rgba, u32 size,
+                                   TextureCompressionFormat::Enum format,
+                                   u32 channels, f64 min_psnr,
+                                   Allocator* allocator) {
+  cstring name = TextureCompressionFormat::ToString(format);
+  bool passed = true;
+
+  CompressedTexture texture;
+  if (!compression_expect(texture_compress(rgba, size, size, 0, format,
+                                           TextureContent::Linear, allocator,
+                                           texture),
+                          name)) {
+    return false;
+  }
+  passed &= compression_expect(
+      texture.mip_count == texture_compression_mip_count(size, size), name);
+
+  sizet file_size = 0;
+  u8* file = ktx2_write_memory(texture, allocator, file_size);
+  CompressedTexture read_texture;
+  const bool read = ktx2_read_memory(file, file_size, read_texture);
+  passed &= compression_expect(
+      read && read_texture.format == format && read_texture.width == size &&
+          read_texture.height == size &&
+          read_texture.mip_count == texture.mip_count,
+      name);
+
+  const sizet level_bytes = (sizet)size * size * 4;
+  u8* reference = (u8*)halloca(level_bytes, allocator);
+  u8* next_reference = (u8*)halloca(level_bytes, allocator);
+  u8* decoded = (u8*)halloca(level_bytes, allocator);
+  memcpy(reference, rgba, level_bytes);
+
+  u32 mip_size = size;
+  for (u32 mip = 0; read && mip < read_texture.mip_count; ++mip) {
+    passed &= compression_expect(
+        read_texture.mip_sizes[mip] == texture.mip_sizes[mip] &&
+            memcmp(read_texture.data + read_texture.mip_offsets[mip],
+                   texture.data + texture.mip_offsets[mip],
+                   texture.mip_sizes[mip]) == 0,
+        name);
+    passed &= compression_expect(
+        texture_decompress_level(read_texture, mip, decoded), name);
+
+    const f64 psnr =
+        texture_compute_psnr(reference, decoded, mip_size, mip_size, channels);
+    const f64 mip_min_psnr = min_psnr - 8.0 * mip;
+    if (psnr < mip_min_psnr) {
+      HERROR("Texture compression self test: {} mip {} psnr {:.2f} < {:.2f}",
+             name, mip, psnr, mip_min_psnr);
+      passed = false;
+    }
+
+    texture_downsample_rgba8(reference, mip_size, mip_size, next_reference,
+                             TextureContent::Linear);
+    u8* swap = reference;
+    reference = next_reference;
+    next_reference = swap;
+    mip_size = mip_size > 1 ? mip_size / 2 : 1;
+  }
+
+  hfree(decoded, allocator);
+  hfree(next_reference, allocator);
+  hfree(reference, allocator);
+  hfree(file, allocator);
+  texture_compressed_free(texture);
+  return passed;
+}
+
+bool texture_compression_self_test(Allocator* allocator) {
+  static const u32 k_size = 64;
+  u8* rgba = (u8*)halloca(k_size * k_size * 4, allocator);
+  fill_test_image(rgba, k_size);
+
+  bool passed = true;
+  passed &= compression_round_trip(rgba, k_size, TextureCompressionFormat::BC1,
+                                   3, 38.0, allocator);
+  passed &= compression_round_trip(rgba, k_size, TextureCompressionFormat::BC3,
+                                   4, 38.0, allocator);
+  passed &= compression_round_trip(rgba, k_size, TextureCompressionFormat::BC4,
+                                   1, 50.0, allocator);
+  passed &= compression_round_trip(rgba, k_size, TextureCompressionFormat::BC5,
+                                   2, 50.0, allocator);
+  passed &= compression_round_trip(rgba, k_size, TextureCompressionFormat::BC7,
+                                   4, 40.0, allocator);
+
+  // Mips of flat colors keep their value, in sRGB and for normals.
+  u8 flat[4 * 4 * 4];
+  u8 flat_mip[2 * 2 * 4];
+  for (u32 i = 0; i < 16; ++i) {
+    flat[i * 4 + 0] = 128;
+    flat[i * 4 + 1] = 128;
+    flat[i * 4 + 2] = 255;
+    flat[i * 4 + 3] = 255;
+  }
+  texture_downsample_rgba8(flat, 4, 4, flat_mip, TextureContent::Color);
+  passed &= compression_expect(flat_mip[0] == 128 && flat_mip[2] == 255 &&
+                                   flat_mip[3] == 255,
+                               "flat color mip");
+  texture_downsample_rgba8(flat, 4, 4, flat_mip, TextureContent::Normal);
+  passed &= compression_expect(flat_mip[0] == 128 && flat_mip[1] == 128 &&
+                                   flat_mip[2] == 255,
+                               "flat normal mip");
+
+  // Invalid input is rejected instead of read out of bounds.
+  CompressedTexture texture;
+  passed &= compression_expect(
+      !texture_compress(rgba, 0, k_size, 0, TextureCompressionFormat::BC1,
+                        TextureContent::Color, allocator, texture),
+      "empty image accepted");
+
+  u8 block[16] = {1};  // BC7 mode 0.
+  passed &= compression_expect(!bc7_decode_block(block, flat),
+                               "unsupported BC7 mode decoded");
+
+  passed &= compression_expect(
+      texture_compress(rgba, k_size, k_size, 0, TextureCompressionFormat::BC7,
+                       TextureContent::Color, allocator, texture),
+      "BC7 compression");
+  sizet file_size = 0;
+  u8* file = ktx2_write_memory(texture, allocator, file_size);
+  CompressedTexture read_texture;
+  passed &= compression_expect(
+      !ktx2_read_memory(file, file_size - 1, read_texture),
+      "truncated KTX2 accepted");
+
+  Ktx2LevelIndex* levels = (Ktx2LevelIndex*)(file + sizeof(Ktx2Header));
+  levels[0].byte_length -= 16;
+  passed &= compression_expect(!ktx2_read_memory(file, file_size, read_texture),
+                               "wrong KTX2 level size accepted");
+  levels[0].byte_length += 16;
+
+  // A single level sized as the 1x1 mip of an empty image.
+  Ktx2Header* header = (Ktx2Header*)file;
+  const Ktx2LevelIndex level = levels[0];
+  header->pixel_width = 0;
+  header->pixel_height = 0;
+  header->level_count = 1;
+  levels[0].byte_length = texture_compression_block_bytes(texture.format);
+  passed &= compression_expect(!ktx2_read_memory(file, file_size, read_texture),
+                               "empty KTX2 accepted");
+  header->pixel_width = k_size;
+  header->pixel_height = k_size;
+  levels[0] = level;
+  header->level_count = texture.mip_count + 1;
+  passed &= compression_expect(!ktx2_read_memory(file, file_size, read_texture),
+                               "KTX2 with too many levels accepted");
+  header->level_count = texture.mip_count;
+  header->identifier[0] = 0;
+  passed &= compression_expect(!ktx2_read_memory(file, file_size, read_texture),
+                               "KTX2 identifier not checked");
+
+  hfree(file, allocator);
+  texture_compressed_free(texture);
+  hfree(rgba, allocator);
+
+  HINFO("Texture compression self test {}", passed ? "passed" : "failed");
+  return passed;
+}
+
+}  // namespace Helix
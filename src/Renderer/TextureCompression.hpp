@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+
+static const u32 k_max_compressed_mips = 16;
+
+//
+// Block compressed formats produced by the texture encoder.
+namespace TextureCompressionFormat {
+enum Enum { BC1, BC3, BC4, BC5, BC7, Count };
+
+static cstring s_value_names[] = {"BC1", "BC3", "BC4", "BC5", "BC7",
+                                  "Count"};
+
+static cstring ToString(Enum e) {
+  return ((u32)e < Enum::Count ? s_value_names[(int)e] : "unsupported");
+}
+}  // namespace TextureCompressionFormat
+
+//
+// What the texels represent, used to pick the mip filter.
+namespace TextureContent {
+enum Enum { Color, Linear, Normal, Count };
+}  // namespace TextureContent
+
+//
+// Tightly packed block data for all the mips of a 2D texture, mip 0 first
+// unless it was read from a KTX2 file, in which case the offsets point inside
+// the file memory.
+struct CompressedTexture {
+  u8* data = nullptr;
+  sizet data_size = 0;
+
+  u32 width = 0;
+  u32 height = 0;
+  u32 mip_count = 0;
+  TextureCompressionFormat::Enum format = TextureCompressionFormat::BC1;
+
+  sizet mip_offsets[k_max_compressed_mips];
+  sizet mip_sizes[k_max_compressed_mips];
+
+  Allocator* allocator = nullptr;
+};  // struct CompressedTexture
+
+// Format helpers ////////////////////////////////////////////////////////
+u32 texture_compression_block_bytes(TextureCompressionFormat::Enum format);
+sizet texture_compression_level_size(TextureCompressionFormat::Enum format,
+                                     u32 width, u32 height);
+// VkFormat values, kept as integers so this file does not need Vulkan.
+u32 texture_compression_to_vk_format(TextureCompressionFormat::Enum format);
+bool texture_compression_from_vk_format(
+    u32 vk_format, TextureCompressionFormat::Enum& out_format);
+u32 texture_compression_mip_count(u32 width, u32 height);
+
+// Block encoders/decoders. Pixels are 4x4 RGBA8, row major. ///////////
+void bc1_encode_block(const u8* rgba, u8* out_block);
+void bc1_decode_block(const u8* block, u8* out_rgba);
+void bc3_encode_block(const u8* rgba, u8* out_block);
+void bc3_decode_block(const u8* block, u8* out_rgba);
+// Single channel blocks read channel 'channel' of the RGBA pixels.
+void bc4_encode_block(const u8* rgba, u32 channel, u8* out_block);
+void bc4_decode_block(const u8* block, u32 channel, u8* out_rgba);
+void bc5_encode_block(const u8* rgba, u8* out_block);
+void bc5_decode_block(const u8* block, u8* out_rgba);
+// BC7 encoding uses mode 6 only. The decoder handles only mode 6 and returns
+// false for other modes.
+void bc7_encode_block(const u8* rgba, u8* out_block);
+bool bc7_decode_block(const u8* block, u8* out_rgba);
+
+// Texture level methods /////////////////////////////////////////////////
+void texture_downsample_rgba8(const u8* source, u32 source_width,
+                              u32 source_height, u8* destination,
+                              TextureContent::Enum content);
+
+// Encodes all mips of an RGBA8 image. mip_count 0 means full chain.
+bool texture_compress(const u8* rgba, u32 width, u32 height, u32 mip_count,
+                      TextureCompressionFormat::Enum format,
+                      TextureContent::Enum content, Allocator* allocator,
+                      CompressedTexture& out_texture);
+bool texture_decompress_level(const CompressedTexture& texture, u32 mip,
+                              u8* out_rgba);
+void texture_compressed_free(CompressedTexture& texture);
+// Makes 'first_mip' the new mip 0 without moving the data.
+void texture_compressed_skip_mips(CompressedTexture& texture, u32 first_mip);
+
+// Peak signal to noise ratio in dB over the first 'channels' channels of two
+// RGBA8 images. Identical images return 99.
+f64 texture_compute_psnr(const u8* a, const u8* b, u32 width, u32 height,
+                         u32 channels);
+
+// KTX2 container ////////////////////////////////////////////////////////
+// Writes a KTX2 file without supercompression and with a basic data format
+// descriptor. The returned memory is allocated from 'allocator'.
+u8* ktx2_write_memory(const CompressedTexture& texture, Allocator* allocator,
+                      sizet& out_size);
+bool ktx2_write_file(cstring filename, const CompressedTexture& texture,
+                     Allocator* temp_allocator);
+// Parses the memory in place: out_texture.data points to 'memory' and the
+// caller keeps ownership of it.
+bool ktx2_read_memory(u8* memory, sizet size, CompressedTexture& out_texture);
+// Reads the whole file, out_texture owns the memory.
+bool ktx2_read_file(cstring filename, Allocator* allocator,
+                    CompressedTexture& out_texture);
+
+// Self test /////////////////////////////////////////////////////////////
+// Round-trips a gradient image through every format and a KTX2 container,
+// checks the PSNR of each mip and that malformed files are rejected. Logs the
+// failures, returns false if there are any.
+bool texture_compression_self_test(Allocator* allocator);
+
+}  // namespace Helix
@@ -0,0 +1,383 @@
+#include "Renderer/TextureStreaming.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "Core/Assert.hpp"
+#include "Core/Log.hpp"
+
+namespace Helix {
+
+// TextureStreamingPolicy ////////////////////////////////////////////////
+
+void TextureStreamingPolicy::init(Allocator* allocator, u32 initial_capacity) {
+  entries.init(allocator, initial_capacity);
+  sorted_indices.init(allocator, initial_capacity);
+  target_mips.init(allocator, initial_capacity);
+
+  committed_size = 0;
+  tail_size = 0;
+}
+
+void TextureStreamingPolicy::shutdown() {
+  entries.shutdown();
+  sorted_indices.shutdown();
+  target_mips.shutdown();
+}
+
+u32 TextureStreamingPolicy::add_texture(u32 width, u32 height, u32 mip_count,
+                                        TextureCompressionFormat::Enum format) {
+  HASSERT(mip_count > 0 && mip_count <= k_max_compressed_mips);
+
+  const u32 texture_index = entries.size;
+  TextureStreamingEntry& entry = entries.push_use();
+  entry = TextureStreamingEntry{};
+  entry.width = width;
+  entry.height = height;
+  entry.mip_count = mip_count;
+  entry.tail_mip = texture_streaming_tail_mip(width, height, mip_count);
+
+  for (u32 mip = 0; mip < mip_count; ++mip) {
+    const u32 mip_width = width >> mip;
+    const u32 mip_height = height >> mip;
+    entry.mip_sizes[mip] = texture_compression_level_size(
+        format, mip_width ? mip_width : 1, mip_height ? mip_height : 1);
+  }
+
+  // Nothing is resident until the tail arrives.
+  entry.resident_mip = mip_count;
+  entry.pending_mip = entry.tail_mip;
+  entry.desired_mip = entry.tail_mip;
+
+  const sizet size = chain_size(texture_index, entry.tail_mip);
+  committed_size += size;
+  tail_size += size;
+
+  return texture_index;
+}
+
+void TextureStreamingPolicy::begin_feedback() {
+  for (u32 i = 0; i < entries.size; ++i) {
+    TextureStreamingEntry& entry = entries[i];
+    entry.desired_mip = entry.tail_mip;
+    entry.priority = 0.f;
+  }
+}
+
+void TextureStreamingPolicy::add_feedback(u32 texture_index, u32 desired_mip,
+                                          f32 priority, u64 frame) {
+  TextureStreamingEntry& entry = entries[texture_index];
+
+  if (desired_mip < entry.desired_mip) {
+    entry.desired_mip = desired_mip;
+  }
+  if (priority > entry.priority) {
+    entry.priority = priority;
+  }
+  // Resident mips that are still needed are kept for a while after their
+  // last use to avoid load/evict cycles while the camera moves.
+  if (entry.desired_mip <= entry.resident_mip) {
+    entry.last_used_frame = frame;
+  }
+}
+
+void TextureStreamingPolicy::update(
+    sizet budget, u32 max_loads, u64 frame,
+    Array<TextureStreamingDecision>& out_loads,
+    Array<TextureStreamingDecision>& out_evictions) {
+  out_loads.clear();
+  out_evictions.clear();
+
+  sorted_indices.clear();
+  for (u32 i = 0; i < entries.size; ++i) {
+    sorted_indices.push(i);
+  }
+  std::sort(sorted_indices.data, sorted_indices.data + sorted_indices.size,
+            [&](const u32 a, const u32 b) {
+              const TextureStreamingEntry& entry_a = entries[a];
+              const TextureStreamingEntry& entry_b = entries[b];
+              if (entry_a.priority != entry_b.priority) {
+                return entry_a.priority > entry_b.priority;
+              }
+              return a < b;
+            });
+
+  // Tails are always resident, in flight work is already paid for.
+  sizet available = budget > tail_size ? budget - tail_size : 0;
+  target_mips.set_size(entries.size);
+  for (u32 i = 0; i < entries.size; ++i) {
+    const TextureStreamingEntry& entry = entries[i];
+    target_mips[i] = entry.tail_mip;
+    if (entry.is_pending()) {
+      const u32 in_flight_mip = entry.pending_mip < entry.resident_mip
+                                    ? entry.pending_mip
+                                    : entry.resident_mip;
+      const sizet cost =
+          chain_size(i, in_flight_mip) - chain_size(i, entry.tail_mip);
+      available = available > cost ? available - cost : 0;
+      target_mips[i] = in_flight_mip;
+    }
+  }
+
+  // Hand out the remaining budget in priority order, each texture getting the
+  // most detailed mip that still fits.
+  for (u32 i = 0; i < sorted_indices.size; ++i) {
+    const u32 texture_index = sorted_indices[i];
+    const TextureStreamingEntry& entry = entries[texture_index];
+    if (entry.is_pending()) {
+      continue;
+    }
+
+    u32 wanted_mip = entry.desired_mip;
+    if (entry.resident_mip < wanted_mip &&
+        frame - entry.last_used_frame < eviction_delay_frames) {
+      wanted_mip = entry.resident_mip;
+    }
+
+    const sizet tail = chain_size(texture_index, entry.tail_mip);
+    u32 target_mip = wanted_mip;
+    while (target_mip < entry.tail_mip &&
+           chain_size(texture_index, target_mip) - tail > available) {
+      ++target_mip;
+    }
+    available -= chain_size(texture_index, target_mip) - tail;
+    target_mips[texture_index] = target_mip;
+  }
+
+  // Loads, most important first, as long as they fit next to what is already
+  // resident. Evicted memory counts only once the eviction is done.
+  bool needs_space = committed_size > budget;
+  for (u32 i = 0; i < sorted_indices.size; ++i) {
+    const u32 texture_index = sorted_indices[i];
+    TextureStreamingEntry& entry = entries[texture_index];
+    const u32 target_mip = target_mips[texture_index];
+    if (entry.is_pending() || target_mip >= entry.resident_mip) {
+      continue;
+    }
+
+    const sizet delta = chain_size(texture_index, target_mip) -
+                        chain_size(texture_index, entry.resident_mip);
+    if (committed_size + delta > budget) {
+      needs_space = true;
+      continue;
+    }
+    if (out_loads.size >= max_loads) {
+      continue;
+    }
+
+    out_loads.push({texture_index, target_mip});
+    entry.pending_mip = target_mip;
+    committed_size += delta;
+  }
+
+  // Unused mips stay cached until the memory is needed.
+  if (!needs_space) {
+    return;
+  }
+
+  for (u32 i = sorted_indices.size; i > 0; --i) {
+    const u32 texture_index = sorted_indices[i - 1];
+    TextureStreamingEntry& entry = entries[texture_index];
+    const u32 target_mip = target_mips[texture_index];
+    if (entry.is_pending() || target_mip <= entry.resident_mip) {
+      continue;
+    }
+
+    out_evictions.push({texture_index, target_mip});
+    entry.pending_mip = target_mip;
+  }
+}
+
+void TextureStreamingPolicy::on_residency_changed(u32 texture_index,
+                                                  u32 resident_mip) {
+  TextureStreamingEntry& entry = entries[texture_index];
+  HASSERT(resident_mip <= entry.mip_count);
+
+  const u32 committed_mip = entry.pending_mip < entry.resident_mip
+                                ? entry.pending_mip
+                                : entry.resident_mip;
+  committed_size -= chain_size(texture_index, committed_mip);
+  committed_size += chain_size(texture_index, resident_mip);
+
+  entry.resident_mip = resident_mip;
+  entry.pending_mip = resident_mip;
+}
+
+sizet TextureStreamingPolicy::chain_size(u32 texture_index, u32 mip) const {
+  const TextureStreamingEntry& entry = entries[texture_index];
+  sizet size = 0;
+  for (u32 i = mip; i < entry.mip_count; ++i) {
+    size += entry.mip_sizes[i];
+  }
+  return size;
+}
+
+u32 texture_streaming_tail_mip(u32 width, u32 height, u32 mip_count) {
+  u32 mip = 0;
+  while (mip + 1 < mip_count &&
+         ((width >> mip) > k_texture_streaming_tail_size ||
+          (height >> mip) > k_texture_streaming_tail_size)) {
+    ++mip;
+  }
+  return mip;
+}
+
+u32 texture_streaming_desired_mip(u32 width, u32 height, f32 distance,
+                                  f32 radius, f32 pixels_per_unit) {
+  if (distance <= radius || radius <= 0.f) {
+    return 0;
+  }
+
+  const f32 screen_size = 2.f * radius / distance * pixels_per_unit;
+  const f32 texture_size = (f32)(width > height ? width : height);
+  if (screen_size >= texture_size) {
+    return 0;
+  }
+  if (screen_size < 1.f) {
+    return k_max_compressed_mips - 1;
+  }
+  return (u32)floorf(log2f(texture_size / screen_size));
+}
+
+// Self test ////////////////////////////////////////////////////////////////
+
+static bool streaming_expect(bool condition, cstring what) {
+  if (!condition) {
+    HERROR("Texture streaming self test: {}", what);
+  }
+  return condition;
+}
+
+// Committed memory is the resident chains plus the loads in flight.
+static bool streaming_expect_committed(const TextureStreamingPolicy& policy,
+                                       cstring what) {
+  sizet size = 0;
+  for (u32 i = 0; i < policy.entries.size; ++i) {
+    const TextureStreamingEntry& entry = policy.entries[i];
+    size += policy.chain_size(i, entry.pending_mip < entry.resident_mip
+                                     ? entry.pending_mip
+                                     : entry.resident_mip);
+  }
+  return streaming_expect(policy.committed_size == size, what);
+}
+
+static bool streaming_expect_decision(
+    const Array<TextureStreamingDecision>& decisions, u32 index,
+    u32 texture_index, u32 target_mip, cstring what) {
+  return streaming_expect(index < decisions.size &&
+                              decisions[index].texture_index ==
+                                  texture_index &&
+                              decisions[index].target_mip == target_mip,
+                          what);
+}
+
+bool texture_streaming_self_test(Allocator* allocator) {
+  static const u32 k_size = 1024;
+  static const u32 k_mip_count = 11;
+  static const sizet k_unlimited_budget = (sizet)1 << 40;
+
+  TextureStreamingPolicy policy;
+  policy.init(allocator, 4);
+
+  Array<TextureStreamingDecision> loads;
+  loads.init(allocator, 4);
+  Array<TextureStreamingDecision> evictions;
+  evictions.init(allocator, 4);
+
+  // Three 1024x1024 textures, the 64x64 mip starts the tail.
+  const u32 texture_a = policy.add_texture(k_size, k_size, k_mip_count,
+                                           TextureCompressionFormat::BC1);
+  const u32 texture_b = policy.add_texture(k_size, k_size, k_mip_count,
+                                           TextureCompressionFormat::BC1);
+  const u32 texture_c = policy.add_texture(k_size, k_size, k_mip_count,
+                                           TextureCompressionFormat::BC1);
+  const u32 tail_mip = policy.entries[texture_a].tail_mip;
+
+  bool passed = streaming_expect(tail_mip == 4, "tail mip");
+  passed &= streaming_expect(
+      policy.tail_size == 3 * policy.chain_size(texture_a, tail_mip),
+      "tail size");
+  passed &= streaming_expect_committed(policy, "committed tails");
+
+  // Lowest mips first: nothing more is loaded while the tails are in flight.
+  policy.begin_feedback();
+  policy.add_feedback(texture_a, 0, 1.f, 1);
+  policy.add_feedback(texture_b, 0, 3.f, 1);
+  policy.add_feedback(texture_c, 2, 2.f, 1);
+  policy.update(k_unlimited_budget, 4, 1, loads, evictions);
+  passed &= streaming_expect(loads.size == 0 && evictions.size == 0,
+                             "loads before the tails");
+
+  for (u32 i = 0; i < policy.entries.size; ++i) {
+    policy.on_residency_changed(i, tail_mip);
+  }
+  passed &= streaming_expect(policy.committed_size == policy.tail_size,
+                             "resident tails");
+
+  // Higher mips in priority order, limited by the loads per update.
+  policy.begin_feedback();
+  policy.add_feedback(texture_a, 0, 1.f, 2);
+  policy.add_feedback(texture_b, 0, 3.f, 2);
+  policy.add_feedback(texture_c, 2, 2.f, 2);
+  policy.update(k_unlimited_budget, 2, 2, loads, evictions);
+  passed &= streaming_expect(loads.size == 2 && evictions.size == 0,
+                             "priority load count");
+  passed &= streaming_expect_decision(loads, 0, texture_b, 0, "first load");
+  passed &= streaming_expect_decision(loads, 1, texture_c, 2, "second load");
+  passed &= streaming_expect_committed(policy, "committed loads");
+
+  policy.on_residency_changed(texture_b, 0);
+  // A dropped load reports the old resident mip.
+  policy.on_residency_changed(texture_c, tail_mip);
+  passed &= streaming_expect_committed(policy, "committed dropped load");
+
+  policy.begin_feedback();
+  policy.add_feedback(texture_a, 0, 1.f, 3);
+  policy.add_feedback(texture_b, 0, 3.f, 3);
+  policy.add_feedback(texture_c, 2, 2.f, 3);
+  policy.update(k_unlimited_budget, 2, 3, loads, evictions);
+  passed &= streaming_expect(loads.size == 2, "reload count");
+  passed &= streaming_expect_decision(loads, 0, texture_c, 2, "reload");
+  passed &= streaming_expect_decision(loads, 1, texture_a, 0, "last load");
+  policy.on_residency_changed(texture_c, 2);
+  policy.on_residency_changed(texture_a, 0);
+  passed &= streaming_expect_committed(policy, "committed full chains");
+
+  // Only the most important texture keeps its detail under a smaller budget,
+  // the others are evicted from the least important one.
+  const sizet budget = policy.tail_size + policy.chain_size(texture_b, 0) -
+                       policy.chain_size(texture_b, tail_mip);
+  policy.begin_feedback();
+  policy.add_feedback(texture_a, 0, 1.f, 4);
+  policy.add_feedback(texture_b, 0, 3.f, 4);
+  policy.add_feedback(texture_c, 2, 2.f, 4);
+  policy.update(budget, 2, 4, loads, evictions);
+  passed &= streaming_expect(loads.size == 0 && evictions.size == 2,
+                             "eviction count");
+  passed &= streaming_expect_decision(evictions, 0, texture_a, tail_mip,
+                                      "first eviction");
+  passed &= streaming_expect_decision(evictions, 1, texture_c, tail_mip,
+                                      "second eviction");
+  passed &= streaming_expect_committed(policy, "committed evictions");
+
+  policy.on_residency_changed(texture_a, tail_mip);
+  policy.on_residency_changed(texture_c, tail_mip);
+  passed &= streaming_expect(policy.committed_size == budget,
+                             "committed after evictions");
+  passed &= streaming_expect_committed(policy, "resident after evictions");
+
+  // Nothing changes once the budget is respected.
+  policy.update(budget, 2, 5, loads, evictions);
+  passed &= streaming_expect(loads.size == 0 && evictions.size == 0,
+                             "stable budget");
+
+  evictions.shutdown();
+  loads.shutdown();
+  policy.shutdown();
+
+  HINFO("Texture streaming self test {}", passed ? "passed" : "failed");
+  return passed;
+}
+
+}  // namespace Helix
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Core/Array.hpp"
+#include "Core/Platform.hpp"
+#include "Renderer/TextureCompression.hpp"
+
+namespace Helix {
+struct Allocator;
+
+// Mips whose biggest side is at or below this size are always resident.
+static const u32 k_texture_streaming_tail_size = 64;
+
+//
+// Residency state of a single streamed texture. Mip indices are relative to
+// the full resolution texture, mip_count means nothing is resident.
+struct TextureStreamingEntry {
+  u32 width = 0;
+  u32 height = 0;
+  u32 mip_count = 0;
+  u32 tail_mip = 0;
+
+  u32 resident_mip = 0;
+  // Equal to resident_mip when no load or eviction is in flight.
+  u32 pending_mip = 0;
+
+  // Feedback for the current frame.
+  u32 desired_mip = 0;
+  f32 priority = 0.f;
+  u64 last_used_frame = 0;
+
+  sizet mip_sizes[k_max_compressed_mips];
+
+  bool is_pending() const { return pending_mip != resident_mip; }
+};  // struct TextureStreamingEntry
+
+//
+//
+struct TextureStreamingDecision {
+  u32 texture_index;
+  u32 target_mip;
+};  // struct TextureStreamingDecision
+
+//
+// Decides which mips should be resident given per frame feedback and a memory
+// budget. It has no GPU dependency: the caller executes the decisions and
+// reports back with on_residency_changed.
+struct TextureStreamingPolicy {
+  void init(Allocator* allocator, u32 initial_capacity);
+  void shutdown();
+
+  // Registers a texture with nothing resident and its tail mips pending.
+  u32 add_texture(u32 width, u32 height, u32 mip_count,
+                  TextureCompressionFormat::Enum format);
+
+  // Feedback: called once per frame before any add_feedback.
+  void begin_feedback();
+  // Multiple calls for the same texture keep the most detailed request.
+  void add_feedback(u32 texture_index, u32 desired_mip, f32 priority,
+                    u64 frame);
+
+  // Fills at most max_loads loads and the evictions needed to respect the
+  // budget. Decisions mark the entries as pending.
+  void update(sizet budget, u32 max_loads, u64 frame,
+              Array<TextureStreamingDecision>& out_loads,
+              Array<TextureStreamingDecision>& out_evictions);
+
+  // Called when a load or eviction completed (or was dropped, passing the old
+  // resident mip).
+  void on_residency_changed(u32 texture_index, u32 resident_mip);
+
+  // Memory used by mips [mip, mip_count) of a texture.
+  sizet chain_size(u32 texture_index, u32 mip) const;
+
+  Array<TextureStreamingEntry> entries;
+  Array<u32> sorted_indices;
+  Array<u32> target_mips;
+
+  // Memory of resident mips plus in flight loads.
+  sizet committed_size = 0;
+  sizet tail_size = 0;
+  // Frames a mip stays resident after it was last requested.
+  u32 eviction_delay_frames = 120;
+};  // struct TextureStreamingPolicy
+
+u32 texture_streaming_tail_mip(u32 width, u32 height, u32 mip_count);
+
+// Mip that gives about one texel per pixel for a texture mapped once on a
+// sphere of 'radius' at 'distance' from the camera. pixels_per_unit is the
+// screen size in pixels of one unit at distance 1, i.e.
+// projection[1][1] * screen_height * 0.5.
+u32 texture_streaming_desired_mip(u32 width, u32 height, f32 distance,
+                                  f32 radius, f32 pixels_per_unit);
+
+// Drives a few textures through feedback, loads and a budget drop and checks
+// the decisions and the committed memory. Logs the mismatches, returns false
+// if there are any.
+bool texture_streaming_self_test(Allocator* allocator);
+
+}  // namespace Helix
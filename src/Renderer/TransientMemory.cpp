@@ -0,0 +1,190 @@
+#include "Renderer/TransientMemory.hpp"
+
+#include <algorithm>
+
+#include "Core/Log.hpp"
+#include "Core/Memory.hpp"
+#include "Core/Numerics.hpp"
+
+namespace Helix {
+
+static sizet transient_align(sizet offset, sizet alignment) {
+  return alignment > 1 ? (offset + alignment - 1) / alignment * alignment
+                       : offset;
+}
+
+static bool transient_lifetimes_overlap(const TransientResource& a,
+                                        const TransientResource& b) {
+  return a.first_node <= b.last_node && b.first_node <= a.last_node;
+}
+
+void TransientMemoryPlan::init(Allocator* allocator, u32 resource_count) {
+  placements.init(allocator, resource_count, resource_count);
+  blocks.init(allocator, 4);
+}
+
+void TransientMemoryPlan::shutdown() {
+  placements.shutdown();
+  blocks.shutdown();
+}
+
+void transient_memory_plan(const TransientResource* resources, u32 count,
+                           sizet max_block_size, bool alias,
+                           TransientMemoryPlan& plan,
+                           Allocator* temp_allocator) {
+  plan.placements.set_size(count);
+  plan.blocks.clear();
+  plan.unaliased_size = 0;
+  plan.aliased_size = 0;
+  plan.peak_live_size = 0;
+
+  u32 last_node = 0;
+  for (u32 i = 0; i < count; ++i) {
+    plan.placements[i] = {};
+    plan.unaliased_size += resources[i].size;
+    last_node = Helix::max(last_node, resources[i].last_node);
+  }
+  for (u32 node = 0; count > 0 && node <= last_node; ++node) {
+    sizet live_size = 0;
+    for (u32 i = 0; i < count; ++i) {
+      if (resources[i].first_node <= node && node <= resources[i].last_node) {
+        live_size += resources[i].size;
+      }
+    }
+    plan.peak_live_size = Helix::max(plan.peak_live_size, live_size);
+  }
+
+  Array<u32> order;
+  order.init(temp_allocator, count);
+  for (u32 i = 0; i < count; ++i) {
+    order.push(i);
+  }
+  // Largest first, the small resources fill the gaps left between them.
+  std::sort(order.data, order.data + order.size,
+            [&](const u32 a, const u32 b) {
+              if (resources[a].size != resources[b].size) {
+                return resources[a].size > resources[b].size;
+              }
+              if (resources[a].first_node != resources[b].first_node) {
+                return resources[a].first_node < resources[b].first_node;
+              }
+              return a < b;
+            });
+
+  // Placed resources of the current block alive with the current resource,
+  // sorted by offset.
+  Array<u32> neighbours;
+  neighbours.init(temp_allocator, count);
+
+  for (u32 o = 0; o < count; ++o) {
+    const u32 r = order[o];
+    const TransientResource& resource = resources[r];
+
+    u32 block_index = k_invalid_transient_block;
+    sizet offset = 0;
+    for (u32 b = 0; alias && b < plan.blocks.size; ++b) {
+      if ((plan.blocks[b].memory_type_bits & resource.memory_type_bits) ==
+          0) {
+        continue;
+      }
+
+      neighbours.clear();
+      for (u32 p = 0; p < o; ++p) {
+        const u32 placed = order[p];
+        if (plan.placements[placed].block == b &&
+            transient_lifetimes_overlap(resources[placed], resource)) {
+          neighbours.push(placed);
+        }
+      }
+      std::sort(neighbours.data, neighbours.data + neighbours.size,
+                [&](const u32 a, const u32 c) {
+                  return plan.placements[a].offset < plan.placements[c].offset;
+                });
+
+      // First gap, in offset order, the resource fits in.
+      sizet candidate = transient_align(0, resource.alignment);
+      for (u32 n = 0; n < neighbours.size; ++n) {
+        const sizet neighbour_offset = plan.placements[neighbours[n]].offset;
+        if (candidate + resource.size <= neighbour_offset) {
+          break;
+        }
+        candidate = Helix::max(
+            candidate,
+            transient_align(neighbour_offset + resources[neighbours[n]].size,
+                            resource.alignment));
+      }
+
+      if (candidate + resource.size <= max_block_size) {
+        block_index = b;
+        offset = candidate;
+        break;
+      }
+    }
+
+    if (block_index == k_invalid_transient_block) {
+      block_index = plan.blocks.size;
+      offset = 0;
+      plan.blocks.push({0, resource.memory_type_bits});
+    }
+
+    TransientMemoryBlock& block = plan.blocks[block_index];
+    block.size = Helix::max(block.size, offset + resource.size);
+    block.memory_type_bits &= resource.memory_type_bits;
+    plan.placements[r] = {block_index, offset};
+  }
+
+  for (u32 b = 0; b < plan.blocks.size; ++b) {
+    plan.aliased_size += plan.blocks[b].size;
+  }
+
+  neighbours.shutdown();
+  order.shutdown();
+}
+
+bool transient_memory_plan_validate(const TransientResource* resources,
+                                    u32 count,
+                                    const TransientMemoryPlan& plan) {
+  if (plan.placements.size != count) {
+    return false;
+  }
+
+  for (u32 a = 0; a < count; ++a) {
+    const TransientPlacement& placement_a = plan.placements[a];
+    if (placement_a.block >= plan.blocks.size) {
+      return false;
+    }
+    const TransientMemoryBlock& block = plan.blocks[placement_a.block];
+    if (transient_align(placement_a.offset, resources[a].alignment) !=
+            placement_a.offset ||
+        placement_a.offset + resources[a].size > block.size ||
+        (block.memory_type_bits & resources[a].memory_type_bits) == 0) {
+      return false;
+    }
+
+    for (u32 b = a + 1; b < count; ++b) {
+      const TransientPlacement& placement_b = plan.placements[b];
+      if (placement_a.block != placement_b.block ||
+          !transient_lifetimes_overlap(resources[a], resources[b])) {
+        continue;
+      }
+      if (placement_a.offset < placement_b.offset + resources[b].size &&
+          placement_b.offset < placement_a.offset + resources[a].size) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void transient_memory_plan_log(const TransientMemoryPlan& plan,
+                               cstring name) {
+  const f64 megabyte = 1024.0 * 1024.0;
+  HINFO(
+      "Frame graph {} transient memory: {} resources, {:.2f} MB without "
+      "aliasing, {:.2f} MB aliased in {} blocks, {:.2f} MB peak live",
+      name, plan.placements.size, plan.unaliased_size / megabyte,
+      plan.aliased_size / megabyte, plan.blocks.size,
+      plan.peak_live_size / megabyte);
+}
+
+}  // namespace Helix
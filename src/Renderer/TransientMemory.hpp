@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Core/Array.hpp"
+#include "Core/Platform.hpp"
+
+namespace Helix {
+struct Allocator;
+
+// Transient memory /////////////////////////////////////////////////////////
+// Frame graph resources only live from the node writing them to their last
+// reader. Resources whose lifetimes don't overlap can share memory: they are
+// placed in a few memory blocks, largest first, at the lowest offset that is
+// free for their whole lifetime. The plan only needs sizes and node indices,
+// it runs without a device.
+
+static const u32 k_invalid_transient_block = u32_max;
+
+//
+// Memory needs and lifetime of a resource, nodes in execution order.
+struct TransientResource {
+  sizet size;
+  sizet alignment;
+  // Memory types the resource can be bound to.
+  u32 memory_type_bits;
+  u32 first_node;
+  u32 last_node;
+};  // struct TransientResource
+
+//
+//
+struct TransientPlacement {
+  u32 block = k_invalid_transient_block;
+  sizet offset = 0;
+};  // struct TransientPlacement
+
+//
+//
+struct TransientMemoryBlock {
+  sizet size;
+  // Memory types every resource of the block can be bound to.
+  u32 memory_type_bits;
+};  // struct TransientMemoryBlock
+
+//
+//
+struct TransientMemoryPlan {
+  void init(Allocator* allocator, u32 resource_count);
+  void shutdown();
+
+  // Parallel to the planned resources.
+  Array<TransientPlacement> placements;
+  Array<TransientMemoryBlock> blocks;
+
+  // Memory of the resources each in its own allocation.
+  sizet unaliased_size = 0;
+  // Memory of the blocks.
+  sizet aliased_size = 0;
+  // Most memory alive during one node, no placement can go below it.
+  sizet peak_live_size = 0;
+};  // struct TransientMemoryPlan
+
+// Blocks grow up to max_block_size, bigger resources get a block of their
+// own. Without aliasing every resource gets its own block.
+void transient_memory_plan(const TransientResource* resources, u32 count,
+                           sizet max_block_size, bool alias,
+                           TransientMemoryPlan& plan,
+                           Allocator* temp_allocator);
+
+// Returns false when two resources alive during the same node overlap in the
+// same block, or a resource is misaligned or out of its block.
+bool transient_memory_plan_validate(const TransientResource* resources,
+                                    u32 count,
+                                    const TransientMemoryPlan& plan);
+
+void transient_memory_plan_log(const TransientMemoryPlan& plan, cstring name);
+
+}  // namespace Helix
@@ -3,6 +3,9 @@
 #include "Application/Keys.hpp"
 #include "Application/Window.hpp"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <vendor/glm/glm/glm.hpp>
@@ -17,13 +20,21 @@
 #include "Renderer/AsynchronousLoader.hpp"
 #include "Renderer/Camera.hpp"
 #include "Renderer/CommandBuffer.hpp"
+#include "Renderer/DynamicResolution.hpp"
 #include "Renderer/FrameGraph.hpp"
 #include "Renderer/GPUDevice.hpp"
 #include "Renderer/GPUProfiler.hpp"
 #include "Renderer/HelixImgui.hpp"
+#include "Renderer/InstanceBvh.hpp"
+#include "Renderer/LightClustering.hpp"
+#include "Renderer/MatrixBatch.hpp"
+#include "Renderer/MeshCulling.hpp"
+#include "Renderer/OcclusionBuffer.hpp"
 #include "Renderer/Renderer.hpp"
 #include "Renderer/ResourcesLoader.hpp"
 #include "Renderer/Scene.hpp"
+#include "Renderer/TextureCompression.hpp"
+#include "Renderer/TextureStreaming.hpp"
 #include "vendor/imgui/imgui.h"
 #include "vendor/tracy/tracy/Tracy.hpp"
 
@@ -85,30 +96,6 @@ glm::vec3 decodeNormalOctahedron(glm::vec2 f) {
   return normalize(n);
 }
 
-bool project_sphere(glm::vec3 C, float r, float znear, float P00, float P11,
-                    glm::vec4& aabb) {
-  // Check if the sphere intersects with the near plane
-  if (-C.z - r < znear) return false;
-
-  glm::vec2 cx = glm::vec2(C.x, -C.z);
-  glm::vec2 vx = glm::vec2(sqrt(dot(cx, cx) - r * r), r);
-  glm::vec2 minx = glm::mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
-  glm::vec2 maxx = glm::mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
-
-  glm::vec2 cy = glm::vec2(-C.y, -C.z);
-  glm::vec2 vy = glm::vec2(sqrt(dot(cy, cy) - r * r), r);
-  glm::vec2 miny = glm::mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
-  glm::vec2 maxy = glm::mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
-
-  aabb = glm::vec4(minx.x / minx.y * P00, miny.x / miny.y * P11,
-                   maxx.x / maxx.y * P00, maxy.x / maxy.y * P11);
-  aabb = glm::vec4(aabb.x, aabb.w, aabb.z, aabb.y) *
-             glm::vec4(0.5f, -0.5f, 0.5f, -0.5f) +
-         glm::vec4(0.5f);  // clip space -> uv space
-
-  return true;
-}
-
 int main(int argc, char** argv) {
   _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 
@@ -118,6 +105,25 @@ int main(int argc, char** argv) {
   log.init();
   Time::service_init();
 
+  // --pass-timings <file> writes the frame graph pass timings at exit, as CSV
+  // for a .csv file and JSON otherwise. --frame-count <n> exits after n
+  // frames. --self-test runs the device free checks and exits with their
+  // result.
+  cstring pass_timings_path = nullptr;
+  u32 exit_frame_count = 0;
+  bool self_test = false;
+  for (i32 i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--self-test") == 0) {
+      self_test = true;
+    } else if (i + 1 == argc) {
+      break;
+    } else if (strcmp(argv[i], "--pass-timings") == 0) {
+      pass_timings_path = argv[++i];
+    } else if (strcmp(argv[i], "--frame-count") == 0) {
+      exit_frame_count = (u32)atoi(argv[++i]);
+    }
+  }
+
   MemoryServiceConfiguration memory_configuration;
   memory_configuration.maximum_dynamic_size = hmega(900);
 
@@ -127,6 +133,22 @@ int main(int argc, char** argv) {
   StackAllocator stack_allocator;
   stack_allocator.init(hmega(700));
 
+  if (self_test) {
+    bool passed = mesh_culling_self_test(allocator);
+    passed &= light_clustering_self_test(allocator);
+    passed &= texture_compression_self_test(allocator);
+    passed &= texture_streaming_self_test(allocator);
+    passed &= occlusion_buffer_self_test(HELIX_FRAMEGRAPH_FOLDER, allocator);
+    passed &= frame_graph_transient_memory_self_test(HELIX_FRAMEGRAPH_FOLDER,
+                                                     &stack_allocator);
+    passed &= frame_graph_barrier_plan_self_test(HELIX_FRAMEGRAPH_FOLDER,
+                                                 &stack_allocator);
+
+    stack_allocator.shutdown();
+    MemoryService::instance()->shutdown();
+    return passed ? 0 : 1;
+  }
+
   // [TAG: MULTITHREADING]
   enki::TaskSchedulerConfig config;
   config.numTaskThreadsToCreate = 4;
@@ -160,6 +182,8 @@ int main(int argc, char** argv) {
   GPUProfiler gpu_profiler;
   gpu_profiler.init(allocator, 100);
 
+  DynamicResolution dynamic_resolution;
+
   Renderer renderer;
   renderer.init({&gpu, allocator});
 
@@ -184,8 +208,21 @@ int main(int argc, char** argv) {
       cstring frame_graph_path = temporary_name_buffer.append_use_f(
           HELIX_FRAMEGRAPH_FOLDER "cull_graph.json");
 
-      frame_graph.parse(frame_graph_path, &stack_allocator);
-      frame_graph.compile();
+      // The compiled graph is cached next to its file, it is compiled again
+      // when the file, the device or the window size change.
+      cstring frame_graph_cache_path =
+          temporary_name_buffer.append_use_f("%s.cache", frame_graph_path);
+      const u64 frame_graph_key =
+          frame_graph_cache_key(frame_graph_path, &gpu, &stack_allocator);
+      if (frame_graph.load_cache(frame_graph_cache_path, frame_graph_key,
+                                 &stack_allocator)) {
+        HINFO("Frame graph loaded from {}", frame_graph_cache_path);
+      } else {
+        frame_graph.parse(frame_graph_path, &stack_allocator);
+        frame_graph.compile();
+        frame_graph.write_cache(frame_graph_cache_path, frame_graph_key,
+                                &stack_allocator);
+      }
 
       resources_loader.init(&renderer, &stack_allocator, &frame_graph);
 
@@ -233,6 +270,19 @@ int main(int argc, char** argv) {
   AsynchronousLoader async_loader;
   async_loader.init(&renderer, &task_scheduler, allocator);
 
+#if defined(HELIX_MATRIX_BENCHMARK)
+  matrix_batch_benchmark(&task_scheduler, allocator);
+#endif
+#if defined(HELIX_BVH_BENCHMARK)
+  instance_bvh_benchmark(&task_scheduler, allocator);
+#endif
+#if defined(HELIX_FRAME_GRAPH_MEMORY_REPORT)
+  frame_graph_transient_memory_report(HELIX_FRAMEGRAPH_FOLDER "main.json",
+                                      &stack_allocator);
+  frame_graph_transient_memory_report(HELIX_FRAMEGRAPH_FOLDER "cull_graph.json",
+                                      &stack_allocator);
+#endif
+
   Directory cwd{};
   directory_current(&cwd);
 
@@ -248,6 +298,7 @@ int main(int argc, char** argv) {
   directory_change(cwd.path);
 
   scene->register_render_passes(&frame_graph);
+  scene->scene_data.render_scale = glm::vec4(1.0f);
   // scene->prepare_draws(&renderer, &stack_allocator);
 
   directory_change(cwd.path);
@@ -278,6 +329,7 @@ int main(int argc, char** argv) {
   float light_intensity = 20.f;
 
   int frame_count = 0;
+  u32 total_frame_count = 0;
   double last_time = 0.0;
 
   glm::vec3 light_position = glm::vec3(0, 0, 0.0f);
@@ -299,7 +351,7 @@ int main(int argc, char** argv) {
     if (!window.minimized) {
       gpu.new_frame();
       static bool checksz = true;
-      if (async_loader.file_load_requests.size == 0 && checksz) {
+      if (async_loader.load_jobs.get_pending_count() == 0 && checksz) {
         checksz = false;
         HINFO("Finished uploading textures in {} seconds",
               Time::from_seconds(absolute_begin_frame_tick));
@@ -359,6 +411,21 @@ int main(int argc, char** argv) {
           ImGui::SliderFloat("Light Range", &light_range, 0.f, 30.f);
           ImGui::Checkbox("Freeze Camera", &freeze_occlusion_camera);
           ImGui::Checkbox("Enable Shadows", &scene->enable_shadows);
+          ImGui::Checkbox("CPU Occlusion Culling",
+                          &scene->cpu_occlusion_culling);
+          if (scene->cpu_occlusion_culling) {
+            const OcclusionBufferStats& stats = scene->occlusion_buffer.stats;
+            ImGui::Text(
+                "Occluder triangles: %u, culled %u frustum + %u occlusion / "
+                "%u meshes, raster %.2f ms, test %.2f ms",
+                stats.occluder_triangles - stats.dropped_triangles,
+                stats.frustum_culled, stats.occlusion_culled, stats.tested,
+                stats.rasterize_ms, stats.test_ms);
+          }
+          ImGui::Text("Streamed textures: %u, %lluMB / %lluMB",
+                      scene->streamed_textures.size,
+                      scene->texture_streaming.committed_size / (1024 * 1024),
+                      scene->texture_streaming_budget / (1024 * 1024));
         }
         ImGui::End();
 
@@ -367,12 +434,53 @@ int main(int argc, char** argv) {
         if (ImGui::Begin("GPU")) {
           renderer.imgui_draw();
 
+          ImGui::Separator();
+          ImGui::Checkbox("Dynamic Resolution", &dynamic_resolution.enabled);
+          ImGui::SliderFloat("GPU Budget (ms)", &dynamic_resolution.budget_ms,
+                             4.f, 33.f);
+          ImGui::Text("Render scale %.2f, average GPU time %.2f ms",
+                      frame_graph.resolution_scale,
+                      dynamic_resolution.average_ms);
+
           ImGui::Separator();
           gpu_profiler.imgui_draw();
         }
         ImGui::End();
 
+        if (ImGui::Begin("Pass Timings") &&
+            ImGui::BeginTable("pass_timings", 5,
+                              ImGuiTableFlags_Borders |
+                                  ImGuiTableFlags_RowBg)) {
+          ImGui::TableSetupColumn("Pass");
+          ImGui::TableSetupColumn("CPU avg");
+          ImGui::TableSetupColumn("GPU avg");
+          ImGui::TableSetupColumn("GPU p95");
+          ImGui::TableSetupColumn("GPU p99");
+          ImGui::TableHeadersRow();
+
+          PassTimings& timings = frame_graph.timings;
+          for (u32 i = 0; i < timings.passes.size; ++i) {
+            PassTimingStats cpu, gpu_stats;
+            timings.get_statistics(timings.passes[i].name, cpu, gpu_stats);
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", timings.passes[i].name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", cpu.average);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", gpu_stats.average);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", gpu_stats.p95);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", gpu_stats.p99);
+          }
+          ImGui::EndTable();
+        }
+        ImGui::End();
+
         scene->imgui_draw_hierarchy();
+        scene->imgui_draw_sections();
 
         renderer.imgui_resources_draw();
 
@@ -421,6 +529,20 @@ int main(int argc, char** argv) {
           scene_data.aspect_ratio =
               gpu.swapchain_width * 1.f / gpu.swapchain_height;
 
+          // Scale of the frame from the GPU time of the last resolved one,
+          // the previous scale is kept for the passes reading the depth
+          // pyramid of the previous frame.
+          frame_graph.resolution_scale =
+              dynamic_resolution.update(gpu_profiler.frame_time_ms);
+          scene_data.render_scale = glm::vec4(
+              dynamic_resolution_extent(gpu.swapchain_width,
+                                        frame_graph.resolution_scale) *
+                  1.f / gpu.swapchain_width,
+              dynamic_resolution_extent(gpu.swapchain_height,
+                                        frame_graph.resolution_scale) *
+                  1.f / gpu.swapchain_height,
+              scene_data.render_scale.x, scene_data.render_scale.y);
+
           // Frustum computations
           if (!freeze_occlusion_camera) {
             scene_data.camera_position_debug = scene_data.camera_position;
@@ -467,7 +589,14 @@ int main(int argc, char** argv) {
           // model;
         }
 
+        scene->update_sections();
         scene->fill_gpu_data_buffers(model_scale);
+        scene->update_occlusion_buffer(&task_scheduler, model_scale);
+        scene->update_texture_streaming(model_scale);
+      }
+      // Nodes toggled during the frame are planned again before recording.
+      if (frame_graph.dirty) {
+        frame_graph.compile();
       }
       scene->submit_draw_task(imgui, &gpu_profiler, &task_scheduler);
 
@@ -475,6 +604,10 @@ int main(int argc, char** argv) {
 
       f64 current_time = Time::from_seconds(absolute_begin_frame_tick);
       frame_count++;
+      ++total_frame_count;
+      if (exit_frame_count > 0 && total_frame_count >= exit_frame_count) {
+        window.requested_exit = true;
+      }
       if (current_time - last_time >= 1.0) {
         renderer.fps = (f64)frame_count / (current_time - last_time);
 
@@ -492,8 +625,6 @@ int main(int argc, char** argv) {
 
   vkDeviceWaitIdle(gpu.vulkan_device);
 
-  async_loader.shutdown();
-
   // gpu.destroy_buffer(scene->scene_constant_buffer);
   // gpu.destroy_buffer(scene->light_cb);
 
@@ -501,11 +632,24 @@ int main(int argc, char** argv) {
 
   gpu_profiler.shutdown();
 
+  if (pass_timings_path) {
+    const sizet length = strlen(pass_timings_path);
+    if (length >= 4 && strcmp(pass_timings_path + length - 4, ".csv") == 0) {
+      frame_graph.timings.write_csv(pass_timings_path, allocator);
+    } else {
+      frame_graph.timings.write_json(pass_timings_path, allocator);
+    }
+    HINFO("Pass timings written to {}", pass_timings_path);
+  }
+
   frame_graph.shutdown();
   frame_graph_builder.shutdown();
 
+  // Cancels the scene loads still queued.
   scene->free_gpu_resources(&renderer);
 
+  async_loader.shutdown();
+
   resources_loader.shutdown();
 
   rm.shutdown();